@@ -167,6 +167,8 @@ bool THwEth_atsam::TryRecv(TPacketMem * * ppmem)
 {
 	__DSB();
 
+	recv_missed_count += (regs->GMAC_RRE & 0x3FFFF);  // frames missed for lack of RX buffers (cleared on read)
+
 	HW_ETH_DMA_DESC * pdesc = rx_desc_list;
 
 	int i = 0;
@@ -286,6 +288,35 @@ void THwEth_atsam::SetMacAddress(uint8_t * amacaddr)
 	regs->GMAC_SA[0].GMAC_SAT = ((uint32_t) amacaddr[5] << 8) | ((uint32_t) amacaddr[4]);
 }
 
+bool THwEth_atsam::SetMulticastFilter(uint8_t * amaclist, unsigned acount)
+{
+  // 64-bit hash filter: every index bit is the XOR of every 6th destination address bit
+  uint32_t hash[2] = {0, 0};
+  for (unsigned n = 0; n < acount; ++n)
+  {
+    uint8_t * pmac = amaclist + 6 * n;
+    unsigned idx = 0;
+    for (unsigned b = 0; b < 48; ++b)
+    {
+      idx ^= (((pmac[b >> 3] >> (b & 7)) & 1) << (b % 6));
+    }
+    hash[idx >> 5] |= (1u << (idx & 31));
+  }
+
+  regs->GMAC_HRB = hash[0];
+  regs->GMAC_HRT = hash[1];
+  if (acount)
+  {
+    regs->GMAC_NCFGR |= GMAC_NCFGR_MTIHEN;
+  }
+  else
+  {
+    regs->GMAC_NCFGR &= ~GMAC_NCFGR_MTIHEN;
+  }
+
+  return true;
+}
+
 void THwEth_atsam::SetSpeed(bool speed100)
 {
 	if (speed100)
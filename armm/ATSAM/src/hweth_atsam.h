@@ -60,6 +60,7 @@ public:
 
 	void               SetMdcClock(void);
 	void               SetMacAddress(uint8_t * amacaddr);
+	bool               SetMulticastFilter(uint8_t * amaclist, unsigned acount);
 	void               SetSpeed(bool speed100);
 	void               SetDuplex(bool full);
 
@@ -122,6 +122,11 @@ bool THwEth_imxrt::InitMac(void * prxdesclist, uint32_t rxcnt, void * ptxdesclis
 	regs->MRBR = HWETH_MAX_PACKET_SIZE;
 	regs->FTRL = HWETH_MAX_PACKET_SIZE;
 
+	// clear and enable the MIB statistic counters (the RX FIFO overflows are counted there)
+	regs->MIBC = (1 << 31) | (1 << 29);  // MIB_DIS + MIB_CLEAR
+	regs->MIBC = 0;
+	macerr_prev = 0;
+
 	regs->RCR = 0
 		| (0    << 31)  // GRS: Graceful Receive Stopped (RO)
 		| (0    << 30)  // NLC: Payload Length Check Disable
@@ -322,6 +327,22 @@ void THwEth_imxrt::SetMacAddress(uint8_t * amacaddr)
 	regs->PAUR = ((uint32_t) amacaddr[4] << 24) | ((uint32_t) amacaddr[5] << 16);
 }
 
+bool THwEth_imxrt::SetMulticastFilter(uint8_t * amaclist, unsigned acount)
+{
+  // 64-bit group hash filter: the upper 6 bits of the (not inverted) CRC32
+  uint32_t hash[2] = {0, 0};
+  for (unsigned n = 0; n < acount; ++n)
+  {
+    unsigned idx = ((~hweth_mac_crc32(amaclist + 6 * n)) >> 26);
+    hash[idx >> 5] |= (1u << (idx & 31));
+  }
+
+  regs->GALR = hash[0];
+  regs->GAUR = hash[1];
+
+  return true;
+}
+
 void THwEth_imxrt::SetSpeed(bool speed100)
 {
 	if (speed100)
@@ -372,6 +393,11 @@ bool THwEth_imxrt::TryRecv(TPacketMem * * ppmem) // uint32_t * pidx, void * * pp
 
   __DSB();
 
+	// the frames arriving without an empty RX descriptor are lost as RX FIFO overflows
+	uint16_t macerr = regs->IEEE_R_MACERR;
+	recv_missed_count += uint16_t(macerr - macerr_prev);
+	macerr_prev = macerr;
+
 	// TODO: optimize through checking only the next descriptor
 
 	int i = 0;
@@ -46,6 +46,8 @@ public:
 
 public:
 	void               SetMacAddress(uint8_t * amacaddr);
+	bool               SetMulticastFilter(uint8_t * amaclist, unsigned acount);
+	bool               TxIrqSupported() { return true; }  // EIMR TXF
 	void               SetSpeed(bool speed100);
 	void               SetDuplex(bool full);
 
@@ -61,6 +63,8 @@ public:
 	HW_ETH_DMA_DESC *  rx_desc_list = nullptr;
 	HW_ETH_DMA_DESC *  tx_desc_list = nullptr;
 
+	uint16_t           macerr_prev = 0;  // IEEE_R_MACERR at the last TryRecv()
+
 	bool               InitMac(void * prxdesclist, uint32_t rxcnt, void * ptxdesclist, uint32_t txcnt);
 	void               AssignRxBuf(uint32_t idx, TPacketMem * pmem, uint32_t datalen);
 
@@ -277,6 +277,10 @@ bool THwEth_stm32::TryRecv(TPacketMem * * ppmem)
 
 	__DSB();
 
+	// missed frames: bit 0-15 no RX descriptor available, bit 17-27 RX FIFO overflow (cleared on read)
+	uint32_t mfbo = regs->DMA_MFRM_BUFOF;
+	recv_missed_count += (mfbo & 0xFFFF) + ((mfbo >> 17) & 0x7FF);
+
 	HW_ETH_DMA_DESC * pdesc = (HW_ETH_DMA_DESC *)regs->DMA_CURHOST_REC_DES;
 
   while (1)
@@ -445,6 +449,35 @@ void THwEth_stm32::SetMacAddress(uint8_t * amacaddr)
 	regs->MAC_ADDR0_HIGH = ((uint32_t) amacaddr[5] << 8) | ((uint32_t) amacaddr[4]);
 }
 
+bool THwEth_stm32::SetMulticastFilter(uint8_t * amaclist, unsigned acount)
+{
+  // 64-bit hash filter: the upper 6 bits of the bit-reversed CRC32 = the reversed lower 6 bits
+  uint32_t hash[2] = {0, 0};
+  for (unsigned n = 0; n < acount; ++n)
+  {
+    uint32_t crc = hweth_mac_crc32(amaclist + 6 * n);
+    unsigned idx = 0;
+    for (unsigned b = 0; b < 6; ++b)
+    {
+      idx = (idx << 1) | ((crc >> b) & 1);
+    }
+    hash[idx >> 5] |= (1u << (idx & 31));
+  }
+
+  regs->MAC_HASHTABLE_LOW  = hash[0];
+  regs->MAC_HASHTABLE_HIGH = hash[1];
+  if (acount)
+  {
+    regs->MAC_FRAME_FILTER |= (1 << 2);  // HMC: Hash Multicast
+  }
+  else
+  {
+    regs->MAC_FRAME_FILTER &= ~(1 << 2);
+  }
+
+  return true;
+}
+
 void THwEth_stm32::SetSpeed(bool speed100)
 {
 	if (speed100)
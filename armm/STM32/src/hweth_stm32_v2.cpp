@@ -305,6 +305,8 @@ bool THwEth_stm32_v2::TryRecv(TPacketMem * * ppmem)
     return false;
   }
 
+  recv_missed_count += (regs->DMACMFCR & 0x7FF);  // frames missed for lack of RX descriptors (cleared on read)
+
   while (1)
   {
     __DSB();
@@ -499,6 +501,35 @@ void THwEth_stm32_v2::SetMacAddress(uint8_t * amacaddr)
                 | ((uint32_t) amacaddr[1] << 8) | ((uint32_t) amacaddr[0]);
 }
 
+bool THwEth_stm32_v2::SetMulticastFilter(uint8_t * amaclist, unsigned acount)
+{
+  // 64-bit hash filter: the upper 6 bits of the bit-reversed CRC32 = the reversed lower 6 bits
+  uint32_t hash[2] = {0, 0};
+  for (unsigned n = 0; n < acount; ++n)
+  {
+    uint32_t crc = hweth_mac_crc32(amaclist + 6 * n);
+    unsigned idx = 0;
+    for (unsigned b = 0; b < 6; ++b)
+    {
+      idx = (idx << 1) | ((crc >> b) & 1);
+    }
+    hash[idx >> 5] |= (1u << (idx & 31));
+  }
+
+  regs->MACHT0R = hash[0];
+  regs->MACHT1R = hash[1];
+  if (acount)
+  {
+    regs->MACPFR |= (1 << 2);  // HMC: Hash Multicast
+  }
+  else
+  {
+    regs->MACPFR &= ~(1 << 2);
+  }
+
+  return true;
+}
+
 void THwEth_stm32_v2::SetSpeed(bool speed100)
 {
   if (speed100)
@@ -93,6 +93,7 @@ public:
 public:
   uint32_t           CalcMdcClock(void);
   void               SetMacAddress(uint8_t * amacaddr);
+  bool               SetMulticastFilter(uint8_t * amaclist, unsigned acount);
   void               SetSpeed(bool speed100);
   void               SetDuplex(bool full);
 
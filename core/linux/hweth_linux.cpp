@@ -0,0 +1,389 @@
+/*
+ *  file:     hweth_linux.cpp
+ *  brief:    Host Linux Ethernet backend (TAP device, AF_PACKET socket or pcap file replay)
+ *  date:     2026-10-17
+ *  authors:  agent
+*/
+
+#include "platform.h"
+
+#if defined(HWETH_LINUX)
+
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <linux/if_tun.h>
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+
+#include "hweth.h"
+#include "traces.h"
+
+#define PCAP_MAGIC_US   0xA1B2C3D4
+#define PCAP_MAGIC_NS   0xA1B23C4D
+
+static uint64_t linux_monotonic_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return uint64_t(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+bool THwEth_linux::InitMac(void * prxdesclist, uint32_t rxcnt, void * ptxdesclist, uint32_t txcnt)
+{
+	initialized = false;
+
+	rx_desc_list = (HW_ETH_DMA_DESC *)prxdesclist;
+	rx_desc_count = rxcnt;
+	tx_desc_count = txcnt;
+	rx_idx = 0;
+	tx_idx = 0;
+
+	memset(rx_desc_list, 0, sizeof(HW_ETH_DMA_DESC) * rxcnt);
+
+	Close();
+
+	bool ok;
+	if (HWETH_LINUX_PCAP == backend)
+	{
+		ok = OpenPcap();
+	}
+	else if (HWETH_LINUX_PACKET == backend)
+	{
+		ok = OpenPacket();
+	}
+	else
+	{
+		ok = OpenTap();
+	}
+
+	if (!ok)
+	{
+		Close();
+		return false;
+	}
+
+	if (pcap_tx_filename)
+	{
+		pcap_tx_file = fopen(pcap_tx_filename, "wb");
+		if (pcap_tx_file)
+		{
+			uint32_t fh[6] = {PCAP_MAGIC_NS, 0x00040002, 0, 0, HWETH_MAX_PACKET_SIZE, 1};  // version 2.4, Ethernet
+			fwrite(&fh[0], sizeof(fh), 1, pcap_tx_file);
+		}
+	}
+
+	NsTimeStart();
+
+	initialized = true;
+	return true;
+}
+
+void THwEth_linux::Close()
+{
+	if (fd >= 0)
+	{
+		close(fd);
+		fd = -1;
+	}
+	if (pcap_rx_file)
+	{
+		fclose(pcap_rx_file);
+		pcap_rx_file = nullptr;
+	}
+	if (pcap_tx_file)
+	{
+		fclose(pcap_tx_file);
+		pcap_tx_file = nullptr;
+	}
+}
+
+bool THwEth_linux::OpenTap()
+{
+	fd = open("/dev/net/tun", O_RDWR | O_NONBLOCK);
+	if (fd < 0)
+	{
+		TRACE("ETH: error opening /dev/net/tun: %s\r\n", strerror(errno));
+		return false;
+	}
+
+	struct ifreq ifr;
+	memset(&ifr, 0, sizeof(ifr));
+	ifr.ifr_flags = IFF_TAP | IFF_NO_PI;
+	strncpy(ifr.ifr_name, ifname, IFNAMSIZ - 1);
+	if (ioctl(fd, TUNSETIFF, &ifr) < 0)
+	{
+		TRACE("ETH: error attaching to TAP \"%s\": %s\r\n", ifname, strerror(errno));
+		return false;
+	}
+
+	return true;
+}
+
+bool THwEth_linux::OpenPacket()
+{
+	fd = socket(AF_PACKET, SOCK_RAW | SOCK_NONBLOCK, __builtin_bswap16(ETH_P_ALL));
+	if (fd < 0)
+	{
+		TRACE("ETH: error opening AF_PACKET socket: %s\r\n", strerror(errno));
+		return false;
+	}
+
+	unsigned ifindex = if_nametoindex(ifname);
+	if (!ifindex)
+	{
+		TRACE("ETH: unknown interface \"%s\"\r\n", ifname);
+		return false;
+	}
+
+	struct sockaddr_ll sll;
+	memset(&sll, 0, sizeof(sll));
+	sll.sll_family = AF_PACKET;
+	sll.sll_protocol = __builtin_bswap16(ETH_P_ALL);
+	sll.sll_ifindex = ifindex;
+	if (bind(fd, (struct sockaddr *)&sll, sizeof(sll)) < 0)
+	{
+		TRACE("ETH: error binding to \"%s\": %s\r\n", ifname, strerror(errno));
+		return false;
+	}
+
+	// our MAC address differs from the interface's one
+	struct packet_mreq mr;
+	memset(&mr, 0, sizeof(mr));
+	mr.mr_ifindex = ifindex;
+	mr.mr_type = PACKET_MR_PROMISC;
+	setsockopt(fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mr, sizeof(mr));
+
+	return true;
+}
+
+bool THwEth_linux::OpenPcap()
+{
+	if (!pcap_rx_filename)
+	{
+		return true;  // TX only
+	}
+
+	pcap_rx_file = fopen(pcap_rx_filename, "rb");
+	if (!pcap_rx_file)
+	{
+		TRACE("ETH: error opening \"%s\"\r\n", pcap_rx_filename);
+		return false;
+	}
+
+	uint32_t fh[6];
+	if ((1 != fread(&fh[0], sizeof(fh), 1, pcap_rx_file))
+	    || ((PCAP_MAGIC_US != fh[0]) && (PCAP_MAGIC_NS != fh[0])) || (1 != fh[5]))
+	{
+		TRACE("ETH: \"%s\" is not a little endian Ethernet pcap file\r\n", pcap_rx_filename);
+		return false;
+	}
+
+	return true;
+}
+
+int THwEth_linux::ReadPcapFrame(uint8_t * pdst, unsigned amaxlen)
+{
+	if (!pcap_rx_file)
+	{
+		return -1;
+	}
+
+	uint32_t rh[4];  // ts_sec, ts_usec / ts_nsec, incl_len, orig_len
+	if (1 != fread(&rh[0], sizeof(rh), 1, pcap_rx_file))
+	{
+		if (!pcap_loop)
+		{
+			return -1;
+		}
+
+		fseek(pcap_rx_file, 24, SEEK_SET);
+		if (1 != fread(&rh[0], sizeof(rh), 1, pcap_rx_file))
+		{
+			return -1;
+		}
+	}
+
+	unsigned len = rh[2];
+	unsigned skip = 0;
+	if (len > amaxlen)
+	{
+		skip = len - amaxlen;
+		len = amaxlen;
+	}
+
+	if ((len && (1 != fread(pdst, len, 1, pcap_rx_file))) || (skip && fseek(pcap_rx_file, skip, SEEK_CUR)))
+	{
+		return -1;
+	}
+
+	return len;
+}
+
+void THwEth_linux::WritePcapFrame(void * pdata, unsigned alen)
+{
+	uint64_t t = NsTimeRead();
+	uint32_t rh[4] = {uint32_t(t / 1000000000ull), uint32_t(t % 1000000000ull), alen, alen};
+	fwrite(&rh[0], sizeof(rh), 1, pcap_tx_file);
+	fwrite(pdata, alen, 1, pcap_tx_file);
+}
+
+void THwEth_linux::SetMacAddress(uint8_t * amacaddr)
+{
+	if (amacaddr != &mac_address[0])
+	{
+		memcpy(&mac_address[0], amacaddr, 6);
+	}
+}
+
+void THwEth_linux::AssignRxBuf(uint32_t idx, TPacketMem * pmem, uint32_t datalen)
+{
+	if (idx >= rx_desc_count)
+	{
+		return;
+	}
+
+	pmem->idx = idx;
+	rx_desc_list[idx].pmem = pmem;
+	rx_desc_list[idx].status = 0;
+}
+
+bool THwEth_linux::TryRecv(TPacketMem * * pmem)
+{
+	HW_ETH_DMA_DESC * pdesc = &rx_desc_list[rx_idx];
+	if (pdesc->status || !pdesc->pmem)
+	{
+		return false;  // the ring is full
+	}
+
+	TPacketMem * pkt = pdesc->pmem;
+	int r;
+	if (HWETH_LINUX_PCAP == backend)
+	{
+		r = ReadPcapFrame(&pkt->data[0], HWETH_MAX_PACKET_SIZE);
+	}
+	else
+	{
+		r = read(fd, &pkt->data[0], HWETH_MAX_PACKET_SIZE);
+	}
+
+	if (r <= 0)
+	{
+		if ((r < 0) && (HWETH_LINUX_PCAP != backend) && (EAGAIN != errno))
+		{
+			++recv_error_count;
+		}
+		return false;
+	}
+
+	pdesc->status = 1;
+	pdesc->timestamp = NsTimeRead();
+
+	pkt->idx = rx_idx;
+	pkt->datalen = r;
+	pkt->timestamp_ns = pdesc->timestamp;
+
+	++rx_idx;
+	if (rx_idx >= rx_desc_count)  rx_idx = 0;
+
+	++recv_count;
+	*pmem = pkt;
+	return true;
+}
+
+void THwEth_linux::ReleaseRxBuf(TPacketMem * pmem)
+{
+	if (pmem->idx < rx_desc_count)
+	{
+		rx_desc_list[pmem->idx].status = 0;
+	}
+}
+
+uint64_t THwEth_linux::GetTimeStamp(uint32_t idx)
+{
+	if (idx >= rx_desc_count)
+	{
+		return 0;
+	}
+	return rx_desc_list[idx].timestamp;
+}
+
+bool THwEth_linux::TrySend(uint32_t * pidx, void * pdata, uint32_t datalen)
+{
+	if (pcap_tx_file)
+	{
+		WritePcapFrame(pdata, datalen);
+	}
+
+	if (fd >= 0)
+	{
+		int r = write(fd, pdata, datalen);
+		if (r != int(datalen))
+		{
+			++send_error_count;
+			return false;
+		}
+	}
+
+	*pidx = tx_idx;
+	++tx_idx;
+	if (tx_idx >= tx_desc_count)  tx_idx = 0;
+
+	++send_count;
+	return true;
+}
+
+void THwEth_linux::StartMiiRead(uint8_t reg)
+{
+	// a LAN8720A like PHY with a 100 MBit full duplex link that is always up
+	if (HWETH_PHY_BSR_REG == reg)
+	{
+		mii_data = HWETH_PHY_BSR_LINK_STATUS | HWETH_PHY_BSR_AUTONEG_COMP | HWETH_PHY_BSR_AUTONEG_ABILITY;
+	}
+	else if (HWETH_PHY_PHYID1_REG == reg)
+	{
+		mii_data = 0x0007;
+	}
+	else if (HWETH_PHY_PHYID2_REG == reg)
+	{
+		mii_data = 0xC0F0;
+	}
+	else if (HWETH_PHY_SPEEDINFO_REG == reg)
+	{
+		mii_data = HWETH_PHY_SPEEDINFO_100M | HWETH_PHY_SPEEDINFO_FULLDX;
+	}
+	else
+	{
+		mii_data = 0;  // BCR: no reset, no power down
+	}
+}
+
+void THwEth_linux::NsTimeStart()
+{
+	ns_base = 0;
+	ns_mono_ref = linux_monotonic_ns();
+	ns_corr = 0;
+}
+
+uint64_t THwEth_linux::NsTimeRead()
+{
+	uint64_t elapsed = linux_monotonic_ns() - ns_mono_ref;
+	return ns_base + elapsed + int64_t(double(elapsed) * ns_corr);
+}
+
+void THwEth_linux::NsTimeSetCorrection(float acorr)
+{
+	// rebase, the new rate applies from now on
+	uint64_t now = linux_monotonic_ns();
+	uint64_t elapsed = now - ns_mono_ref;
+	ns_base += elapsed + int64_t(double(elapsed) * ns_corr);
+	ns_mono_ref = now;
+	ns_corr = acorr;
+}
+
+#endif
@@ -0,0 +1,98 @@
+/*
+ *  file:     hweth_linux.h
+ *  brief:    Host Linux Ethernet backend (TAP device, AF_PACKET socket or pcap file replay)
+ *  date:     2026-10-17
+ *  authors:  agent
+ *
+ *  Allows running the network stack (TNetAdapter, TIp4Handler...) natively on a Linux host.
+ *  Activate it with the HWETH_LINUX define, then the hweth.h uses this instead of the MCU driver.
+ *  The PHY is emulated with the link always up, the frames are transferred with non-blocking
+ *  read() / write() calls, so TrySend() completes the transmission immediately.
+*/
+
+#ifndef HWETH_LINUX_H_
+#define HWETH_LINUX_H_
+
+#define HWETH_PRE_ONLY
+#include "hweth.h"
+
+#include "stdio.h"
+
+#define HWETH_LINUX_TAP      0  // ifname = TAP device name (created when not exists, requires CAP_NET_ADMIN)
+#define HWETH_LINUX_PACKET   1  // ifname = existing network interface (requires CAP_NET_RAW)
+#define HWETH_LINUX_PCAP     2  // RX frames from a pcap file, TX frames into a pcap file (optional)
+
+typedef struct
+{
+	TPacketMem *      pmem;
+	uint32_t          status;  // RX: 1 = the packet is at the application, TX: unused
+	uint64_t          timestamp;
+//
+} HW_ETH_DMA_DESC;
+
+class THwEth_linux : public THwEth_pre
+{
+public: // settings
+	uint8_t            backend = HWETH_LINUX_TAP;
+	const char *       ifname = "tap0";
+	const char *       pcap_rx_filename = nullptr;
+	const char *       pcap_tx_filename = nullptr;
+	bool               pcap_loop = false;  // restart the RX file at the end
+
+public:
+	int                fd = -1;
+	FILE *             pcap_rx_file = nullptr;
+	FILE *             pcap_tx_file = nullptr;
+
+	uint32_t           send_count = 0;
+	uint32_t           send_error_count = 0;
+
+	bool               InitMac(void * prxdesclist, uint32_t rxcnt, void * ptxdesclist, uint32_t txcnt);
+	void               Start()  { }
+	void               Stop()   { }
+	void               Close();
+
+	void               SetMacAddress(uint8_t * amacaddr);
+	void               SetSpeed(bool speed100)   { }
+	void               SetDuplex(bool full)      { }
+	bool               SetMulticastFilter(uint8_t * amaclist, unsigned acount) { return true; }  // filtered in software
+
+	bool               TryRecv(TPacketMem * * pmem);
+	void               ReleaseRxBuf(TPacketMem * pmem);
+	void               AssignRxBuf(uint32_t idx, TPacketMem * pmem, uint32_t datalen);
+
+	bool               TrySend(uint32_t * pidx, void * pdata, uint32_t datalen);
+	bool               SendFinished(uint32_t idx) { return true; }
+	uint64_t           GetTimeStamp(uint32_t idx);
+
+	// emulated PHY
+	void               StartMiiWrite(uint8_t reg, uint16_t data) { }
+	void               StartMiiRead(uint8_t reg);
+	bool               IsMiiBusy() { return false; }
+	inline uint16_t    MiiData() { return mii_data; }
+
+	// CLOCK_MONOTONIC based, the correction is emulated in software
+	void               NsTimeStart();
+	uint64_t           NsTimeRead();
+	void               NsTimeSetCorrection(float acorr);
+
+protected:
+	HW_ETH_DMA_DESC *  rx_desc_list = nullptr;
+	uint32_t           rx_idx = 0;
+	uint32_t           tx_idx = 0;
+	uint16_t           mii_data = 0;
+
+	uint64_t           ns_base = 0;      // NsTimeRead() value at ns_mono_ref
+	uint64_t           ns_mono_ref = 0;
+	double             ns_corr = 0;
+
+	bool               OpenTap();
+	bool               OpenPacket();
+	bool               OpenPcap();
+	int                ReadPcapFrame(uint8_t * pdst, unsigned amaxlen);
+	void               WritePcapFrame(void * pdata, unsigned alen);
+};
+
+#define HWETH_IMPL THwEth_linux
+
+#endif // def HWETH_LINUX_H_
@@ -32,9 +32,27 @@
 
 //----------------------------------------------------------------------
 
+uint32_t hweth_mac_crc32(uint8_t * amac)
+{
+  // reflected CRC32 (polynomial 0x04C11DB7), like the Ethernet FCS
+  uint32_t crc = 0xFFFFFFFF;
+  for (unsigned n = 0; n < 6; ++n)
+  {
+    crc ^= amac[n];
+    for (unsigned b = 0; b < 8; ++b)
+    {
+      crc = (crc >> 1) ^ ((crc & 1) ? 0xEDB88320 : 0);
+    }
+  }
+  return ~crc;
+}
+
+//----------------------------------------------------------------------
+
 bool THwEth::Init(void * prxdesclist, uint32_t rxcnt, void * ptxdesclist, uint32_t txcnt)
 {
 	initialized = false;
+	recv_missed_count = 0;
 
 	if (!InitMac(prxdesclist, rxcnt, ptxdesclist, txcnt))
 	{
@@ -90,6 +90,8 @@ typedef struct TPacketMem
 
 static_assert(offsetof(TPacketMem, data) == HWETH_PMEM_HEAD_SIZE, "Packet definition error!");
 
+uint32_t hweth_mac_crc32(uint8_t * amac);  // Ethernet CRC32 of a MAC address, for the multicast hash filters
+
 class THwEth_pre
 {
 public: // settings
@@ -123,12 +125,20 @@ public:
 
 	uint32_t      recv_count = 0;
 	uint32_t      recv_error_count = 0;
+	uint32_t      recv_missed_count = 0;  // frames dropped by the MAC because no free RX descriptor was available (0 when the HW does not report it)
 
 	uint8_t *     descmem = nullptr;
 	uint32_t      descmemsize = 0;
 
 	virtual ~THwEth_pre() { }
 
+	// Sets the accepted multicast destination MAC addresses (6 bytes each), returns false when
+	// the MAC has no multicast filter support (the implementations with hash filter override this)
+	bool          SetMulticastFilter(uint8_t * amaclist, unsigned acount) { return false; }
+
+	// true when the irq_on_tx setting enables a TX complete interrupt (the implementations with TX IRQ override this)
+	bool          TxIrqSupported() { return false; }
+
 };
 
 #endif // ndef HWETH_H_PRE_
@@ -140,7 +150,11 @@ public:
 #ifndef HWETH_H_
 #define HWETH_H_
 
-#include "mcu_impl.h"
+#if defined(HWETH_LINUX)
+  #include "hweth_linux.h"  // host Linux backend (core/linux)
+#else
+  #include "mcu_impl.h"
+#endif
 
 #if !defined(HWETH_IMPL)
 
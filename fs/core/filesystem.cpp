@@ -129,11 +129,11 @@ void TFile::Seek(uint64_t afilepos)
 
 	targetpos = afilepos;
 
-	// check if withing the current cluster
-	if ((targetpos & filesys->cluster_start_mask) == (filepos & filesys->cluster_start_mask))
+	// check if withing the current cluster (a cluster end position belongs to the previous cluster)
+	if (filepos && targetpos && ((((targetpos - 1) ^ (filepos - 1)) & filesys->cluster_start_mask) == 0))
 	{
+		curlocation += (targetpos - filepos);
 		filepos = targetpos;
-		curlocation = (curlocation & filesys->cluster_start_mask) + (targetpos & filesys->cluster_reminder_mask);
 		FinishTra(0);
 		return;
 	}
@@ -177,10 +177,98 @@ void TFileSystem::Init(TStorManager * astorman, uint64_t afirstaddr, uint64_t am
 	initstate = 0;
 	fsok = false;
 
+	NameCacheInvalidate();
+
 	memset(&stra, 0, sizeof(stra));
 	stra.completed = true;
 }
 
+void TFile::Write(void * src, uint32_t len)
+{
+	if (!finished)
+	{
+		TRACE("TFile::Write: File Busy!\r\n");
+		return;
+	}
+
+	dataptr = (uint8_t *)src;
+	datalen = len;
+	transferlen = 0;
+
+	remaining = len;
+
+	if (!opened)
+	{
+		FinishTra(FSRESULT_FILE_NOT_OPEN);
+		return;
+	}
+
+	if (directory)
+	{
+		FinishTra(FSRESULT_ACCESS_DENIED);
+		return;
+	}
+
+	filesys->AddTransaction(this, FSTRA_FILE_WRITE);
+}
+
+void TFile::Truncate()
+{
+	if (!finished)
+	{
+		TRACE("TFile::Truncate: File Busy!\r\n");
+		return;
+	}
+
+	if (!opened)
+	{
+		FinishTra(FSRESULT_FILE_NOT_OPEN);
+		return;
+	}
+
+	if (directory)
+	{
+		FinishTra(FSRESULT_ACCESS_DENIED);
+		return;
+	}
+
+	filesys->AddTransaction(this, FSTRA_FILE_TRUNCATE);
+}
+
+void TFile::Flush()
+{
+	if (!finished)
+	{
+		TRACE("TFile::Flush: File Busy!\r\n");
+		return;
+	}
+
+	if (!opened)
+	{
+		FinishTra(FSRESULT_FILE_NOT_OPEN);
+		return;
+	}
+
+	filesys->AddTransaction(this, FSTRA_FILE_FLUSH);
+}
+
+void TFile::Close()
+{
+	if (!finished)
+	{
+		TRACE("TFile::Close: File Busy!\r\n");
+		return;
+	}
+
+	if (!opened)
+	{
+		FinishTra(0);
+		return;
+	}
+
+	filesys->AddTransaction(this, FSTRA_FILE_CLOSE);
+}
+
 void TFileSystem::Run()
 {
 	if (!pstorman)
@@ -206,6 +294,18 @@ void TFileSystem::Run()
 		{
 			RunOpDirRead();
 		}
+		else if (FSOP_ALLOC == curop)
+		{
+			RunOpAlloc();
+		}
+		else if (FSOP_FREE == curop)
+		{
+			RunOpFree();
+		}
+		else if (FSOP_FLUSH == curop)
+		{
+			RunOpFlush();
+		}
 
 		if (curop != FSOP_IDLE)
 		{
@@ -244,6 +344,22 @@ void TFileSystem::Run()
 			{
 				HandleFileSeek();
 			}
+			else if (FSTRA_FILE_WRITE == curtra->tratype)
+			{
+				HandleFileWrite();
+			}
+			else if (FSTRA_FILE_CREATE == curtra->tratype)
+			{
+				HandleFileCreate();
+			}
+			else if (FSTRA_FILE_TRUNCATE == curtra->tratype)
+			{
+				HandleFileTruncate();
+			}
+			else if ((FSTRA_FILE_FLUSH == curtra->tratype) || (FSTRA_FILE_CLOSE == curtra->tratype))
+			{
+				HandleFileClose();
+			}
 			else
 			{
 				// unknown transaction
@@ -270,7 +386,7 @@ void TFileSystem::HandleFileOpen()
 
 		pseg_start = path;
 		dir_location = rootdirstart;
-		dir_cluster_end = dir_location + clusterbytes;
+		dir_cluster_end = rootdirend;
 		trastate = 1;
 	}
 
@@ -308,26 +424,75 @@ void TFileSystem::HandleFileOpen()
 			return;
 		}
 
-		trastate = 2; // continue at process directory entry in fdata
+		dir_start = dir_location;
+		dir_start_end = dir_cluster_end;
+		seg_hash = NameHash(pseg_start, pseg_len);
+		namecache_idx = NameCacheFind(dir_start, seg_hash);
+		if (namecache_idx >= 0)
+		{
+			// read only the entry at the cached location
+			dir_location = namecache[namecache_idx].readlocation;
+			dir_cluster_end = namecache[namecache_idx].readend;
+			trastate = 3;
+		}
+		else
+		{
+			trastate = 2; // continue at process directory entry in fdata
+		}
+
 		if (StartOpDirRead(dir_location, dir_cluster_end))
 		{
 			return; // not finished yet
 		}
 	}
 
+	if (3 == trastate)  // check the entry from the cached location
+	{
+		if (opresult || !SegmentMatches())
+		{
+			// changed or hash collision, search the whole directory
+			++namecache_misses;
+			namecache[namecache_idx].hash = 0;
+			dir_location = dir_start;
+			dir_cluster_end = dir_start_end;
+			trastate = 2;
+			if (StartOpDirRead(dir_location, dir_cluster_end))
+			{
+				return; // not finished yet
+			}
+		}
+		else
+		{
+			++namecache_hits;
+			trastate = 2;
+		}
+	}
+
 	// process directory entry in fdata
 
 	while (true)
 	{
 		if (opresult)
 		{
+			if ((FSRESULT_EOF == opresult) && (0 == *pseg_end) && !curtra->directory
+			    && (curtra->open_flags & FOPEN_CREATE))
+			{
+				// the file does not exist, create it in this directory (op_location: end of the directory)
+				curtra->tratype = FSTRA_FILE_CREATE;
+				trastate = 0;
+				HandleFileCreate();
+				return;
+			}
+
 			if (opresult == FSRESULT_EOF)  opresult = FSRESULT_FILE_NOT_FOUND;
 			FinishCurTra(opresult);
 			return;
 		}
 
-		if (strncasecmp(pseg_start, fdata.name, pseg_len) == 0)
+		if (SegmentMatches())
 		{
+			NameCacheStore(dir_start, seg_hash, dir_location, dir_cluster_end);
+
       #ifdef TRACE_PATH
 			  char segname[FS_FNAME_MAX_LEN];
 			  strncpy(segname, pseg_start, pseg_len);
@@ -389,6 +554,78 @@ void TFileSystem::HandleFileOpen()
 	}
 }
 
+bool TFileSystem::SegmentMatches()
+{
+	if ((strncasecmp(pseg_start, fdata.name, pseg_len) == 0) && (0 == fdata.name[pseg_len]))
+	{
+		return true;
+	}
+
+	return ((strncasecmp(pseg_start, fdata.shortname, pseg_len) == 0) && (0 == fdata.shortname[pseg_len]));
+}
+
+uint32_t TFileSystem::NameHash(const char * aname, unsigned alen)
+{
+	uint32_t h = 2166136261u;  // FNV-1a
+	for (unsigned n = 0; n < alen; ++n)
+	{
+		char c = aname[n];
+		if ((c >= 'A') && (c <= 'Z'))  c += 32;
+		h = (h ^ uint8_t(c)) * 16777619u;
+	}
+	return (h ? h : 1);
+}
+
+int TFileSystem::NameCacheFind(uint64_t adirlocation, uint32_t ahash)
+{
+	for (unsigned n = 0; n < FS_NAMECACHE_ENTRIES; ++n)
+	{
+		TFsNameCacheEntry * pce = &namecache[n];
+		if ((pce->hash == ahash) && (pce->dirlocation == adirlocation))
+		{
+			pce->lastuse = ++namecache_usecnt;
+			return n;
+		}
+	}
+	return -1;
+}
+
+void TFileSystem::NameCacheStore(uint64_t adirlocation, uint32_t ahash, uint64_t areadlocation, uint64_t areadend)
+{
+	unsigned idx = 0;
+	for (unsigned n = 0; n < FS_NAMECACHE_ENTRIES; ++n)
+	{
+		TFsNameCacheEntry * pce = &namecache[n];
+		if ((pce->hash == ahash) && (pce->dirlocation == adirlocation))
+		{
+			idx = n;
+			break;
+		}
+
+		if (int32_t(pce->lastuse - namecache[idx].lastuse) < 0)
+		{
+			idx = n;  // least recently used
+		}
+	}
+
+	TFsNameCacheEntry * pce = &namecache[idx];
+	pce->dirlocation = adirlocation;
+	pce->readlocation = areadlocation;
+	pce->readend = areadend;
+	pce->hash = ahash;
+	pce->lastuse = ++namecache_usecnt;
+}
+
+void TFileSystem::NameCacheInvalidate()
+{
+	for (unsigned n = 0; n < FS_NAMECACHE_ENTRIES; ++n)
+	{
+		namecache[n].hash = 0;
+		namecache[n].lastuse = 0;
+	}
+	namecache_usecnt = 0;
+}
+
 void TFileSystem::HandleDirRead()  // must be overridden
 {
 	// called only when curop == FSOP_IDLE
@@ -445,6 +682,45 @@ void TFileSystem::HandleFileSeek() // must be overridden
 	FinishCurTra(FSRESULT_NOTIMPL);
 }
 
+void TFileSystem::HandleFileCreate() // must be overridden for the FOPEN_CREATE
+{
+	FinishCurTra(FSRESULT_NOTIMPL);
+}
+
+void TFileSystem::HandleFileWrite() // must be overridden
+{
+	FinishCurTra(FSRESULT_NOTIMPL);
+}
+
+void TFileSystem::HandleFileTruncate() // must be overridden
+{
+	FinishCurTra(FSRESULT_NOTIMPL);
+}
+
+void TFileSystem::HandleFileClose() // should be overridden when the file system is writable
+{
+	if (FSTRA_FILE_CLOSE == curtra->tratype)
+	{
+		curtra->opened = false;
+	}
+	FinishCurTra(0);
+}
+
+void TFileSystem::RunOpAlloc()
+{
+	FinishCurOp(FSRESULT_NOTIMPL);
+}
+
+void TFileSystem::RunOpFree()
+{
+	FinishCurOp(FSRESULT_NOTIMPL);
+}
+
+void TFileSystem::RunOpFlush()
+{
+	FinishCurOp(0);
+}
+
 void TFileSystem::AddTransaction(TFile * afile, TFsTraType atype)
 {
 	afile->nexttra = nullptr;
@@ -43,10 +43,14 @@
 #ifndef FS_PATH_MAX_LEN
   #define FS_PATH_MAX_LEN    128
 #endif
+#ifndef FS_NAMECACHE_ENTRIES
+  #define FS_NAMECACHE_ENTRIES  8  // path resolution cache: directory + name hash -> directory read location
+#endif
 
 // Flags, etc.
 
 #define FOPEN_CREATE                1
+#define FOPEN_APPEND                2  // every write goes to the end of the file
 #define FOPEN_DIRECTORY             8
 
 #define FSRESULT_OK                 0
@@ -60,6 +64,8 @@
 #define FSRESULT_DIR_NOT_FOUND      8
 #define FSRESULT_INVALID_FDATABUF   9  // data buffer for fdata entry (directory read)
 #define FSRESULT_SEEK_BEYOND_EOF   10
+#define FSRESULT_DISK_FULL         11
+#define FSRESULT_ACCESS_DENIED     12  // read-only file or directory
 
 #define FS_MAX_TDATA       256
 
@@ -84,13 +90,26 @@ struct TFileDirData
 	uint32_t        attributes;
 	TFileDateTime   create_time;
 	TFileDateTime   modif_time;
-	char            name[FS_FNAME_MAX_LEN];
+	char            name[FS_FNAME_MAX_LEN];  // UTF-8, the long name when present
+	char            shortname[13];  // 8.3 alias when the file system has one, otherwise empty
+};
+
+struct TFsNameCacheEntry
+{
+	uint64_t        dirlocation;   // start of the directory
+	uint64_t        readlocation;  // the directory read of the entry starts here
+	uint64_t        readend;       // cluster end for the readlocation
+	uint32_t        hash;          // 0 = empty
+	uint32_t        lastuse;
 };
 
 enum TFsOpType
 {
 	FSOP_IDLE = 0,
 	FSOP_DIR_READ = 1,
+	FSOP_ALLOC = 2,   // allocate a storage unit (cluster) for a file
+	FSOP_FREE = 3,    // release the storage units (cluster chain) of a file
+	FSOP_FLUSH = 4,   // write back the cached file system data
 };
 
 enum TFsTraType
@@ -100,6 +119,11 @@ enum TFsTraType
 	FSTRA_FILE_OPEN,
 	FSTRA_FILE_READ,
 	FSTRA_FILE_SEEK,
+	FSTRA_FILE_CREATE,  // internal, started by the FSTRA_FILE_OPEN with the FOPEN_CREATE
+	FSTRA_FILE_WRITE,
+	FSTRA_FILE_TRUNCATE,
+	FSTRA_FILE_FLUSH,
+	FSTRA_FILE_CLOSE,
 };
 
 
@@ -156,6 +180,10 @@ public:
 	void             Open(const char * aname, uint32_t aflags);
 	void             Read(void * dst, uint32_t len);
 	void             Seek(uint64_t afilepos);
+	void             Write(void * src, uint32_t len);
+	void             Truncate();  // at the current file position
+	void             Flush();     // updates the directory entry and writes back the cached file system data
+	void             Close();     // Flush() + closing
 
 	int              WaitComplete(); // returns the result
 
@@ -179,10 +207,14 @@ public:
 public:
 	uint32_t         clusterbytes = 0;
 	uint64_t         rootdirstart = 0;
+	uint64_t         rootdirend = 0;  // end of the first root directory area (a cluster or a fixed size area)
 	uint8_t          clustersizeshift = 0;
 	uint64_t         cluster_reminder_mask = 0x1FF;
 	uint64_t         cluster_start_mask = 0xFFFFFFFFFFFFFE00;
 
+	uint32_t         namecache_hits = 0;
+	uint32_t         namecache_misses = 0;  // the cached location did not contain the name anymore
+
 public:
 	virtual          ~TFileSystem() { }
 
@@ -196,6 +228,13 @@ public:
 	virtual void     RunOpDirRead();
 	virtual void     HandleFileRead();
 	virtual void     HandleFileSeek();
+	virtual void     HandleFileCreate();
+	virtual void     HandleFileWrite();
+	virtual void     HandleFileTruncate();
+	virtual void     HandleFileClose();  // FSTRA_FILE_FLUSH too
+	virtual void     RunOpAlloc();
+	virtual void     RunOpFree();
+	virtual void     RunOpFlush();
 
 protected:
 
@@ -231,6 +270,19 @@ protected:
 	int              pseg_len;
 	uint64_t         dir_location;
 	uint64_t         dir_cluster_end;
+	uint64_t         dir_start;  // the directory being searched
+	uint64_t         dir_start_end;
+	uint32_t         seg_hash;
+	int              namecache_idx;
+
+	TFsNameCacheEntry  namecache[FS_NAMECACHE_ENTRIES];
+	uint32_t         namecache_usecnt = 0;
+
+	bool             SegmentMatches();  // the path segment matches the fdata
+	uint32_t         NameHash(const char * aname, unsigned alen);  // case insensitive
+	int              NameCacheFind(uint64_t adirlocation, uint32_t ahash);  // returns -1 when not found
+	void             NameCacheStore(uint64_t adirlocation, uint32_t ahash, uint64_t areadlocation, uint64_t areadend);
+	void             NameCacheInvalidate();
 
 	uint32_t         chunksize;
 
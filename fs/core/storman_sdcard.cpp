@@ -33,8 +33,10 @@
 #define SMDS_WAIT_NORMAL           1
 #define SMDS_RD_WAIT_PARTIAL      10
 #define SMDS_RD_PROCESS_PARTIAL   11
+#define SMDS_RD_WAIT_BLOCKS       12
 #define SMDS_WR_WAIT_PARTIAL_RD   20
 #define SMDS_WR_WAIT_PARTIAL_WR   21
+#define SMDS_WR_WAIT_BLOCKS       22
 #define SMDS_FINISH              100
 
 #define SMD_BLOCK_ADDR_MASK    0xFFFFFFFFFFFFFE00
@@ -51,6 +53,28 @@ bool TStorManSdcard::Init(TSdCard * asdcard)
 	return true;
 }
 
+void TStorManSdcard::ContinueRead()
+{
+	// the block aligned middle part is read directly into the target with one multi-block command,
+	// only the unaligned head and tail go through the sector buffer
+
+	if ((curaddr & 0x1FF) || (remaining < 512) || (uintptr_t(dataptr) & 3))
+	{
+		StartPartialRead();
+		return;
+	}
+
+	chunksize = (remaining & ~0x1FF);
+	if (!sdcard->StartReadBlocks((curaddr >> 9), dataptr, (chunksize >> 9)))
+	{
+		curtra->errorcode = sdcard->errorcode;
+		state = SMDS_FINISH;
+		return;
+	}
+
+	state = SMDS_RD_WAIT_BLOCKS;
+}
+
 void TStorManSdcard::StartPartialRead()
 {
 	uint64_t bladdr = (curaddr & SMD_BLOCK_ADDR_MASK);
@@ -87,7 +111,7 @@ void TStorManSdcard::ProcessPartialRead()
 
 	if (remaining > 0)
 	{
-		StartPartialRead();
+		ContinueRead();
 	}
 	else
 	{
@@ -95,6 +119,30 @@ void TStorManSdcard::ProcessPartialRead()
 	}
 }
 
+void TStorManSdcard::ContinueWrite()
+{
+	if ((curaddr & 0x1FF) || (remaining < 512) || (uintptr_t(dataptr) & 3))
+	{
+		PreparePartialWrite();
+		return;
+	}
+
+	chunksize = (remaining & ~0x1FF);
+	if ((sdbufaddr >= curaddr) && (sdbufaddr < curaddr + chunksize))
+	{
+		sdbufaddr = 1;  // the buffered sector is overwritten
+	}
+
+	if (!sdcard->StartWriteBlocks((curaddr >> 9), dataptr, (chunksize >> 9)))
+	{
+		curtra->errorcode = sdcard->errorcode;
+		state = SMDS_FINISH;
+		return;
+	}
+
+	state = SMDS_WR_WAIT_BLOCKS;
+}
+
 void TStorManSdcard::PreparePartialWrite()
 {
 	uint64_t bladdr = (curaddr & SMD_BLOCK_ADDR_MASK);
@@ -143,7 +191,7 @@ void TStorManSdcard::FinishPartialWrite()
 
 	if (remaining > 0)
 	{
-		PreparePartialWrite();
+		ContinueWrite();
 	}
 	else
 	{
@@ -192,23 +240,7 @@ void TStorManSdcard::Run()
 			dataptr = curtra->dataptr;
 			curaddr = curtra->address;
 
-			if ((curaddr & 0x1FF) || (remaining & 0x1FF))
-			{
-				// partial mode
-				StartPartialRead();
-				return;
-			}
-			else
-			{
-				// full block mode
-				if (!sdcard->StartReadBlocks((curaddr >> 9), dataptr, (remaining >> 9)))
-				{
-					FinishCurTraError(sdcard->errorcode);
-					return;
-				}
-
-				state = SMDS_WAIT_NORMAL;
-			}
+			ContinueRead();
 		}
 		else if (STRA_WRITE == curtra->trtype)
 		{
@@ -218,23 +250,7 @@ void TStorManSdcard::Run()
 			dataptr = curtra->dataptr;
 			curaddr = curtra->address;
 
-			if ((curaddr & 0x1FF) || (remaining & 0x1FF))
-			{
-				// partial mode
-				PreparePartialWrite();
-				return;
-			}
-			else
-			{
-				// full block mode
-				if (!sdcard->StartWriteBlocks((curaddr >> 9), dataptr, (remaining >> 9)))
-				{
-					FinishCurTraError(sdcard->errorcode);
-					return;
-				}
-
-				state = SMDS_WAIT_NORMAL;
-			}
+			ContinueWrite();
 		}
 		else
 		{
@@ -257,6 +273,34 @@ void TStorManSdcard::Run()
 		sdbufaddr = (curaddr & SMD_BLOCK_ADDR_MASK);
 		ProcessPartialRead();
 	}
+	else if ((SMDS_RD_WAIT_BLOCKS == state) || (SMDS_WR_WAIT_BLOCKS == state))
+	{
+		if (sdcard->errorcode)
+		{
+			FinishCurTraError(sdcard->errorcode);
+			return;
+		}
+
+		remaining -= chunksize;
+		dataptr   += chunksize;
+		curaddr   += chunksize;
+
+		if (remaining > 0)  // the partial tail
+		{
+			if (SMDS_RD_WAIT_BLOCKS == state)
+			{
+				ContinueRead();
+			}
+			else
+			{
+				ContinueWrite();
+			}
+		}
+		else
+		{
+			FinishCurTra();
+		}
+	}
 	else if (SMDS_WR_WAIT_PARTIAL_RD == state)
 	{
 		if (sdcard->errorcode)
@@ -54,9 +54,11 @@ protected:
   uint64_t       sdbufaddr = 1;  // address of the buffered sector, 1 = invalid
   uint8_t        sdbuf[512] __attribute__((aligned(16)));  // buffer for the partial reads/writes
 
+	void           ContinueRead();  // partial head, multi-block middle, partial tail
 	void           StartPartialRead();
 	void           ProcessPartialRead();
 
+	void           ContinueWrite();  // partial head, multi-block middle, partial tail
 	void           PreparePartialWrite();
 	void           StartPartialWrite();
 	void           FinishPartialWrite();
@@ -43,6 +43,116 @@ TFileFat::TFileFat(TFileSysFat * afilesys)
 	//super::TFile(afilesys);
 }
 
+void TFileFat::MapReset(uint64_t alocation, uint32_t afirstcluster)
+{
+	map_location = alocation;
+	extent_count = 0;
+	if (afirstcluster >= 2)
+	{
+		extents[0].fcluster = 0;
+		extents[0].cluster = afirstcluster;
+		extents[0].count = 1;
+		extent_count = 1;
+	}
+}
+
+TFsFatExtent * TFileFat::MapFind(uint32_t afcluster)
+{
+	// binary search for the last extent with fcluster <= afcluster
+	unsigned lo = 0;
+	unsigned hi = extent_count;
+	while (lo < hi)
+	{
+		unsigned mid = ((lo + hi) >> 1);
+		if (extents[mid].fcluster <= afcluster)
+		{
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+
+	return (lo ? &extents[lo - 1] : nullptr);
+}
+
+uint32_t TFileFat::MapCluster(uint32_t afcluster)
+{
+	TFsFatExtent * pext = MapFind(afcluster);
+	if (pext && (afcluster - pext->fcluster < pext->count))
+	{
+		return pext->cluster + (afcluster - pext->fcluster);
+	}
+	return 0;
+}
+
+uint32_t TFileFat::MapRunLength(uint32_t afcluster)
+{
+	TFsFatExtent * pext = MapFind(afcluster);
+	if (pext && (afcluster - pext->fcluster < pext->count))
+	{
+		return pext->count - (afcluster - pext->fcluster);
+	}
+	return 1;
+}
+
+void TFileFat::MapAdd(uint32_t afcluster, uint32_t acluster)
+{
+	TFsFatExtent * pext = MapFind(afcluster);
+	unsigned idx = (pext ? pext - &extents[0] + 1 : 0);  // insert position
+	if (pext)
+	{
+		uint32_t rofs = afcluster - pext->fcluster;
+		if (rofs < pext->count)
+		{
+			return;  // already mapped
+		}
+
+		if ((rofs == pext->count) && (acluster == pext->cluster + rofs))  // continues the run
+		{
+			++pext->count;
+			if ((idx < extent_count) && (extents[idx].fcluster == afcluster + 1) && (extents[idx].cluster == acluster + 1))
+			{
+				// joins the next run
+				pext->count += extents[idx].count;
+				--extent_count;
+				memmove(&extents[idx], &extents[idx + 1], (extent_count - idx) * sizeof(TFsFatExtent));
+			}
+			return;
+		}
+	}
+
+	if ((idx < extent_count) && (extents[idx].fcluster == afcluster + 1) && (extents[idx].cluster == acluster + 1))
+	{
+		// the next run starts one cluster earlier
+		--extents[idx].fcluster;
+		--extents[idx].cluster;
+		++extents[idx].count;
+		return;
+	}
+
+	if (extent_count >= FSFAT_FILE_EXTENTS)
+	{
+		// drop every second entry, the first one (file start) always remains
+		unsigned n;
+		for (n = 1; 2 * n < extent_count; ++n)
+		{
+			extents[n] = extents[2 * n];
+		}
+		extent_count = n;
+
+		pext = MapFind(afcluster);
+		idx = (pext ? pext - &extents[0] + 1 : 0);
+	}
+
+	memmove(&extents[idx + 1], &extents[idx], (extent_count - idx) * sizeof(TFsFatExtent));
+	extents[idx].fcluster = afcluster;
+	extents[idx].cluster = acluster;
+	extents[idx].count = 1;
+	++extent_count;
+}
+
 //--------------------------------------------------------------------------------------------
 
 TFile * TFileSysFat::NewFileObj(void * astorage, unsigned astoragesize)
@@ -86,6 +196,8 @@ void TFileSysFat::HandleInitState()
 
 	if (0 == initstate)  // read the boot sector
 	{
+		FatCacheInvalidate();
+		bufaddr = 1; // invalid
 		pstorman->AddTransaction(&stra, STRA_READ, firstaddr,  &buf[0], 512);
 		initstate = 1;
 	}
@@ -152,7 +264,9 @@ void TFileSysFat::HandleInitState()
 			}
 
 			sysbytes = reservedbytes + rootdirbytes + fatcount * fatbytes;
-			rootdirstart =  firstaddr + sysbytes;
+			// FAT12/16: the fixed size root directory is between the FATs and the data area
+			rootdirstart = firstaddr + reservedbytes + fatcount * fatbytes;
+			rootdirend = rootdirstart + rootdirbytes;
 			databytes = totalbytes - sysbytes;
 			clustercount = (databytes >> clustersizeshift);
 
@@ -160,6 +274,25 @@ void TFileSysFat::HandleInitState()
 			{
 				fat12 = true;
 			}
+
+			// the FAT might have less entries than the data area clusters
+			uint32_t fatentries = (fat32 ? (fatbytes >> 2) : (fat12 ? (fatbytes << 1) / 3 : (fatbytes >> 1)));
+			clusterlimit = clustercount + 2;
+			if (clusterlimit > fatentries)  clusterlimit = fatentries;
+
+			fsinfo_addr = 0;
+			if (fat32)
+			{
+				rootcluster = *(uint32_t *)&buf[0x2C];
+				rootdirstart = ClusterToAddr(rootcluster);
+				rootdirend = rootdirstart + clusterbytes;
+
+				uint16_t fsinfo_sector = *(uint16_t *)&buf[0x30];
+				if ((fsinfo_sector > 0) && (fsinfo_sector < 0xFFFF))
+				{
+					fsinfo_addr = firstaddr + (fsinfo_sector << 9);
+				}
+			}
 		}
 
 		if (reservedbytes < 512)
@@ -174,7 +307,36 @@ void TFileSysFat::HandleInitState()
 			return;
 		}
 
-		// no more initialization yet.
+		free_count = 0xFFFFFFFF;
+		free_hint = 2;
+		freemap_end = 0;
+
+		if (fsinfo_addr)
+		{
+			pstorman->AddTransaction(&stra, STRA_READ, fsinfo_addr,  &buf[0], 512);
+			initstate = 2;
+			return;
+		}
+
+		fsok = true;
+		initialized = true;
+	}
+	else if (2 == initstate)  // process the FSInfo sector
+	{
+		if ((0x41615252 == *(uint32_t *)&buf[0]) && (0x61417272 == *(uint32_t *)&buf[0x1E4]))
+		{
+			free_count = *(uint32_t *)&buf[0x1E8];
+			uint32_t nextfree = *(uint32_t *)&buf[0x1EC];
+			if ((nextfree >= 2) && (nextfree < clusterlimit))
+			{
+				free_hint = nextfree;
+			}
+		}
+		else
+		{
+			fsinfo_addr = 0;  // invalid, not maintained
+		}
+
 		fsok = true;
 		initialized = true;
 	}
@@ -184,12 +346,21 @@ void TFileSysFat::RunOpDirRead()
 {
 	// called only when stra.completed == true and stra.errorcode == 0
 
-	if (5 == opstate) // wait for FAT resolution
+	if (5 == opstate) // wait for FAT sector read
+	{
+		if (!ContinueFatLookup())
+		{
+			return;
+		}
+		opstate = 6;
+	}
+
+	if (6 == opstate) // FAT resolved
 	{
 		TRACE_CHAIN("FAT next cluster = %u\r\n", next_cluster);
-		if ((next_cluster < 2) || (next_cluster >= clustercount))
+		if ((next_cluster < 2) || (next_cluster >= clusterlimit))
 		{
-			FinishCurTra(FSRESULT_EOF);
+			FinishCurOp(FSRESULT_EOF);
 			return;
 		}
 
@@ -203,7 +374,6 @@ void TFileSysFat::RunOpDirRead()
 		if (op_location < op_cluster_end)
 		{
 			// cache the 512 byte of the directory sector
-			// todo: handle long file names
 
 			sectoraddr = (op_location & sector_base_mask);
 
@@ -220,12 +390,24 @@ void TFileSysFat::RunOpDirRead()
 		}
 		else // cluster end reached
 		{
+			if (FixedRootDirEnd(op_cluster_end))
+			{
+				FinishCurOp(FSRESULT_EOF);  // not in the FAT, it can not continue
+				return;
+			}
+
 			// resolve FAT chain
 			uint32_t curcluster = AddrToCluster(op_location) - 1;
 			TRACE_CHAIN("FAT find next cluster of %u\r\n", curcluster);
 
-			FindNextCluster(curcluster);
-			opstate = 5;
+			if (!FindNextCluster(curcluster))
+			{
+				opstate = 5;
+				return;
+			}
+
+			opstate = 6;  // resolved from the FAT cache
+			RunOpDirRead();
 			return;
 		}
 	}
@@ -246,6 +428,8 @@ void TFileSysFat::RunOpDirRead()
 			if (0 == pdire->name[0])
 			{
 				// 0 at signalizes the end of the directory (and a free entry)
+				lfn_next = 0;
+				lfn_valid = false;
 				FinishCurOp(FSRESULT_EOF);
 				return;
 			}
@@ -253,12 +437,15 @@ void TFileSysFat::RunOpDirRead()
 			op_location += sizeof(TFsFatDirEntry);  // advance to the next location
 
 			bool bok = true;
-			if ((0x05 == pdire->name[0]) || (0xE5 == pdire->name[0])) // is the entry deleted ?
+			if ((0x05 == uint8_t(pdire->name[0])) || (0xE5 == uint8_t(pdire->name[0]))) // is the entry deleted ?
 			{
 				bok = false;
+				lfn_next = 0;
+				lfn_valid = false;
 			}
-			else if (0x0F == pdire->attr) // is it a long file name chunk ?
+			else if (FSFAT_ATTR_LFN == pdire->attr) // is it a long file name chunk ?
 			{
+				CollectLongName(pdire);
 				bok = false;
 			}
 
@@ -266,6 +453,9 @@ void TFileSysFat::RunOpDirRead()
 			{
 				// convert the directory entry to the unified format
 				ConvertDirEntry(pdire, &fdata, dirlocation);
+				ConvertLongName(pdire, &fdata);  // replaces the name when a long name belongs to the entry
+				lfn_next = 0;
+				lfn_valid = false;
 				FinishCurOp(0);
 				return;
 			}
@@ -281,55 +471,123 @@ void TFileSysFat::HandleFileRead()
 {
 	// called only when curop == FSOP_IDLE and stra.competed without error
 
+	TFileFat * pfile = CurFileMapped();
+
 	if (1 == trastate) // wait for chunk read finish
 	{
-		curtra->curlocation += chunksize;
-		curtra->dataptr += chunksize;
-		curtra->transferlen += chunksize;
-		curtra->filepos += chunksize;
-		curtra->remaining -= chunksize;
+		pfile->curlocation += chunksize;
+		pfile->dataptr += chunksize;
+		pfile->transferlen += chunksize;
+		pfile->filepos += chunksize;
+		pfile->remaining -= chunksize;
+		trastate = 0;
 	}
 
-	if (0 == curtra->remaining)
+	if (0 == pfile->remaining)
 	{
 		FinishCurTra(0);
 		return;
 	}
 
-	if (5 == trastate) // wait for FAT next cluster
+	if (5 == trastate) // wait for FAT sector read
+	{
+		if (!ContinueFatLookup())
+		{
+			return;
+		}
+		trastate = 6;
+	}
+
+	if (6 == trastate) // FAT resolved, the filepos is at the beginning of the next cluster
 	{
 		TRACE_CHAIN("FAT next cluster = %u\r\n", next_cluster);
-		if ((next_cluster < 2) || (next_cluster >= clustercount))
+		if ((next_cluster < 2) || (next_cluster >= clusterlimit))
 		{
 			FinishCurTra(FSRESULT_EOF);
 			return;
 		}
 
-		curtra->curlocation = ClusterToAddr(next_cluster);
-		curtra->cluster_end = curtra->curlocation + clusterbytes;
+		pfile->MapAdd(uint32_t(pfile->filepos >> clustersizeshift), next_cluster);
+		EnterFileCluster(pfile, next_cluster);
 		trastate = 0; // go on with normal read
 	}
 
-	// process the next chunk
-	// the curlocation must point to a valid file segment !
-	chunksize = (curtra->cluster_end - curtra->curlocation);
-	if (0 == chunksize)
+	if (4 == trastate) // wait for FAT sector read of the run look-ahead
 	{
-		// FAT chain resolution required
-		uint32_t curcluster = AddrToCluster(curtra->curlocation) - 1;
-		TRACE_CHAIN("FAT find next cluster of %u\r\n", curcluster);
+		if (!ContinueFatLookup())
+		{
+			return;
+		}
+		trastate = 3;
+	}
 
-		FindNextCluster(curcluster);
-		trastate = 5;
-		return;
+	if (0 == trastate)
+	{
+		// process the next chunk
+		// the curlocation must point to a valid file segment !
+		if (pfile->cluster_end == pfile->curlocation)
+		{
+			// the next cluster comes from the cluster run map or from the FAT chain
+			next_cluster = pfile->MapCluster(uint32_t(pfile->filepos >> clustersizeshift));
+			if (!next_cluster)
+			{
+				uint32_t curcluster = AddrToCluster(pfile->curlocation) - 1;
+				TRACE_CHAIN("FAT find next cluster of %u\r\n", curcluster);
+
+				if (!FindNextCluster(curcluster))
+				{
+					trastate = 5;
+					return;
+				}
+			}
+
+			trastate = 6;  // resolved from the map or from the FAT cache
+			HandleFileRead();
+			return;
+		}
 	}
 
-	if (chunksize > curtra->remaining)
+	// look ahead in the FAT chain, the directly following clusters are merged into one storage transaction
+	while (true)
 	{
-		chunksize = curtra->remaining;
+		uint64_t runbytes = pfile->cluster_end - pfile->curlocation;
+		uint32_t endfc = uint32_t((pfile->filepos + runbytes) >> clustersizeshift);  // file cluster after the run
+
+		if (3 == trastate)  // the FAT entry of the last run cluster is resolved
+		{
+			if ((next_cluster < 2) || (next_cluster >= clusterlimit))
+			{
+				break;  // chain end, the read stops at the file end anyway
+			}
+
+			pfile->MapAdd(endfc, next_cluster);
+			if (next_cluster != fat_cluster + 1)
+			{
+				break;  // fragmented, continued after this chunk without FAT lookup
+			}
+
+			pfile->cluster_end += clusterbytes;
+			runbytes += clusterbytes;
+			++endfc;
+		}
+
+		if ((runbytes >= pfile->remaining) || pfile->MapCluster(endfc))
+		{
+			break;  // long enough, or the following cluster is known (then it is not contiguous)
+		}
+
+		if (!FindNextCluster(AddrToCluster(pfile->cluster_end - 1)))
+		{
+			trastate = 4;
+			return;
+		}
+		trastate = 3;
 	}
 
-	pstorman->AddTransaction(&stra, STRA_READ, curtra->curlocation,  curtra->dataptr, chunksize);
+	uint64_t runbytes = pfile->cluster_end - pfile->curlocation;
+	chunksize = (runbytes > pfile->remaining ? pfile->remaining : uint32_t(runbytes));
+
+	pstorman->AddTransaction(&stra, STRA_READ, pfile->curlocation,  pfile->dataptr, chunksize);
 	trastate = 1;
 	return;
 }
@@ -338,80 +596,1079 @@ void TFileSysFat::HandleFileSeek()
 {
 	// called only when curop == FSOP_IDLE and stra.competed without error
 
-	if (5 == trastate) // wait for FAT next cluster
+	TFileFat * pfile = CurFileMapped();
+
+	if (0 == trastate)
 	{
-		TRACE_CHAIN("FAT next cluster = %u\r\n", next_cluster);
-		if ((next_cluster < 2) || (next_cluster >= clustercount))
+		seekstate = 0;
+		trastate = 1;
+	}
+
+	if (ContinueSeek(pfile))
+	{
+		FinishCurTra(seekresult);
+	}
+}
+
+bool TFileSysFat::ContinueSeek(TFileFat * afile)
+{
+	// positions the afile to the afile->targetpos, start with seekstate = 0
+
+	if (0 == seekstate)  // start from the closest mapped cluster
+	{
+		// a cluster boundary target is addressed as the end of the previous cluster
+		uint32_t tfc = (afile->targetpos ? uint32_t((afile->targetpos - 1) >> clustersizeshift) : 0);
+		TFsFatExtent * pext = afile->MapFind(tfc);
+		if (!pext)
 		{
-			FinishCurTra(FSRESULT_EOF);
-			return;
+			seekresult = FSRESULT_EOF;
+			return true;
 		}
 
-		curtra->filepos += clusterbytes;
-		curtra->curlocation = ClusterToAddr(next_cluster);
-		curtra->cluster_end = curtra->curlocation + clusterbytes;
+		uint32_t fc = tfc;
+		if (fc - pext->fcluster >= pext->count)
+		{
+			fc = pext->fcluster + pext->count - 1;  // the chain continues from the run end
+		}
+
+		afile->filepos = (uint64_t(fc) << clustersizeshift);
+		EnterFileCluster(afile, pext->cluster + (fc - pext->fcluster));
+		seekstate = 2;
 	}
 
-	if (curtra->filepos + clusterbytes >= curtra->targetpos)  // include the cluster end
+	if (5 == seekstate) // wait for FAT sector read
 	{
-		curtra->curlocation += (curtra->targetpos & cluster_reminder_mask);
-		curtra->filepos = curtra->targetpos;
-		FinishCurTra(0);
-		return;
+		if (!ContinueFatLookup())
+		{
+			return false;
+		}
+		seekstate = 6;
 	}
 
-	// go to the next cluster
-	uint32_t curcluster = AddrToCluster(curtra->curlocation);
-	TRACE_CHAIN("FAT find next cluster of %u\r\n", curcluster);
-	FindNextCluster(curcluster);
-	trastate = 5;
+	while (true)
+	{
+		if (6 == seekstate) // FAT resolved
+		{
+			TRACE_CHAIN("FAT next cluster = %u\r\n", next_cluster);
+			if ((next_cluster < 2) || (next_cluster >= clusterlimit))
+			{
+				seekresult = FSRESULT_EOF;
+				return true;
+			}
+
+			afile->filepos += clusterbytes;
+			afile->MapAdd(uint32_t(afile->filepos >> clustersizeshift), next_cluster);
+			EnterFileCluster(afile, next_cluster);
+			seekstate = 2;
+		}
+
+		if (afile->filepos + clusterbytes >= afile->targetpos)  // include the cluster end
+		{
+			afile->curlocation += (afile->targetpos - afile->filepos);
+			afile->filepos = afile->targetpos;
+			seekresult = 0;
+			return true;
+		}
+
+		// go to the next cluster
+		uint32_t curcluster = AddrToCluster(afile->curlocation);
+		TRACE_CHAIN("FAT find next cluster of %u\r\n", curcluster);
+		if (!FindNextCluster(curcluster))
+		{
+			seekstate = 5;
+			return false;
+		}
+		seekstate = 6;  // resolved from the FAT cache, continue with the next cluster
+	}
 }
 
-void TFileSysFat::ConvertDirEntry(TFsFatDirEntry * pdire, TFileDirData * pfdata, uint64_t adirlocation)
+void TFileSysFat::HandleFileWrite()
 {
-	pfdata->size = pdire->size;
-	pfdata->location = ClusterToAddr(pdire->cluster_low + (pdire->cluster_high << 16));
-	pfdata->dirlocation = adirlocation;
+	// called only when curop == FSOP_IDLE and stra.competed without error
 
-	// attributes
-	pfdata->attributes = (pdire->attr << 16); // keep the original attributes
-	if (pdire->attr & 0x10)
+	TFileFat * pfile = CurFileMapped();
+
+	if (0 == trastate)
 	{
-		pfdata->attributes |= FSATTR_DIR;
+		if ((pfile->fdata.attributes >> 16) & FSFAT_ATTR_READONLY)
+		{
+			FinishCurTra(FSRESULT_ACCESS_DENIED);
+			return;
+		}
+
+		if ((pfile->open_flags & FOPEN_APPEND) && (pfile->filepos != pfile->fdata.size))
+		{
+			pfile->targetpos = pfile->fdata.size;
+			seekstate = 0;
+			trastate = 10;
+		}
+		else
+		{
+			trastate = 30;
+		}
 	}
 
-	if (pdire->attr & 0x08)
+	if (10 == trastate)  // positioning to the file end
 	{
-		pfdata->attributes |= FSATTR_VOLLABEL;
+		if (!ContinueSeek(pfile))
+		{
+			return;
+		}
+
+		if (seekresult)
+		{
+			FinishCurTra(seekresult);
+			return;
+		}
+		trastate = 30;
 	}
+	else if (1 == trastate) // wait for chunk write finish
+	{
+		pfile->curlocation += chunksize;
+		pfile->dataptr += chunksize;
+		pfile->transferlen += chunksize;
+		pfile->filepos += chunksize;
+		pfile->remaining -= chunksize;
+		if (pfile->filepos > pfile->fdata.size)
+		{
+			pfile->fdata.size = pfile->filepos;
+		}
+		pfile->entry_dirty = true;
+		trastate = 30;
+	}
+	else if (21 == trastate)  // first cluster allocated
+	{
+		if (opresult)
+		{
+			FinishCurTra(opresult);
+			return;
+		}
 
-	//pfdata->create_time = 0; // todo: implement
-	//pfdata->modif_time = 0; // todo: implement
+		pfile->fdata.location = ClusterToAddr(op_cluster);
+		pfile->entry_dirty = true;
+		pfile->MapReset(pfile->fdata.location, op_cluster);
+		EnterFileCluster(pfile, op_cluster);  // the filepos is 0 here
+		trastate = 30;
+	}
 
-	// 8+3 name:
-	char * dp = &pfdata->name[0];
-	char * sp = &pdire->name[0];
-	char * endp = &pdire->name[8];
-	while ((sp < endp) && (*sp > 32))
+	if (0 == pfile->remaining)
 	{
-		*dp++ = *sp++;
+		FinishCurTra(0);
+		return;
 	}
-	sp = &pdire->name[8];
-	endp = &pdire->name[11];
-	if (*sp > 32)
+
+	if (FS_INVALID_ADDR == pfile->fdata.location)  // empty file without cluster
 	{
-		*dp++ = '.';
+		trastate = 21;
+		if (StartOpAlloc(0))
+		{
+			return;
+		}
+		HandleFileWrite();
+		return;
 	}
-	while ((sp < endp) && (*sp > 32))
+
+	// extend the run to cover the remaining bytes: from the cluster run map, from the FAT chain
+	// or with allocating new clusters at the chain end (the following cluster is preferred)
+	while (true)
 	{
-		*dp++ = *sp++;
+		uint64_t runbytes = pfile->cluster_end - pfile->curlocation;
+		uint32_t endfc = uint32_t((pfile->filepos + runbytes) >> clustersizeshift);  // file cluster after the run
+		uint32_t lastcl = AddrToCluster(pfile->cluster_end - 1);
+		uint32_t newcl = 0;
+
+		if (31 == trastate) // wait for FAT sector read
+		{
+			if (!ContinueFatLookup())
+			{
+				return;
+			}
+			trastate = 32;
+		}
+
+		if (32 == trastate)  // FAT resolved
+		{
+			if ((next_cluster >= 2) && (next_cluster < clusterlimit))
+			{
+				newcl = next_cluster;
+			}
+			else  // chain end
+			{
+				trastate = 33;
+				if (StartOpAlloc(lastcl))
+				{
+					return;
+				}
+			}
+		}
+
+		if (33 == trastate)  // cluster allocated
+		{
+			if (opresult)
+			{
+				if (runbytes)
+				{
+					trastate = 30;
+					break;  // write the already available part first, the error comes at the next allocation
+				}
+				FinishCurTra(opresult);
+				return;
+			}
+			newcl = op_cluster;
+		}
+
+		if (newcl)
+		{
+			trastate = 30;
+			pfile->MapAdd(endfc, newcl);
+			if (0 == runbytes)
+			{
+				EnterFileCluster(pfile, newcl);
+				continue;
+			}
+
+			if (newcl != lastcl + 1)
+			{
+				break;  // not contiguous
+			}
+
+			pfile->cluster_end += clusterbytes;
+			continue;
+		}
+
+		if (runbytes >= pfile->remaining)
+		{
+			break;
+		}
+
+		newcl = pfile->MapCluster(endfc);
+		if (newcl)
+		{
+			if (0 == runbytes)
+			{
+				EnterFileCluster(pfile, newcl);
+				continue;
+			}
+			break;  // mapped separately, so not contiguous
+		}
+
+		if (!FindNextCluster(lastcl))
+		{
+			trastate = 31;
+			return;
+		}
+		trastate = 32;
 	}
-	*dp = 0; // zero terminate
+
+	uint64_t runbytes = pfile->cluster_end - pfile->curlocation;
+	chunksize = (runbytes > pfile->remaining ? pfile->remaining : uint32_t(runbytes));
+
+	pstorman->AddTransaction(&stra, STRA_WRITE, pfile->curlocation,  pfile->dataptr, chunksize);
+	trastate = 1;
 }
 
-uint64_t TFileSysFat::ClusterToAddr(uint32_t acluster)
+void TFileSysFat::HandleFileTruncate()
 {
-	if ((acluster < 2) || (acluster >= clustercount))
+	// called only when curop == FSOP_IDLE and stra.competed without error
+
+	TFileFat * pfile = CurFileMapped();
+
+	if (0 == trastate)
+	{
+		if ((pfile->fdata.attributes >> 16) & FSFAT_ATTR_READONLY)
+		{
+			FinishCurTra(FSRESULT_ACCESS_DENIED);
+			return;
+		}
+
+		if (pfile->filepos >= pfile->fdata.size)
+		{
+			FinishCurTra(0);  // nothing to do
+			return;
+		}
+
+		uint32_t lastcl = 0;  // the new chain end
+		uint32_t firstfree = 0;
+		if (pfile->filepos)
+		{
+			// the curlocation is in the last remaining cluster (or at its end)
+			lastcl = AddrToCluster(pfile->curlocation - 1);
+			pfile->cluster_end = ClusterToAddr(lastcl) + clusterbytes;
+			pfile->map_location = FS_INVALID_ADDR;  // rebuilt at the next use
+		}
+		else
+		{
+			firstfree = AddrToCluster(pfile->fdata.location);
+			pfile->fdata.location = FS_INVALID_ADDR;
+			pfile->curlocation = FS_INVALID_ADDR;
+			pfile->cluster_end = FS_INVALID_ADDR;
+			pfile->MapReset(FS_INVALID_ADDR, 0);
+		}
+
+		pfile->fdata.size = pfile->filepos;
+		pfile->entry_dirty = true;
+
+		trastate = 1;
+		if (StartOpFree(lastcl, firstfree))
+		{
+			return;
+		}
+	}
+
+	if (1 == trastate)
+	{
+		if (opresult)
+		{
+			FinishCurTra(opresult);
+			return;
+		}
+		trastate = 40;
+	}
+
+	ContinueFileSync(pfile);
+}
+
+void TFileSysFat::HandleFileClose()
+{
+	// called only when curop == FSOP_IDLE and stra.competed without error
+
+	if (0 == trastate)
+	{
+		trastate = 40;
+	}
+
+	ContinueFileSync(CurFileMapped());
+}
+
+void TFileSysFat::ContinueFileSync(TFileFat * afile)
+{
+	// the FAT goes first, so the directory entry never refers to unwritten chain
+
+	if (40 == trastate)
+	{
+		trastate = 41;
+		if (StartOpFlush())
+		{
+			return;
+		}
+	}
+
+	if (41 == trastate)
+	{
+		if (opresult)
+		{
+			FinishCurTra(opresult);
+			return;
+		}
+
+		trastate = 42;
+		if (afile->entry_dirty)
+		{
+			// update the last access date, the first cluster, the modification time and the size
+			wr_dirlocation = afile->fdata.dirlocation;
+			uint32_t cluster = AddrToCluster(afile->fdata.location);
+			wr_direntry.last_acc_date = uint16_t(write_datetime >> 16);
+			wr_direntry.cluster_high = uint16_t(cluster >> 16);
+			wr_direntry.mtime = uint16_t(write_datetime);
+			wr_direntry.mdate = uint16_t(write_datetime >> 16);
+			wr_direntry.cluster_low = uint16_t(cluster);
+			wr_direntry.size = uint32_t(afile->fdata.size);
+			WriteDirEntry(0x12, 14);
+			return;
+		}
+	}
+
+	// 42: finished
+	afile->entry_dirty = false;
+	if (FSTRA_FILE_CLOSE == afile->tratype)
+	{
+		afile->opened = false;
+	}
+	FinishCurTra(0);
+}
+
+void TFileSysFat::HandleFileCreate()
+{
+	// called only when curop == FSOP_IDLE and stra.competed without error
+	// the directory search ended at op_location: a free entry or the directory end
+
+	TFileFat * pfile = (TFileFat *)curtra;
+
+	if (0 == trastate)
+	{
+		memset(&wr_direntry, 0, sizeof(wr_direntry));
+		if (!MakeShortName(pseg_start, pseg_len, &wr_direntry.name[0]))
+		{
+			FinishCurTra(FSRESULT_INVALID_NAME);
+			return;
+		}
+		wr_direntry.attr = FSFAT_ATTR_ARCHIVE;
+		wr_direntry.ctime = uint16_t(write_datetime);
+		wr_direntry.cdate = uint16_t(write_datetime >> 16);
+		wr_direntry.last_acc_date = wr_direntry.cdate;
+		wr_direntry.mtime = wr_direntry.ctime;
+		wr_direntry.mdate = wr_direntry.cdate;
+
+		if (op_location < op_cluster_end)
+		{
+			wr_dirlocation = op_location;  // the end marker entry
+			trastate = 4;
+		}
+		else
+		{
+			// the directory is full, extend it with a new cluster
+			uint32_t lastcl = AddrToCluster(op_cluster_end - 1);
+			if (FixedRootDirEnd(op_cluster_end) || !lastcl)
+			{
+				FinishCurTra(FSRESULT_DISK_FULL);  // the FAT12/16 root directory can not be extended
+				return;
+			}
+
+			trastate = 1;
+			if (StartOpAlloc(lastcl))
+			{
+				return;
+			}
+		}
+	}
+
+	if (1 == trastate)  // directory cluster allocated, clear it
+	{
+		if (opresult)
+		{
+			FinishCurTra(opresult);
+			return;
+		}
+
+		wr_dirlocation = ClusterToAddr(op_cluster);
+		sectoraddr = wr_dirlocation;
+		memset(&buf[0], 0, sizeof(buf));
+		bufaddr = 1; // invalid
+		trastate = 2;
+	}
+
+	if (2 == trastate)
+	{
+		if (sectoraddr < wr_dirlocation + clusterbytes)
+		{
+			pstorman->AddTransaction(&stra, STRA_WRITE, sectoraddr,  &buf[0], 512);
+			sectoraddr += 512;
+			return;
+		}
+		trastate = 4;
+	}
+
+	if (4 == trastate)
+	{
+		WriteDirEntry(0, sizeof(wr_direntry));
+		trastate = 5;
+		return;
+	}
+
+	if (5 == trastate)  // entry written, the file is open
+	{
+		ConvertDirEntry(&wr_direntry, &pfile->fdata, wr_dirlocation);
+		pfile->opened = true;
+		pfile->filepos = 0;
+		pfile->curlocation = pfile->fdata.location;
+		pfile->cluster_end = pfile->fdata.location;
+		pfile->entry_dirty = false;
+		pfile->MapReset(FS_INVALID_ADDR, 0);
+		trastate = 40;  // the FAT might have been changed by the directory extension
+	}
+
+	ContinueFileSync(pfile);
+}
+
+void TFileSysFat::WriteDirEntry(unsigned aoffset, unsigned alen)
+{
+	uint8_t * psrc = ((uint8_t *)&wr_direntry) + aoffset;
+	if (bufaddr == (wr_dirlocation & sector_base_mask))  // keep the directory sector buffer up to date
+	{
+		memcpy(&buf[(wr_dirlocation & 0x1FF) + aoffset], psrc, alen);
+	}
+	pstorman->AddTransaction(&stra, STRA_WRITE, wr_dirlocation + aoffset,  psrc, alen);
+}
+
+bool TFileSysFat::MakeShortName(const char * asrc, unsigned alen, char * adst)
+{
+	// 8.3 name, upper case, padded with spaces
+
+	memset(adst, ' ', 11);
+
+	unsigned n = 0;
+	bool     ext = false;
+	for (unsigned i = 0; i < alen; ++i)
+	{
+		char c = asrc[i];
+		if ('.' == c)
+		{
+			if (ext || (0 == n))
+			{
+				return false;
+			}
+			ext = true;
+			n = 8;
+			continue;
+		}
+
+		if ((c <= 32) || (c >= 127) || strchr("\"*+,/:;<=>?[\\]|", c))
+		{
+			return false;
+		}
+
+		if (n >= (ext ? 11 : 8))
+		{
+			return false;  // does not fit
+		}
+
+		adst[n++] = (((c >= 'a') && (c <= 'z')) ? c - 32 : c);
+	}
+
+	if (' ' == adst[0])
+	{
+		return false;
+	}
+
+	if (0xE5 == uint8_t(adst[0]))
+	{
+		adst[0] = 0x05;
+	}
+
+	return true;
+}
+
+bool TFileSysFat::StartOpAlloc(uint32_t aprevcluster)
+{
+	op_cluster = aprevcluster;
+	curop = FSOP_ALLOC;
+	opstate = 0;
+
+	RunOpAlloc();
+
+	return (curop != FSOP_IDLE);
+}
+
+void TFileSysFat::RunOpAlloc()
+{
+	// called only when stra.completed == true and stra.errorcode == 0
+	// searches a free cluster, the one after op_cluster is preferred, links it to the op_cluster chain (when not 0)
+	// result: op_cluster = the new cluster
+
+	if (0 == opstate)
+	{
+		op_scan_cluster = (op_cluster ? op_cluster + 1 : free_hint);
+		op_scan_count = 0;
+		opstate = 1;
+	}
+
+	if ((10 == opstate) || (11 == opstate))  // free map loading, the freemap_end is set only when complete
+	{
+		uint32_t endcl = freemap_base + FSFAT_FREEMAP_CLUSTERS;
+		if (endcl > clusterlimit)  endcl = clusterlimit;
+
+		while (freemap_scan < endcl)
+		{
+			if (11 == opstate) // wait for FAT sector read
+			{
+				if (!ContinueFatLookup())
+				{
+					return;
+				}
+			}
+			else if (!FindNextCluster(freemap_scan))
+			{
+				opstate = 11;
+				return;
+			}
+			opstate = 10;
+
+			if (0 == next_cluster)
+			{
+				uint32_t idx = freemap_scan - freemap_base;
+				freemap[idx >> 5] |= (1u << (idx & 31));
+			}
+			++freemap_scan;
+		}
+
+		freemap_end = endcl;
+		opstate = 1;
+	}
+
+	if (1 == opstate)  // search in the free map
+	{
+		while (true)
+		{
+			if (op_scan_count >= clusterlimit - 2)
+			{
+				FinishCurOp(FSRESULT_DISK_FULL);
+				return;
+			}
+
+			if (op_scan_cluster >= clusterlimit)
+			{
+				op_scan_cluster = 2;  // wrap around
+			}
+
+			if ((op_scan_cluster < freemap_base) || (op_scan_cluster >= freemap_end))
+			{
+				// load the window containing the op_scan_cluster
+				freemap_base = 2 + ((op_scan_cluster - 2) & ~(FSFAT_FREEMAP_CLUSTERS - 1));
+				freemap_end = 0;
+				freemap_scan = freemap_base;
+				memset(&freemap[0], 0, sizeof(freemap));
+				opstate = 10;
+				RunOpAlloc();
+				return;
+			}
+
+			uint32_t idx = op_scan_cluster - freemap_base;
+			uint32_t bits = (freemap[idx >> 5] & (0xFFFFFFFF << (idx & 31)));
+			if (bits)
+			{
+				uint32_t found = freemap_base + (idx & ~31) + __builtin_ctz(bits);
+				if (found < freemap_end)
+				{
+					op_scan_count += found - op_scan_cluster;
+					op_new_cluster = found;
+					opstate = 20;
+					break;
+				}
+			}
+
+			// continue at the next word
+			uint32_t next = freemap_base + (idx & ~31) + 32;
+			if (next > freemap_end)  next = freemap_end;
+			op_scan_count += next - op_scan_cluster;
+			op_scan_cluster = next;
+		}
+	}
+
+	if (20 == opstate)  // mark the new cluster as chain end
+	{
+		opstate = 21;
+		if (!SetFatEntry(op_new_cluster, FatEndOfChain()))
+		{
+			return;
+		}
+	}
+	else if (21 == opstate)
+	{
+		if (!ContinueFatUpdate())
+		{
+			return;
+		}
+	}
+
+	if (21 == opstate)  // link to the previous
+	{
+		opstate = 23;
+		if (op_cluster && !SetFatEntry(op_cluster, op_new_cluster))
+		{
+			opstate = 22;
+			return;
+		}
+	}
+	else if (22 == opstate)
+	{
+		if (!ContinueFatUpdate())
+		{
+			return;
+		}
+		opstate = 23;
+	}
+
+	// 23: done
+	if (free_count < clusterlimit)
+	{
+		--free_count;
+	}
+	free_hint = op_new_cluster + 1;
+	fsinfo_dirty = true;
+	op_cluster = op_new_cluster;
+	FinishCurOp(0);
+}
+
+bool TFileSysFat::StartOpFree(uint32_t alastcluster, uint32_t afirstfree)
+{
+	op_cluster = alastcluster;
+	op_free_cluster = afirstfree;
+	curop = FSOP_FREE;
+	opstate = 0;
+
+	RunOpFree();
+
+	return (curop != FSOP_IDLE);
+}
+
+void TFileSysFat::RunOpFree()
+{
+	// called only when stra.completed == true and stra.errorcode == 0
+	// when op_cluster is set, it becomes the chain end and the rest of its chain is released,
+	// otherwise the chain starting at op_free_cluster
+
+	if (0 == opstate)
+	{
+		op_scan_count = 0;
+		if (op_cluster)
+		{
+			opstate = 2;
+			if (!FindNextCluster(op_cluster))
+			{
+				opstate = 1;
+				return;
+			}
+		}
+		else
+		{
+			opstate = 10;
+		}
+	}
+
+	if (1 == opstate)  // wait for FAT sector read
+	{
+		if (!ContinueFatLookup())
+		{
+			return;
+		}
+		opstate = 2;
+	}
+
+	if (2 == opstate)  // the rest of the chain is resolved
+	{
+		op_free_cluster = next_cluster;
+		opstate = 10;
+		if (!SetFatEntry(op_cluster, FatEndOfChain()))
+		{
+			opstate = 3;
+			return;
+		}
+	}
+	else if (3 == opstate)
+	{
+		if (!ContinueFatUpdate())
+		{
+			return;
+		}
+		opstate = 10;
+	}
+
+	while (true)
+	{
+		if (10 == opstate)  // release the op_free_cluster
+		{
+			if ((op_free_cluster < 2) || (op_free_cluster >= clusterlimit))
+			{
+				FinishCurOp(0);  // chain end
+				return;
+			}
+
+			if (++op_scan_count > clusterlimit)
+			{
+				FinishCurOp(FSRESULT_IOERROR);  // chain loop
+				return;
+			}
+
+			if (!FindNextCluster(op_free_cluster))
+			{
+				opstate = 11;
+				return;
+			}
+			opstate = 12;
+		}
+
+		if (11 == opstate) // wait for FAT sector read
+		{
+			if (!ContinueFatLookup())
+			{
+				return;
+			}
+			opstate = 12;
+		}
+
+		if (12 == opstate)  // next_cluster: the following
+		{
+			op_new_cluster = next_cluster;
+			if (!SetFatEntry(op_free_cluster, 0))
+			{
+				opstate = 13;
+				return;
+			}
+			opstate = 14;
+		}
+
+		if (13 == opstate)
+		{
+			if (!ContinueFatUpdate())
+			{
+				return;
+			}
+			opstate = 14;
+		}
+
+		// 14: released
+		if (free_count < clusterlimit)
+		{
+			++free_count;
+		}
+		if (op_free_cluster < free_hint)
+		{
+			free_hint = op_free_cluster;
+		}
+		fsinfo_dirty = true;
+		op_free_cluster = op_new_cluster;
+		opstate = 10;
+	}
+}
+
+bool TFileSysFat::StartOpFlush()
+{
+	curop = FSOP_FLUSH;
+	opstate = 0;
+	fatcache_loading = -1;  // forget the unfinished (failed) cache transactions
+	fatcache_writing = -1;
+
+	RunOpFlush();
+
+	return (curop != FSOP_IDLE);
+}
+
+void TFileSysFat::RunOpFlush()
+{
+	// called only when stra.completed == true and stra.errorcode == 0
+	// writes back the dirty FAT sectors (to every FAT copy) and the FSInfo
+
+	if (0 == opstate)
+	{
+		if (!FatCacheFlush())
+		{
+			return;
+		}
+
+		if (fsinfo_dirty && fsinfo_addr)
+		{
+			fsinfo_wrbuf[0] = free_count;
+			fsinfo_wrbuf[1] = free_hint;
+			pstorman->AddTransaction(&stra, STRA_WRITE, fsinfo_addr + 0x1E8,  &fsinfo_wrbuf[0], 8);
+			opstate = 1;
+			return;
+		}
+	}
+
+	// 1: done
+	fsinfo_dirty = false;
+	FinishCurOp(0);
+}
+
+TFileFat * TFileSysFat::CurFileMapped()
+{
+	TFileFat * pfile = (TFileFat *)curtra;
+	if (pfile->map_location != pfile->fdata.location)
+	{
+		pfile->MapReset(pfile->fdata.location, AddrToCluster(pfile->fdata.location));
+	}
+	return pfile;
+}
+
+void TFileSysFat::EnterFileCluster(TFileFat * afile, uint32_t acluster)
+{
+	// the cluster_end is set to the end of the known contiguous run, so the reads can span more clusters
+	uint32_t runlen = afile->MapRunLength(uint32_t(afile->filepos >> clustersizeshift));
+	afile->curlocation = ClusterToAddr(acluster);
+	afile->cluster_end = afile->curlocation + (uint64_t(runlen) << clustersizeshift);
+}
+
+void TFileSysFat::ConvertDirEntry(TFsFatDirEntry * pdire, TFileDirData * pfdata, uint64_t adirlocation)
+{
+	pfdata->size = pdire->size;
+	pfdata->location = ClusterToAddr(pdire->cluster_low + (pdire->cluster_high << 16));
+	pfdata->dirlocation = adirlocation;
+
+	// attributes
+	pfdata->attributes = (pdire->attr << 16); // keep the original attributes
+	if (pdire->attr & 0x10)
+	{
+		pfdata->attributes |= FSATTR_DIR;
+	}
+
+	if (pdire->attr & 0x08)
+	{
+		pfdata->attributes |= FSATTR_VOLLABEL;
+	}
+
+	//pfdata->create_time = 0; // todo: implement
+	//pfdata->modif_time = 0; // todo: implement
+
+	// 8+3 name, the attr_ex bit 3 and 4 request lower case base name and extension (Windows NT)
+	char * dp = &pfdata->shortname[0];
+	char * sp = &pdire->name[0];
+	char * endp = &pdire->name[8];
+	while ((sp < endp) && (*sp > 32))
+	{
+		*dp++ = ((pdire->attr_ex & 0x08) && (*sp >= 'A') && (*sp <= 'Z') ? *sp + 32 : *sp);
+		++sp;
+	}
+	sp = &pdire->name[8];
+	endp = &pdire->name[11];
+	if (*sp > 32)
+	{
+		*dp++ = '.';
+	}
+	while ((sp < endp) && (*sp > 32))
+	{
+		*dp++ = ((pdire->attr_ex & 0x10) && (*sp >= 'A') && (*sp <= 'Z') ? *sp + 32 : *sp);
+		++sp;
+	}
+	*dp = 0; // zero terminate
+
+	strcpy(&pfdata->name[0], &pfdata->shortname[0]);
+}
+
+void TFileSysFat::CollectLongName(TFsFatDirEntry * pdire)
+{
+	uint8_t * pe = (uint8_t *)pdire;
+	uint8_t seq = (pe[0] & 0x3F);
+
+	if (pe[0] & 0x40)  // the last part of the name comes first
+	{
+		lfn_valid = false;
+		lfn_overflow = false;
+		lfn_checksum = pe[13];
+		lfn_next = seq;
+		for (unsigned n = 0; n < FSFAT_LFN_MAX_CHARS; ++n)
+		{
+			lfn_chars[n] = 0;
+		}
+	}
+	else if (lfn_valid || (0 == lfn_next) || (seq != lfn_next) || (pe[13] != lfn_checksum))
+	{
+		// broken chain, wait for the next start
+		lfn_next = 0;
+		lfn_valid = false;
+		return;
+	}
+
+	if ((seq < 1) || (seq > 20))
+	{
+		lfn_next = 0;
+		return;
+	}
+
+	// 13 UTF-16 characters at the offsets 1, 14, 28
+	static const uint8_t lfn_char_offs[13] = { 1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30 };
+
+	unsigned cidx = (seq - 1) * 13;
+	for (unsigned n = 0; n < 13; ++n)
+	{
+		if (cidx + n >= FSFAT_LFN_MAX_CHARS)
+		{
+			if (pe[lfn_char_offs[n]] | pe[lfn_char_offs[n] + 1])
+			{
+				lfn_overflow = true;  // the name does not fit
+			}
+			break;
+		}
+		lfn_chars[cidx + n] = (pe[lfn_char_offs[n]] | (pe[lfn_char_offs[n] + 1] << 8));
+	}
+
+	--lfn_next;
+	if (0 == lfn_next)
+	{
+		lfn_valid = true;  // the 8.3 entry must follow
+	}
+}
+
+bool TFileSysFat::ConvertLongName(TFsFatDirEntry * pdire, TFileDirData * pfdata)
+{
+	if (!lfn_valid || lfn_overflow)
+	{
+		return false;
+	}
+
+	uint8_t sum = 0;
+	uint8_t * sp = (uint8_t *)&pdire->name[0];
+	for (unsigned n = 0; n < 11; ++n)
+	{
+		sum = ((sum & 1) << 7) + (sum >> 1) + sp[n];
+	}
+
+	if (sum != lfn_checksum)
+	{
+		return false;  // orphaned long name, the entry was modified by a non-LFN aware system
+	}
+
+	// UTF-16 -> UTF-8
+
+	char    namebuf[FS_FNAME_MAX_LEN];
+	char *  dp = &namebuf[0];
+	char *  endp = &namebuf[FS_FNAME_MAX_LEN - 1];  // keep place for the terminating zero
+	unsigned n = 0;
+	while (n < FSFAT_LFN_MAX_CHARS)
+	{
+		uint32_t c = lfn_chars[n++];
+		if ((0 == c) || (0xFFFF == c))
+		{
+			break;
+		}
+
+		if ((c >= 0xD800) && (c < 0xDC00))  // high surrogate
+		{
+			uint32_t c2 = (n < FSFAT_LFN_MAX_CHARS ? lfn_chars[n] : 0);
+			if ((c2 < 0xDC00) || (c2 >= 0xE000))
+			{
+				return false;
+			}
+			++n;
+			c = 0x10000 + ((c - 0xD800) << 10) + (c2 - 0xDC00);
+		}
+		else if ((c >= 0xDC00) && (c < 0xE000))  // unpaired low surrogate
+		{
+			return false;
+		}
+
+		unsigned clen = (c < 0x80 ? 1 : (c < 0x800 ? 2 : (c < 0x10000 ? 3 : 4)));
+		if (dp + clen > endp)
+		{
+			return false;  // does not fit, keep the 8.3 name
+		}
+
+		if (1 == clen)
+		{
+			*dp++ = char(c);
+		}
+		else if (2 == clen)
+		{
+			*dp++ = char(0xC0 | (c >> 6));
+			*dp++ = char(0x80 | (c & 0x3F));
+		}
+		else if (3 == clen)
+		{
+			*dp++ = char(0xE0 | (c >> 12));
+			*dp++ = char(0x80 | ((c >> 6) & 0x3F));
+			*dp++ = char(0x80 | (c & 0x3F));
+		}
+		else
+		{
+			*dp++ = char(0xF0 | (c >> 18));
+			*dp++ = char(0x80 | ((c >> 12) & 0x3F));
+			*dp++ = char(0x80 | ((c >> 6) & 0x3F));
+			*dp++ = char(0x80 | (c & 0x3F));
+		}
+	}
+
+	if (dp == &namebuf[0])
+	{
+		return false;
+	}
+
+	*dp = 0;
+	memcpy(&pfdata->name[0], &namebuf[0], (dp - &namebuf[0]) + 1);
+	return true;
+}
+
+uint64_t TFileSysFat::ClusterToAddr(uint32_t acluster)
+{
+	if ((acluster < 2) || (acluster >= clusterlimit))
 	{
 		return FS_INVALID_ADDR;
 	}
@@ -420,9 +1677,267 @@ uint64_t TFileSysFat::ClusterToAddr(uint32_t acluster)
 	return res;
 }
 
-void TFileSysFat::FindNextCluster(uint32_t acluster)
+bool TFileSysFat::FindNextCluster(uint32_t acluster)
+{
+	fat_cluster = acluster;
+	fatcache_loading = -1;  // forget the unfinished (failed) cache transactions
+	fatcache_writing = -1;
+	return ContinueFatLookup();
+}
+
+bool TFileSysFat::ContinueFatLookup()
+{
+	uint32_t offs = FatEntryOffset(fat_cluster);
+	uint64_t  saddr = firstaddr + reservedbytes + (offs & ~0x1FF);
+	unsigned  soffs = (offs & 0x1FF);
+	uint8_t * psect = FatCacheSector(saddr);
+	if (!psect)
+	{
+		return false;
+	}
+
+	if (fat32)
+	{
+		next_cluster = (*(uint32_t *)&psect[soffs] & 0x0FFFFFFF);
+	}
+	else if (fat12)
+	{
+		uint32_t v = psect[soffs];
+		if (soffs < 511)
+		{
+			v |= (psect[soffs + 1] << 8);
+		}
+		else  // the entry continues in the next sector
+		{
+			uint8_t * psect2 = FatCacheSector(saddr + 512);
+			if (!psect2)
+			{
+				return false;
+			}
+			v |= (psect2[0] << 8);
+		}
+		next_cluster = ((fat_cluster & 1) ? (v >> 4) : (v & 0xFFF));
+	}
+	else
+	{
+		next_cluster = *(uint16_t *)&psect[soffs];
+	}
+
+	return true;
+}
+
+bool TFileSysFat::SetFatEntry(uint32_t acluster, uint32_t avalue)
+{
+	fat_cluster = acluster;
+	fat_value = avalue;
+	fatcache_loading = -1;  // forget the unfinished (failed) cache transactions
+	fatcache_writing = -1;
+	return ContinueFatUpdate();
+}
+
+bool TFileSysFat::ContinueFatUpdate()
+{
+	// the entry is changed in the cache only, the sector is written back at eviction or at FatCacheFlush()
+
+	uint32_t offs = FatEntryOffset(fat_cluster);
+	uint64_t  saddr = firstaddr + reservedbytes + (offs & ~0x1FF);
+	unsigned  soffs = (offs & 0x1FF);
+	uint8_t * psect = FatCacheSector(saddr);
+	if (!psect)
+	{
+		return false;
+	}
+
+	if (fat32)
+	{
+		uint32_t * pentry = (uint32_t *)&psect[soffs];
+		*pentry = (*pentry & 0xF0000000) | (fat_value & 0x0FFFFFFF);  // the upper 4 bits are reserved
+	}
+	else if (fat12)
+	{
+		uint8_t * psect2 = nullptr;
+		if (soffs >= 511)  // the entry continues in the next sector, both must be loaded before the change
+		{
+			psect2 = FatCacheSector(saddr + 512);
+			if (!psect2)
+			{
+				return false;
+			}
+		}
+
+		uint8_t * phigh = (psect2 ? psect2 : &psect[soffs + 1]);
+		uint32_t v = psect[soffs] | (*phigh << 8);
+		if (fat_cluster & 1)
+		{
+			v = (v & 0x000F) | ((fat_value & 0xFFF) << 4);
+		}
+		else
+		{
+			v = (v & 0xF000) | (fat_value & 0xFFF);
+		}
+		psect[soffs] = uint8_t(v);
+		*phigh = uint8_t(v >> 8);
+
+		if (psect2)
+		{
+			fatcache_dirty[(psect2 - &fatcache_buf[0][0]) >> 9] = true;
+		}
+	}
+	else
+	{
+		*(uint16_t *)&psect[soffs] = uint16_t(fat_value);
+	}
+
+	fatcache_dirty[(psect - &fatcache_buf[0][0]) >> 9] = true;
+	FreemapUpdate(fat_cluster, (0 == fat_value));
+	return true;
+}
+
+uint32_t TFileSysFat::FatEntryOffset(uint32_t acluster)
+{
+	if (fat32)
+	{
+		return (acluster << 2);
+	}
+	else if (fat12)
+	{
+		return acluster + (acluster >> 1);  // 1.5 bytes / entry
+	}
+	else
+	{
+		return (acluster << 1);
+	}
+}
+
+uint32_t TFileSysFat::FatEndOfChain()
+{
+	return (fat32 ? 0x0FFFFFFF : (fat12 ? 0xFFF : 0xFFFF));
+}
+
+uint8_t * TFileSysFat::FatCacheSector(uint64_t asectoraddr)
+{
+	if (!FatCacheCommit())
+	{
+		return nullptr;
+	}
+
+	unsigned lru = 0;
+	for (unsigned n = 0; n < FSFAT_FATCACHE_SECTORS; ++n)
+	{
+		if (fatcache_addr[n] == asectoraddr)
+		{
+			++fatcache_hits;
+			fatcache_lastuse[n] = ++fatcache_usecnt;
+			return &fatcache_buf[n][0];
+		}
+
+		if (int32_t(fatcache_lastuse[n] - fatcache_lastuse[lru]) < 0)
+		{
+			lru = n;
+		}
+	}
+
+	if (fatcache_dirty[lru])
+	{
+		// write back first, the load is started at the next call
+		FatCacheWrite(lru);
+		return nullptr;
+	}
+
+	// load into the least recently used slot, it becomes valid only when the read succeeds
+
+	++fatcache_misses;
+	fatcache_addr[lru] = FS_INVALID_ADDR;
+	fatcache_lastuse[lru] = ++fatcache_usecnt;
+	fatcache_loading = lru;
+	fatcache_loadaddr = asectoraddr;
+	pstorman->AddTransaction(&stra, STRA_READ, asectoraddr, &fatcache_buf[lru][0], 512);
+	return nullptr;
+}
+
+bool TFileSysFat::FatCacheCommit()
+{
+	if (fatcache_loading >= 0)  // the sector read completed successfully
+	{
+		fatcache_addr[fatcache_loading] = fatcache_loadaddr;
+		fatcache_loading = -1;
+	}
+
+	if (fatcache_writing >= 0)  // a FAT copy of the sector is written, continue with the next copy
+	{
+		++fatcache_wrcopy;
+		if (fatcache_wrcopy < fatcount)
+		{
+			pstorman->AddTransaction(&stra, STRA_WRITE, fatcache_addr[fatcache_writing] + fatcache_wrcopy * fatbytes,
+					                     &fatcache_buf[fatcache_writing][0], 512);
+			return false;
+		}
+
+		fatcache_dirty[fatcache_writing] = false;
+		fatcache_writing = -1;
+	}
+
+	return true;
+}
+
+void TFileSysFat::FatCacheWrite(unsigned aslot)
+{
+	fatcache_writing = aslot;
+	fatcache_wrcopy = 0;
+	pstorman->AddTransaction(&stra, STRA_WRITE, fatcache_addr[aslot], &fatcache_buf[aslot][0], 512);
+}
+
+bool TFileSysFat::FatCacheFlush()
+{
+	if (!FatCacheCommit())
+	{
+		return false;
+	}
+
+	for (unsigned n = 0; n < FSFAT_FATCACHE_SECTORS; ++n)
+	{
+		if (fatcache_dirty[n])
+		{
+			FatCacheWrite(n);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+void TFileSysFat::FatCacheInvalidate()
+{
+	for (unsigned n = 0; n < FSFAT_FATCACHE_SECTORS; ++n)
+	{
+		fatcache_addr[n] = FS_INVALID_ADDR;
+		fatcache_lastuse[n] = 0;
+		fatcache_dirty[n] = false;
+	}
+	fatcache_usecnt = 0;
+	fatcache_loading = -1;
+	fatcache_writing = -1;
+}
+
+void TFileSysFat::FreemapUpdate(uint32_t acluster, bool afree)
+{
+	if ((acluster >= freemap_base) && (acluster < freemap_end))
+	{
+		uint32_t idx = acluster - freemap_base;
+		if (afree)
+		{
+			freemap[idx >> 5] |= (1u << (idx & 31));
+		}
+		else
+		{
+			freemap[idx >> 5] &= ~(1u << (idx & 31));
+		}
+	}
+}
+
+bool TFileSysFat::FixedRootDirEnd(uint64_t aaddr)
 {
-	pstorman->AddTransaction(&stra, STRA_READ, firstaddr + reservedbytes + (acluster << 2),  &next_cluster, 4);
+	return (!fat32 && (aaddr == rootdirend));
 }
 
 uint32_t TFileSysFat::AddrToCluster(uint64_t aaddr)
@@ -432,7 +1947,7 @@ uint32_t TFileSysFat::AddrToCluster(uint64_t aaddr)
 		return 0;
 	}
 	uint32_t res = 2 + ((aaddr - (firstaddr + sysbytes)) >> clustersizeshift);
-	if (res > clustercount)
+	if (res > clusterlimit)  // the end address of the last cluster is accepted
 	{
 		return 0;
 	}
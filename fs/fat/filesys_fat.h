@@ -30,6 +30,22 @@
 
 #include "filesystem.h"
 
+// FAT table sector cache (LRU), shared by all files of the file system, at least 2 sectors required
+#ifndef FSFAT_FATCACHE_SECTORS
+  #define FSFAT_FATCACHE_SECTORS  4
+#endif
+
+// Cluster run map entries per open file, when it gets full every second entry is dropped,
+// the missing parts are resolved again from the FAT chain
+#ifndef FSFAT_FILE_EXTENTS
+  #define FSFAT_FILE_EXTENTS  16
+#endif
+
+// Free cluster bitmap window for the allocation, must be a multiple of 32
+#ifndef FSFAT_FREEMAP_CLUSTERS
+  #define FSFAT_FREEMAP_CLUSTERS  2048
+#endif
+
 struct TFsFatDirEntry
 {
 	char          name[11];      // 0x00:  8 + 3 format padded with space
@@ -46,6 +62,21 @@ struct TFsFatDirEntry
 	uint32_t      size;          // 0x1C
 };
 
+#define FSFAT_ATTR_READONLY  0x01
+#define FSFAT_ATTR_ARCHIVE   0x20
+
+#define FSFAT_ATTR_LFN       0x0F
+
+// the long name UTF-16 characters are collected in 13 character chunks
+#define FSFAT_LFN_MAX_CHARS  (((FS_FNAME_MAX_LEN - 1 + 12) / 13) * 13)
+
+struct TFsFatExtent  // contiguous cluster run of a file
+{
+	uint32_t      fcluster;      // file relative index of the first cluster
+	uint32_t      cluster;       // first cluster on the disk
+	uint32_t      count;         // number of clusters
+};
+
 class TFileSysFat;
 
 class TFileFat : public TFile
@@ -55,6 +86,19 @@ private:
 
 public:
 	              TFileFat(TFileSysFat * afilesys);
+
+public: // cluster run map, built lazily while the FAT chain is followed, sorted by fcluster
+	uint64_t      map_location = FS_INVALID_ADDR;  // the fdata.location that the map belongs to
+	unsigned      extent_count = 0;
+	TFsFatExtent  extents[FSFAT_FILE_EXTENTS];
+
+	bool          entry_dirty = false;  // the directory entry must be updated (size, first cluster, time)
+
+	void            MapReset(uint64_t alocation, uint32_t afirstcluster);
+	void            MapAdd(uint32_t afcluster, uint32_t acluster);
+	TFsFatExtent *  MapFind(uint32_t afcluster);  // the last extent starting at or before afcluster, nullptr if none
+	uint32_t        MapCluster(uint32_t afcluster);  // returns 0 when not mapped
+	uint32_t        MapRunLength(uint32_t afcluster);  // known contiguous clusters from afcluster, 1 when not mapped
 };
 
 class TFileSysFat : public TFileSystem
@@ -72,7 +116,17 @@ public:
 	uint32_t      rootdirbytes = 0;
 
 	uint32_t      clustercount = 0;
+	uint32_t      clusterlimit = 0;  // the first invalid cluster number
 	uint32_t      fatbytes = 0;
+	uint32_t      rootcluster = 0;   // FAT32 only
+
+	uint64_t      fsinfo_addr = 0;   // 0 = no FSInfo sector
+	uint32_t      free_count = 0xFFFFFFFF;  // from the FSInfo, 0xFFFFFFFF = unknown
+	uint32_t      free_hint = 2;     // the allocation search starts here
+
+	// FAT date << 16 | FAT time for the created and the modified directory entries,
+	// the application should keep it updated from a clock
+	uint32_t      write_datetime = (0x0021 << 16);  // 1980-01-01 00:00
 
 	uint64_t      sectoraddr = 0; // used internally
 	uint64_t      sectorend = 0; // used internally
@@ -81,6 +135,9 @@ public:
 	uint64_t      bufendaddr = 1; // invalid
 	uint8_t       buf[512] __attribute__((aligned(16)));
 
+	uint32_t      fatcache_hits = 0;
+	uint32_t      fatcache_misses = 0;
+
 public:
 	virtual       ~TFileSysFat() { }
 
@@ -93,15 +150,89 @@ public: // overrides
 	virtual void     RunOpDirRead();
 	virtual void     HandleFileRead();
 	virtual void     HandleFileSeek();
+	virtual void     HandleFileCreate();
+	virtual void     HandleFileWrite();
+	virtual void     HandleFileTruncate();
+	virtual void     HandleFileClose();
+
+	virtual void     RunOpAlloc();
+	virtual void     RunOpFree();
+	virtual void     RunOpFlush();
 
 protected:
 	uint32_t      next_cluster = 0;  // fat resolution target
-
-	void          FindNextCluster(uint32_t acluster);
+	uint32_t      fat_cluster = 0;   // fat resolution source
+
+	uint64_t      fatcache_addr[FSFAT_FATCACHE_SECTORS];  // FS_INVALID_ADDR = empty slot
+	uint32_t      fatcache_lastuse[FSFAT_FATCACHE_SECTORS];
+	uint32_t      fatcache_usecnt = 0;
+	int           fatcache_loading = -1;  // slot index of the running sector read
+	uint64_t      fatcache_loadaddr = 0;
+	bool          fatcache_dirty[FSFAT_FATCACHE_SECTORS];
+	int           fatcache_writing = -1;  // slot index of the running write back
+	unsigned      fatcache_wrcopy = 0;    // FAT copy index of the running write back
+	uint8_t       fatcache_buf[FSFAT_FATCACHE_SECTORS][512] __attribute__((aligned(16)));
+
+	uint32_t      fat_value = 0;     // fat update value
+
+	// free cluster bitmap of the clusters [freemap_base .. freemap_end), 1 = free
+	uint32_t      freemap_base = 0;
+	uint32_t      freemap_end = 0;   // 0 = invalid
+	uint32_t      freemap[FSFAT_FREEMAP_CLUSTERS / 32];
+
+	// operation parameters and results
+	uint32_t      op_cluster = 0;       // alloc: the previous cluster (0 = new chain) -> the new cluster
+	uint32_t      op_free_cluster = 0;  // free: the first cluster to release
+	uint32_t      op_new_cluster = 0;
+	uint32_t      op_scan_cluster = 0;
+	uint32_t      op_scan_count = 0;
+	uint32_t      freemap_scan = 0;
+	bool          fsinfo_dirty = false;
+	uint32_t      fsinfo_wrbuf[2];
+
+	// long file name collection (the LFN entries precede the 8.3 entry in reverse order)
+	uint8_t       lfn_next = 0;       // expected sequence number of the next LFN entry, 0 = none
+	uint8_t       lfn_checksum = 0;
+	bool          lfn_valid = false;  // the complete chain is collected
+	bool          lfn_overflow = false;  // longer than the FSFAT_LFN_MAX_CHARS
+	uint16_t      lfn_chars[FSFAT_LFN_MAX_CHARS];
+
+	TFsFatDirEntry  wr_direntry;    // for the directory entry writes
+	uint64_t        wr_dirlocation = 0;
+	uint32_t        seekresult = 0;
+	int             seekstate = 0;
+
+	bool          FindNextCluster(uint32_t acluster);  // returns true when the next_cluster is resolved from the cache
+	bool          ContinueFatLookup();  // call after the sector read started by the FindNextCluster() completed
+	bool          SetFatEntry(uint32_t acluster, uint32_t avalue);  // returns true when done in the cache
+	bool          ContinueFatUpdate();  // call after the sector transaction started by the SetFatEntry() completed
+	uint8_t *     FatCacheSector(uint64_t asectoraddr);  // returns nullptr when a sector transaction was started
+	bool          FatCacheCommit();  // processes the completed cache transaction, false: a further write was started
+	bool          FatCacheFlush();  // writes back the dirty sectors one by one, returns true when all are clean
+	void          FatCacheWrite(unsigned aslot);
+	void          FatCacheInvalidate();
+	uint32_t      FatEntryOffset(uint32_t acluster);  // byte offset in the FAT
+	uint32_t      FatEndOfChain();
+	void          FreemapUpdate(uint32_t acluster, bool afree);
+
+	bool          StartOpAlloc(uint32_t aprevcluster);  // returns true when not finished yet
+	bool          StartOpFree(uint32_t alastcluster, uint32_t afirstfree);  // alastcluster: new chain end or 0
+	bool          StartOpFlush();
+
+	bool          ContinueSeek(TFileFat * afile);  // returns true when finished, the result is in the seekresult
+	bool          MakeShortName(const char * asrc, unsigned alen, char * adst);
+	void          ContinueFileSync(TFileFat * afile);  // FAT flush + directory entry update from trastate = 40
+	void          WriteDirEntry(unsigned aoffset, unsigned alen);
+
+	TFileFat *    CurFileMapped();  // the curtra with a valid cluster run map
+	void          EnterFileCluster(TFileFat * afile, uint32_t acluster);  // afile->filepos must be at the cluster start
 
 	void          ConvertDirEntry(TFsFatDirEntry * pdire, TFileDirData * pfdata, uint64_t adirlocation);
+	void          CollectLongName(TFsFatDirEntry * pdire);
+	bool          ConvertLongName(TFsFatDirEntry * pdire, TFileDirData * pfdata);  // false: no valid long name for the entry
 	uint64_t      ClusterToAddr(uint32_t acluster);
 	uint32_t      AddrToCluster(uint64_t aaddr);
+	bool          FixedRootDirEnd(uint64_t aaddr);  // aaddr is the end of the FAT12/16 root directory
 };
 
 #endif /* FILESYS_FAT_H_ */
@@ -92,6 +92,7 @@ bool TEspWifiUart::Init(void * anetmem, unsigned anetmemsize)
   // start the DMA receive with circular DMA buffer
   rxdmapos = 0;
   ipd_rx_remaining = 0;
+  ipd_pmem = nullptr;
   dmaxfer_rx.bytewidth = 1;
   dmaxfer_rx.count = sizeof(rxdmabuf);
   dmaxfer_rx.dstaddr = &rxdmabuf[0];
@@ -103,6 +104,7 @@ bool TEspWifiUart::Init(void * anetmem, unsigned anetmemsize)
   state = 0;
   txstate = 0;
   cmd_running = false;
+  link_cmd_socket = nullptr;
   initstate = 1;  // start initialization
   prev_state_time = CLOCKCNT;
 
@@ -258,7 +260,7 @@ void TEspWifiUart::RunInit()
 
   else if (50 == initstate)
   {
-    for (unsigned n; n < ESPWIFI_MAX_SOCKETS; ++n)
+    for (unsigned n = 0; n < ESPWIFI_MAX_SOCKETS; ++n)
     {
       if (sockets[n])  sockets[n]->Reset();
     }
@@ -267,14 +269,16 @@ void TEspWifiUart::RunInit()
   }
   else if (51 == initstate)
   {
-    while ((initsocknum < ESPWIFI_MAX_SOCKETS) && (!sockets[initsocknum] || sockets[initsocknum]->initialized))
+    // the TCP sockets are connected on request
+    while ((initsocknum < ESPWIFI_MAX_SOCKETS)
+           && (!sockets[initsocknum] || (ESPSOCK_UDP != sockets[initsocknum]->protocol) || sockets[initsocknum]->initialized))
     {
       ++initsocknum;
     }
 
     if (initsocknum < ESPWIFI_MAX_SOCKETS)
     {
-      TEspAtUdpSocket * psock = sockets[initsocknum];
+      TEspAtSocket * psock = sockets[initsocknum];
 
       StartCommand("AT+CIPSTART=%i,\"UDP\",\"%u.%u.%u.%u\",%u,%u,2",
           psock->socketnum,
@@ -505,32 +509,33 @@ void TEspWifiUart::RunRx()
 
   while (rxdmapos != newrxdmapos)
   {
-    uint8_t b = rxdmabuf[rxdmapos];
-
     if (ipd_rx_remaining > 0)
     {
-      if (rxmsglen < sizeof(rxmsgbuf))
+      // +IPD data: copy the continuous part of the ring directly into the packet
+      unsigned len = (newrxdmapos > rxdmapos ? newrxdmapos : sizeof(rxdmabuf)) - rxdmapos;
+      if (len > ipd_rx_remaining)  len = ipd_rx_remaining;
+
+      if (ipd_pmem)
       {
-        rxmsgbuf[rxmsglen] = b;
-        ++rxmsglen;
+        memcpy(&ipd_pmem->data[ipd_pmem->datalen], &rxdmabuf[rxdmapos], len);
+        ipd_pmem->datalen += len;
       }
 
-      --ipd_rx_remaining;
+      ipd_rx_remaining -= len;
       if (0 == ipd_rx_remaining)
       {
-        if (ipd_data_start + ipd_data_len > sizeof(rxmsgbuf))
-        {
-          // the data does not fit into our buffer, just ignore it.
-        }
-        else // process the IPD data
-        {
-          ProcessIpdData();
-        }
+        ProcessIpdData();
         rxmsglen = 0;
       }
+
+      rxdmapos += len;
+      if (rxdmapos >= sizeof(rxdmabuf))  rxdmapos = 0;
+      continue;
     }
     else
     {
+      uint8_t b = rxdmabuf[rxdmapos];
+
       if (10 == b)
       {
         rxmsgbuf[rxmsglen] = 0; // zero terminate the message
@@ -547,7 +552,7 @@ void TEspWifiUart::RunRx()
       }
       else
       {
-        if (rxmsglen < sizeof(rxmsgbuf))
+        if (rxmsglen < UARTCOMM_MAX_RX_MSG_LEN)
         {
           rxmsgbuf[rxmsglen] = b;
           ++rxmsglen;
@@ -585,12 +590,19 @@ void TEspWifiUart::RunTx()
   {
     if (!cmd_running)
     {
-      StartCommand("AT+CIPSEND=%u,%u,\"%u.%u.%u.%u\",%u",
-          pmem->psocket->socketnum,
-          pmem->datalen,
-          pmem->ip_addr.u8[0], pmem->ip_addr.u8[1], pmem->ip_addr.u8[2], pmem->ip_addr.u8[3],
-          pmem->ip_port
-      );
+      if (ESPSOCK_TCP == pmem->psocket->protocol)
+      {
+        StartCommand("AT+CIPSEND=%u,%u", pmem->psocket->socketnum, pmem->datalen);
+      }
+      else
+      {
+        StartCommand("AT+CIPSEND=%u,%u,\"%u.%u.%u.%u\",%u",
+            pmem->psocket->socketnum,
+            pmem->datalen,
+            pmem->ip_addr.u8[0], pmem->ip_addr.u8[1], pmem->ip_addr.u8[2], pmem->ip_addr.u8[3],
+            pmem->ip_port
+        );
+      }
       send_start_time = CLOCKCNT;
       ++txstate;
     }
@@ -627,7 +639,22 @@ void TEspWifiUart::RunTx()
 
     //TRACE("ESP-AT: send data prompt detected.\r\n")
 
-    AddTx(&pmem->data[0], pmem->datalen);
+    txstate = 2;
+  }
+  else if (2 == txstate) // send the data with DMA directly from the packet
+  {
+    if (txlen || dma_tx.Active())
+    {
+      return;  // the buffered commands go first
+    }
+
+    dmaxfer_tx.flags = 0;
+    dmaxfer_tx.bytewidth = 1;
+    dmaxfer_tx.count = pmem->datalen;
+    dmaxfer_tx.srcaddr = &pmem->data[0];
+
+    uart.DmaStartSend(&dmaxfer_tx);
+
     send_start_time = CLOCKCNT;
     txstate = 10;
   }
@@ -635,7 +662,7 @@ void TEspWifiUart::RunTx()
   {
     // Let the RX state machine to process the messages
 
-    if (CLOCKCNT - send_start_time > 2000 * ms_clocks)
+    if ((CLOCKCNT - send_start_time > 2000 * ms_clocks) && !dma_tx.Active())
     {
       TRACE("ESP-AT: send timeout\r\n");
       ++data_send_error_count;
@@ -675,21 +702,85 @@ void TEspWifiUart::Run()
   }
   else
   {
+    RunLinks();
     RunTx();
   }
 
   StartSendTxBuffer();  // Sending buffered tx messages
 }
 
-void TEspWifiUart::AddUdpSocket(TEspAtUdpSocket * audp)
+void TEspWifiUart::RunLinks()
+{
+  if (cmd_running)
+  {
+    return;
+  }
+
+  if (link_cmd_socket)  // the previous link command is finished
+  {
+    TEspAtSocket * psock = link_cmd_socket;
+    link_cmd_socket = nullptr;
+
+    if (psock->connect_requested)
+    {
+      psock->connect_requested = false;
+      psock->connected = (!cmd_error && (cmd_responses & 1));
+      if (!psock->connected)
+      {
+        TRACE("ESP-AT: TCP connect failed on link %i\r\n", psock->socketnum);
+      }
+    }
+    else
+    {
+      psock->close_requested = false;
+      psock->connected = false;
+    }
+  }
+
+  if (txstate)
+  {
+    return;  // do not disturb the CIPSEND sequence
+  }
+
+  for (unsigned n = 0; n < ESPWIFI_MAX_SOCKETS; ++n)
+  {
+    TEspAtSocket * psock = sockets[n];
+    if (!psock || (ESPSOCK_TCP != psock->protocol))
+    {
+      continue;
+    }
+
+    if (psock->close_requested)
+    {
+      StartCommand("AT+CIPCLOSE=%i", psock->socketnum);
+      cmd_ignore_error = true;  // might be already closed by the remote side
+      link_cmd_socket = psock;
+      return;
+    }
+
+    if (psock->connect_requested)
+    {
+      StartCommand("AT+CIPSTART=%i,\"TCP\",\"%u.%u.%u.%u\",%u",
+          psock->socketnum,
+          psock->destaddr.u8[0], psock->destaddr.u8[1], psock->destaddr.u8[2], psock->destaddr.u8[3],
+          psock->destport
+      );
+      ExpectCmdResponse(0, "%i,CONNECT", psock->socketnum);
+      link_cmd_socket = psock;
+      return;
+    }
+  }
+}
+
+void TEspWifiUart::AddSocket(TEspAtSocket * asock)
 {
   unsigned n = 0;
   while (n < ESPWIFI_MAX_SOCKETS)
   {
-    if ((sockets[n] == audp) || (sockets[n] == nullptr))
+    if ((sockets[n] == asock) || (sockets[n] == nullptr))
     {
-      audp->socketnum = n;
-      sockets[n] = audp;
+      asock->socketnum = n;
+      sockets[n] = asock;
       return;
     }
     ++n;
@@ -749,6 +840,11 @@ void TEspWifiUart::ProcessRxMessage()
     }
   }
 
+  if (ProcessLinkStatus())
+  {
+    return;
+  }
+
   if (10 == txstate) // expecting send result ?
   {
     if (sp.CheckSymbol("SEND OK"))
@@ -806,14 +902,7 @@ void TEspWifiUart::ProcessIpdStart()
     return;
   }
 
-  int i = sp.PrevToInt();
-  if ((i < 0) || (i >= ESPWIFI_MAX_SOCKETS) || !sockets[i])
-  {
-    ++invalid_ipd_count;  // invalid socket
-    return;
-  }
-
-  ipd_sock_num = i;
+  ipd_sock_num = sp.PrevToInt();
 
   sp.CheckSymbol(","); // skip comma
 
@@ -855,37 +944,98 @@ void TEspWifiUart::ProcessIpdStart()
     return;
   }
 
-  ipd_data_start = (uint8_t *)sp.readptr - &rxmsgbuf[0]; // here comes the data
+  // the data follows, the RunRx() copies it directly into the ipd_pmem (or skips it when there is none)
   ipd_rx_remaining = ipd_data_len;
-}
+  if (!ipd_data_len)
+  {
+    return;
+  }
 
-void TEspWifiUart::ProcessIpdData()
-{
-  TEspAtUdpSocket * psock = sockets[ipd_sock_num];
-  TEspPmem * pmem = AllocatePmem();
-  if (!pmem)
+  if ((ipd_sock_num < 0) || (ipd_sock_num >= ESPWIFI_MAX_SOCKETS) || !sockets[ipd_sock_num])
+  {
+    ++invalid_ipd_count;  // invalid socket
+    return;
+  }
+
+  TEspAtSocket * psock = sockets[ipd_sock_num];
+  if (psock->rx_aborted)
+  {
+    ++ipd_drop_count;  // the rest of an aborted TCP stream
+    return;
+  }
+
+  ipd_pmem = AllocatePmem();
+  if (!ipd_pmem)
   {
     TRACE("ESP-AT: no more pme to store RX data!\r\n");
+    IpdDropped(psock);
     return;
   }
 
-  if (ipd_data_len > pmem->max_datalen)
+  if (ipd_data_len > ipd_pmem->max_datalen)
   {
     TRACE("ESP-AT: data chunk does not fit into a pmem buffer!\r\n");
-    ReleasePmem(pmem);
+    ReleasePmem(ipd_pmem);
+    ipd_pmem = nullptr;
+    IpdDropped(psock);
     return;
   }
 
-  pmem->datalen = ipd_data_len;
-  pmem->ip_addr = ipd_ip_addr;  // acquired in ParseIpAddr()
-  pmem->ip_port = ipd_port;
-  memcpy(&pmem->data[0], &rxmsgbuf[ipd_data_start], ipd_data_len);
-  psock->AddRxPacket(pmem);
+  ipd_pmem->datalen = 0;
+  ipd_pmem->ip_addr = ipd_ip_addr;  // acquired in ParseIpAddr()
+  ipd_pmem->ip_port = ipd_port;
+}
+
+void TEspWifiUart::IpdDropped(TEspAtSocket * psock)
+{
+  ++ipd_drop_count;
+
+  if (ESPSOCK_TCP == psock->protocol)
+  {
+    // the byte stream has a gap now, and the module can not send the chunk again: close the link
+    TRACE("ESP-AT: TCP data lost, closing link %i\r\n", psock->socketnum);
+    psock->rx_aborted = true;
+    psock->connected = false;
+    psock->close_requested = true;
+  }
+}
+
+void TEspWifiUart::ProcessIpdData()
+{
+  if (!ipd_pmem)
+  {
+    return;  // skipped
+  }
+
+  sockets[ipd_sock_num]->AddRxPacket(ipd_pmem);
+  ipd_pmem = nullptr;
 
   //TRACE("ESP-AT: %i bytes received for socket %i\r\n", ipd_data_len, psock->socketnum);
   //TRACE("ESP-AT:   \"%s\"\r\n", &rxmsgbuf[0]);
 }
 
+bool TEspWifiUart::ProcessLinkStatus()  // "<link id>,CONNECT", "<link id>,CLOSED"
+{
+  if (!sp.ReadDecimalNumbers())
+  {
+    return false;
+  }
+
+  int i = sp.PrevToInt();
+  bool closed = (sp.CheckSymbol(",CLOSED") || sp.CheckSymbol(",CONNECT FAIL"));
+  if (!closed && !sp.CheckSymbol(",CONNECT"))
+  {
+    sp.Init((char *)&rxmsgbuf[0], rxmsglen);  // restore for the further checks
+    return false;
+  }
+
+  if ((i >= 0) && (i < ESPWIFI_MAX_SOCKETS) && sockets[i])
+  {
+    sockets[i]->connected = !closed;
+  }
+  return true;
+}
+
 bool TEspWifiUart::ParseIpAddr()
 {
   for (int n = 0; n < 4; ++n)
@@ -962,6 +1112,7 @@ void TEspWifiUart::RemoveSendingPacket(TEspPmem * apmem)
         sending_first = pmem->next;
       }
 
+      if (pmem->psocket->tx_queued)  --pmem->psocket->tx_queued;
       ReleasePmem(pmem);
       return;
     }
@@ -973,34 +1124,21 @@ void TEspWifiUart::RemoveSendingPacket(TEspPmem * apmem)
 
 //-----------------------------------------------------------------------------
 
-void TEspAtUdpSocket::Init(TEspWifiUart * awifim, uint16_t alistenport)
-{
-  pwifim = awifim;
-  listenport = alistenport;
-
-  pwifim->AddUdpSocket(this);
-}
-
-void TEspAtUdpSocket::Reset()
+void TEspAtSocket::Reset()
 {
   initialized = false;
   connected = false;
+  connect_requested = false;
+  close_requested = false;
+  rx_aborted = false;
 }
 
-int TEspAtUdpSocket::Send(void * adataptr, unsigned adatalen)
+TEspPmem * TEspAtSocket::QueueTx(void * adataptr, unsigned adatalen)
 {
-  TEspPmem * pmem;
-
-  pmem = pwifim->AllocatePmem();
+  TEspPmem * pmem = pwifim->AllocatePmem();
   if (!pmem)
   {
-    return 0;  // no free packet !
-  }
-
-  if (pmem->max_datalen < adatalen)
-  {
-    pwifim->ReleasePmem(pmem);
-    return -1;
+    return nullptr;  // no free packet !
   }
 
   pmem->ip_addr = destaddr;
@@ -1009,20 +1147,61 @@ int TEspAtUdpSocket::Send(void * adataptr, unsigned adatalen)
 
   memcpy(&pmem->data[0], adataptr, adatalen);
 
-  // add to the sending packet chain
+  pmem->psocket = this;
+  ++tx_queued;
+  pwifim->AddSendingPacket(pmem);
+
+  return pmem;
+}
+
+void TEspAtSocket::ReleaseFirstRx()
+{
+  TEspPmem * pmem = rxpkt_first;
+
+  // unchain the pmem first
+  rxpkt_first = rxpkt_first->next;
+  if (!rxpkt_first)  rxpkt_last = nullptr;
+
+  // release the packet !
+  pwifim->ReleasePmem(pmem);
+}
+
+void TEspAtSocket::AddRxPacket(TEspPmem *pmem)
+{
   pmem->next = nullptr;
-  if (txpkt_last)
+  if (rxpkt_last)
   {
-    txpkt_last->next = pmem;
+    rxpkt_last->next = pmem;
   }
   else
   {
-    txpkt_first = pmem;
+    rxpkt_first = pmem;
   }
-  txpkt_last = pmem;
+  rxpkt_last = pmem;
+}
 
-  pmem->psocket = this;
-  pwifim->AddSendingPacket(pmem);
+//-----------------------------------------------------------------------------
+
+void TEspAtUdpSocket::Init(TEspWifiUart * awifim, uint16_t alistenport)
+{
+  pwifim = awifim;
+  protocol = ESPSOCK_UDP;
+  listenport = alistenport;
+
+  pwifim->AddSocket(this);
+}
+
+int TEspAtUdpSocket::Send(void * adataptr, unsigned adatalen)
+{
+  if (adatalen > ESPWIFI_MAX_PACKET_SIZE)
+  {
+    return -1;
+  }
+
+  if (!QueueTx(adataptr, adatalen))
+  {
+    return 0;  // no free packet !
+  }
 
   return adatalen;
 }
@@ -1050,27 +1229,101 @@ int TEspAtUdpSocket::Receive(void * adataptr, unsigned adatalen)
   srcaddr = pmem->ip_addr;
   srcport = pmem->ip_port;
 
-  // unchain the pmem first
-  rxpkt_first = rxpkt_first->next;
-  if (!rxpkt_first)  rxpkt_last = nullptr;
-
-  // release the packet !
-  pwifim->ReleasePmem(pmem);
+  ReleaseFirstRx();
 
   return err;
 }
 
-void TEspAtUdpSocket::AddRxPacket(TEspPmem *pmem)
+//-----------------------------------------------------------------------------
+
+void TEspAtTcpSocket::Init(TEspWifiUart * awifim)
 {
-  pmem->next = nullptr;
-  if (rxpkt_last)
+  pwifim = awifim;
+  protocol = ESPSOCK_TCP;
+  listenport = 0;
+
+  pwifim->AddSocket(this);
+}
+
+bool TEspAtTcpSocket::Connect(TIp4Addr * aaddr, uint16_t aport)
+{
+  if (connected || connect_requested || close_requested)
   {
-    rxpkt_last->next = pmem;
+    return false;
   }
-  else
+
+  destaddr = *aaddr;
+  destport = aport;
+  rx_offset = 0;
+  rx_aborted = false;
+  while (rxpkt_first)
   {
-    rxpkt_first = pmem;
+    ReleaseFirstRx();
   }
-  rxpkt_last = pmem;
+
+  connect_requested = true;  // processed by the TEspWifiUart::RunLinks()
+  return true;
+}
+
+void TEspAtTcpSocket::Close()
+{
+  if (connected)
+  {
+    close_requested = true;
+  }
+  connect_requested = false;
+}
+
+int TEspAtTcpSocket::Send(void * adataptr, unsigned adatalen)
+{
+  if (!connected || close_requested)
+  {
+    return -1;
+  }
+
+  // split into packets
+  uint8_t * psrc = (uint8_t *)adataptr;
+  unsigned  result = 0;
+  while ((result < adatalen) && (tx_queued < max_tx_packets))
+  {
+    unsigned len = adatalen - result;
+    if (len > ESPWIFI_MAX_PACKET_SIZE)  len = ESPWIFI_MAX_PACKET_SIZE;
+
+    if (!QueueTx(psrc + result, len))
+    {
+      break;  // no free packet
+    }
+    result += len;
+  }
+
+  return result;
 }
 
+int TEspAtTcpSocket::Receive(void * adataptr, unsigned adatalen)
+{
+  uint8_t * pdst = (uint8_t *)adataptr;
+  unsigned  result = 0;
+  while (rxpkt_first && (result < adatalen))
+  {
+    TEspPmem * pmem = rxpkt_first;
+    unsigned len = pmem->datalen - rx_offset;
+    if (len > adatalen - result)  len = adatalen - result;
+
+    memcpy(pdst + result, &pmem->data[rx_offset], len);
+    result += len;
+    rx_offset += len;
+
+    if (rx_offset >= pmem->datalen)
+    {
+      ReleaseFirstRx();
+      rx_offset = 0;
+    }
+  }
+
+  if (!result && rx_aborted)
+  {
+    return -1;  // the data before the gap is already read
+  }
+
+  return result;
+}
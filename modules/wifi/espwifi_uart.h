@@ -41,13 +41,20 @@
 #include "strparse.h"
 
 #define UARTCOMM_RXBUF_SIZE       512  // circular DMA buffer
-#define UARTCOMM_TXBUF_SIZE      1600  // one tx response must fit into it
-#define UARTCOMM_MAX_RX_MSG_LEN  1600  // maximal length of a parsed message
+#define UARTCOMM_TXBUF_SIZE       256  // AT commands, the data is sent directly from the TEspPmem
+#define UARTCOMM_MAX_RX_MSG_LEN   256  // maximal length of a parsed message, the +IPD data goes directly into a TEspPmem
+
+// link ids (AT+CIPMUX=1), the standard ESP8266 / ESP32 AT firmwares support 5, custom builds can support more
+#ifndef ESPWIFI_MAX_SOCKETS
+  #define ESPWIFI_MAX_SOCKETS   5
+#endif
 
-#define ESPWIFI_MAX_SOCKETS   5
 #define ESPWIFI_MAX_EXPCMDR   4
 
-class TEspAtUdpSocket;
+#define ESPSOCK_UDP           0
+#define ESPSOCK_TCP           1
+
+class TEspAtSocket;
 
 #ifndef ESPWIFI_MAX_PACKET_SIZE
   #define ESPWIFI_MAX_PACKET_SIZE  1516
@@ -62,7 +69,7 @@ typedef struct TEspPmem  // 1.5 kByte
   uint16_t           ip_port;
   uint16_t           _reserved;
   TIp4Addr           ip_addr;
-  TEspAtUdpSocket *  psocket;
+  TEspAtSocket *     psocket;
   TEspPmem *         next;
 
   uint8_t            data[ESPWIFI_MAX_PACKET_SIZE];
@@ -72,7 +79,9 @@ typedef struct TEspPmem  // 1.5 kByte
 
 class TEspWifiUart
 {
+  friend class TEspAtSocket;
   friend class TEspAtUdpSocket;
+  friend class TEspAtTcpSocket;
 
 protected:
   uint8_t             state = 0;
@@ -129,13 +138,14 @@ public:  // settings
 public:
   bool                initialized = false;
   unsigned            invalid_ipd_count = 0;  // number of invalid +IPD (data) messages
+  unsigned            ipd_drop_count = 0;     // +IPD data dropped because of no free (or too small) TEspPmem
   unsigned            data_send_error_count = 0;
-  TEspAtUdpSocket *   sockets[ESPWIFI_MAX_SOCKETS] = {0};
+  TEspAtSocket *      sockets[ESPWIFI_MAX_SOCKETS] = {0};  // indexed by the link id
 
   bool                Init(void * anetmem, unsigned anetmemsize);
   void                Run();  // processes Rx and Tx
 
-  void                AddUdpSocket(TEspAtUdpSocket * audp);
+  void                AddSocket(TEspAtSocket * asock);
 
   bool                IsLinkUp() { return (0 == initstate); }
 
@@ -164,23 +174,28 @@ protected:
   TIp4Addr            ipd_ip_addr;
   uint16_t            ipd_port = 0;
   uint16_t            ipd_data_len = 0;
-  uint16_t            ipd_data_start = 0;
+  TEspPmem *          ipd_pmem = nullptr;  // the +IPD data is copied here directly from the rxdmabuf
 
   TIp4Addr            sp_ipaddr;
 
   TEspPmem *          sending_first = nullptr;
   TEspPmem *          sending_last = nullptr;
 
+  TEspAtSocket *      link_cmd_socket = nullptr;  // TCP connect or close command is running for this
+
   bool                InitHw();  // board specific implementation
 
   void                ResetConnection();
 
   void                RunRx();
   void                RunTx();
+  void                RunLinks(); // TCP connect and close requests
   void                RunInit(); // initialization state-machine
   void                ProcessRxMessage();
   void                ProcessIpdStart();
   void                ProcessIpdData();
+  void                IpdDropped(TEspAtSocket * psock);
+  bool                ProcessLinkStatus();
 
   uint8_t *           AllocateNetMem(unsigned asize);
   TEspPmem *          AllocatePmem();
@@ -199,17 +214,20 @@ protected:
 
 protected: // these big buffers must come to the last
 
-  uint8_t             rxmsgbuf[UARTCOMM_MAX_RX_MSG_LEN];  // parsed message buffer
+  uint8_t             rxmsgbuf[UARTCOMM_MAX_RX_MSG_LEN + 1];  // parsed message buffer, +1: zero termination
   uint8_t             rxdmabuf[UARTCOMM_RXBUF_SIZE];  // circular buffer, might contain more messages
   uint8_t             txbuf[UARTCOMM_TXBUF_SIZE];
 
 };
 
-class TEspAtUdpSocket
+class TEspAtSocket
 {
+  friend class TEspWifiUart;
+
 public:
 
-  int               socketnum = -1;
+  int               socketnum = -1;  // link id
+  uint8_t           protocol = ESPSOCK_UDP;
   bool              initialized = false;
   bool              connected = false;
 
@@ -228,19 +246,52 @@ public:
 
   TEspPmem *        rxpkt_first = nullptr;
   TEspPmem *        rxpkt_last  = nullptr;
-  TEspPmem *        txpkt_first = nullptr;
-  TEspPmem *        txpkt_last  = nullptr;
+  uint8_t           tx_queued = 0;  // packets in the sending chain
+
+  void              Reset();
+
+  void              AddRxPacket(TEspPmem * pmem);
 
-  TEspAtUdpSocket * sending_next = nullptr;
+protected:
+  bool              connect_requested = false;
+  bool              close_requested = false;
+  bool              rx_aborted = false;  // TCP: received data was dropped, the link is closed
+
+  TEspPmem *        QueueTx(void * adataptr, unsigned adatalen);
+  void              ReleaseFirstRx();
+};
 
+class TEspAtUdpSocket : public TEspAtSocket
+{
+public:
   void              Init(TEspWifiUart * awifim, uint16_t alistenport);
 
   int               Send(void * adataptr, unsigned adatalen);
   int               Receive(void * adataptr, unsigned adatalen);
+};
 
-  void              Reset();
+/* TCP client connection over an AT link, the data is handled as a byte stream.
+   The module does not wait for the application: when a received chunk does not get a free TEspPmem,
+   the link is closed (AT+CIPCLOSE) instead of passing a stream with a gap to the application. */
 
-  void              AddRxPacket(TEspPmem * pmem);
+class TEspAtTcpSocket : public TEspAtSocket
+{
+public: // settings
+  uint8_t           max_tx_packets = 4;  // limits the TEspPmem usage
+
+public:
+  void              Init(TEspWifiUart * awifim);
+
+  bool              Connect(TIp4Addr * aaddr, uint16_t aport);  // the result comes later, see Connected()
+  void              Close();
+  bool              Connected() { return connected; }
+  bool              Connecting() { return connect_requested; }
+
+  int               Send(void * adataptr, unsigned adatalen);  // returns the number of bytes queued
+  int               Receive(void * adataptr, unsigned adatalen);  // -1: the link was aborted because of lost data
+
+protected:
+  uint16_t          rx_offset = 0;  // already read bytes of the rxpkt_first
 };
 
 #endif /* SRC_ESPWIFI_UART_H_ */
@@ -0,0 +1,197 @@
+/*
+ * net_capture.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#include "string.h"
+#include "platform.h"
+#include "net_capture.h"
+#include "net_ip4.h"
+
+void TNetCapture::Init(TNetAdapter * aadapter, void * abuf, unsigned abufsize)
+{
+  adapter = aadapter;
+  buf = (uint8_t *)abuf;
+  bufsize = abufsize;
+  enabled = false;
+
+  Restart();
+}
+
+void TNetCapture::Start()
+{
+  enabled = true;
+  adapter->capture = this;
+}
+
+void TNetCapture::Stop()
+{
+  enabled = false;
+  if (adapter->capture == this)
+  {
+    adapter->capture = nullptr;
+  }
+}
+
+void TNetCapture::Restart()
+{
+  rdidx = 0;
+  datalen = 0;
+
+  captured_count = 0;
+  filtered_count = 0;
+  overflow_count = 0;
+
+  TPcapFileHeader fh;
+  fh.magic = PCAP_MAGIC_NS;
+  fh.version_major = 2;
+  fh.version_minor = 4;
+  fh.thiszone = 0;
+  fh.sigfigs = 0;
+  fh.snaplen = snaplen;
+  fh.linktype = PCAP_LINKTYPE_ETH;
+
+  PutData(&fh, sizeof(fh));
+}
+
+bool TNetCapture::FilterMatch(uint8_t * pframe, unsigned alen)
+{
+  PEthernetHeader peh = PEthernetHeader(pframe);
+  uint16_t etype = __builtin_bswap16(peh->ethertype);
+
+  if (filter_ethertype && (etype != filter_ethertype))
+  {
+    return false;
+  }
+
+  if (!filter_port)
+  {
+    return true;
+  }
+
+  if (0x0800 != etype)
+  {
+    return false;
+  }
+
+  PIp4Header piph = PIp4Header(peh + 1);
+  if (((6 != piph->protocol) && (17 != piph->protocol)) || (piph->fl_offs & 0xFF1F))  // not TCP/UDP or not the first fragment
+  {
+    return false;
+  }
+
+  unsigned hlen = ((piph->hl_v & 0xF) << 2);
+  if (sizeof(TEthernetHeader) + hlen + 4 > alen)
+  {
+    return false;
+  }
+
+  // the source and destination ports are at the same place for TCP and UDP
+  uint16_t * pports = (uint16_t *)(((uint8_t *)piph) + hlen);
+  uint16_t port = __builtin_bswap16(filter_port);
+  return ((pports[0] == port) || (pports[1] == port));
+}
+
+void TNetCapture::CaptureFrame(TPacketMem * pmem, bool atx)
+{
+  if (!enabled || (atx ? !capture_tx : !capture_rx))
+  {
+    return;
+  }
+
+  unsigned framelen = pmem->datalen;
+  if (framelen < sizeof(TEthernetHeader))
+  {
+    return;
+  }
+
+  if ((filter_ethertype || filter_port) && !FilterMatch(&pmem->data[0], framelen))
+  {
+    ++filtered_count;
+    return;
+  }
+
+  unsigned caplen = (framelen > snaplen ? snaplen : framelen);
+  if (sizeof(TPcapRecHeader) + caplen > bufsize - datalen)
+  {
+    ++overflow_count;
+    return;
+  }
+
+  uint64_t ts = pmem->timestamp_ns;
+  if (!ts)
+  {
+    ts = adapter->peth->NsTimeRead();
+    if (!ts)
+    {
+      ts = uint64_t(adapter->mscounter) * 1000000;  // no ns timer
+    }
+  }
+
+  TPcapRecHeader rh;
+  rh.ts_sec = ts / 1000000000;
+  rh.ts_nsec = ts - uint64_t(rh.ts_sec) * 1000000000;
+  rh.incl_len = caplen;
+  rh.orig_len = framelen;
+
+  PutData(&rh, sizeof(rh));
+  PutData(&pmem->data[0], caplen);
+
+  ++captured_count;
+}
+
+void TNetCapture::PutData(void * asrc, unsigned alen)  // the free space must be checked before
+{
+  uint8_t * psrc = (uint8_t *)asrc;
+  unsigned wridx = rdidx + datalen;
+  if (wridx >= bufsize)  wridx -= bufsize;
+
+  unsigned chunk = bufsize - wridx;
+  if (chunk > alen)  chunk = alen;
+
+  memcpy(&buf[wridx], psrc, chunk);
+  if (chunk < alen)
+  {
+    memcpy(&buf[0], psrc + chunk, alen - chunk);
+  }
+
+  datalen += alen;
+}
+
+unsigned TNetCapture::ReadRef(uint8_t * * rdataptr)
+{
+  *rdataptr = &buf[rdidx];
+
+  unsigned chunk = bufsize - rdidx;
+  return (chunk < datalen ? chunk : datalen);
+}
+
+void TNetCapture::Consume(unsigned alen)
+{
+  if (alen > datalen)  alen = datalen;
+
+  rdidx += alen;
+  if (rdidx >= bufsize)  rdidx -= bufsize;
+  datalen -= alen;
+}
+
+unsigned TNetCapture::Read(void * adst, unsigned amaxlen)
+{
+  uint8_t * pdst = (uint8_t *)adst;
+  unsigned  result = 0;
+
+  while ((result < amaxlen) && datalen)
+  {
+    uint8_t * psrc;
+    unsigned chunk = ReadRef(&psrc);
+    if (chunk > amaxlen - result)  chunk = amaxlen - result;
+
+    memcpy(pdst + result, psrc, chunk);
+    Consume(chunk);
+    result += chunk;
+  }
+
+  return result;
+}
@@ -0,0 +1,86 @@
+/*
+ * net_capture.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#ifndef NETWORK_NET_CAPTURE_H_
+#define NETWORK_NET_CAPTURE_H_
+
+#include "stdint.h"
+#include "netadapter.h"
+
+#define PCAP_MAGIC_NS        0xA1B23C4D  // nanosecond resolution timestamps
+#define PCAP_LINKTYPE_ETH    1
+
+typedef struct  // 24 bytes, at the start of the capture stream
+{
+  uint32_t  magic;
+  uint16_t  version_major;
+  uint16_t  version_minor;
+  int32_t   thiszone;
+  uint32_t  sigfigs;
+  uint32_t  snaplen;
+  uint32_t  linktype;
+//
+} TPcapFileHeader, * PPcapFileHeader;
+
+typedef struct  // 16 bytes, before every captured frame
+{
+  uint32_t  ts_sec;
+  uint32_t  ts_nsec;
+  uint32_t  incl_len;  // captured length
+  uint32_t  orig_len;  // length on the wire
+//
+} TPcapRecHeader, * PPcapRecHeader;
+
+/* Frame capture tap for the TNetAdapter: the RX and TX frames are stored in pcap format into a RAM ring buffer.
+   The content can be drained as a byte stream (UART, USB, UDP...), the pcap file header is inserted
+   at the start of the stream and after every Restart().
+   It is activated by setting the adapter->capture, otherwise the adapter does only a pointer check.
+   When the buffer is full the new frames are dropped, the already captured ones are never overwritten. */
+
+class TNetCapture
+{
+public: // settings
+  uint16_t            snaplen = 128;     // maximal stored length of a frame
+  uint16_t            filter_ethertype = 0;  // 0 = any, in host byte order
+  uint16_t            filter_port = 0;   // TCP/UDP source or destination port, 0 = any
+  bool                capture_rx = true;
+  bool                capture_tx = true;
+
+public: // statistics
+  uint32_t            captured_count = 0;
+  uint32_t            filtered_count = 0;  // frames not matching the filter
+  uint32_t            overflow_count = 0;  // frames dropped because of the full buffer
+
+public:
+  TNetAdapter *       adapter = nullptr;
+  bool                enabled = false;
+
+  void                Init(TNetAdapter * aadapter, void * abuf, unsigned abufsize);
+  void                Start();    // attaches to the adapter
+  void                Stop();     // detaches, the captured data remains readable
+  void                Restart();  // clears the buffer
+
+  void                CaptureFrame(TPacketMem * pmem, bool atx);  // called by the TNetAdapter
+
+  unsigned            Available() { return datalen; }
+  unsigned            Read(void * adst, unsigned amaxlen);  // copies out and consumes the data
+
+  // zero-copy drain (e.g. UART DMA): returns the largest contiguous block, then Consume() it after the transfer
+  unsigned            ReadRef(uint8_t * * rdataptr);
+  void                Consume(unsigned alen);
+
+protected:
+  uint8_t *           buf = nullptr;
+  unsigned            bufsize = 0;
+  unsigned            rdidx = 0;
+  unsigned            datalen = 0;
+
+  bool                FilterMatch(uint8_t * pframe, unsigned alen);
+  void                PutData(void * asrc, unsigned alen);
+};
+
+#endif /* NETWORK_NET_CAPTURE_H_ */
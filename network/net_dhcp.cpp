@@ -0,0 +1,406 @@
+/*
+ * net_dhcp.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#include "string.h"
+#include "platform.h"
+#include "net_dhcp.h"
+#include "clockcnt.h"
+#include "traces.h"
+
+static uint32_t dhcp_get_u32(uint8_t * p)  // big endian, unaligned
+{
+  return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+void TDhcpClient::Init(TIp4Handler * aiphandler)
+{
+  phandler = aiphandler;
+  adapter = phandler->adapter;
+
+  udp.Init(phandler, DHCP_CLIENT_PORT);
+  udp.destport = DHCP_SERVER_PORT;
+
+  seconds = 0;
+  last_sec_ms = adapter->mscounter;
+
+  DropLease();
+  state = DHCPS_INIT;
+  timeout_ms = 0;  // start immediately
+
+  adapter->AddHandler(this);
+}
+
+void TDhcpClient::SetCachedLease(TDhcpLease * alease)
+{
+  lease = *alease;
+  if ((DHCPS_INIT == state) && lease.ipaddress.u32)
+  {
+    state = DHCPS_REBOOTING;  // the request will be sent at the next Run()
+    trycnt = 0;
+    timeout_ms = 0;
+    start_ms = adapter->mscounter;
+  }
+}
+
+void TDhcpClient::StartTimer(bool afirst)
+{
+  if (afirst)
+  {
+    timeout_ms = retry_timeout_ms;
+  }
+  else
+  {
+    timeout_ms <<= 1;
+    if (timeout_ms > retry_timeout_max_ms)  timeout_ms = retry_timeout_max_ms;
+  }
+  start_ms = adapter->mscounter;
+}
+
+bool TDhcpClient::TimerExpired()
+{
+  return (adapter->mscounter - start_ms >= timeout_ms);
+}
+
+void TDhcpClient::StartDiscover()
+{
+  xid = CLOCKCNT ^ dhcp_get_u32(&adapter->peth->mac_address[2]);
+  state = DHCPS_SELECTING;
+  trycnt = 0;
+  SendMessage(DHCPDISCOVER);
+  StartTimer(true);
+}
+
+void TDhcpClient::StartRequest(uint8_t astate)
+{
+  if (DHCPS_REQUESTING != astate)
+  {
+    xid = CLOCKCNT ^ dhcp_get_u32(&adapter->peth->mac_address[2]);  // new transaction
+  }
+  state = astate;
+  trycnt = 0;
+  SendMessage(DHCPREQUEST);
+  StartTimer(true);
+}
+
+void TDhcpClient::SendMessage(uint8_t amsgtype)
+{
+  uint8_t * pdata;
+  TPacketMem * pmem = udp.AllocateTxPacket(&pdata);
+  if (!pmem)
+  {
+    return;  // will be repeated after the timeout
+  }
+
+  unsigned n;
+
+  memset(pdata, 0, 300);
+
+  PDhcpHeader pdh = PDhcpHeader(pdata);
+  pdh->op = 1;  // request
+  pdh->htype = 1;  // Ethernet
+  pdh->hlen = 6;
+  pdh->xid[0] = (xid >> 16);
+  pdh->xid[1] = (xid & 0xFFFF);
+  if ((DHCPS_RENEWING == state) || (DHCPS_REBINDING == state))
+  {
+    for (n = 0; n < 4; ++n)  pdh->ciaddr[n] = lease.ipaddress.u8[n];
+  }
+  for (n = 0; n < 6; ++n)  pdh->chaddr[n] = adapter->peth->mac_address[n];
+
+  uint8_t * popt = (uint8_t *)(pdh + 1);
+
+  // magic cookie
+  popt[0] = 99;
+  popt[1] = 130;
+  popt[2] = 83;
+  popt[3] = 99;
+  popt += 4;
+
+  popt[0] = 53;  // message type
+  popt[1] = 1;
+  popt[2] = amsgtype;
+  popt += 3;
+
+  if ((DHCPREQUEST == amsgtype) && ((DHCPS_REQUESTING == state) || (DHCPS_REBOOTING == state)))
+  {
+    TIp4Addr * paddr = (DHCPS_REQUESTING == state ? &offered_ip : &lease.ipaddress);
+    popt[0] = 50;  // requested IP address
+    popt[1] = 4;
+    for (n = 0; n < 4; ++n)  popt[2 + n] = paddr->u8[n];
+    popt += 6;
+  }
+
+  if ((DHCPREQUEST == amsgtype) && (DHCPS_REQUESTING == state))
+  {
+    popt[0] = 54;  // server identifier
+    popt[1] = 4;
+    for (n = 0; n < 4; ++n)  popt[2 + n] = offered_server.u8[n];
+    popt += 6;
+  }
+
+  popt[0] = 55;  // parameter request list
+  popt[1] = 6;
+  popt[2] = 1;   // subnet mask
+  popt[3] = 3;   // router
+  popt[4] = 6;   // DNS server
+  popt[5] = 51;  // lease time
+  popt[6] = 58;  // T1
+  popt[7] = 59;  // T2
+  popt += 8;
+
+  if (hostname)
+  {
+    unsigned len = strlen(hostname);
+    if (len > 32)  len = 32;
+    popt[0] = 12;  // host name
+    popt[1] = len;
+    memcpy(&popt[2], hostname, len);
+    popt += 2 + len;
+  }
+
+  *popt++ = 255;  // end
+
+  unsigned msglen = popt - pdata;
+  if (msglen < 300)  msglen = 300;  // BOOTP minimum message size
+
+  if (DHCPS_RENEWING == state)
+  {
+    udp.destaddr = lease.serverid;  // unicast to the server
+  }
+  else
+  {
+    udp.destaddr.u32 = 0xFFFFFFFF;  // broadcast
+  }
+
+  udp.SendTxPacket(pmem, msglen);
+}
+
+void TDhcpClient::ProcessReply(uint8_t * pdata, unsigned adatalen)
+{
+  if (adatalen < sizeof(TDhcpHeader) + 4)
+  {
+    return;
+  }
+
+  PDhcpHeader pdh = PDhcpHeader(pdata);
+  if ((2 != pdh->op) || (pdh->xid[0] != (xid >> 16)) || (pdh->xid[1] != (xid & 0xFFFF)))
+  {
+    return;  // not for us
+  }
+
+  for (unsigned n = 0; n < 6; ++n)
+  {
+    if (pdh->chaddr[n] != adapter->peth->mac_address[n])
+    {
+      return;
+    }
+  }
+
+  uint8_t * popt = (uint8_t *)(pdh + 1);
+  uint8_t * popt_end = pdata + adatalen;
+  if ((popt[0] != 99) || (popt[1] != 130) || (popt[2] != 83) || (popt[3] != 99))
+  {
+    return;  // no magic cookie
+  }
+  popt += 4;
+
+  uint8_t     msgtype = 0;
+  TDhcpLease  newlease = lease;
+  uint32_t    t1 = 0;
+  uint32_t    t2 = 0;
+
+  newlease.ipaddress.CopyFrom8(&pdh->yiaddr[0]);
+  newlease.lease_time_s = 0;
+
+  while (popt < popt_end)
+  {
+    uint8_t code = *popt++;
+    if (0 == code)  // pad
+    {
+      continue;
+    }
+    if ((255 == code) || (popt >= popt_end))  // end
+    {
+      break;
+    }
+
+    uint8_t len = *popt++;
+    if (popt + len > popt_end)
+    {
+      break;  // invalid option
+    }
+
+    if (53 == code)
+    {
+      msgtype = popt[0];
+    }
+    else if (len >= 4)
+    {
+      if       (1 == code)  newlease.netmask.CopyFrom8(popt);
+      else if  (3 == code)  newlease.gwaddress.CopyFrom8(popt);  // the first router
+      else if  (6 == code)  newlease.dnsaddress.CopyFrom8(popt);  // the first DNS server
+      else if (54 == code)  newlease.serverid.CopyFrom8(popt);
+      else if (51 == code)  newlease.lease_time_s = dhcp_get_u32(popt);
+      else if (58 == code)  t1 = dhcp_get_u32(popt);
+      else if (59 == code)  t2 = dhcp_get_u32(popt);
+    }
+
+    popt += len;
+  }
+
+  if (DHCPOFFER == msgtype)
+  {
+    if (DHCPS_SELECTING == state)
+    {
+      offered_ip = newlease.ipaddress;
+      offered_server = newlease.serverid;
+      StartRequest(DHCPS_REQUESTING);
+    }
+  }
+  else if (DHCPACK == msgtype)
+  {
+    if ((DHCPS_REQUESTING <= state) && (DHCPS_BOUND != state))
+    {
+      if (0 == newlease.lease_time_s)
+      {
+        newlease.lease_time_s = 0xFFFFFFFF;  // infinite
+      }
+      lease = newlease;
+
+      t1_s = (t1 ? t1 : (lease.lease_time_s >> 1));
+      t2_s = (t2 ? t2 : lease.lease_time_s - (lease.lease_time_s >> 3));
+
+      ApplyLease();
+    }
+  }
+  else if (DHCPNAK == msgtype)
+  {
+    if ((DHCPS_REQUESTING <= state) && (DHCPS_BOUND != state))
+    {
+      TRACE("DHCP: NAK received\r\n");
+      DropLease();
+      state = DHCPS_INIT;
+      StartTimer(true);  // do not flood the server, restart after the retry timeout
+    }
+  }
+}
+
+void TDhcpClient::ApplyLease()
+{
+  phandler->ipaddress = lease.ipaddress;
+  phandler->netmask   = lease.netmask;
+  phandler->gwaddress = lease.gwaddress;
+
+  bound = true;
+  lease_start_s = seconds;
+  state = DHCPS_BOUND;
+
+  TRACE("DHCP: bound to %u.%u.%u.%u\r\n", lease.ipaddress.u8[0], lease.ipaddress.u8[1], lease.ipaddress.u8[2], lease.ipaddress.u8[3]);
+
+  OnLeaseUpdated();
+}
+
+void TDhcpClient::DropLease()
+{
+  bound = false;
+  phandler->ipaddress.u32 = 0;
+  phandler->netmask.u32 = 0;
+  phandler->gwaddress.u32 = 0;
+}
+
+void TDhcpClient::Run()
+{
+  uint32_t now = adapter->mscounter;
+  while (now - last_sec_ms >= 1000)
+  {
+    ++seconds;
+    last_sec_ms += 1000;
+  }
+
+  uint8_t * pdata;
+  unsigned  datalen;
+  while (udp.ReceiveRef(&pdata, &datalen))
+  {
+    ProcessReply(pdata, datalen);
+    udp.ReleaseRx();
+  }
+
+  if (!adapter->IsLinkUp())
+  {
+    return;
+  }
+
+  uint32_t elapsed_s = seconds - lease_start_s;
+
+  if (DHCPS_INIT == state)
+  {
+    if (TimerExpired())
+    {
+      StartDiscover();
+    }
+  }
+  else if (DHCPS_SELECTING == state)
+  {
+    if (TimerExpired())
+    {
+      SendMessage(DHCPDISCOVER);
+      StartTimer(false);
+    }
+  }
+  else if ((DHCPS_REQUESTING == state) || (DHCPS_REBOOTING == state))
+  {
+    if (TimerExpired())
+    {
+      if (0 == timeout_ms)  // first request with a cached lease
+      {
+        StartRequest(DHCPS_REBOOTING);
+      }
+      else if (++trycnt >= max_tries)
+      {
+        StartDiscover();
+      }
+      else
+      {
+        SendMessage(DHCPREQUEST);
+        StartTimer(false);
+      }
+    }
+  }
+  else if (DHCPS_BOUND == state)
+  {
+    if (elapsed_s >= t1_s)
+    {
+      StartRequest(DHCPS_RENEWING);
+    }
+  }
+  else if (DHCPS_RENEWING == state)
+  {
+    if (elapsed_s >= t2_s)
+    {
+      StartRequest(DHCPS_REBINDING);
+    }
+    else if (TimerExpired())
+    {
+      SendMessage(DHCPREQUEST);
+      StartTimer(false);
+    }
+  }
+  else if (DHCPS_REBINDING == state)
+  {
+    if (elapsed_s >= lease.lease_time_s)
+    {
+      TRACE("DHCP: lease expired\r\n");
+      DropLease();
+      StartDiscover();
+    }
+    else if (TimerExpired())
+    {
+      SendMessage(DHCPREQUEST);
+      StartTimer(false);
+    }
+  }
+}
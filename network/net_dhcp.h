@@ -0,0 +1,115 @@
+/*
+ * net_dhcp.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#ifndef NETWORK_NET_DHCP_H_
+#define NETWORK_NET_DHCP_H_
+
+#include "stdint.h"
+#include "net_ip4.h"
+
+#define DHCP_SERVER_PORT   67
+#define DHCP_CLIENT_PORT   68
+
+#define DHCP_MAGIC_COOKIE  0x63538263  // 99.130.83.99 in memory order
+
+#define DHCPDISCOVER       1
+#define DHCPOFFER          2
+#define DHCPREQUEST        3
+#define DHCPDECLINE        4
+#define DHCPACK            5
+#define DHCPNAK            6
+#define DHCPRELEASE        7
+
+typedef struct  // 236 bytes, the magic cookie and the options follow
+{
+  uint8_t   op;          // 1 = request, 2 = reply
+  uint8_t   htype;       // 1 = Ethernet
+  uint8_t   hlen;        // hardware address length = 6
+  uint8_t   hops;
+  uint16_t  xid[2];      // transaction id, 2x16 bit for unaligned handling
+  uint16_t  secs;
+  uint16_t  flags;
+  uint8_t   ciaddr[4];   // client IP address (when it is bound)
+  uint8_t   yiaddr[4];   // "your" (client) IP address
+  uint8_t   siaddr[4];   // next server IP address
+  uint8_t   giaddr[4];   // relay agent IP address
+  uint8_t   chaddr[16];  // client hardware address
+  uint8_t   sname[64];
+  uint8_t   file[128];
+//
+} TDhcpHeader, * PDhcpHeader;
+
+typedef struct  // the lease data, which can be saved and given back at the next start
+{
+  TIp4Addr  ipaddress;
+  TIp4Addr  netmask;
+  TIp4Addr  gwaddress;
+  TIp4Addr  dnsaddress;
+  TIp4Addr  serverid;
+  uint32_t  lease_time_s;
+//
+} TDhcpLease, * PDhcpLease;
+
+#define DHCPS_INIT          0
+#define DHCPS_SELECTING     1
+#define DHCPS_REQUESTING    2
+#define DHCPS_REBOOTING     3  // INIT-REBOOT with a cached lease
+#define DHCPS_BOUND         4
+#define DHCPS_RENEWING      5
+#define DHCPS_REBINDING     6
+
+class TDhcpClient : public TProtocolHandler
+{
+public: // settings
+  uint32_t            retry_timeout_ms = 4000;  // doubled at every retry up to retry_timeout_max_ms
+  uint32_t            retry_timeout_max_ms = 32000;
+  uint8_t             max_tries = 4;  // for the requests, then starting over
+  const char *        hostname = nullptr;
+
+public:
+  uint8_t             state = DHCPS_INIT;
+
+  TIp4Handler *       phandler = nullptr;
+  TUdp4Socket         udp;
+
+  TDhcpLease          lease;
+  bool                bound = false;  // the ipaddress is valid
+
+  uint32_t            seconds = 0;  // lease timing, does not overflow like the mscounter
+
+  void                Init(TIp4Handler * aiphandler);
+  void                SetCachedLease(TDhcpLease * alease);  // requests the same address again at the start
+
+  virtual void        Run();
+
+  virtual void        OnLeaseUpdated() { }  // override to store the lease (e.g. to flash) for faster restart
+
+protected:
+  uint32_t            xid = 0;
+  uint8_t             trycnt = 0;
+  uint32_t            timeout_ms = 0;
+  uint32_t            start_ms = 0;
+  uint32_t            last_sec_ms = 0;
+
+  uint32_t            lease_start_s = 0;
+  uint32_t            t1_s = 0;
+  uint32_t            t2_s = 0;
+
+  TIp4Addr            offered_ip;
+  TIp4Addr            offered_server;
+
+  void                StartDiscover();
+  void                StartRequest(uint8_t astate);
+  void                SendMessage(uint8_t amsgtype);
+  void                ProcessReply(uint8_t * pdata, unsigned adatalen);
+  void                ApplyLease();
+  void                DropLease();
+  void                StartTimer(bool afirst);
+  bool                TimerExpired();
+};
+
+#endif /* NETWORK_NET_DHCP_H_ */
@@ -0,0 +1,764 @@
+/*
+ * net_http.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#include "string.h"
+#include "stdlib.h"
+#include "stdarg.h"
+#include <new> // required for placement new
+#include "platform.h"
+#include "net_http.h"
+#include "mp_printf.h"
+#include "traces.h"
+
+const char * http_status_text(unsigned astatus)
+{
+  switch (astatus)
+  {
+    case 200:  return "OK";
+    case 201:  return "Created";
+    case 204:  return "No Content";
+    case 301:  return "Moved Permanently";
+    case 304:  return "Not Modified";
+    case 400:  return "Bad Request";
+    case 403:  return "Forbidden";
+    case 404:  return "Not Found";
+    case 405:  return "Method Not Allowed";
+    case 408:  return "Request Timeout";
+    case 411:  return "Length Required";
+    case 413:  return "Payload Too Large";
+    case 431:  return "Request Header Fields Too Large";
+    case 500:  return "Internal Server Error";
+    case 501:  return "Not Implemented";
+    case 503:  return "Service Unavailable";
+    default:   return "Unknown";
+  }
+}
+
+static unsigned http_append(char * abuf, unsigned abufsize, unsigned apos, const char * fmt, ...)
+{
+  if (apos >= abufsize)
+  {
+    return abufsize;
+  }
+
+  va_list va;
+  va_start(va, fmt);
+  int r = mp_vsnprintf(abuf + apos, abufsize - apos, fmt, va);
+  va_end(va);
+
+  return (r < 0 ? abufsize : apos + r);
+}
+
+static int http_hexval(char c)
+{
+  if ((c >= '0') && (c <= '9'))  return c - '0';
+  if ((c >= 'A') && (c <= 'F'))  return c - 'A' + 10;
+  if ((c >= 'a') && (c <= 'f'))  return c - 'a' + 10;
+  return -1;
+}
+
+static bool http_name_equals(const char * aname, const char * astr, unsigned alen)  // case insensitive
+{
+  for (unsigned n = 0; n < alen; ++n)
+  {
+    if ((aname[n] | 0x20) != (astr[n] | 0x20))
+    {
+      return false;
+    }
+  }
+  return (0 == aname[alen]);
+}
+
+//--------------------------------------------------------------
+
+bool THttpConnection::Init(THttpServer * aserver, unsigned aindex)
+{
+  server = aserver;
+  index = aindex;
+  state = HTTPCS_IDLE;
+
+  reqbuf = (char *)server->adapter->AllocateNetMem(server->request_buf_size + 1);  // +1: zero termination
+  if (!reqbuf)
+  {
+    return false;
+  }
+
+  socket.rx_buf_size = server->rx_buf_size;
+  socket.tx_buf_size = server->tx_buf_size;
+  if (!socket.Init(server->phandler))
+  {
+    return false;
+  }
+
+  return socket.Listen(server->port);
+}
+
+bool THttpConnection::IsMethod(const char * amethod)
+{
+  return method && (0 == strcmp(method, amethod));
+}
+
+const char * THttpConnection::GetHeader(const char * aname)
+{
+  // the header lines are zero terminated, separated by "\0\n"
+  unsigned namelen = strlen(aname);
+  char * p = headers;
+  char * pend = reqbuf + head_len;
+  while (p && (p < pend) && *p)
+  {
+    unsigned len = strlen(p);
+    if ((len > namelen) && (':' == p[namelen]) && http_name_equals(aname, p, namelen))
+    {
+      p += namelen + 1;
+      while ((' ' == *p) || ('\t' == *p))
+      {
+        ++p;
+      }
+      return p;
+    }
+    p += len + 2;
+  }
+
+  return nullptr;
+}
+
+void THttpConnection::StartRequest()
+{
+  method = nullptr;
+  path = nullptr;
+  query = nullptr;
+  headers = nullptr;
+  body = nullptr;
+  body_len = 0;
+  appdata = nullptr;
+
+  head_len = 0;
+  request_len = 0;
+  scan_pos = 0;
+  chunked = false;
+  head_only = false;
+  head_valid = false;
+  body_too_large = false;
+
+  last_rx_ms = server->adapter->mscounter;
+  state = HTTPCS_REQUEST;
+}
+
+bool THttpConnection::ParseHead()
+{
+  // terminate the lines
+  char * pend = reqbuf + head_len;
+  for (char * p = reqbuf; p < pend; ++p)
+  {
+    if ('\r' == *p)  *p = 0;
+  }
+
+  // request line: METHOD SP PATH SP VERSION
+  method = reqbuf;
+  char * p = strchr(method, ' ');
+  if (!p)
+  {
+    return false;
+  }
+  *p++ = 0;
+  path = p;
+  p = strchr(path, ' ');
+  if (!p || ('/' != *path))
+  {
+    return false;
+  }
+  *p++ = 0;
+  char * version = p;
+
+  headers = version + strlen(version) + 2;
+
+  keep_alive = (0 == strcmp(version, "HTTP/1.1"));
+  if (!keep_alive && (0 != strcmp(version, "HTTP/1.0")))
+  {
+    return false;
+  }
+
+  // the query is not decoded
+  query = strchr(path, '?');
+  if (query)
+  {
+    *query++ = 0;
+  }
+
+  // percent decoding of the path in place
+  char * pdst = path;
+  for (p = path; *p; ++p)
+  {
+    if (('%' == *p) && (http_hexval(p[1]) >= 0) && (http_hexval(p[2]) >= 0))
+    {
+      *pdst++ = (http_hexval(p[1]) << 4) | http_hexval(p[2]);
+      p += 2;
+    }
+    else
+    {
+      *pdst++ = *p;
+    }
+  }
+  *pdst = 0;
+
+  const char * hv = GetHeader("Connection");
+  if (hv)
+  {
+    if (http_name_equals("close", hv, strlen(hv)))
+    {
+      keep_alive = false;
+    }
+    else if (http_name_equals("keep-alive", hv, strlen(hv)))
+    {
+      keep_alive = true;
+    }
+  }
+
+  hv = GetHeader("Content-Length");
+  if (hv)
+  {
+    // the body must fit into the request buffer after the head, checked before any arithmetic with it
+    unsigned long cl = strtoul(hv, nullptr, 10);
+    if (cl > unsigned(server->request_buf_size - head_len))
+    {
+      body_too_large = true;
+    }
+    else
+    {
+      body_len = cl;
+    }
+  }
+
+  return true;
+}
+
+void THttpConnection::ReceiveRequest()
+{
+  uint32_t now = server->adapter->mscounter;
+
+  if (reqlen < server->request_buf_size)
+  {
+    int r = socket.Receive(reqbuf + reqlen, server->request_buf_size - reqlen);
+    if (r > 0)
+    {
+      reqlen += r;
+      last_rx_ms = now;
+    }
+  }
+
+  bool complete = false;
+  if (!head_len)
+  {
+    // search the empty line
+    unsigned n = scan_pos;
+    while (n + 4 <= reqlen)
+    {
+      if (('\r' == reqbuf[n]) && ('\n' == reqbuf[n + 1]) && ('\r' == reqbuf[n + 2]) && ('\n' == reqbuf[n + 3]))
+      {
+        head_len = n + 4;
+        head_valid = ParseHead();
+        break;
+      }
+      ++n;
+    }
+    scan_pos = n;
+  }
+
+  if (head_len)
+  {
+    complete = (unsigned(reqlen - head_len) >= body_len) || (reqlen >= server->request_buf_size) || body_too_large;
+  }
+  else if (reqlen >= server->request_buf_size)
+  {
+    complete = true;  // will be rejected
+  }
+
+  if (!complete)
+  {
+    if (socket.RemoteClosed())
+    {
+      socket.Close();
+      state = HTTPCS_CLOSING;
+    }
+    else if (now - last_rx_ms >= (reqlen ? server->request_timeout_ms : server->keepalive_timeout_ms))
+    {
+      socket.Close();
+      state = HTTPCS_CLOSING;
+    }
+    return;
+  }
+
+  if (socket.TxFree() < HTTP_MAX_RESPONSE_HEAD)
+  {
+    return;  // wait until the previous response is (mostly) acknowledged
+  }
+
+  ProcessRequest();
+}
+
+void THttpConnection::ProcessRequest()
+{
+  ++server->request_count;
+  state = HTTPCS_RESPONSE;
+
+  if (!head_len)
+  {
+    keep_alive = false;
+    request_len = reqlen;
+    RespondError(431);
+    return;
+  }
+
+  if (!head_valid)
+  {
+    keep_alive = false;
+    request_len = reqlen;
+    RespondError(400);
+    return;
+  }
+
+  if (body_too_large)
+  {
+    keep_alive = false;
+    request_len = reqlen;
+    RespondError(413);
+    return;
+  }
+
+  if (GetHeader("Transfer-Encoding"))  // chunked request bodies are not supported
+  {
+    keep_alive = false;
+    request_len = reqlen;
+    RespondError(411);
+    return;
+  }
+
+  request_len = head_len + body_len;  // body_len <= request_buf_size - head_len
+
+  body = (uint8_t *)reqbuf + head_len;
+  head_only = IsMethod("HEAD");
+
+  if (server->HandleRequest(this))
+  {
+    return;
+  }
+
+  if (!server->ServeFile(this))
+  {
+    RespondError(404);
+  }
+}
+
+void THttpConnection::RespondError(unsigned astatus)
+{
+  if (!SendError(astatus))
+  {
+    // no room for the response, the client would wait forever
+    keep_alive = false;
+    socket.Abort();
+    state = HTTPCS_IDLE;
+  }
+}
+
+bool THttpConnection::StartResponse(unsigned astatus, const char * acontenttype, uint32_t acontentlen,
+                                    const char * aextraheaders)
+{
+  char hbuf[HTTP_MAX_RESPONSE_HEAD];
+  unsigned len = http_append(hbuf, sizeof(hbuf), 0, "HTTP/1.1 %u %s\r\n", astatus, http_status_text(astatus));
+  if (acontenttype)
+  {
+    len = http_append(hbuf, sizeof(hbuf), len, "Content-Type: %s\r\n", acontenttype);
+  }
+  if (HTTP_CHUNKED == acontentlen)
+  {
+    len = http_append(hbuf, sizeof(hbuf), len, "Transfer-Encoding: chunked\r\n");
+  }
+  else
+  {
+    len = http_append(hbuf, sizeof(hbuf), len, "Content-Length: %u\r\n", acontentlen);
+  }
+  if (!keep_alive)
+  {
+    len = http_append(hbuf, sizeof(hbuf), len, "Connection: close\r\n");
+  }
+  if (aextraheaders)
+  {
+    len = http_append(hbuf, sizeof(hbuf), len, "%s", aextraheaders);
+  }
+  len = http_append(hbuf, sizeof(hbuf), len, "\r\n");
+
+  if ((len >= sizeof(hbuf)) || (socket.TxFree() < len))
+  {
+    return false;
+  }
+
+  socket.Send(&hbuf[0], len);
+  chunked = (HTTP_CHUNKED == acontentlen);
+
+  if (astatus >= 400)
+  {
+    ++server->error_count;
+  }
+  return true;
+}
+
+unsigned THttpConnection::WriteSpace()
+{
+  unsigned space = socket.TxFree();
+  if (chunked)
+  {
+    // chunk head ("FFFF\r\n") + trailing "\r\n" + the last chunk ("0\r\n\r\n") is always reserved
+    space = (space > 13 ? space - 13 : 0);
+  }
+  return space;
+}
+
+int THttpConnection::Write(const void * adata, unsigned alen)
+{
+  if (head_only)
+  {
+    return alen;  // HEAD: no body
+  }
+
+  unsigned len = WriteSpace();
+  if (len > alen)  len = alen;
+  if (!len)
+  {
+    return 0;
+  }
+
+  if (chunked)
+  {
+    char chead[8];
+    unsigned hlen = mp_snprintf(&chead[0], sizeof(chead), "%X\r\n", len);
+    socket.Send(&chead[0], hlen);
+    socket.Send((void *)adata, len);
+    socket.Send((void *)"\r\n", 2);
+    return len;
+  }
+
+  int r = socket.Send((void *)adata, len);
+  return (r > 0 ? r : 0);
+}
+
+int THttpConnection::WriteStr(const char * astr)
+{
+  return Write(astr, strlen(astr));
+}
+
+void THttpConnection::EndResponse()
+{
+  if (HTTPCS_RESPONSE != state)
+  {
+    return;
+  }
+
+  if (chunked && !head_only)
+  {
+    socket.Send((void *)"0\r\n\r\n", 5);
+  }
+  chunked = false;
+
+  FinishRequest();
+}
+
+bool THttpConnection::SendError(unsigned astatus)
+{
+  char tbuf[48];
+  unsigned len = mp_snprintf(&tbuf[0], sizeof(tbuf), "%u %s\r\n", astatus, http_status_text(astatus));
+  if (!StartResponse(astatus, "text/plain", len))
+  {
+    return false;
+  }
+  Write(&tbuf[0], len);
+  EndResponse();
+  return true;
+}
+
+void THttpConnection::FinishRequest()
+{
+  // keep the pipelined request data
+  if (request_len > reqlen)  request_len = reqlen;
+  unsigned rest = reqlen - request_len;
+  if (rest)
+  {
+    memmove(reqbuf, reqbuf + request_len, rest);
+  }
+  reqlen = rest;
+
+  if (keep_alive && !socket.RemoteClosed())
+  {
+    StartRequest();
+  }
+  else
+  {
+    socket.Close();  // the buffered data is sent before the FIN
+    last_rx_ms = server->adapter->mscounter;
+    state = HTTPCS_CLOSING;
+  }
+}
+
+void THttpConnection::Run()
+{
+  if (HTTPCS_IDLE == state)
+  {
+    if (socket.Connected())
+    {
+      reqlen = 0;
+      StartRequest();
+    }
+    else
+    {
+      return;
+    }
+  }
+  else if (socket.state <= TCPS_LISTEN)
+  {
+    state = HTTPCS_IDLE;  // closed or reset
+    return;
+  }
+
+  if (HTTPCS_REQUEST == state)
+  {
+    ReceiveRequest();
+  }
+  else if (HTTPCS_RESPONSE == state)
+  {
+    if (WriteSpace())
+    {
+      server->ContinueRequest(this);
+    }
+  }
+  else if (HTTPCS_CLOSING == state)
+  {
+    if (server->adapter->mscounter - last_rx_ms >= server->request_timeout_ms)
+    {
+      socket.Abort();  // the peer did not close its side
+      state = HTTPCS_IDLE;
+    }
+  }
+}
+
+//--------------------------------------------------------------
+
+bool THttpServer::Init(TIp4Handler * aiphandler, uint16_t aport)
+{
+  phandler = aiphandler;
+  adapter = phandler->adapter;
+  port = aport;
+
+  connections = (THttpConnection *)adapter->AllocateNetMem(sizeof(THttpConnection) * max_connections);
+  if (!connections)
+  {
+    TRACE("HTTP: Error allocating the connections!\r\n");
+    return false;
+  }
+
+  for (unsigned n = 0; n < max_connections; ++n)
+  {
+    new (&connections[n]) THttpConnection();
+    if (!connections[n].Init(this, n))
+    {
+      TRACE("HTTP: Error initializing the connection %u!\r\n", n);
+      max_connections = n;  // Run() must not touch the rest
+      return false;
+    }
+  }
+
+  adapter->AddHandler(this);
+  return true;
+}
+
+bool THttpServer::SetVrofs(const void * aimage)
+{
+  vrofs = nullptr;
+  vrofs_count = 0;
+
+  const TVrofsMainHead * pmh = (const TVrofsMainHead *)aimage;
+  if (!pmh || (0 != memcmp(&pmh->vrofsid[0], VROFS_ID_10, 8)) || (pmh->index_rec_bytes < 24))
+  {
+    TRACE("HTTP: invalid VROFS image\r\n");
+    return false;
+  }
+
+  vrofs_index = (const uint8_t *)aimage + pmh->main_head_bytes;
+  vrofs_data  = vrofs_index + pmh->index_block_bytes;
+  vrofs_count = pmh->index_block_bytes / pmh->index_rec_bytes;
+  vrofs = pmh;
+  return true;
+}
+
+static int vrofs_path_compare(const TVrofsIndexRec * arec, const char * apath, unsigned alen)
+{
+  const char * rpath = &arec->path[0];
+  unsigned rlen = arec->path_len;
+  if (rlen && ('/' == *rpath))
+  {
+    ++rpath;
+    --rlen;
+  }
+
+  int r = memcmp(rpath, apath, (rlen < alen ? rlen : alen));
+  if (r)
+  {
+    return r;
+  }
+  return int(rlen) - int(alen);
+}
+
+const TVrofsIndexRec * THttpServer::FindFile(const char * apath, unsigned alen)
+{
+  if (!vrofs)
+  {
+    return nullptr;
+  }
+
+  if (alen && ('/' == *apath))
+  {
+    ++apath;
+    --alen;
+  }
+
+  unsigned recsize = vrofs->index_rec_bytes;
+  if (vrofs->flags & VROFS_FLAG_ORDERED)
+  {
+    unsigned lo = 0;
+    unsigned hi = vrofs_count;
+    while (lo < hi)
+    {
+      unsigned mid = ((lo + hi) >> 1);
+      const TVrofsIndexRec * prec = (const TVrofsIndexRec *)(vrofs_index + mid * recsize);
+      int r = vrofs_path_compare(prec, apath, alen);
+      if (0 == r)
+      {
+        return prec;
+      }
+      if (r < 0)
+      {
+        lo = mid + 1;
+      }
+      else
+      {
+        hi = mid;
+      }
+    }
+  }
+  else
+  {
+    for (unsigned n = 0; n < vrofs_count; ++n)
+    {
+      const TVrofsIndexRec * prec = (const TVrofsIndexRec *)(vrofs_index + n * recsize);
+      if (0 == vrofs_path_compare(prec, apath, alen))
+      {
+        return prec;
+      }
+    }
+  }
+
+  return nullptr;
+}
+
+const uint8_t * THttpServer::FileData(const TVrofsIndexRec * arec)
+{
+  return vrofs_data + arec->offset;  // 8-byte aligned
+}
+
+const char * THttpServer::ContentType(const char * apath, unsigned alen)
+{
+  static const char * const ext_types[] =
+  {
+    "html", "text/html",
+    "htm",  "text/html",
+    "css",  "text/css",
+    "js",   "application/javascript",
+    "json", "application/json",
+    "txt",  "text/plain",
+    "svg",  "image/svg+xml",
+    "png",  "image/png",
+    "jpg",  "image/jpeg",
+    "gif",  "image/gif",
+    "ico",  "image/x-icon",
+    nullptr
+  };
+
+  const char * pext = apath + alen;
+  while ((pext > apath) && ('.' != pext[-1]) && ('/' != pext[-1]))
+  {
+    --pext;
+  }
+
+  if ((pext > apath) && ('.' == pext[-1]))
+  {
+    unsigned extlen = apath + alen - pext;
+    for (const char * const * pt = &ext_types[0]; *pt; pt += 2)
+    {
+      if (http_name_equals(pt[0], pext, extlen))
+      {
+        return pt[1];
+      }
+    }
+  }
+
+  return "application/octet-stream";
+}
+
+bool THttpServer::ServeFile(THttpConnection * pconn)
+{
+  char     fpath[VROFS_MAX_PATH_LEN + 1];
+  unsigned len = strlen(pconn->path);
+  if (len > VROFS_MAX_PATH_LEN)
+  {
+    return false;
+  }
+  memcpy(&fpath[0], pconn->path, len);
+
+  if ('/' == fpath[len - 1])
+  {
+    unsigned ilen = strlen(index_filename);
+    if (len + ilen > VROFS_MAX_PATH_LEN)
+    {
+      return false;
+    }
+    memcpy(&fpath[len], index_filename, ilen);
+    len += ilen;
+  }
+  fpath[len] = 0;
+
+  const TVrofsIndexRec * prec = FindFile(&fpath[0], len);
+  if (!prec)
+  {
+    return false;
+  }
+
+  if (!pconn->IsMethod("GET") && !pconn->IsMethod("HEAD"))
+  {
+    pconn->RespondError(405);
+    return true;
+  }
+
+  if (!pconn->StartResponse(200, ContentType(&fpath[0], len), prec->data_bytes))
+  {
+    pconn->RespondError(500);
+    return true;
+  }
+
+  if (!pconn->IsMethod("HEAD") && prec->data_bytes)
+  {
+    pconn->socket.SendRef(FileData(prec), prec->data_bytes);  // zero-copy, the socket buffer holds only the head
+  }
+
+  pconn->EndResponse();
+  return true;
+}
+
+void THttpServer::Run()
+{
+  for (unsigned n = 0; n < max_connections; ++n)
+  {
+    connections[n].Run();
+  }
+}
@@ -0,0 +1,135 @@
+/*
+ * net_http.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#ifndef NETWORK_NET_HTTP_H_
+#define NETWORK_NET_HTTP_H_
+
+#include "stdint.h"
+#include "net_ip4.h"
+#include "net_tcp4.h"
+#include "vrofs.h"
+
+#define HTTP_CHUNKED  0xFFFFFFFF  // response content length for the chunked transfer encoding
+
+#define HTTP_MAX_RESPONSE_HEAD  256  // the requests are processed only when the TX buffer has so much free space
+
+#define HTTPCS_IDLE        0  // the socket is listening
+#define HTTPCS_REQUEST     1  // receiving the request head (and body)
+#define HTTPCS_RESPONSE    2  // the application response is in progress, see THttpServer::ContinueRequest()
+#define HTTPCS_CLOSING     3  // waiting for the socket close
+
+class THttpServer;
+
+class THttpConnection
+{
+public:
+  uint8_t           state = HTTPCS_IDLE;
+  uint8_t           index = 0;
+
+  THttpServer *     server = nullptr;
+  TTcp4Socket       socket;
+
+  // the parsed request, the strings point into the request buffer and are zero terminated
+  char *            method = nullptr;
+  char *            path = nullptr;
+  char *            query = nullptr;    // after the '?', nullptr when there is no query
+  uint8_t *         body = nullptr;
+  uint32_t          body_len = 0;
+  bool              keep_alive = false;
+
+  void *            appdata = nullptr;  // free for the application response handler
+
+  bool              IsMethod(const char * amethod);
+  const char *      GetHeader(const char * aname);  // nullptr when not present
+
+  // Response, header lines can be added with the aextraheaders ("Name: value\r\n" each).
+  // With acontentlen = HTTP_CHUNKED every Write() call produces one chunk, so better to write larger blocks.
+  bool              StartResponse(unsigned astatus, const char * acontenttype, uint32_t acontentlen,
+                                  const char * aextraheaders = nullptr);
+  int               Write(const void * adata, unsigned alen);  // returns the bytes accepted (might be less)
+  int               WriteStr(const char * astr);
+  unsigned          WriteSpace();  // the Write() accepts at least so many bytes
+  void              EndResponse();  // sends the last chunk, then continues with the next request or closes
+  bool              SendError(unsigned astatus);  // complete response with a short text body
+  void              RespondError(unsigned astatus);  // SendError(), resets the connection when the response could not be queued
+
+  bool              Init(THttpServer * aserver, unsigned aindex);  // false: not enough NetMem
+  void              Run();
+
+protected:
+  char *            reqbuf = nullptr;
+  uint16_t          reqlen = 0;
+  uint16_t          head_len = 0;  // including the empty line
+  uint32_t          request_len = 0;  // head + body
+  uint32_t          last_rx_ms = 0;
+  bool              chunked = false;
+  bool              head_only = false;
+  bool              head_valid = false;
+  bool              body_too_large = false;  // the Content-Length does not fit into the request buffer
+  char *            headers = nullptr;
+  uint16_t          scan_pos = 0;  // searching the end of the head from here
+
+  void              StartRequest();
+  void              ReceiveRequest();
+  bool              ParseHead();
+  void              ProcessRequest();
+  void              FinishRequest();
+};
+
+/* HTTP/1.1 server for status pages and REST endpoints. The connection table has a fixed size,
+   every connection has its own TCP socket listening on the same port.
+   The GET and HEAD requests are served from the VROFS image (when set), the file data is sent
+   directly from the image memory, so large files do not occupy the socket TX buffer. */
+
+class THttpServer : public TProtocolHandler
+{
+public: // settings, must be set before Init()
+  uint8_t             max_connections = 4;
+  uint16_t            request_buf_size = 1024;  // head + body
+  uint16_t            rx_buf_size = 1024;       // TCP socket buffers
+  uint16_t            tx_buf_size = 2048;
+  uint32_t            keepalive_timeout_ms = 5000;
+  uint32_t            request_timeout_ms = 10000;
+  const char *        index_filename = "index.html";  // for the paths ending with '/'
+
+public:
+  TIp4Handler *       phandler = nullptr;
+  THttpConnection *   connections = nullptr;
+  uint16_t            port = 80;
+
+  const TVrofsMainHead *  vrofs = nullptr;
+
+  uint32_t            request_count = 0;
+  uint32_t            error_count = 0;  // 4xx and 5xx responses
+
+  bool                Init(TIp4Handler * aiphandler, uint16_t aport = 80);
+  bool                SetVrofs(const void * aimage);  // the memory mapped image, returns false when invalid
+
+  const TVrofsIndexRec *  FindFile(const char * apath, unsigned alen);  // the leading '/' is ignored
+  const uint8_t *         FileData(const TVrofsIndexRec * arec);
+
+  virtual void        Run();
+
+  // Override to handle the application requests (REST endpoints, generated pages).
+  // Must return true when the response was started (or completed). When it does not call the
+  // EndResponse() the ContinueRequest() will be called at every Run() until it does.
+  virtual bool        HandleRequest(THttpConnection * pconn) { return false; }
+  virtual void        ContinueRequest(THttpConnection * pconn) { pconn->EndResponse(); }
+
+  virtual const char *  ContentType(const char * apath, unsigned alen);  // by the file extension
+
+  bool                ServeFile(THttpConnection * pconn);  // returns false when the file was not found
+
+protected:
+  const uint8_t *     vrofs_index = nullptr;
+  const uint8_t *     vrofs_data = nullptr;
+  uint32_t            vrofs_count = 0;
+};
+
+const char * http_status_text(unsigned astatus);
+
+#endif /* NETWORK_NET_HTTP_H_ */
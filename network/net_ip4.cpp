@@ -8,173 +8,210 @@
 #include "string.h"
 #include "platform.h"
 #include "net_ip4.h"
+#include "net_tcp4.h"
+#include "clockcnt.h"
 #include "traces.h"
 
 uint16_t calc_ip4_header_checksum(TIp4Header * piph)
 {
-  uint32_t sum = 0;
-  uint16_t * pd16 = (uint16_t *)(piph);
-  uint16_t * pd16_end = (uint16_t *)(piph + 1);
+  uint32_t sum = net_checksum_add(0, piph, sizeof(TIp4Header));
+  sum += uint16_t(~piph->csum);  // remove the csum
 
-  while (pd16 < pd16_end)
-  {
-    sum += __builtin_bswap16(*pd16++);
-  }
-
-  sum -= __builtin_bswap16(piph->csum);  // remove the csum
-
-  //  Fold 32-bit sum to 16 bits
-  while (sum >> 16)
-  {
-    sum = (sum & 0xffff) + (sum >> 16);
-  }
+  return net_checksum_fold(sum);
+}
 
-  return __builtin_bswap16(~sum);
+uint32_t calc_ip4_pseudo_header_sum(TIp4Header * piph, uint16_t alen)
+{
+  // the two IP addresses, the protocol and the length
+  uint32_t sum = net_checksum_add(0, &piph->srcaddr[0], 8);
+  sum += __builtin_bswap16(uint16_t(piph->protocol));
+  sum += __builtin_bswap16(alen);
+  return sum;
 }
 
 uint16_t calc_udp4_checksum(TIp4Header * piph, uint16_t datalen)
 {
-  uint32_t n;
-  uint32_t sum = 0;
   TUdp4Header * pudp = PUdp4Header(piph + 1); // the UDP header comes after the IP header
-  uint16_t * pd16;
-  uint16_t * pd16_end;  // using this needs fewer registers
 
-  // add the two IP addresses first
-  pd16 = (uint16_t *)&piph->srcaddr;
-  pd16_end = pd16 + 4;
-  while (pd16 < pd16_end)
+  uint32_t sum = calc_ip4_pseudo_header_sum(piph, datalen + sizeof(TUdp4Header));
+  sum = net_checksum_add(sum, pudp, 6);  // the UDP header parts exlusive the checksum
+  sum = net_checksum_add(sum, pudp + 1, datalen);
+
+  uint16_t result = net_checksum_fold(sum);
+  if (0 == result)
   {
-    sum += __builtin_bswap16(*pd16++);
+    result = 0xFFFF;  // the zero means no checksum
   }
+  return result;
+}
+
+//--------------------------------------------------------------
+
+bool TArp4Table::Init(TIp4Handler * ahandler)
+{
+  phandler = ahandler;
+  adapter  = phandler->adapter;
 
-  sum += piph->protocol; // add the protocol as well (8-bit only)
-  sum += __builtin_bswap16(pudp->len); // add the UDP length
+  itemcount = 0;
+  lookup_count = 0;
+  miss_count = 0;
+  evict_count = 0;
+  drop_count = 0;
 
-  // add the UDP header parts exlusive the checksum
-  pd16 = (uint16_t *)pudp;
-  pd16_end = pd16 + 3;
-  while (pd16 < pd16_end)
+  firstwait = nullptr;
+  lastwait = nullptr;
+
+  // allocate the request slots, every one has its own ARP request packet
+  requests = (TArp4Request *) adapter->AllocateNetMem(sizeof(TArp4Request) * max_requests);
+  if (!requests)
   {
-    sum += __builtin_bswap16(*pd16++);
+    return false;
   }
-
-  // and then the data
-  pd16 = (uint16_t *)(pudp + 1);
-  pd16_end = pd16 + (datalen >> 1);
-  while (pd16 < pd16_end)
+  for (unsigned n = 0; n < max_requests; ++n)
   {
-    sum += __builtin_bswap16(*pd16++);
+    TArp4Request * preq = &requests[n];
+    preq->phase = 0;
+    preq->jobcnt = 0;
+    preq->firstjob = nullptr;
+    preq->lastjob = nullptr;
+    preq->syspkt = adapter->CreateSysTxPacket(64);
+    if (!preq->syspkt)
+    {
+      return false;
+    }
   }
 
-  if (datalen & 1)  // one byte remained
+  // allocate the arp table
+  items = (TArp4TableItem *) adapter->AllocateNetMem(sizeof(TArp4TableItem) * max_items);
+  if (!items)
   {
-    sum += ((*(uint8_t *)pd16) << 8);
+    return false;
   }
 
-  //  Fold 32-bit sum to 16 bits
-  while (sum >> 16)
+  // the hash table is at least twice as large as the item count for short probe sequences
+  hashbits = 1;
+  while ((1u << hashbits) < 2u * max_items)
   {
-    sum = (sum & 0xffff) + (sum >> 16);
+    ++hashbits;
   }
+  hashtable = (uint16_t *) adapter->AllocateNetMem(sizeof(uint16_t) << hashbits);
+  if (!hashtable)
+  {
+    return false;
+  }
+  memset(hashtable, 0xFF, sizeof(uint16_t) << hashbits);  // fill with ARP_HASH_EMPTY
 
-  return __builtin_bswap16(~sum);
+  return true;
 }
 
-//--------------------------------------------------------------
-
-void TArp4Table::Init(TIp4Handler * ahandler)
+TArp4TableItem * TArp4Table::FindItem(uint32_t aip)
 {
-  phandler = ahandler;
-  adapter  = phandler->adapter;
-
-  firstitem = nullptr;
-  lastitem = nullptr;
-  freelist = nullptr;
-
-  syspkt = adapter->CreateSysTxPacket(128); // actually 64 would be enough
+  unsigned mask = (1u << hashbits) - 1;
+  unsigned h = HashIndex(aip);
+  while (true)
+  {
+    uint16_t idx = hashtable[h];
+    if (ARP_HASH_EMPTY == idx)
+    {
+      return nullptr;
+    }
 
-  // allocate the arp table
-  TArp4TableItem *  items =
-      (TArp4TableItem *) phandler->adapter->AllocateNetMem(sizeof(TArp4TableItem) * max_items);
+    TArp4TableItem * item = &items[idx];
+    if (item->ipaddr.u32 == aip)
+    {
+      return item;
+    }
 
-  // fill the free list
-  for (int i = max_items - 1; i >= 0; --i)  // make it reverse to be linear in the memory (cache optimization)
-  {
-    TArp4TableItem *  item = &items[i];
-    item->next = freelist;
-    item->prev = nullptr; // not used here
-    freelist = item;
+    h = ((h + 1) & mask);
   }
 }
 
-TArp4TableItem * TArp4Table::CreateNewItem(uint8_t * amacaddr)
+void TArp4Table::RemoveFromHash(TArp4TableItem * aitem)
 {
-  TArp4TableItem *  item;
+  unsigned mask = (1u << hashbits) - 1;
+  uint16_t idx  = aitem - items;
 
-  if (freelist)
+  unsigned i = HashIndex(aitem->ipaddr.u32);
+  while (hashtable[i] != idx)
   {
-    item = freelist;
-    freelist = freelist->next;
+    i = ((i + 1) & mask);
   }
-  else
+
+  // backward shift deletion, keeps the probe sequences intact without tombstones
+  unsigned j = i;
+  while (true)
   {
-    // take the last (oldest) item
-    item = lastitem;
+    hashtable[i] = ARP_HASH_EMPTY;
 
-    lastitem = lastitem->prev;
-    if (lastitem)
-    {
-      lastitem->next = nullptr;
-    }
-    else
+    unsigned k;
+    do
     {
-      firstitem = nullptr; // (impossible case)
+      j = ((j + 1) & mask);
+      if (ARP_HASH_EMPTY == hashtable[j])
+      {
+        return;
+      }
+      k = HashIndex(items[hashtable[j]].ipaddr.u32);
     }
-  }
-
-  mac_address_copy(&item->macaddr[0], &amacaddr[0]);
+    while ((i <= j) ? ((i < k) && (k <= j)) : ((i < k) || (k <= j)));
 
-  item->prev = nullptr;
-  item->next = nullptr;
-  return item;
+    hashtable[i] = hashtable[j];
+    i = j;
+  }
 }
 
-void TArp4Table::Update(TIp4Addr * aipaddr, uint8_t * amacaddr)
+TArp4TableItem * TArp4Table::CreateNewItem(uint32_t aip)
 {
-  TArp4TableItem *  item = FindByMac(amacaddr);
+  TArp4TableItem *  item;
 
-  if (item)
+  if (itemcount < max_items)
   {
-    // just move to forward
-
-    // unchain
-    if (item->prev)   item->prev->next = item->next;
-    else              firstitem = item->next;
-
-    if (item->next)   item->next->prev = item->prev;
-    else              lastitem = item->prev;
+    item = &items[itemcount];
+    ++itemcount;
   }
   else
   {
-    item = CreateNewItem(amacaddr);
-  }
+    // replace the least recently used item
+    uint32_t now = adapter->mscounter;
+    item = &items[0];
+    for (unsigned n = 1; n < itemcount; ++n)
+    {
+      if (now - items[n].timestamp_ms > now - item->timestamp_ms)
+      {
+        item = &items[n];
+      }
+    }
 
-  item->ipaddr.CopyFrom16(aipaddr);
+    RemoveFromHash(item);
+    ++evict_count;
+  }
 
-  // add as first
+  item->ipaddr.u32 = aip;
 
-  item->next = firstitem;
-  item->prev = nullptr;
-  if (firstitem)
+  unsigned mask = (1u << hashbits) - 1;
+  unsigned h = HashIndex(aip);
+  while (ARP_HASH_EMPTY != hashtable[h])
   {
-    firstitem->prev = item;
+    h = ((h + 1) & mask);
   }
-  firstitem = item;
-  if (!lastitem)
+  hashtable[h] = item - items;
+
+  return item;
+}
+
+void TArp4Table::Update(TIp4Addr * aipaddr, uint8_t * amacaddr)
+{
+  TIp4Addr  laddr;
+  laddr.CopyFrom16(aipaddr);  // the source might be unaligned
+
+  TArp4TableItem *  item = FindItem(laddr.u32);
+  if (!item)
   {
-    lastitem = item;
+    item = CreateNewItem(laddr.u32);
   }
+
+  mac_address_copy(&item->macaddr[0], &amacaddr[0]);
+  item->timestamp_ms = adapter->mscounter;
 }
 
 TArp4TableItem * TArp4Table::FindByIp(PIp4Addr paddr)
@@ -182,30 +219,31 @@ TArp4TableItem * TArp4Table::FindByIp(PIp4Addr paddr)
   // copy the IP address locally for handling unaligned
   TIp4Addr  laddr;
   laddr.CopyFrom16(paddr);
-  TArp4TableItem *  item = firstitem;
-  while (item)
+
+  ++lookup_count;
+  TArp4TableItem *  item = FindItem(laddr.u32);
+  if (item)
   {
-    if (item->ipaddr.u32 == laddr.u32)
-    {
-      return item;
-    }
-    item = item->next;
+    item->timestamp_ms = adapter->mscounter;
   }
-  return nullptr;
+  else
+  {
+    ++miss_count;
+  }
+  return item;
 }
 
 TArp4TableItem * TArp4Table::FindByMac(uint8_t * amacaddr)
 {
-  TArp4TableItem *  item = firstitem;
-  while (item)
+  for (unsigned n = 0; n < itemcount; ++n)
   {
+    TArp4TableItem *  item = &items[n];
     if (    (*(uint16_t *)&item->macaddr[0] == *(uint16_t *)&amacaddr[0])
          && (*(uint16_t *)&item->macaddr[2] == *(uint16_t *)&amacaddr[2])
          && (*(uint16_t *)&item->macaddr[4] == *(uint16_t *)&amacaddr[4]) )
     {
       return item;
     }
-    item = item->next;
   }
   return nullptr;
 }
@@ -218,9 +256,12 @@ bool TArp4Table::SendWithArp(TPacketMem * pmem, PIp4Addr paddr)
     // update the destination MAC (this is the first field)
     mac_address_copy(&pmem->data[0], &arpitem->macaddr[0]);
 
+    NET_STAT_INC(adapter, arp_hits);
     return adapter->SendTxPacket(pmem);
   }
 
+  NET_STAT_INC(adapter, arp_misses);
+
   // add to the jobs
 
   // copy the IP in an unaligned safe way (the source IP might be unaligned):
@@ -228,19 +269,124 @@ bool TArp4Table::SendWithArp(TPacketMem * pmem, PIp4Addr paddr)
 
   pmem->next = nullptr;
 
-  if (lastjob)
+  uint32_t ip = *(uint32_t *)&pmem->extra[0];
+  TArp4Request * preq = FindRequest(ip);
+  if (!preq)
   {
-    lastjob->next = pmem;
+    preq = AllocateRequest(ip);
   }
-  else
+
+  bool result = true;
+  if (preq)
   {
-    firstjob = pmem;
+    result = AddRequestJob(preq, pmem);
   }
+  else  // all request slots are busy, wait for a free one
+  {
+    // the same limit applies to the waiting packets of one address
+    unsigned waitcnt = 0;
+    for (TPacketMem * pwait = firstwait; pwait; pwait = pwait->next)
+    {
+      if (*(uint32_t *)&pwait->extra[0] == ip)
+      {
+        ++waitcnt;
+      }
+    }
 
-  lastjob = pmem;
+    if (waitcnt >= max_request_jobs)
+    {
+      ++drop_count;
+      adapter->ReleaseTxPacket(pmem);
+      result = false;
+    }
+    else
+    {
+      if (lastwait)
+      {
+        lastwait->next = pmem;
+      }
+      else
+      {
+        firstwait = pmem;
+      }
+      lastwait = pmem;
+    }
+  }
 
   Run();
 
+  return result;
+}
+
+bool TArp4Table::Resolve(PIp4Addr paddr)
+{
+  if (FindByIp(paddr))
+  {
+    return true;
+  }
+
+  TIp4Addr  laddr;
+  laddr.CopyFrom16(paddr);
+  if (!FindRequest(laddr.u32) && AllocateRequest(laddr.u32))
+  {
+    Run();  // sends the request
+  }
+
+  return false;
+}
+
+TArp4Request * TArp4Table::FindRequest(uint32_t aip)
+{
+  for (unsigned n = 0; n < max_requests; ++n)
+  {
+    TArp4Request * preq = &requests[n];
+    if (preq->phase && (preq->ipaddr.u32 == aip))
+    {
+      return preq;
+    }
+  }
+  return nullptr;
+}
+
+TArp4Request * TArp4Table::AllocateRequest(uint32_t aip)
+{
+  for (unsigned n = 0; n < max_requests; ++n)
+  {
+    TArp4Request * preq = &requests[n];
+    if (0 == preq->phase)
+    {
+      preq->ipaddr.u32 = aip;
+      preq->jobcnt = 0;
+      preq->firstjob = nullptr;
+      preq->lastjob = nullptr;
+      preq->phase = 1;  // send the request
+      return preq;
+    }
+  }
+  return nullptr;
+}
+
+bool TArp4Table::AddRequestJob(TArp4Request * preq, TPacketMem * pmem)
+{
+  if (preq->jobcnt >= max_request_jobs)
+  {
+    // do not let a dead host to consume all the TX packets
+    ++drop_count;
+    adapter->ReleaseTxPacket(pmem);
+    return false;
+  }
+
+  pmem->next = nullptr;
+  if (preq->lastjob)
+  {
+    preq->lastjob->next = pmem;
+  }
+  else
+  {
+    preq->firstjob = pmem;
+  }
+  preq->lastjob = pmem;
+  ++preq->jobcnt;
   return true;
 }
 
@@ -259,15 +405,47 @@ bool TArp4Table::ProcessArpResponse(TPacketMem * pmem)
 
 void TArp4Table::Run()
 {
-  TPacketMem * pmem = firstjob;
-  if (!pmem)
+  TPacketMem *    pmem;
+  TArp4Request *  preq;
+
+  // assign the waiting packets to request slots
+  while (firstwait)
   {
-    return;
+    pmem = firstwait;
+    uint32_t ip = *(uint32_t *)&pmem->extra[0];
+    preq = FindRequest(ip);
+    if (!preq)
+    {
+      preq = AllocateRequest(ip);
+      if (!preq)
+      {
+        break;  // still no free slot
+      }
+    }
+
+    firstwait = firstwait->next;
+    if (!firstwait)  lastwait = nullptr;
+
+    AddRequestJob(preq, pmem);
+  }
+
+  for (unsigned n = 0; n < max_requests; ++n)
+  {
+    preq = &requests[n];
+    if (preq->phase)
+    {
+      RunRequest(preq);
+    }
   }
+}
+
+void TArp4Table::RunRequest(TArp4Request * preq)
+{
+  TPacketMem * syspkt = preq->syspkt;
 
-  if (0 == phase)  // prepare the request
+  if (1 == preq->phase)  // prepare the request
   {
-    //TRACE("%u Start ARP %d.%d.%d.%d\r\n", adapter->mscounter, pmem->extra[0], pmem->extra[1], pmem->extra[2], pmem->extra[3]);
+    //TRACE("%u Start ARP %d.%d.%d.%d\r\n", adapter->mscounter, preq->ipaddr.u8[0], preq->ipaddr.u8[1], preq->ipaddr.u8[2], preq->ipaddr.u8[3]);
 
     PEthernetHeader txeh = PEthernetHeader(&syspkt->data[0]);
     PArpHeader      parp = PArpHeader(txeh + 1);
@@ -289,7 +467,7 @@ void TArp4Table::Run()
     for (n = 0; n < 4; ++n)
     {
       parp->spa[n] = phandler->ipaddress.u8[n];
-      parp->tpa[n] = pmem->extra[n]; // the required address is copied to here
+      parp->tpa[n] = preq->ipaddr.u8[n];
     }
 
     txeh->ethertype = 0x0608; // ARP, byte swapped
@@ -303,88 +481,85 @@ void TArp4Table::Run()
     syspkt->datalen = sizeof(TEthernetHeader) + sizeof(TArpHeader);
 
     adapter->SendTxPacket(syspkt);
-    start_ms = adapter->mscounter;
+    preq->start_ms = adapter->mscounter;
 
-    trycnt = 1; // reset the try count
-    phase = 1;  // wait until it is sent
+    preq->trycnt = 1; // reset the try count
+    preq->phase = 2;  // wait until it is sent
   }
-  else if (1 == phase) // wait until the packet is sent
+  else if (2 == preq->phase) // wait until the packet is sent
   {
     if (0 == syspkt->status)
     {
-      phase = 5; // wait for the resolution (with the ARP response)
+      preq->phase = 5; // wait for the resolution (with the ARP response)
     }
-    else if (adapter->mscounter - start_ms > response_timeout_ms)
+    else if (adapter->mscounter - preq->start_ms > response_timeout_ms)
     {
       // something is very wrong!
       //TRACE("%u Timeout sending ARP request!\r\n", adapter->mscounter);
-      phase = 9; // re-sending
+      preq->phase = 9; // re-sending
     }
   }
-  else if (5 == phase) // check if the ip is resolved
+  else if (5 == preq->phase) // check if the ip is resolved
   {
-    PIp4Addr paddr = PIp4Addr(&pmem->extra[0]);
-    TArp4TableItem * arpitem = FindByIp(paddr);
+    TArp4TableItem * arpitem = FindItem(preq->ipaddr.u32);
     if (arpitem)
     {
-      //TRACE("%u ARP %d.%d.%d.%d resolved, continue sending...\r\n", adapter->mscounter, pmem->extra[0], pmem->extra[1], pmem->extra[2], pmem->extra[3]);
+      //TRACE("%u ARP %d.%d.%d.%d resolved, continue sending...\r\n", adapter->mscounter, preq->ipaddr.u8[0], preq->ipaddr.u8[1], preq->ipaddr.u8[2], preq->ipaddr.u8[3]);
 
-      // the address is resolved!, we can finish this job!
-      // update the destination MAC (this is the first field
-      mac_address_copy(&pmem->data[0], &arpitem->macaddr[0]);
-
-      FinishJob(true); // finish the job sending the packet
-
-      phase = 0;  // go to the next job
+      // the address is resolved!, we can finish this request
+      FinishRequest(preq, arpitem);
     }
-    else if (adapter->mscounter - start_ms > response_timeout_ms) // repeat on timeout
+    else if (adapter->mscounter - preq->start_ms > response_timeout_ms) // repeat on timeout
     {
-      phase = 9; // repeat the request
+      preq->phase = 9; // repeat the request
     }
   }
-  else if (9 == phase)
+  else if (9 == preq->phase)
   {
-    if (trycnt >= max_tries)
+    if (preq->trycnt >= max_tries)
     {
-      FinishJob(false); // give up, free the packet
-
-      phase = 0;  // go to the next
+      FinishRequest(preq, nullptr); // give up, free the packets
     }
     else // try again
     {
       //TRACE("%u re-trying ARP...\r\n", adapter->mscounter);
 
-      ++trycnt;
+      ++preq->trycnt;
       adapter->SendTxPacket(syspkt);
-      start_ms = adapter->mscounter;
-      phase = 1; // wait until it is sent
+      preq->start_ms = adapter->mscounter;
+      preq->phase = 2; // wait until it is sent
     }
   }
 }
 
-void TArp4Table::FinishJob(bool asend)
+void TArp4Table::FinishRequest(TArp4Request * preq, TArp4TableItem * aarpitem)
 {
-  TPacketMem * pmem = firstjob;
-  if (!pmem)
-  {
-    return;
-  }
-
   // warning: unchain required first
-  firstjob = firstjob->next;
-  if (!firstjob)  lastjob = nullptr;
+  TPacketMem * pmem = preq->firstjob;
+  preq->firstjob = nullptr;
+  preq->lastjob = nullptr;
+  preq->jobcnt = 0;
+  preq->phase = 0;  // free the slot
 
-  if (asend)
+  while (pmem)
   {
-    adapter->SendTxPacket(pmem);
-  }
-  else
-  {
-    adapter->ReleaseTxPacket(pmem);
+    TPacketMem * nextpmem = pmem->next;
+    if (aarpitem)
+    {
+      // update the destination MAC (this is the first field)
+      mac_address_copy(&pmem->data[0], &aarpitem->macaddr[0]);
+      adapter->SendTxPacket(pmem);
+    }
+    else
+    {
+      ++drop_count;
+      NET_STAT_INC(adapter, arp_drops);
+      adapter->ReleaseTxPacket(pmem);
+    }
+    pmem = nextpmem;
   }
 }
 
-
 //--------------------------------------------------------------
 
 void TUdp4Socket::Init(TIp4Handler * ahandler, uint16_t alistenport)
@@ -428,60 +603,43 @@ void mem_copy_32(void * adst, void * asrc, unsigned acount)
   }
 }
 
-int TUdp4Socket::Send(void * adataptr, unsigned adatalen)
+TPacketMem * TUdp4Socket::AllocateTxPacket(uint8_t * * rdataptr, unsigned amaxdatalen)
 {
-  TPacketMem * pmem;
-
-  if (adatalen > sizeof(pmem->data) - (sizeof(TIp4Header) + sizeof(TUdp4Header) + sizeof(TEthernetHeader)))
+  TPacketMem * pmem = phandler->adapter->AllocateTxPacket(sizeof(TEthernetHeader) + sizeof(TIp4Header) + sizeof(TUdp4Header) + amaxdatalen);
+  if (pmem)
   {
-    return -1;
+    // the headers will be filled at SendTxPacket()
+    *rdataptr = &pmem->data[sizeof(TEthernetHeader) + sizeof(TIp4Header) + sizeof(TUdp4Header)];  // only 2-bytes aligned !
   }
+  return pmem;
+}
 
-  pmem = phandler->adapter->AllocateTxPacket();
-  if (!pmem)
+void TUdp4Socket::ReleaseTxPacket(TPacketMem * pmem)
+{
+  phandler->adapter->ReleaseTxPacket(pmem);
+}
+
+int TUdp4Socket::SendTxPacket(TPacketMem * pmem, unsigned adatalen)
+{
+  if (adatalen + sizeof(TEthernetHeader) + sizeof(TIp4Header) + sizeof(TUdp4Header) > pmem->max_datalen)
   {
-    return 0;  // no free packet !
+    phandler->adapter->ReleaseTxPacket(pmem);
+    return -1;
   }
 
-  // assemble the UDP packet
+  // fill the headers only, the payload is already in place
   PEthernetHeader eh    = PEthernetHeader(&pmem->data[0]);  // 14 bytes
   PIp4Header      iph   = PIp4Header(eh + 1);               // 20 bytes
   PUdp4Header     udph  = PUdp4Header(iph + 1);             //  8 bytes
-  uint8_t *       pdata = (uint8_t *)(udph + 1);            // pdata is only 2-bytes aligned !
 
   eh->ethertype = 0x0008; // ether type: 0x0800 = IPV4 (byte swapped)
 
   #if MCU_NO_UNALIGNED
-
     mem_copy_16(&iph->srcaddr[0], &phandler->ipaddress, 2);
     mem_copy_16(&iph->dstaddr[0], &destaddr, 2);
-
-    if (0 == (unsigned(adataptr) & 1)) // src is 16-bit aligned ?
-    {
-      mem_copy_16(pdata, adataptr, (adatalen + 1) >> 1);
-    }
-    else
-    {
-      mem_copy_8(pdata, adataptr, adatalen);
-    }
-
   #else
-
     *PIp4Addr(&iph->srcaddr[0]) = phandler->ipaddress;
     *PIp4Addr(&iph->dstaddr[0]) = destaddr;
-
-    // COPY the buffer
-
-    // fast copy using 4-byte moves (memcpy is slow)
-    unsigned dwcnt = ((adatalen + 3) >> 2);
-    uint32_t * pdst = (uint32_t *)pdata;
-    uint32_t * pdst_end = pdst + dwcnt;
-    uint32_t * psrc = (uint32_t *)adataptr;
-    while (pdst < pdst_end)
-    {
-      *pdst++ = *psrc++;
-    }
-
   #endif
 
   ++idcounter;
@@ -501,9 +659,14 @@ int TUdp4Socket::Send(void * adataptr, unsigned adatalen)
   udph->len   = __builtin_bswap16(adatalen + sizeof(TUdp4Header));
   udph->csum  = 0;
 
-  // UDP checksum is optional, this takes a long time so it is turned off now
-  //  udph->csum  = calc_udp4_checksum(iph, adatalen);
-
+  if (phandler->adapter->peth->hw_ip_checksum)
+  {
+    iph->csum = 0;  // the MAC inserts the checksums, the fields must be 0
+  }
+  else if (tx_checksum)
+  {
+    udph->csum  = calc_udp4_checksum(iph, adatalen);
+  }
 
   pmem->datalen = adatalen + sizeof(TIp4Header) + sizeof(TUdp4Header) + sizeof(TEthernetHeader);
 
@@ -515,137 +678,843 @@ int TUdp4Socket::Send(void * adataptr, unsigned adatalen)
   return adatalen;
 }
 
-int TUdp4Socket::Receive(void * adataptr, unsigned adatalen)
+int TUdp4Socket::Send(void * adataptr, unsigned adatalen)
 {
-  int err = 0;
+  TPacketMem * pmem;
+  uint8_t *    pdata;  // pdata is only 2-bytes aligned !
 
-  TPacketMem * pmem = rxpkt_first;
-  if (!pmem)
+  if (adatalen > UDP4_MAX_DATALEN)
   {
-    return 0;
+    return SendFragmented(adataptr, adatalen);
   }
 
-  PEthernetHeader eh    = PEthernetHeader(&pmem->data[0]);
-  PIp4Header      iph   = PIp4Header(eh + 1);
-  PUdp4Header     udph  = PUdp4Header(iph + 1);
-  uint8_t *       pdata = (uint8_t *)(udph + 1);
-
-  uint16_t dlen = __builtin_bswap16(udph->len) - sizeof(TUdp4Header);
-  if (dlen > adatalen)
+  pmem = AllocateTxPacket(&pdata, adatalen);
+  if (!pmem)
   {
-    err = -1;
+    return 0;  // no free packet !
   }
-  else
-  {
-    err = dlen;
 
-    // copy the data
-    #if MCU_NO_UNALIGNED
-      if (0 == (unsigned(adataptr) & 1)) // dst is 16-bit aligned ?
-      {
-        mem_copy_16(adataptr, pdata, (adatalen + 1) >> 1);
-      }
-      else
-      {
-        mem_copy_8(adataptr, pdata, adatalen);
-      }
-    #else
-      mem_copy_32(adataptr, pdata, (adatalen + 3) >> 2);
-    #endif
-  }
+  // COPY the buffer, not a byte more: the packet might come from a smaller pool with a tight buffer
 
-  srcaddr.CopyFrom16(&iph->srcaddr[0]);
-  srcport = __builtin_bswap16(udph->sport);
+  #if MCU_NO_UNALIGNED
 
-  // unchain the pmem first
-  rxpkt_first = rxpkt_first->next;
-  if (!rxpkt_first)  rxpkt_last = nullptr;
+    if (0 == (unsigned(adataptr) & 1)) // src is 16-bit aligned ?
+    {
+      mem_copy_16(pdata, adataptr, adatalen >> 1);
+      if (adatalen & 1)
+      {
+        pdata[adatalen - 1] = ((uint8_t *)adataptr)[adatalen - 1];
+      }
+    }
+    else
+    {
+      mem_copy_8(pdata, adataptr, adatalen);
+    }
+
+  #else
+
+    // fast copy using 4-byte moves (memcpy is slow)
+    unsigned dwcnt = (adatalen >> 2);
+    uint32_t * pdst = (uint32_t *)pdata;
+    uint32_t * pdst_end = pdst + dwcnt;
+    uint32_t * psrc = (uint32_t *)adataptr;
+    while (pdst < pdst_end)
+    {
+      *pdst++ = *psrc++;
+    }
+
+    // the remaining 0..3 bytes
+    uint8_t * pdst8 = (uint8_t *)pdst;
+    uint8_t * psrc8 = (uint8_t *)psrc;
+    uint8_t * pdst8_end = pdata + adatalen;
+    while (pdst8 < pdst8_end)
+    {
+      *pdst8++ = *psrc8++;
+    }
+
+  #endif
+
+  return SendTxPacket(pmem, adatalen);
+}
+
+int TUdp4Socket::SendFragmented(void * adataptr, unsigned adatalen)
+{
+  if (adatalen > UDP4_MAX_FRAG_DATALEN)
+  {
+    return -1;
+  }
+
+  TNetAdapter * adapter = phandler->adapter;
+  unsigned      iplen = adatalen + sizeof(TUdp4Header);  // the whole IP payload
+  unsigned      fragcnt = (iplen + IP4_FRAG_DATALEN - 1) / IP4_FRAG_DATALEN;
+  unsigned      n;
+  TPacketMem *  pmem;
+
+  // only arptable.max_request_jobs fragments can wait for the address resolution,
+  // so longer datagrams go only to resolved addresses (the resolution is started here)
+  if ((fragcnt > phandler->arptable.max_request_jobs) && !phandler->ResolveNextHop(&destaddr))
+  {
+    ++phandler->frag_tx_fail_count;
+    return 0;  // try again later
+  }
+
+  // allocate all the fragments first, the datagram is sent completely or not at all
+  TPacketMem *  firstpkt = nullptr;
+  TPacketMem *  lastpkt = nullptr;
+  for (n = 0; n < fragcnt; ++n)
+  {
+    pmem = adapter->AllocateTxPacket();
+    if (!pmem)
+    {
+      while (firstpkt)
+      {
+        pmem = firstpkt;
+        firstpkt = firstpkt->next;
+        adapter->ReleaseTxPacket(pmem);
+      }
+      ++phandler->frag_tx_fail_count;
+      return 0;  // not enough free packets
+    }
+
+    pmem->next = nullptr;
+    if (lastpkt)  lastpkt->next = pmem;
+    else          firstpkt = pmem;
+    lastpkt = pmem;
+  }
+
+  ++idcounter;
+
+  // fill the fragments, the UDP checksum is calculated over the fragment payloads
+  // (fragment boundaries are at 8 byte multiples, so the partial sums can be simply added)
+
+  PIp4Header   firstiph = PIp4Header(&firstpkt->data[sizeof(TEthernetHeader)]);
+  PUdp4Header  udph = PUdp4Header(firstiph + 1);
+  uint32_t     csum = 0;
+  uint8_t *    psrc = (uint8_t *)adataptr;
+  unsigned     offs = 0;
+
+  pmem = firstpkt;
+  while (pmem)
+  {
+    PEthernetHeader eh  = PEthernetHeader(&pmem->data[0]);
+    PIp4Header      iph = PIp4Header(eh + 1);
+    uint8_t *       pdata = (uint8_t *)(iph + 1);  // only 2-bytes aligned !
+    unsigned        fraglen = iplen - offs;
+    if (fraglen > IP4_FRAG_DATALEN)  fraglen = IP4_FRAG_DATALEN;
+
+    eh->ethertype = 0x0008; // ether type: 0x0800 = IPV4 (byte swapped)
+
+    #if MCU_NO_UNALIGNED
+      mem_copy_16(&iph->srcaddr[0], &phandler->ipaddress, 2);
+      mem_copy_16(&iph->dstaddr[0], &destaddr, 2);
+    #else
+      *PIp4Addr(&iph->srcaddr[0]) = phandler->ipaddress;
+      *PIp4Addr(&iph->dstaddr[0]) = destaddr;
+    #endif
+
+    iph->hl_v = 0x45;
+    iph->tos = 0;
+    iph->len = __builtin_bswap16(fraglen + sizeof(TIp4Header));
+    iph->id = __builtin_bswap16(idcounter);
+    iph->fl_offs = __builtin_bswap16((pmem->next ? 0x2000 : 0) | (offs >> 3));  // MF flag + offset
+    iph->ttl = 64;
+    iph->protocol = 17;
+    iph->csum = 0;
+    if (!adapter->peth->hw_ip_checksum)
+    {
+      iph->csum = calc_ip4_header_checksum(iph);
+    }
+
+    unsigned copylen = fraglen;
+    if (0 == offs)  // the first fragment carries the UDP header
+    {
+      pdata += sizeof(TUdp4Header);
+      copylen -= sizeof(TUdp4Header);
+    }
+
+    memcpy(pdata, psrc, copylen);
+    if (tx_checksum)
+    {
+      csum = net_checksum_add(csum, pdata, copylen);
+    }
+    psrc += copylen;
+
+    pmem->datalen = fraglen + sizeof(TIp4Header) + sizeof(TEthernetHeader);
+
+    offs += fraglen;
+    pmem = pmem->next;
+  }
+
+  udph->sport = __builtin_bswap16(listenport);
+  udph->dport = __builtin_bswap16(destport);
+  udph->len   = __builtin_bswap16(iplen);
+  udph->csum  = 0;
+  if (tx_checksum)  // the MAC can not insert the checksum into fragmented datagrams
+  {
+    csum += calc_ip4_pseudo_header_sum(firstiph, iplen);
+    csum = net_checksum_add(csum, udph, 6);
+    udph->csum = net_checksum_fold(csum);
+    if (0 == udph->csum)
+    {
+      udph->csum = 0xFFFF;
+    }
+  }
+
+  // send the fragments, the rest is not sent when one of them was dropped
+  while (firstpkt)
+  {
+    pmem = firstpkt;
+    firstpkt = firstpkt->next;  // the sending uses the next field
+    if (!phandler->SendWithRouting(pmem))
+    {
+      while (firstpkt)
+      {
+        pmem = firstpkt;
+        firstpkt = firstpkt->next;
+        adapter->ReleaseTxPacket(pmem);
+      }
+      ++phandler->frag_tx_fail_count;
+      return -1;
+    }
+  }
+
+  ++phandler->frag_tx_count;
+
+  return adatalen;
+}
+
+bool TUdp4Socket::ReceiveRef(uint8_t * * rdataptr, unsigned * rdatalen)
+{
+  TPacketMem * pmem = rxpkt_first;
+  if (!pmem)
+  {
+    return false;
+  }
+
+  PEthernetHeader eh    = PEthernetHeader(&pmem->data[0]);
+  PIp4Header      iph   = PIp4Header(eh + 1);
+  PUdp4Header     udph  = PUdp4Header(iph + 1);
+
+  *rdataptr = (uint8_t *)(udph + 1);  // pdata is only 2-bytes aligned !
+
+  srcaddr.CopyFrom16(&iph->srcaddr[0]);
+  srcport = __builtin_bswap16(udph->sport);
+
+  *rdatalen = __builtin_bswap16(udph->len) - sizeof(TUdp4Header);
+
+  // the packet stays in the rx chain (with PMEMFLAG_KEEP) until ReleaseRx()
+  return true;
+}
+
+void TUdp4Socket::ReleaseRx()
+{
+  TPacketMem * pmem = rxpkt_first;
+  if (!pmem)
+  {
+    return;
+  }
+
+  // unchain the pmem first
+  rxpkt_first = rxpkt_first->next;
+  if (!rxpkt_first)  rxpkt_last = nullptr;
 
   // release the packet !
   phandler->adapter->ReleaseRxPacket(pmem);
+}
+
+int TUdp4Socket::Receive(void * adataptr, unsigned adatalen)
+{
+  int err = 0;
+
+  uint8_t * pdata;
+  unsigned  dlen;
+  if (!ReceiveRef(&pdata, &dlen))
+  {
+    return 0;
+  }
+
+  if (dlen > adatalen)
+  {
+    err = -1;
+  }
+  else
+  {
+    err = dlen;
+
+    // copy the data
+    #if MCU_NO_UNALIGNED
+      if (0 == (unsigned(adataptr) & 1)) // dst is 16-bit aligned ?
+      {
+        mem_copy_16(adataptr, pdata, (dlen + 1) >> 1);
+      }
+      else
+      {
+        mem_copy_8(adataptr, pdata, dlen);
+      }
+    #else
+      mem_copy_32(adataptr, pdata, (dlen + 3) >> 2);
+    #endif
+  }
+
+  ReleaseRx();
 
   return err;
 }
 
-void TUdp4Socket::AddRxPacket(TPacketMem * pmem)
-{
-  pmem->flags = PMEMFLAG_KEEP; // do not release this packet until it is processed !
-  pmem->next = nullptr;
-  if (rxpkt_last)
+bool TUdp4Socket::JoinGroup(TIp4Addr * agroup)
+{
+  return phandler->JoinGroup(agroup);
+}
+
+void TUdp4Socket::LeaveGroup(TIp4Addr * agroup)
+{
+  phandler->LeaveGroup(agroup);
+}
+
+void TUdp4Socket::AddRxPacket(TPacketMem * pmem)
+{
+  pmem->flags |= PMEMFLAG_KEEP; // do not release this packet until it is processed !
+  pmem->next = nullptr;
+  if (rxpkt_last)
+  {
+    rxpkt_last->next = pmem;
+  }
+  else
+  {
+    rxpkt_first = pmem;
+  }
+  rxpkt_last = pmem;
+}
+
+
+//--------------------------------------------------------------
+
+bool TIp4Handler::Init(TNetAdapter * aadapter)
+{
+  adapter = aadapter;
+
+  udp_first = nullptr;
+  udp_last  = nullptr;
+
+  tcp_first = nullptr;
+  tcp_last  = nullptr;
+
+  if (!arptable.Init(this))
+  {
+    TRACE("IP4: Error allocating the ARP table!\r\n");
+    return false;
+  }
+
+  syspkt = adapter->AllocateTxPacket();  // reserve one TX packet for system purposes
+
+  // UDP demultiplexer hash table, at most 50% load
+  udp_hashcount = 0;
+  udp_unhashed = 0;
+  udp_hashbits = 1;
+  while ((1u << udp_hashbits) < 2u * udp_max_sockets)
+  {
+    ++udp_hashbits;
+  }
+  udp_hashtable = (TUdp4Socket **) adapter->AllocateNetMem(sizeof(TUdp4Socket *) << udp_hashbits);
+  if (udp_hashtable)
+  {
+    memset(udp_hashtable, 0, sizeof(TUdp4Socket *) << udp_hashbits);
+  }
+  else
+  {
+    udp_max_sockets = 0;  // list scan only
+  }
+
+  reasm_ok_count = 0;
+  reasm_timeout_count = 0;
+  reasm_nomem_count = 0;
+  reasm_toobig_count = 0;
+  reasm_overlap_count = 0;
+  reasm_error_count = 0;
+  frag_tx_count = 0;
+  frag_tx_fail_count = 0;
+
+  mcast_drop_count = 0;
+  mcgroups = nullptr;
+  if (max_mcast_groups)
+  {
+    mcgroups = (TIp4McGroup *)adapter->AllocateNetMem(sizeof(TIp4McGroup) * max_mcast_groups);
+    mcmaclist = adapter->AllocateNetMem(((6 * (max_mcast_groups + 1)) + 3) & ~3);  // +1: all hosts group
+    if (mcgroups && mcmaclist)
+    {
+      memset(mcgroups, 0, sizeof(TIp4McGroup) * max_mcast_groups);
+    }
+    else
+    {
+      max_mcast_groups = 0;
+    }
+  }
+
+  reasm = nullptr;
+  if (reasm_slots)
+  {
+    reasm_max_datalen &= ~7;
+    unsigned mapsize = ((reasm_max_datalen / 8 + 31) / 32) * 4;
+    unsigned pktsize = ((sizeof(TEthernetHeader) + sizeof(TIp4Header) + reasm_max_datalen + 3) & ~3);
+
+    reasm = (TIp4ReasmSlot *)adapter->AllocateNetMem(sizeof(TIp4ReasmSlot) * reasm_slots);
+    if (!reasm)
+    {
+      reasm_slots = 0;
+    }
+
+    for (unsigned n = 0; n < reasm_slots; ++n)
+    {
+      TIp4ReasmSlot * pslot = &reasm[n];
+      pslot->blockmap = (uint32_t *)adapter->AllocateNetMem(mapsize);
+      pslot->pmem = adapter->CreateSysTxPacket(pktsize);  // can be larger than a normal packet
+      if (!pslot->blockmap || !pslot->pmem)
+      {
+        reasm_slots = n;
+        break;
+      }
+      pslot->pmem->status = 0;
+    }
+  }
+
+  adapter->AddHandler(this);
+  return true;
+}
+
+void TIp4Handler::AddUdpSocket(TUdp4Socket * audp)
+{
+  if (udp_last)
+  {
+    udp_last->nextsocket = audp;
+  }
+  else
+  {
+    udp_first = audp;
+  }
+  udp_last = audp;
+
+  audp->nextsocket = nullptr;
+
+  if (udp_hashcount < udp_max_sockets)
+  {
+    unsigned mask = (1u << udp_hashbits) - 1;
+    unsigned h = UdpHashIndex(audp->listenport);
+    while (udp_hashtable[h])
+    {
+      h = ((h + 1) & mask);
+    }
+    udp_hashtable[h] = audp;
+    ++udp_hashcount;
+  }
+  else
+  {
+    ++udp_unhashed;
+  }
+}
+
+void TIp4Handler::RemoveUdpSocket(TUdp4Socket * audp)
+{
+  // unchain from the list
+  TUdp4Socket * prev = nullptr;
+  TUdp4Socket * udp = udp_first;
+  while (udp && (udp != audp))
+  {
+    prev = udp;
+    udp = udp->nextsocket;
+  }
+
+  if (!udp)
+  {
+    return;  // not registered
+  }
+
+  if (prev)  prev->nextsocket = audp->nextsocket;
+  else       udp_first = audp->nextsocket;
+  if (udp_last == audp)  udp_last = prev;
+
+  audp->nextsocket = nullptr;
+
+  if (RemoveUdpFromHash(audp))
+  {
+    --udp_hashcount;
+  }
+  else if (udp_unhashed)
+  {
+    --udp_unhashed;
+  }
+
+  while (audp->rxpkt_first)
+  {
+    audp->ReleaseRx();
+  }
+}
+
+bool TIp4Handler::RemoveUdpFromHash(TUdp4Socket * audp)
+{
+  if (!udp_hashcount)
+  {
+    return false;
+  }
+
+  unsigned mask = (1u << udp_hashbits) - 1;
+  unsigned i = UdpHashIndex(audp->listenport);
+  while (udp_hashtable[i] != audp)
+  {
+    if (!udp_hashtable[i])
+    {
+      return false;  // only in the list
+    }
+    i = ((i + 1) & mask);
+  }
+
+  // backward shift deletion, like at the ARP table
+  unsigned j = i;
+  while (true)
+  {
+    udp_hashtable[i] = nullptr;
+
+    unsigned k;
+    do
+    {
+      j = ((j + 1) & mask);
+      if (!udp_hashtable[j])
+      {
+        return true;
+      }
+      k = UdpHashIndex(udp_hashtable[j]->listenport);
+    }
+    while ((i <= j) ? ((i < k) && (k <= j)) : ((i < k) || (k <= j)));
+
+    udp_hashtable[i] = udp_hashtable[j];
+    i = j;
+  }
+}
+
+TUdp4Socket * TIp4Handler::FindUdpSocket(uint16_t aport)
+{
+  if (udp_hashcount)
+  {
+    unsigned mask = (1u << udp_hashbits) - 1;
+    unsigned h = UdpHashIndex(aport);
+    TUdp4Socket * udp;
+    while (nullptr != (udp = udp_hashtable[h]))
+    {
+      if (udp->listenport == aport)
+      {
+        return udp;
+      }
+      h = ((h + 1) & mask);
+    }
+  }
+
+  if (udp_unhashed)  // slow path, when there are more sockets than udp_max_sockets
+  {
+    TUdp4Socket * udp = udp_first;
+    while (udp)
+    {
+      if (udp->listenport == aport)
+      {
+        return udp;
+      }
+      udp = udp->nextsocket;
+    }
+  }
+
+  return nullptr;
+}
+
+
+void TIp4Handler::AddTcpSocket(TTcp4Socket * atcp)
+{
+  if (tcp_last)
+  {
+    tcp_last->nextsocket = atcp;
+  }
+  else
+  {
+    tcp_first = atcp;
+  }
+  tcp_last = atcp;
+
+  atcp->nextsocket = nullptr;
+}
+
+uint16_t TIp4Handler::TcpEphemeralPort()
+{
+  uint16_t result = tcp_ephemeral_port;
+  if (++tcp_ephemeral_port < 49152)
+  {
+    tcp_ephemeral_port = 49152;
+  }
+  return result;
+}
+
+void TIp4Handler::Run()
+{
+  arptable.Run();
+
+  if (max_mcast_groups)
+  {
+    RunMulticast();
+  }
+
+  for (unsigned n = 0; n < reasm_slots; ++n)
+  {
+    TIp4ReasmSlot * pslot = &reasm[n];
+    if ((1 == pslot->pmem->status) && (adapter->mscounter - pslot->start_ms > reasm_timeout_ms))
+    {
+      pslot->pmem->status = 0;  // drop the incomplete datagram
+      ++reasm_timeout_count;
+    }
+  }
+
+  TTcp4Socket * tcp = tcp_first;
+  while (tcp)
+  {
+    tcp->Run();
+    tcp = tcp->nextsocket;
+  }
+}
+
+bool TIp4Handler::HandleRxPacket(TPacketMem * pmem)  // return true, if the packet is handled
+{
+  rxpkt = pmem;
+  rxeh = PEthernetHeader(&pmem->data[0]);
+
+  uint16_t etype = __builtin_bswap16(rxeh->ethertype);
+
+  if (0x0806 == etype) // ARP ?
+  {
+    NET_STAT_INC(adapter, rx_arp);
+    return HandleArp();
+  }
+  else if (0x800 == etype) // IP
+  {
+    NET_STAT_INC(adapter, rx_ip4);
+    rxiph = PIp4Header(rxeh + 1);
+
+    if (rxiph->fl_offs & IP4_FRAGMENT_MASK)  // MF flag or fragment offset present ?
+    {
+      return HandleFragment();
+    }
+
+    return HandleIpPayload();
+  }
+
+  return false;
+}
+
+bool TIp4Handler::HandleIpPayload()
+{
+  // rxpkt, rxeh, rxiph is already set
+
+  if (1 == rxiph->protocol) // ICMP ?
+  {
+    NET_STAT_INC(adapter, rx_icmp);
+    return HandleIcmp();
+  }
+  else if (2 == rxiph->protocol) // IGMP ?
+  {
+    NET_STAT_INC(adapter, rx_igmp);
+    return HandleIgmp();
+  }
+  else if (17 == rxiph->protocol) // UDP ?
+  {
+    NET_STAT_INC(adapter, rx_udp);
+    return HandleUdp();
+  }
+  else if (6 == rxiph->protocol) // TCP ?
+  {
+    NET_STAT_INC(adapter, rx_tcp);
+    return HandleTcp();
+  }
+
+  NET_STAT_INC(adapter, rx_ip_other);
+  return false;
+}
+
+bool TIp4Handler::HandleFragment()
+{
+  // rxpkt, rxeh, rxiph is already set, the fragment packet is always released
+
+  unsigned n;
+  unsigned hlen = ((rxiph->hl_v & 0xF) << 2);
+  unsigned iplen = __builtin_bswap16(rxiph->len);
+  unsigned flags = __builtin_bswap16(rxiph->fl_offs);
+  unsigned offs = ((flags & 0x1FFF) << 3);
+  bool     more = (0 != (flags & 0x2000));
+
+  if ((hlen < sizeof(TIp4Header)) || (iplen <= hlen) || (iplen + sizeof(TEthernetHeader) > rxpkt->datalen))
+  {
+    ++reasm_error_count;
+    return true;
+  }
+
+  unsigned fraglen = iplen - hlen;
+  if (more && (fraglen & 7))  // only the last fragment can have other length
+  {
+    ++reasm_error_count;
+    return true;
+  }
+
+  // search the slot
+  TIp4ReasmSlot * pslot = nullptr;
+  TIp4ReasmSlot * pfree = nullptr;
+  TIp4Addr        srcaddr;
+  srcaddr.CopyFrom16(&rxiph->srcaddr[0]);
+  for (n = 0; n < reasm_slots; ++n)
   {
-    rxpkt_last->next = pmem;
+    TIp4ReasmSlot * ps = &reasm[n];
+    if (1 == ps->pmem->status)
+    {
+      if ((ps->srcaddr.u32 == srcaddr.u32) && (ps->id == rxiph->id) && (ps->protocol == rxiph->protocol))
+      {
+        pslot = ps;
+        break;
+      }
+    }
+    else if (!pfree && (0 == ps->pmem->status))
+    {
+      pfree = ps;
+    }
   }
-  else
+
+  if (offs + fraglen > reasm_max_datalen)
   {
-    rxpkt_first = pmem;
+    ++reasm_toobig_count;
+    if (pslot)
+    {
+      pslot->pmem->status = 0;
+    }
+    return true;
   }
-  rxpkt_last = pmem;
-}
 
+  if (!pslot)
+  {
+    if (!pfree)
+    {
+      ++reasm_nomem_count;
+      return true;
+    }
 
-//--------------------------------------------------------------
+    pslot = pfree;
+    pslot->srcaddr = srcaddr;
+    pslot->id = rxiph->id;
+    pslot->protocol = rxiph->protocol;
+    pslot->totallen = 0;
+    pslot->rcvdlen = 0;
+    pslot->start_ms = adapter->mscounter;
+    memset(pslot->blockmap, 0, ((reasm_max_datalen / 8 + 31) / 32) * 4);
+
+    // the Ethernet and IP headers are taken from the first received fragment (without IP options)
+    memcpy(&pslot->pmem->data[0], &rxpkt->data[0], sizeof(TEthernetHeader) + sizeof(TIp4Header));
+    pslot->pmem->status = 1;
+  }
 
-void TIp4Handler::Init(TNetAdapter * aadapter)
-{
-  adapter = aadapter;
+  // check the overlapping with the already received blocks
+  unsigned firstblock = (offs >> 3);
+  unsigned endblock = ((offs + fraglen + 7) >> 3);
+  unsigned setcnt = ReasmBlockCount(pslot, firstblock, endblock);
+  if (setcnt)
+  {
+    if (setcnt == endblock - firstblock)
+    {
+      return true;  // duplicate fragment, ignore it
+    }
 
-  udp_first = nullptr;
-  udp_last  = nullptr;
+    // partial overlap, this can be used for attacks, drop the whole datagram
+    ++reasm_overlap_count;
+    pslot->pmem->status = 0;
+    return true;
+  }
+
+  if (!more)
+  {
+    if (pslot->totallen)
+    {
+      ++reasm_error_count;  // second last fragment
+      pslot->pmem->status = 0;
+      return true;
+    }
+    pslot->totallen = offs + fraglen;
 
-  arptable.Init(this);
+    // the fragments arrived before the last one must be all inside the datagram
+    if (ReasmBlockCount(pslot, endblock, (reasm_max_datalen + 7) >> 3))
+    {
+      ++reasm_overlap_count;  // data after the end
+      pslot->pmem->status = 0;
+      return true;
+    }
+  }
 
-  syspkt = adapter->AllocateTxPacket();  // reserve one TX packet for system purposes
+  if (pslot->totallen && (offs + fraglen > pslot->totallen))
+  {
+    ++reasm_overlap_count;  // data after the end
+    pslot->pmem->status = 0;
+    return true;
+  }
 
-  adapter->AddHandler(this);
-}
+  for (n = firstblock; n < endblock; ++n)
+  {
+    pslot->blockmap[n >> 5] |= (1u << (n & 31));
+  }
 
-void TIp4Handler::AddUdpSocket(TUdp4Socket * audp)
-{
-  if (udp_last)
+  memcpy(&pslot->pmem->data[sizeof(TEthernetHeader) + sizeof(TIp4Header) + offs], ((uint8_t *)rxiph) + hlen, fraglen);
+  pslot->rcvdlen += fraglen;
+
+  if (!pslot->totallen || (pslot->rcvdlen < pslot->totallen))
   {
-    udp_last->nextsocket = audp;
+    return true;  // more fragments required
   }
-  else
+
+  unsigned totalblocks = ((pslot->totallen + 7) >> 3);
+  if (ReasmBlockCount(pslot, 0, totalblocks) < totalblocks)
   {
-    udp_last = audp;
-    udp_first = audp;
+    return true;  // there is still a hole
   }
 
-  audp->nextsocket = nullptr;
-}
+  // the datagram is complete, pass it to the protocol handlers like a normal packet
 
+  TPacketMem * pmem = pslot->pmem;
+  PIp4Header   iph = PIp4Header(&pmem->data[sizeof(TEthernetHeader)]);
+  iph->hl_v = 0x45;
+  iph->len = __builtin_bswap16(pslot->totallen + sizeof(TIp4Header));
+  iph->fl_offs = 0;
+  iph->csum = 0;
+  iph->csum = calc_ip4_header_checksum(iph);
 
-void TIp4Handler::Run()
-{
-  arptable.Run();
-}
+  pmem->datalen = pslot->totallen + sizeof(TIp4Header) + sizeof(TEthernetHeader);
+  pmem->timestamp_ns = rxpkt->timestamp_ns;
+  pmem->flags = PMEMFLAG_SYS;
+  pmem->status = 2;
+  ++reasm_ok_count;
 
-bool TIp4Handler::HandleRxPacket(TPacketMem * pmem)  // return true, if the packet is handled
-{
   rxpkt = pmem;
-  rxeh = PEthernetHeader(&pmem->data[0]);
+  rxeh  = PEthernetHeader(&pmem->data[0]);
+  rxiph = iph;
 
-  uint16_t etype = __builtin_bswap16(rxeh->ethertype);
+  HandleIpPayload();
 
-  if (0x0806 == etype) // ARP ?
+  if (0 == (pmem->flags & PMEMFLAG_KEEP))
   {
-    return HandleArp();
+    pmem->status = 0;  // processed, the slot is free again
   }
-  else if (0x800 == etype) // IP
-  {
-    rxiph = PIp4Header(rxeh + 1);
+  // otherwise the slot is freed at TNetAdapter::ReleaseRxPacket()
 
-    if (1 == rxiph->protocol) // ICMP ?
-    {
-      return HandleIcmp();
-    }
-    else if (17 == rxiph->protocol) // UDP ?
+  return true;
+}
+
+unsigned TIp4Handler::ReasmBlockCount(TIp4ReasmSlot * pslot, unsigned afirst, unsigned aend)
+{
+  unsigned result = 0;
+  for (unsigned n = afirst; n < aend; ++n)
+  {
+    if (pslot->blockmap[n >> 5] & (1u << (n & 31)))
     {
-      return HandleUdp();
+      ++result;
     }
   }
-
-  return false;
+  return result;
 }
 
 bool TIp4Handler::HandleArp()
@@ -666,7 +1535,7 @@ bool TIp4Handler::HandleArp()
 
       // prepare the answer
 
-      pmem = adapter->AllocateTxPacket();
+      pmem = adapter->AllocateTxPacket(sizeof(TEthernetHeader) + sizeof(TArpHeader));
       if (!pmem)
       {
         return false;
@@ -715,13 +1584,13 @@ bool TIp4Handler::HandleIcmp()
   TPacketMem * pmem;
 
   PIcmpHeader rxich = PIcmpHeader(rxiph + 1);
-  if (8 == rxich->type) // echo request ?
+  if ((8 == rxich->type) && (rxpkt->datalen <= HWETH_MAX_PACKET_SIZE)) // echo request (not reassembled) ?
   {
     //TRACE("Echo request detected.\r\n");
 
     // prepare the answer
 
-    pmem = adapter->AllocateTxPacket();
+    pmem = adapter->AllocateTxPacket(rxpkt->datalen);
     if (!pmem)
     {
       return false;
@@ -748,13 +1617,21 @@ bool TIp4Handler::HandleIcmp()
       txiph->srcaddr[n] = ipaddress.u8[n];
     }
 
+    // only the type changes, so the checksum can be updated incrementally,
+    // the IP header checksum remains valid after the address swap
+    uint16_t oldword = *(uint16_t *)&txich->type;
     txich->type = 0; // ICMP ECHO reply
     txich->code = 0;
-    txich->cksum = 0;
 
-    // the ICMP message can contain arbitrary length data, we need to calculate its size first
-    uint16_t icmp_len = __builtin_bswap16(txiph->len) - sizeof(TIp4Header);
-    txich->cksum = __builtin_bswap16(calc_icmp_checksum(txich, icmp_len));
+    if (adapter->peth->hw_ip_checksum)
+    {
+      txiph->csum = 0;  // the MAC inserts the checksums, the fields must be 0
+      txich->cksum = 0;
+    }
+    else
+    {
+      txich->cksum = net_checksum_update(txich->cksum, oldword, *(uint16_t *)&txich->type);
+    }
 
     // send the packet
     adapter->SendTxPacket(pmem);  // the tx packet will be released automatically
@@ -770,22 +1647,330 @@ bool TIp4Handler::HandleUdp()
 
   uint16_t dport = __builtin_bswap16(udph->dport);
 
-  // search for listeners
-  TUdp4Socket * udp = udp_first;
-  while (udp)
+  if (0xE0 == (rxiph->dstaddr[0] & 0xF0))  // multicast ?
   {
-    if (udp->listenport == dport)
+    TIp4Addr group;
+    group.CopyFrom16(&rxiph->dstaddr[0]);
+    if (!FindGroup(&group))
     {
-      // got it
-      udp->AddRxPacket(rxpkt);
-      return true;  // returning true here does not releases the Rx packet here
+      ++mcast_drop_count;  // the MAC hash filter is not perfect
+      NET_STAT_INC(adapter, drop_mcast);
+      return true;
+    }
+  }
+
+  TUdp4Socket * udp = FindUdpSocket(dport);
+  if (udp)
+  {
+    udp->AddRxPacket(rxpkt);  // keeps the Rx packet
+  }
+  else
+  {
+    NET_STAT_INC(adapter, drop_udp_noport);
+  }
+
+  return true;
+}
+
+bool TIp4Handler::HandleTcp()
+{
+  // rxeh, rxiph is already set
+  TTcp4Header * tcph = (TTcp4Header *)(rxiph + 1);
+
+  unsigned tcplen = __builtin_bswap16(rxiph->len) - sizeof(TIp4Header);
+  if ((tcplen < sizeof(TTcp4Header)) || (tcplen + sizeof(TIp4Header) + sizeof(TEthernetHeader) > rxpkt->datalen))
+  {
+    NET_STAT_INC(adapter, drop_tcp_invalid);
+    return true;  // invalid length, drop it
+  }
+
+  if (!adapter->peth->hw_ip_checksum && (0 != calc_tcp4_checksum(rxiph, tcplen)))
+  {
+    NET_STAT_INC(adapter, drop_tcp_invalid);
+    return true;  // checksum error, drop it
+  }
+
+  // the data is copied into the socket buffers, so the Rx packet is always released
+
+  TTcp4Socket * listener = nullptr;
+  TTcp4Socket * tcp = tcp_first;
+  while (tcp)
+  {
+    if (tcp->Matches(rxiph, tcph))
+    {
+      tcp->HandleRxSegment(rxiph, tcph, tcplen);
+      return true;
+    }
+
+    if (!listener && (TCPS_LISTEN == tcp->state) && (tcp->listenport == __builtin_bswap16(tcph->dport)))
+    {
+      listener = tcp;
+    }
+    tcp = tcp->nextsocket;
+  }
+
+  if (listener)
+  {
+    listener->HandleRxSegment(rxiph, tcph, tcplen);
+  }
+  else
+  {
+    NET_STAT_INC(adapter, tcp_resets_sent);
+    tcp4_send_reset(this, rxiph, tcph, tcplen);
+  }
+
+  return true;
+}
+
+//--------------------------------------------------------------
+// Multicast, IGMPv2 (RFC 2236)
+
+TIp4McGroup * TIp4Handler::FindGroup(TIp4Addr * agroup)
+{
+  for (unsigned n = 0; n < max_mcast_groups; ++n)
+  {
+    if (mcgroups[n].addr.u32 == agroup->u32)
+    {
+      return &mcgroups[n];
+    }
+  }
+  return nullptr;
+}
+
+bool TIp4Handler::JoinGroup(TIp4Addr * agroup)
+{
+  if (!ip4_is_multicast(agroup))
+  {
+    return false;
+  }
+
+  TIp4McGroup * pgrp = FindGroup(agroup);
+  if (pgrp)
+  {
+    ++pgrp->users;
+    return true;
+  }
+
+  TIp4Addr freeaddr;
+  freeaddr.u32 = 0;
+  pgrp = FindGroup(&freeaddr);
+  if (!pgrp)
+  {
+    return false;  // no more free group slots
+  }
+
+  pgrp->addr = *agroup;
+  pgrp->users = 1;
+
+  // the unsolicited report is sent from RunMulticast(), then repeated once
+  pgrp->reports = 2;
+  pgrp->report_pending = true;
+  pgrp->report_start_ms = adapter->mscounter;
+  pgrp->report_delay_ms = 0;
+  pgrp->last_reporter = true;
+
+  UpdateMulticastFilter();
+  return true;
+}
+
+void TIp4Handler::LeaveGroup(TIp4Addr * agroup)
+{
+  TIp4McGroup * pgrp = FindGroup(agroup);
+  if (!pgrp || (0 == agroup->u32))
+  {
+    return;
+  }
+
+  if (--pgrp->users)
+  {
+    return;  // still in use
+  }
+
+  if (pgrp->last_reporter)
+  {
+    TIp4Addr allrouters;
+    allrouters.Set(224, 0, 0, 2);
+    SendIgmp(IGMP_LEAVE_GROUP, agroup, &allrouters);
+  }
+
+  pgrp->addr.u32 = 0;
+  pgrp->report_pending = false;
+
+  UpdateMulticastFilter();
+}
+
+void TIp4Handler::UpdateMulticastFilter()
+{
+  TIp4Addr  allhosts;
+  allhosts.Set(224, 0, 0, 1);  // required for the IGMP queries
+
+  ip4_multicast_mac(&mcmaclist[0], &allhosts);
+  unsigned cnt = 1;
+  for (unsigned n = 0; n < max_mcast_groups; ++n)
+  {
+    if (mcgroups[n].addr.u32)
+    {
+      ip4_multicast_mac(&mcmaclist[6 * cnt], &mcgroups[n].addr);
+      ++cnt;
+    }
+  }
+
+  if (!adapter->peth->SetMulticastFilter(mcmaclist, (cnt > 1 ? cnt : 0)))
+  {
+    TRACE("IP4: the MAC multicast filter is not supported\r\n");
+  }
+}
+
+void TIp4Handler::RunMulticast()
+{
+  for (unsigned n = 0; n < max_mcast_groups; ++n)
+  {
+    TIp4McGroup * pgrp = &mcgroups[n];
+    if (pgrp->addr.u32 && pgrp->report_pending
+        && (adapter->mscounter - pgrp->report_start_ms >= pgrp->report_delay_ms))
+    {
+      if (!adapter->IsLinkUp() || !SendIgmp(IGMP_V2_MEMBERSHIP_REPORT, &pgrp->addr, &pgrp->addr))
+      {
+        continue;  // try again later
+      }
+
+      pgrp->last_reporter = true;
+      pgrp->report_pending = false;
+      if (pgrp->reports)
+      {
+        --pgrp->reports;
+      }
+      if (pgrp->reports)  // repeat the unsolicited report
+      {
+        pgrp->report_pending = true;
+        pgrp->report_start_ms = adapter->mscounter;
+        pgrp->report_delay_ms = igmp_unsolicited_ms;
+      }
+    }
+  }
+}
+
+bool TIp4Handler::HandleIgmp()
+{
+  // rxeh, rxiph is already set, the IP header might have options (router alert)
+
+  unsigned hlen = ((rxiph->hl_v & 0xF) << 2);
+  unsigned iplen = __builtin_bswap16(rxiph->len);
+  if (0 == max_mcast_groups)
+  {
+    return true;
+  }
+
+  if ((iplen < hlen + sizeof(TIgmpHeader)) || (iplen + sizeof(TEthernetHeader) > rxpkt->datalen))
+  {
+    ++igmp_error_count;
+    return true;  // invalid length, drop it
+  }
+
+  // the checksum covers the whole IGMP message (RFC 2236), the IGMPv3 queries are longer
+  PIgmpHeader pigmp = PIgmpHeader(((uint8_t *)rxiph) + hlen);
+  if (0 != net_checksum_fold(net_checksum_add(0, pigmp, iplen - hlen)))
+  {
+    ++igmp_error_count;
+    return true;  // checksum error, drop it
+  }
+
+  TIp4Addr    group;
+  group.CopyFrom16(&pigmp->group[0]);
+
+  if (IGMP_MEMBERSHIP_QUERY == pigmp->type)
+  {
+    // respond with a random delay within the max. response time (IGMPv1 queries: 10 s)
+    uint32_t maxresp_ms = (pigmp->maxresp ? pigmp->maxresp : 100) * 100;
+    for (unsigned n = 0; n < max_mcast_groups; ++n)
+    {
+      TIp4McGroup * pgrp = &mcgroups[n];
+      if (pgrp->addr.u32 && ((0 == group.u32) || (group.u32 == pgrp->addr.u32)))
+      {
+        uint32_t delay = (CLOCKCNT ^ (n * 2654435761u)) % maxresp_ms;
+        uint32_t remaining = pgrp->report_delay_ms - (adapter->mscounter - pgrp->report_start_ms);
+        if (!pgrp->report_pending || (delay < remaining))
+        {
+          pgrp->report_pending = true;
+          pgrp->report_start_ms = adapter->mscounter;
+          pgrp->report_delay_ms = delay;
+        }
+      }
+    }
+  }
+  else if ((IGMP_V2_MEMBERSHIP_REPORT == pigmp->type) || (IGMP_V1_MEMBERSHIP_REPORT == pigmp->type))
+  {
+    // another member reported, our report can be suppressed
+    TIp4McGroup * pgrp = FindGroup(&group);
+    if (pgrp && group.u32 && pgrp->report_pending && (pgrp->reports <= 1))
+    {
+      pgrp->report_pending = false;
+      pgrp->reports = 0;
+      pgrp->last_reporter = false;
     }
-    udp = udp->nextsocket;
   }
 
   return true;
 }
 
+bool TIp4Handler::SendIgmp(uint8_t atype, TIp4Addr * agroup, TIp4Addr * adest)
+{
+  TPacketMem * pmem = adapter->AllocateTxPacket(sizeof(TEthernetHeader) + 24 + sizeof(TIgmpHeader));  // IP header with router alert
+  if (!pmem)
+  {
+    return false;
+  }
+
+  PEthernetHeader eh    = PEthernetHeader(&pmem->data[0]);
+  PIp4Header      iph   = PIp4Header(eh + 1);
+  uint8_t *       popt  = (uint8_t *)(iph + 1);
+  PIgmpHeader     pigmp = PIgmpHeader(popt + 4);
+  unsigned        n;
+
+  ip4_multicast_mac(&eh->dest_mac[0], adest);
+  mac_address_copy(&eh->src_mac[0], &adapter->peth->mac_address[0]);
+  eh->ethertype = 0x0008; // ether type: 0x0800 = IPV4 (byte swapped)
+
+  iph->hl_v = 0x46;  // 24 byte header with the router alert option
+  iph->tos = 0xC0;   // internetwork control
+  iph->len = __builtin_bswap16(sizeof(TIp4Header) + 4 + sizeof(TIgmpHeader));
+  iph->id = 0;
+  iph->fl_offs = __builtin_bswap16(0x4000);
+  iph->ttl = 1;
+  iph->protocol = 2;
+  iph->csum = 0;
+  for (n = 0; n < 4; ++n)
+  {
+    iph->srcaddr[n] = ipaddress.u8[n];
+    iph->dstaddr[n] = adest->u8[n];
+  }
+
+  popt[0] = 0x94;  // router alert
+  popt[1] = 4;
+  popt[2] = 0;
+  popt[3] = 0;
+
+  if (!adapter->peth->hw_ip_checksum)
+  {
+    iph->csum = net_checksum_fold(net_checksum_add(0, iph, sizeof(TIp4Header) + 4));
+  }
+
+  pigmp->type = atype;
+  pigmp->maxresp = 0;
+  pigmp->csum = 0;
+  for (n = 0; n < 4; ++n)
+  {
+    pigmp->group[n] = agroup->u8[n];
+  }
+  pigmp->csum = net_checksum_fold(net_checksum_add(0, pigmp, sizeof(TIgmpHeader)));  // no HW offload for IGMP
+
+  pmem->datalen = sizeof(TEthernetHeader) + sizeof(TIp4Header) + 4 + sizeof(TIgmpHeader);
+
+  return adapter->SendTxPacket(pmem);
+}
+
+//--------------------------------------------------------------
+
 bool TIp4Handler::LocalAddress(TIp4Addr * aaddr)  // the argument must be aligned !
 {
   if ((aaddr->u32 ^ ipaddress.u32) & netmask.u32)
@@ -795,6 +1980,17 @@ bool TIp4Handler::LocalAddress(TIp4Addr * aaddr)  // the argument must be aligne
   return true;
 }
 
+bool TIp4Handler::ResolveNextHop(TIp4Addr * adstaddr)
+{
+  if ((0xFFFFFFFF == adstaddr->u32) || ip4_is_multicast(adstaddr)
+      || (netmask.u32 && ((adstaddr->u32 | netmask.u32) == 0xFFFFFFFF) && LocalAddress(adstaddr)))
+  {
+    return true;  // no ARP resolution is required
+  }
+
+  return arptable.Resolve(LocalAddress(adstaddr) ? adstaddr : &gwaddress);
+}
+
 bool TIp4Handler::SendWithRouting(TPacketMem * pmem)
 {
   PEthernetHeader txeh = PEthernetHeader(&pmem->data[0]);
@@ -806,7 +2002,24 @@ bool TIp4Handler::SendWithRouting(TPacketMem * pmem)
   TIp4Addr    dstip;
   dstip.CopyFrom16(&txiph->dstaddr[0]);  // make it aligned
 
-  // 1. is it a local network packet or it must be sent to the gateway?
+  // 1. broadcast: no ARP resolution is possible (and required)
+  if ((0xFFFFFFFF == dstip.u32) || (netmask.u32 && ((dstip.u32 | netmask.u32) == 0xFFFFFFFF) && LocalAddress(&dstip)))
+  {
+    for (unsigned n = 0; n < 6; ++n)
+    {
+      txeh->dest_mac[n] = 0xFF;
+    }
+    return adapter->SendTxPacket(pmem);
+  }
+
+  // 2. multicast: the MAC address is derived from the group address
+  if (ip4_is_multicast(&dstip))
+  {
+    ip4_multicast_mac(&txeh->dest_mac[0], &dstip);
+    return adapter->SendTxPacket(pmem);
+  }
+
+  // 3. is it a local network packet or it must be sent to the gateway?
   if (LocalAddress(&dstip))
   {
     return arptable.SendWithArp(pmem, &dstip);
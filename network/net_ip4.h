@@ -81,59 +81,152 @@ typedef struct  // 8 bytes
 //
 } TUdp4Header, * PUdp4Header;
 
+#define IGMP_MEMBERSHIP_QUERY      0x11
+#define IGMP_V1_MEMBERSHIP_REPORT  0x12
+#define IGMP_V2_MEMBERSHIP_REPORT  0x16
+#define IGMP_LEAVE_GROUP           0x17
+
+typedef struct  // 8 bytes
+{
+  uint8_t   type;
+  uint8_t   maxresp;   // max response time in 1/10 s units
+  uint16_t  csum;
+  uint8_t   group[4];
+//
+} TIgmpHeader, * PIgmpHeader;
+
+typedef struct TIp4McGroup  // multicast group membership
+{
+  TIp4Addr  addr;        // 0 = free slot
+  uint8_t   users;       // JoinGroup() reference count
+  uint8_t   reports;     // repetitions of the unsolicited report
+  bool      report_pending;
+  bool      last_reporter;  // the Leave Group message is sent only when we were the last reporter
+  uint32_t  report_start_ms;
+  uint32_t  report_delay_ms;
+//
+} TIp4McGroup, * PIp4McGroup;
+
+inline bool ip4_is_multicast(TIp4Addr * aaddr)
+{
+  return (0xE0 == (aaddr->u8[0] & 0xF0));  // 224.0.0.0 - 239.255.255.255
+}
+
+inline void ip4_multicast_mac(uint8_t * rmac, TIp4Addr * aaddr)  // 01:00:5E + the lower 23 bits of the address
+{
+  rmac[0] = 0x01;
+  rmac[1] = 0x00;
+  rmac[2] = 0x5E;
+  rmac[3] = (aaddr->u8[1] & 0x7F);
+  rmac[4] = aaddr->u8[2];
+  rmac[5] = aaddr->u8[3];
+}
+
 typedef struct TArp4TableItem
 {
   TIp4Addr  ipaddr;
   uint8_t   macaddr[6];
   uint8_t   _pad[2];
-  uint32_t  timestamp_ms;
-
-  TArp4TableItem *  prev;
-  TArp4TableItem *  next;
+  uint32_t  timestamp_ms;  // last use, for the LRU replacement
 //
 } TArp4TableItem, * PArp4TableItem;
 
+#define ARP_HASH_EMPTY  0xFFFF
+
+typedef struct TArp4Request  // one outstanding address resolution
+{
+  TIp4Addr        ipaddr;
+  uint8_t         phase;   // 0 = free
+  uint8_t         trycnt;
+  uint8_t         jobcnt;
+  uint8_t         _pad;
+  uint32_t        start_ms;
+
+  TPacketMem *    syspkt;  // the ARP request packet
+  TPacketMem *    firstjob;  // packets waiting for this address
+  TPacketMem *    lastjob;
+//
+} TArp4Request, * PArp4Request;
+
 class TIp4Handler;
+class TTcp4Socket;
 
 class TArp4Table
 {
+public: // settings, must be set before Init()
+  uint16_t            max_items = 8;
+  uint8_t             max_tries = 5;  // after so many tries will be given up
+  uint8_t             max_requests = 4;  // concurrent address resolutions
+  uint8_t             max_request_jobs = 4;  // packets waiting for one address, the further ones are dropped
+  uint32_t            response_timeout_ms = 800;
+
 public:
-  TArp4TableItem *    firstitem = nullptr;
-  TArp4TableItem *    lastitem  = nullptr;
-  TArp4TableItem *    freelist  = nullptr;
+  TArp4TableItem *    items = nullptr;
+  uint16_t            itemcount = 0;
+
+  uint16_t *          hashtable = nullptr;  // open addressed, linear probing, holds item indexes
+  uint8_t             hashbits = 0;
 
   TNetAdapter *       adapter = nullptr;
   TIp4Handler *       phandler = nullptr;
 
-  uint8_t             max_items = 8;
-  uint8_t             max_tries = 5;  // after so many tries will be given up
-  uint32_t            response_timeout_ms = 800;
+  uint32_t            lookup_count = 0;
+  uint32_t            miss_count = 0;
+  uint32_t            evict_count = 0;
+  uint32_t            drop_count = 0;  // packets dropped because of unresolved or overloaded address resolution
 
+  TArp4Request *      requests = nullptr;
 
-  TPacketMem *        firstjob = nullptr;
-  TPacketMem *        lastjob = nullptr;
+  TPacketMem *        firstwait = nullptr;  // packets waiting for a free request slot
+  TPacketMem *        lastwait = nullptr;
 
-  void                Init(TIp4Handler * ahandler);
+  bool                Init(TIp4Handler * ahandler);  // false: not enough NetMem
   void                Update(TIp4Addr * aipaddr, uint8_t * amacaddr);
   TArp4TableItem *    FindByIp(PIp4Addr aipaddr);
   TArp4TableItem *    FindByMac(uint8_t * amacaddr);
 
-  bool                SendWithArp(TPacketMem * pmem, PIp4Addr paddr);
+  bool                SendWithArp(TPacketMem * pmem, PIp4Addr paddr);  // false: the packet was dropped (and released)
+  bool                Resolve(PIp4Addr paddr);  // false: not known yet, the resolution is started
   bool                ProcessArpResponse(TPacketMem * pmem);
 
   void                Run(); // handle resolution state machine
 
 protected:
-  int                 phase = 0;
-  int                 trycnt = 0;
-  uint32_t            start_ms = 0;
+  inline unsigned     HashIndex(uint32_t aip) { return (aip * 2654435761u) >> (32 - hashbits); }
+  TArp4TableItem *    FindItem(uint32_t aip);
+  TArp4TableItem *    CreateNewItem(uint32_t aip);
+  void                RemoveFromHash(TArp4TableItem * aitem);
+
+  TArp4Request *      FindRequest(uint32_t aip);
+  TArp4Request *      AllocateRequest(uint32_t aip);
+  bool                AddRequestJob(TArp4Request * preq, TPacketMem * pmem);  // false: dropped and released
+  void                RunRequest(TArp4Request * preq);
+  void                FinishRequest(TArp4Request * preq, TArp4TableItem * aarpitem);
+};
 
-  TArp4TableItem *    CreateNewItem(uint8_t * amacaddr);
+#define UDP4_MAX_DATALEN  (HWETH_MAX_PACKET_SIZE - (sizeof(TEthernetHeader) + sizeof(TIp4Header) + sizeof(TUdp4Header)))
 
-  TPacketMem *        syspkt = nullptr;
+// fragmented UDP datagrams can be larger, up to the IP limit
+#define UDP4_MAX_FRAG_DATALEN  (65535 - (sizeof(TIp4Header) + sizeof(TUdp4Header)))
 
-  void                FinishJob(bool asend);
-};
+// IP payload bytes in one fragment, must be the multiple of 8
+#define IP4_FRAG_DATALEN  ((HWETH_MAX_PACKET_SIZE - 34) < 1480 ? ((HWETH_MAX_PACKET_SIZE - 34) & ~7) : 1480)
+
+#define IP4_FRAGMENT_MASK  0xFF3F  // MF flag + fragment offset in the fl_offs (byte swapped)
+
+typedef struct TIp4ReasmSlot  // one datagram under reassembly
+{
+  TPacketMem *    pmem;       // the datagram is assembled here, status: 0 = free, 1 = reassembling, 2 = delivered
+  uint32_t *      blockmap;   // bitmap of the received 8-byte blocks
+  TIp4Addr        srcaddr;
+  uint16_t        id;
+  uint8_t         protocol;
+  uint8_t         _pad;
+  uint16_t        totallen;   // IP payload length, 0 = the last fragment has not arrived yet
+  uint16_t        rcvdlen;
+  uint32_t        start_ms;
+//
+} TIp4ReasmSlot, * PIp4ReasmSlot;
 
 class TUdp4Socket
 {
@@ -148,6 +241,8 @@ public:
 
   uint16_t          idcounter = 0;
 
+  bool              tx_checksum = true;  // the UDP checksum is optional, can be turned off
+
   TIp4Handler *     phandler = nullptr;
 
   TPacketMem *      rxpkt_first = nullptr;
@@ -160,14 +255,52 @@ public:
 
   void Init(TIp4Handler * ahandler, uint16_t alistenport);
 
-  int Send(void * adataptr, unsigned adatalen);
+  int Send(void * adataptr, unsigned adatalen);  // larger datagrams than UDP4_MAX_DATALEN are fragmented, 0: try again later
   int Receive(void * adataptr, unsigned adatalen);
 
+  // zero-copy receive: returns a pointer into the received packet and the payload length,
+  // the data remains valid until ReleaseRx() is called
+  bool ReceiveRef(uint8_t * * rdataptr, unsigned * rdatalen);
+  void ReleaseRx();
+
+  // zero-copy send: allocates a TX packet for at least amaxdatalen payload bytes and returns the payload pointer in it,
+  // the payload must be written there directly then committed with SendTxPacket()
+  TPacketMem * AllocateTxPacket(uint8_t * * rdataptr, unsigned amaxdatalen = UDP4_MAX_DATALEN);
+  int  SendTxPacket(TPacketMem * pmem, unsigned adatalen);  // the packet will be automatically released
+  void ReleaseTxPacket(TPacketMem * pmem);  // drop an allocated but unsent packet
+
   void AddRxPacket(TPacketMem * pmem);
+
+  // multicast reception, the datagrams to the joined groups are delivered by the destination port
+  bool JoinGroup(TIp4Addr * agroup);
+  void LeaveGroup(TIp4Addr * agroup);
+
+protected:
+  int  SendFragmented(void * adataptr, unsigned adatalen);
 };
 
 class TIp4Handler : public TProtocolHandler
 {
+public: // settings, must be set before Init()
+  uint8_t             reasm_slots = 0;  // concurrent datagram reassemblies, 0 = the received fragments are dropped
+  uint16_t            reasm_max_datalen = 16384;  // max. reassembled IP payload, allocated from the NetMem for every slot
+  uint16_t            reasm_timeout_ms = 2000;
+  uint8_t             udp_max_sockets = 16;  // UDP port hash table size, the further sockets are found with list scan
+  uint8_t             max_mcast_groups = 4;  // joined multicast groups, 0 = no multicast support
+  uint16_t            igmp_unsolicited_ms = 1000;  // the unsolicited membership report is repeated after this
+
+public: // statistics
+  uint32_t            reasm_ok_count = 0;       // successfully reassembled datagrams
+  uint32_t            reasm_timeout_count = 0;  // incomplete datagrams dropped after reasm_timeout_ms
+  uint32_t            reasm_nomem_count = 0;    // fragments dropped because no free reassembly slot
+  uint32_t            reasm_toobig_count = 0;   // datagrams larger than reasm_max_datalen
+  uint32_t            reasm_overlap_count = 0;  // datagrams dropped because of overlapping fragments
+  uint32_t            reasm_error_count = 0;    // invalid fragments
+  uint32_t            frag_tx_count = 0;        // fragmented datagrams sent
+  uint32_t            frag_tx_fail_count = 0;   // not enough TX packets, unresolved or dropped fragments
+  uint32_t            mcast_drop_count = 0;     // multicast datagrams to not joined groups (imperfect MAC filter)
+  uint32_t            igmp_error_count = 0;     // IGMP messages dropped because of length or checksum error
+
 public:
   TIp4Addr            ipaddress;
   TIp4Addr            netmask;
@@ -176,6 +309,15 @@ public:
   TUdp4Socket *       udp_first = nullptr;
   TUdp4Socket *       udp_last  = nullptr;
 
+  TUdp4Socket **      udp_hashtable = nullptr;  // open addressed, linear probing, by listenport
+  uint8_t             udp_hashbits = 0;
+  uint8_t             udp_hashcount = 0;
+  uint8_t             udp_unhashed = 0;  // sockets only in the list (hash table full)
+
+  TTcp4Socket *       tcp_first = nullptr;
+  TTcp4Socket *       tcp_last  = nullptr;
+  uint16_t            tcp_ephemeral_port = 49152;
+
   TArp4Table          arptable; // this is a small object
 
   TPacketMem *        syspkt = nullptr; // is this necessary?
@@ -184,25 +326,51 @@ public:
   TEthernetHeader *   rxeh  = nullptr;
   TIp4Header *        rxiph = nullptr;
 
+  TIp4ReasmSlot *     reasm = nullptr;
+
+  TIp4McGroup *       mcgroups = nullptr;
+  uint8_t *           mcmaclist = nullptr;  // for the MAC multicast filter
+
 
-  void                Init(TNetAdapter * aadapter);
+  bool                Init(TNetAdapter * aadapter);  // false: not enough NetMem for the ARP table
   virtual void        Run();
 
   virtual bool        HandleRxPacket(TPacketMem * pmem);  // return true, if the packet is handled
 
-  bool                SendWithRouting(TPacketMem * pmem);
+  bool                SendWithRouting(TPacketMem * pmem);  // the packet is always consumed, false: dropped
+  bool                ResolveNextHop(TIp4Addr * adstaddr);  // false: the ARP resolution of the next hop is in progress
   bool                LocalAddress(TIp4Addr * aaddr);
 
 public:
   void                AddUdpSocket(TUdp4Socket * audp);
+  void                RemoveUdpSocket(TUdp4Socket * audp);  // the pending RX packets are released
+  TUdp4Socket *       FindUdpSocket(uint16_t aport);
+
+  bool                JoinGroup(TIp4Addr * agroup);  // reference counted, sends IGMPv2 reports
+  void                LeaveGroup(TIp4Addr * agroup);
+  TIp4McGroup *       FindGroup(TIp4Addr * agroup);
+  void                AddTcpSocket(TTcp4Socket * atcp);
+  uint16_t            TcpEphemeralPort();
 
 protected:
+  inline unsigned     UdpHashIndex(uint16_t aport) { return uint16_t(aport * 40503u) >> (16 - udp_hashbits); }
+  bool                RemoveUdpFromHash(TUdp4Socket * audp);
+
   bool                HandleArp();
+  bool                HandleIpPayload();
+  bool                HandleFragment();
+  unsigned            ReasmBlockCount(TIp4ReasmSlot * pslot, unsigned afirst, unsigned aend);  // received blocks in [afirst, aend)
   bool                HandleIcmp();
+  bool                HandleIgmp();
+  bool                SendIgmp(uint8_t atype, TIp4Addr * agroup, TIp4Addr * adest);
+  void                UpdateMulticastFilter();
+  void                RunMulticast();
   bool                HandleUdp();
+  bool                HandleTcp();
 };
 
 uint16_t calc_ip4_header_checksum(TIp4Header * piph);
+uint32_t calc_ip4_pseudo_header_sum(TIp4Header * piph, uint16_t alen);  // partial sum for UDP/TCP checksums
 uint16_t calc_udp4_checksum(TIp4Header * piph, uint16_t datalen);
 
 inline void  mac_address_copy(uint8_t * pdst, uint8_t * psrc)
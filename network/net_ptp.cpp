@@ -0,0 +1,442 @@
+/*
+ * net_ptp.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#include "string.h"
+#include "math.h"
+#include "platform.h"
+#include "net_ptp.h"
+#include "traces.h"
+
+uint64_t ptp_get_timestamp(uint8_t * psrc)
+{
+  uint64_t sec = 0;
+  for (unsigned n = 0; n < 6; ++n)
+  {
+    sec = (sec << 8) | psrc[n];
+  }
+  uint32_t ns = (psrc[6] << 24) | (psrc[7] << 16) | (psrc[8] << 8) | psrc[9];
+
+  return sec * 1000000000ull + ns;
+}
+
+int64_t ptp_get_correction(uint8_t * psrc)
+{
+  uint64_t v = 0;
+  for (unsigned n = 0; n < 8; ++n)
+  {
+    v = (v << 8) | psrc[n];
+  }
+  return (int64_t(v) >> 16);  // the lower 16 bits are sub-nanoseconds
+}
+
+static int32_t ptp_clamp_i32(int64_t avalue)
+{
+  if (avalue > 0x7FFFFFFF)   return 0x7FFFFFFF;
+  if (avalue < -0x7FFFFFFF)  return -0x7FFFFFFF;
+  return int32_t(avalue);
+}
+
+void TPtpSlave::Init(TIp4Handler * aiphandler)
+{
+  phandler = aiphandler;
+  adapter = phandler->adapter;
+
+  udp_event.Init(phandler, PTP_EVENT_PORT);
+  udp_event.destport = PTP_EVENT_PORT;
+  udp_general.Init(phandler, PTP_GENERAL_PORT);
+  udp_general.destport = PTP_GENERAL_PORT;
+
+  TIp4Addr group;
+  group.Set(224, 0, 1, 129);  // the default PTP primary multicast group
+  udp_event.destaddr = group;
+  udp_event.JoinGroup(&group);
+
+  // clock identity: EUI-64 from the MAC address
+  uint8_t * mac = &adapter->peth->mac_address[0];
+  portid[0] = mac[0];
+  portid[1] = mac[1];
+  portid[2] = mac[2];
+  portid[3] = 0xFF;
+  portid[4] = 0xFE;
+  portid[5] = mac[3];
+  portid[6] = mac[4];
+  portid[7] = mac[5];
+  portid[8] = 0;  // port number = 1
+  portid[9] = 1;
+
+  master_valid = false;
+  sync_count = 0;
+  delay_count = 0;
+  step_count = 0;
+  master_change_count = 0;
+  rxts_soft_count = 0;
+  ts_missing_count = 0;
+
+  ResetServo();
+  ResetStats();
+
+  adapter->AddHandler(this);
+}
+
+uint64_t TPtpSlave::PtpTimeNs()
+{
+  return LocalToPtp(adapter->peth->NsTimeRead());
+}
+
+void TPtpSlave::ResetStats()
+{
+  stat_count = 0;
+  stat_offset_min = 0;
+  stat_offset_max = 0;
+  stat_offset_sqsum = 0;
+  stat_delay_min = 0;
+  stat_delay_max = 0;
+}
+
+float TPtpSlave::OffsetRms()
+{
+  if (!stat_count)
+  {
+    return 0;
+  }
+  return sqrtf(stat_offset_sqsum / stat_count);
+}
+
+void TPtpSlave::ResetServo()
+{
+  servo_phase = 0;
+  servo_drift = 0;
+  SetFrequency(0);
+
+  t12_valid = false;
+  sync_waiting = false;
+  delay_waiting = false;
+  delay_valid = false;
+  path_delay_ns = 0;
+  offset_ns = 0;
+
+  state = (master_valid ? PTPS_UNCALIBRATED : PTPS_LISTENING);
+}
+
+void TPtpSlave::Run()
+{
+  uint8_t *     pdata;
+  unsigned      datalen;
+  TPacketMem *  pmem;
+
+  // event messages, the RX timestamp must be read while the packet is held
+  while (nullptr != (pmem = udp_event.rxpkt_first))
+  {
+    uint64_t rxts = pmem->timestamp_ns;
+    if (!rxts)
+    {
+      rxts = adapter->peth->GetTimeStamp(pmem->idx);
+    }
+    if (!rxts)
+    {
+      // the MAC does not timestamp, the software timestamp includes the RX processing latency
+      rxts = adapter->peth->NsTimeRead();
+      ++rxts_soft_count;
+    }
+    if (udp_event.ReceiveRef(&pdata, &datalen))
+    {
+      if (rxts)
+      {
+        ProcessMessage(pdata, datalen, rxts, true);
+      }
+      else
+      {
+        ++ts_missing_count;  // a zero timestamp would stall the servo
+      }
+    }
+    udp_event.ReleaseRx();
+  }
+
+  while (udp_general.ReceiveRef(&pdata, &datalen))
+  {
+    ProcessMessage(pdata, datalen, 0, false);
+    udp_general.ReleaseRx();
+  }
+
+  if (master_valid && (adapter->mscounter - last_announce_ms > announce_timeout_ms))
+  {
+    TRACE("PTP: master lost\r\n");
+    master_valid = false;
+    ResetServo();
+  }
+
+  if (t12_valid && (adapter->mscounter - delay_req_ms >= delay_req_interval_ms))
+  {
+    SendDelayReq();
+  }
+}
+
+void TPtpSlave::ProcessMessage(uint8_t * pmsg, unsigned alen, uint64_t arxts, bool aevent)
+{
+  PPtpHeader ph = PPtpHeader(pmsg);
+
+  if ((alen < sizeof(TPtpHeader)) || (2 != (ph->version & 0xF)) || (ph->domain != domain))
+  {
+    return;
+  }
+
+  unsigned msglen = __builtin_bswap16(ph->msglen);
+  if (msglen > alen)
+  {
+    return;
+  }
+
+  uint8_t msgtype = (ph->msgtype & 0xF);
+
+  if (PTP_MSG_ANNOUNCE == msgtype)
+  {
+    if (msglen >= PTP_ANNOUNCE_DS_OFFS + PTP_ANNOUNCE_DS_LEN)
+    {
+      ProcessAnnounce(ph);
+    }
+    return;
+  }
+
+  if (!master_valid || (0 != memcmp(&ph->srcportid[0], &master_portid[0], 10)))
+  {
+    return;  // only from the selected master
+  }
+
+  uint16_t  seqid = __builtin_bswap16(ph->seqid);
+  uint8_t * pts = pmsg + PTP_TIMESTAMP_OFFS;
+
+  if ((PTP_MSG_SYNC == msgtype) && aevent && (msglen >= PTP_TIMESTAMP_OFFS + 10))
+  {
+    if (ph->flags[0] & PTP_FLAG_TWO_STEP)
+    {
+      sync_seqid = seqid;
+      sync_t2 = arxts;
+      sync_waiting = true;
+      sync_correction = ptp_get_correction(&ph->correction[0]);  // added to the Follow_Up time
+    }
+    else
+    {
+      ProcessSync(ptp_get_timestamp(pts) + ptp_get_correction(&ph->correction[0]), arxts);
+    }
+  }
+  else if ((PTP_MSG_FOLLOW_UP == msgtype) && (msglen >= PTP_TIMESTAMP_OFFS + 10))
+  {
+    if (sync_waiting && (seqid == sync_seqid))
+    {
+      sync_waiting = false;
+      ProcessSync(ptp_get_timestamp(pts) + ptp_get_correction(&ph->correction[0]) + sync_correction, sync_t2);
+    }
+  }
+  else if ((PTP_MSG_DELAY_RESP == msgtype) && (msglen >= PTP_REQPORTID_OFFS + 10))
+  {
+    if (delay_waiting && (seqid == delay_seqid) && (0 == memcmp(pmsg + PTP_REQPORTID_OFFS, &portid[0], 10)))
+    {
+      delay_waiting = false;
+
+      uint64_t t4 = ptp_get_timestamp(pts) - ptp_get_correction(&ph->correction[0]);
+      int64_t  ms_diff = int64_t(t2 - t1);
+      int64_t  sm_diff = int64_t(t4 - LocalToPtp(delay_t3));
+      int32_t  delay = ptp_clamp_i32((ms_diff + sm_diff) / 2);
+
+      if (delay_valid)
+      {
+        path_delay_ns += int32_t((int64_t(delay) - path_delay_ns) / 4);  // smoothing
+      }
+      else
+      {
+        path_delay_ns = delay;
+        delay_valid = true;
+      }
+      ++delay_count;
+    }
+  }
+}
+
+void TPtpSlave::ProcessAnnounce(PPtpHeader pmsg)
+{
+  uint8_t * pds = ((uint8_t *)pmsg) + PTP_ANNOUNCE_DS_OFFS;
+
+  if (master_valid && (0 == memcmp(&pmsg->srcportid[0], &master_portid[0], 10)))
+  {
+    last_announce_ms = adapter->mscounter;
+    memcpy(&master_ds[0], pds, PTP_ANNOUNCE_DS_LEN);
+    return;
+  }
+
+  // simplified best master selection: priority1, clock class, accuracy, variance, priority2
+  // and the grandmaster identity follow each other in the message, the lower wins
+  if (!master_valid || (memcmp(pds, &master_ds[0], PTP_ANNOUNCE_DS_LEN) < 0))
+  {
+    SelectMaster(pmsg);
+  }
+}
+
+void TPtpSlave::SelectMaster(PPtpHeader pmsg)
+{
+  memcpy(&master_portid[0], &pmsg->srcportid[0], 10);
+  memcpy(&master_ds[0], ((uint8_t *)pmsg) + PTP_ANNOUNCE_DS_OFFS, PTP_ANNOUNCE_DS_LEN);
+  master_valid = true;
+  last_announce_ms = adapter->mscounter;
+  ++master_change_count;
+
+  TRACE("PTP: new master %02X%02X%02X.%02X%02X.%02X%02X%02X\r\n",
+      master_portid[0], master_portid[1], master_portid[2], master_portid[3],
+      master_portid[4], master_portid[5], master_portid[6], master_portid[7]);
+
+  ResetServo();
+}
+
+void TPtpSlave::ProcessSync(uint64_t at1, uint64_t at2)
+{
+  ++sync_count;
+
+  t1 = at1;
+  t2 = LocalToPtp(at2);
+  t12_valid = true;
+
+  int64_t offset = int64_t(t2 - t1) - (delay_valid ? path_delay_ns : 0);
+  UpdateServo(offset, at2);
+}
+
+void TPtpSlave::StepClock(int64_t aoffset)
+{
+  clock_offset_ns -= aoffset;
+  t2 -= aoffset;
+  delay_waiting = false;  // measured with the old time base
+  ++step_count;
+}
+
+void TPtpSlave::SetFrequency(float appb)
+{
+  if (appb > max_freq_ppb)   appb = max_freq_ppb;
+  if (appb < -max_freq_ppb)  appb = -max_freq_ppb;
+
+  freq_ppb = appb;
+  adapter->peth->NsTimeSetCorrection(freq_ppb * 1e-9f);
+}
+
+void TPtpSlave::UpdateServo(int64_t aoffset, uint64_t alocal_ns)
+{
+  offset_ns = ptp_clamp_i32(aoffset);
+
+  bool outside = ((aoffset > int64_t(step_threshold_ns)) || (aoffset < -int64_t(step_threshold_ns)));
+
+  if (0 == servo_phase)  // first sample
+  {
+    if (outside)
+    {
+      StepClock(aoffset);
+      aoffset = 0;
+    }
+    servo_first_offset = aoffset;
+    servo_first_local = alocal_ns;
+    servo_phase = 1;
+  }
+  else if (1 == servo_phase)  // estimate the frequency difference from two samples
+  {
+    int64_t dt = int64_t(alocal_ns - servo_first_local);
+    if (dt < 100000000)
+    {
+      return;  // too close
+    }
+
+    servo_drift = float(aoffset - servo_first_offset) * 1e9f / float(dt);
+    if (servo_drift > max_freq_ppb)   servo_drift = max_freq_ppb;
+    if (servo_drift < -max_freq_ppb)  servo_drift = -max_freq_ppb;
+
+    // remove the remaining offset, the PI controller continues from here
+    StepClock(aoffset);
+    SetFrequency(-servo_drift);
+
+    servo_phase = 2;
+    state = PTPS_SLAVE;
+  }
+  else if (outside)
+  {
+    StepClock(aoffset);  // keeps the frequency
+  }
+  else
+  {
+    float interval = float(int64_t(alocal_ns - servo_last_local)) * 1e-9f;
+    if (interval < 0.01f)  interval = 0.01f;
+    if (interval > 10.0f)  interval = 10.0f;
+
+    float ki_term = servo_ki * float(aoffset) * interval;
+    float ppb = servo_kp * float(aoffset) + servo_drift + ki_term;
+    if ((ppb < max_freq_ppb) && (ppb > -max_freq_ppb))
+    {
+      servo_drift += ki_term;  // no integration when saturated
+    }
+
+    SetFrequency(-ppb);
+    UpdateStats();
+  }
+
+  servo_last_local = alocal_ns;
+}
+
+void TPtpSlave::UpdateStats()
+{
+  if (0 == stat_count)
+  {
+    stat_offset_min = offset_ns;
+    stat_offset_max = offset_ns;
+    stat_delay_min = path_delay_ns;
+    stat_delay_max = path_delay_ns;
+  }
+  else
+  {
+    if (offset_ns < stat_offset_min)      stat_offset_min = offset_ns;
+    if (offset_ns > stat_offset_max)      stat_offset_max = offset_ns;
+    if (path_delay_ns < stat_delay_min)   stat_delay_min = path_delay_ns;
+    if (path_delay_ns > stat_delay_max)   stat_delay_max = path_delay_ns;
+  }
+
+  stat_offset_sqsum += float(offset_ns) * float(offset_ns);
+  ++stat_count;
+}
+
+void TPtpSlave::SendDelayReq()
+{
+  const unsigned msglen = PTP_TIMESTAMP_OFFS + 10;
+
+  if (!adapter->peth->NsTimeRead())
+  {
+    ++ts_missing_count;  // the Delay_Req could not be timestamped
+    delay_req_ms = adapter->mscounter;
+    return;
+  }
+
+  uint8_t *    pdata;
+  TPacketMem * pmem = udp_event.AllocateTxPacket(&pdata, msglen);
+  if (!pmem)
+  {
+    return;
+  }
+
+  delay_req_ms = adapter->mscounter;
+
+  memset(pdata, 0, msglen);
+
+  PPtpHeader ph = PPtpHeader(pdata);
+  ph->msgtype = PTP_MSG_DELAY_REQ;
+  ph->version = 2;
+  ph->msglen = __builtin_bswap16(msglen);
+  ph->domain = domain;
+  memcpy(&ph->srcportid[0], &portid[0], 10);
+  ++delay_seqid;
+  ph->seqid = __builtin_bswap16(delay_seqid);
+  ph->control = 1;  // Delay_Req
+  ph->loginterval = 0x7F;
+
+  // software TX timestamp, taken just before the sending
+  delay_t3 = adapter->peth->NsTimeRead();
+  if (udp_event.SendTxPacket(pmem, msglen) > 0)
+  {
+    delay_waiting = true;
+  }
+}
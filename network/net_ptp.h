@@ -0,0 +1,152 @@
+/*
+ * net_ptp.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#ifndef NETWORK_NET_PTP_H_
+#define NETWORK_NET_PTP_H_
+
+#include "stdint.h"
+#include "net_ip4.h"
+
+#define PTP_EVENT_PORT       319
+#define PTP_GENERAL_PORT     320
+
+#define PTP_MSG_SYNC         0x0
+#define PTP_MSG_DELAY_REQ    0x1
+#define PTP_MSG_FOLLOW_UP    0x8
+#define PTP_MSG_DELAY_RESP   0x9
+#define PTP_MSG_ANNOUNCE     0xB
+
+#define PTP_FLAG_TWO_STEP    0x02  // in the first flag byte
+
+typedef struct  // 34 bytes, the message body follows
+{
+  uint8_t   msgtype;        // transportSpecific(4) + messageType(4)
+  uint8_t   version;        // versionPTP = 2 in the lower 4 bits
+  uint16_t  msglen;
+  uint8_t   domain;
+  uint8_t   _reserved1;
+  uint8_t   flags[2];
+  uint8_t   correction[8];  // nanoseconds * 2^16
+  uint8_t   _reserved2[4];
+  uint8_t   srcportid[10];  // clock identity (8) + port number (2)
+  uint16_t  seqid;
+  uint8_t   control;
+  uint8_t   loginterval;
+//
+} TPtpHeader, * PPtpHeader;
+
+#define PTP_TIMESTAMP_OFFS   34  // the origin/receive timestamp in the message body
+#define PTP_REQPORTID_OFFS   44  // requesting port identity in the Delay_Resp
+#define PTP_ANNOUNCE_DS_OFFS 47  // priority1, clock quality, priority2, grandmaster identity
+#define PTP_ANNOUNCE_DS_LEN  14
+
+#define PTPS_LISTENING       0  // waiting for a master (Announce)
+#define PTPS_UNCALIBRATED    1  // master selected, the servo is not locked yet
+#define PTPS_SLAVE           2  // synchronized
+
+/* PTPv2 (IEEE 1588-2008) ordinary clock, slave only, over UDP/IPv4 with E2E delay measurement.
+   The MAC nanosecond timer is free running, it is not set: the PTP time is kept as a software
+   offset to it, while its frequency is disciplined with NsTimeSetCorrection().
+   The RX timestamps come from THwEth::GetTimeStamp(), the Delay_Req is timestamped with
+   NsTimeRead() before sending, so the TX path latency appears in the path delay.
+   When the MAC gives no RX timestamp, NsTimeRead() at the processing is used (less precise),
+   the event messages are dropped when even that returns 0. */
+
+class TPtpSlave : public TProtocolHandler
+{
+public: // settings, must be set before Init()
+  uint8_t             domain = 0;
+  uint16_t            delay_req_interval_ms = 1000;
+  uint16_t            announce_timeout_ms = 6000;  // the master is dropped when no Announce arrives
+  uint32_t            step_threshold_ns = 100000;  // larger offsets are corrected by stepping
+  float               servo_kp = 0.7;   // PI servo constants for ~1 s sync interval
+  float               servo_ki = 0.3;
+  float               max_freq_ppb = 500000;
+
+public:
+  uint8_t             state = PTPS_LISTENING;
+
+  TIp4Handler *       phandler = nullptr;
+  TUdp4Socket         udp_event;    // port 319: Sync, Delay_Req
+  TUdp4Socket         udp_general;  // port 320: Follow_Up, Delay_Resp, Announce
+
+  uint8_t             portid[10];    // our clock identity (EUI-64 from the MAC) + port number
+  uint8_t             master_portid[10];
+  uint8_t             master_ds[PTP_ANNOUNCE_DS_LEN];  // the selected master's announced data set
+
+  int64_t             clock_offset_ns = 0;  // PTP time = MAC time + clock_offset_ns
+
+public: // statistics
+  int32_t             offset_ns = 0;       // last measured offset from the master
+  int32_t             path_delay_ns = 0;   // mean path delay
+  float               freq_ppb = 0;        // current frequency correction
+
+  uint32_t            sync_count = 0;
+  uint32_t            delay_count = 0;
+  uint32_t            step_count = 0;
+  uint32_t            master_change_count = 0;
+  uint32_t            rxts_soft_count = 0;  // event messages without MAC RX timestamp, NsTimeRead() was used
+  uint32_t            ts_missing_count = 0;  // event messages dropped or not sent, no time source at all
+
+  // offset statistics since the last ResetStats()
+  uint32_t            stat_count = 0;
+  int32_t             stat_offset_min = 0;
+  int32_t             stat_offset_max = 0;
+  float               stat_offset_sqsum = 0;
+  int32_t             stat_delay_min = 0;
+  int32_t             stat_delay_max = 0;
+
+  void                Init(TIp4Handler * aiphandler);
+  virtual void        Run();
+
+  uint64_t            PtpTimeNs();  // the current synchronized time
+  inline uint64_t     LocalToPtp(uint64_t alocal_ns) { return alocal_ns + clock_offset_ns; }
+
+  void                ResetStats();
+  float               OffsetRms();
+
+protected:
+  bool                master_valid = false;
+  uint32_t            last_announce_ms = 0;
+
+  uint16_t            sync_seqid = 0;
+  bool                sync_waiting = false;  // for the Follow_Up
+  uint64_t            sync_t2 = 0;           // local RX time of the Sync
+  int64_t             sync_correction = 0;
+
+  uint64_t            t1 = 0;  // master time of the Sync
+  uint64_t            t2 = 0;  // local (PTP) time of the Sync reception
+  bool                t12_valid = false;
+
+  uint16_t            delay_seqid = 0;
+  bool                delay_waiting = false;
+  uint64_t            delay_t3 = 0;          // local TX time of the Delay_Req
+  uint32_t            delay_req_ms = 0;
+  bool                delay_valid = false;
+
+  uint8_t             servo_phase = 0;  // 0 = no sample, 1 = first sample, 2 = locked
+  int64_t             servo_first_offset = 0;
+  uint64_t            servo_first_local = 0;
+  float               servo_drift = 0;  // frequency estimation + integral part in ppb
+  uint64_t            servo_last_local = 0;
+
+  void                ProcessMessage(uint8_t * pmsg, unsigned alen, uint64_t arxts, bool aevent);
+  void                ProcessAnnounce(PPtpHeader pmsg);
+  void                ProcessSync(uint64_t at1, uint64_t at2);
+  void                SendDelayReq();
+  void                UpdateServo(int64_t aoffset, uint64_t alocal_ns);
+  void                StepClock(int64_t aoffset);
+  void                SetFrequency(float appb);
+  void                UpdateStats();
+  void                SelectMaster(PPtpHeader pmsg);
+  void                ResetServo();
+};
+
+uint64_t ptp_get_timestamp(uint8_t * psrc);  // seconds (48 bit) + nanoseconds (32 bit) to nanoseconds
+int64_t  ptp_get_correction(uint8_t * psrc);  // correction field to nanoseconds
+
+#endif /* NETWORK_NET_PTP_H_ */
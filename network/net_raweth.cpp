@@ -0,0 +1,204 @@
+/*
+ * net_raweth.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#include "string.h"
+#include "platform.h"
+#include "net_raweth.h"
+#include "traces.h"
+
+bool TRawEthHandler::Init(TNetAdapter * aadapter)
+{
+  adapter = aadapter;
+
+  protocol_count = 0;
+  protocols = (TRawEthProtocol * *)adapter->AllocateNetMem(sizeof(TRawEthProtocol *) * max_protocols);
+  if (!protocols)
+  {
+    return false;
+  }
+
+  adapter->AddHandler(this);
+  return true;
+}
+
+bool TRawEthHandler::AddProtocol(TRawEthProtocol * aprot)
+{
+  if ((protocol_count >= max_protocols) || FindProtocol(aprot->ethertype))
+  {
+    TRACE("RawEth: error adding EtherType %04X\r\n", aprot->ethertype);
+    return false;
+  }
+
+  protocols[protocol_count] = aprot;
+  ++protocol_count;
+  return true;
+}
+
+TRawEthProtocol * TRawEthHandler::FindProtocol(uint16_t aethertype)
+{
+  for (unsigned n = 0; n < protocol_count; ++n)
+  {
+    if (protocols[n]->ethertype == aethertype)
+    {
+      return protocols[n];
+    }
+  }
+  return nullptr;
+}
+
+bool TRawEthHandler::HandleRxPacket(TPacketMem * pmem)
+{
+  PEthernetHeader peh = PEthernetHeader(&pmem->data[0]);
+
+  TRawEthProtocol * pprot = FindProtocol(__builtin_bswap16(peh->ethertype));
+  if (!pprot)
+  {
+    return false;
+  }
+
+  ++pprot->rx_count;
+  pprot->HandleFrame(pmem, (uint8_t *)(peh + 1), pmem->datalen - sizeof(TEthernetHeader));
+  return true;
+}
+
+//-----------------------------------------------------------------------------
+
+bool TRawEthProtocol::Init(TRawEthHandler * ahandler, uint16_t aethertype)
+{
+  phandler = ahandler;
+  adapter = phandler->adapter;
+  ethertype = aethertype;
+
+  memset(&dest_mac[0], 0xFF, 6);
+
+  rx_count = 0;
+  tx_count = 0;
+  tx_busy_count = 0;
+  tx_error_count = 0;
+
+  return phandler->AddProtocol(this);
+}
+
+bool TRawEthProtocol::InitTxRing(unsigned acount, unsigned amaxdatalen, uint8_t * adest_mac)
+{
+  if (amaxdatalen > HWETH_MAX_PACKET_SIZE - sizeof(TEthernetHeader))
+  {
+    amaxdatalen = HWETH_MAX_PACKET_SIZE - sizeof(TEthernetHeader);
+  }
+
+  txring = (TPacketMem * *)adapter->AllocateNetMem(sizeof(TPacketMem *) * acount);
+  if (!txring)
+  {
+    return false;
+  }
+
+  // the packet heads must stay 4-byte aligned in the NetMem
+  unsigned pktsize = ((amaxdatalen + sizeof(TEthernetHeader) + 3) & 0xFFFC);
+
+  txring_count = 0;
+  txring_idx = 0;
+  txmaxdatalen = amaxdatalen;
+
+  for (unsigned n = 0; n < acount; ++n)
+  {
+    TPacketMem * pmem = adapter->CreateSysTxPacket(pktsize);
+    if (!pmem)
+    {
+      return false;
+    }
+
+    pmem->status = 0;
+    memset(&pmem->data[0], 0, pktsize);
+
+    PEthernetHeader peh = PEthernetHeader(&pmem->data[0]);
+    memcpy(&peh->src_mac[0], &adapter->peth->mac_address[0], 6);
+    peh->ethertype = __builtin_bswap16(ethertype);
+
+    txring[n] = pmem;
+    ++txring_count;
+  }
+
+  SetDestMac(adest_mac);
+  return true;
+}
+
+void TRawEthProtocol::SetDestMac(uint8_t * adest_mac)
+{
+  if (adest_mac)
+  {
+    memcpy(&dest_mac[0], adest_mac, 6);
+  }
+  else
+  {
+    memset(&dest_mac[0], 0xFF, 6);  // broadcast
+  }
+
+  for (unsigned n = 0; n < txring_count; ++n)
+  {
+    memcpy(&txring[n]->data[0], &dest_mac[0], 6);
+  }
+}
+
+TPacketMem * TRawEthProtocol::AllocateTxFrame(uint8_t * * rdataptr)
+{
+  if (!txring_count)
+  {
+    return nullptr;
+  }
+
+  TPacketMem * pmem = txring[txring_idx];
+  if (pmem->status)  // still sending (the frames are released in order)
+  {
+    ++tx_busy_count;
+    return nullptr;
+  }
+
+  ++txring_idx;
+  if (txring_idx >= txring_count)
+  {
+    txring_idx = 0;
+  }
+
+  *rdataptr = &pmem->data[sizeof(TEthernetHeader)];
+  return pmem;
+}
+
+bool TRawEthProtocol::SendTxFrame(TPacketMem * pmem, unsigned adatalen)
+{
+  if (adatalen > txmaxdatalen)
+  {
+    adatalen = txmaxdatalen;
+  }
+
+  pmem->datalen = sizeof(TEthernetHeader) + adatalen;
+  if (!adapter->SendTxPacket(pmem))  // releases the frame on failure too
+  {
+    ++tx_error_count;
+    return false;
+  }
+
+  ++tx_count;
+  return true;
+}
+
+bool TRawEthProtocol::Send(void * adataptr, unsigned adatalen)
+{
+  uint8_t * pdata;
+  TPacketMem * pmem = AllocateTxFrame(&pdata);
+  if (!pmem)
+  {
+    return false;
+  }
+
+  if (adatalen > txmaxdatalen)
+  {
+    adatalen = txmaxdatalen;
+  }
+  memcpy(pdata, adataptr, adatalen);
+
+  return SendTxFrame(pmem, adatalen);
+}
@@ -0,0 +1,80 @@
+/*
+ * net_raweth.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#ifndef NETWORK_NET_RAWETH_H_
+#define NETWORK_NET_RAWETH_H_
+
+#include "stdint.h"
+#include "netadapter.h"
+
+class TRawEthHandler;
+
+/* One EtherType endpoint for raw layer 2 traffic (e.g. a fieldbus).
+   The received frames are passed to HandleFrame() directly from the TNetAdapter::Run() RX processing,
+   so an answer can be sent from there without waiting for the next Run() call.
+   For sending a small ring of pre-formed frames is used: the Ethernet header is prepared only once,
+   only the payload has to be written at every cycle. */
+
+class TRawEthProtocol
+{
+public:
+  uint16_t            ethertype = 0;  // in host byte order
+  uint8_t             dest_mac[6];    // destination of the TX ring frames
+
+  TRawEthHandler *    phandler = nullptr;
+  TNetAdapter *       adapter = nullptr;
+
+public: // statistics
+  uint32_t            rx_count = 0;
+  uint32_t            tx_count = 0;
+  uint32_t            tx_busy_count = 0;  // every TX ring frame was still sending
+  uint32_t            tx_error_count = 0;
+
+  bool                Init(TRawEthHandler * ahandler, uint16_t aethertype);
+
+  // allocates acount frames with amaxdatalen payload space from the NetMem, adest_mac = nullptr: broadcast
+  bool                InitTxRing(unsigned acount, unsigned amaxdatalen, uint8_t * adest_mac);
+  void                SetDestMac(uint8_t * adest_mac);  // updates the prepared headers too
+
+  // returns the next free ring frame and its payload pointer, nullptr when all of them are still sending
+  TPacketMem *        AllocateTxFrame(uint8_t * * rdataptr);
+  bool                SendTxFrame(TPacketMem * pmem, unsigned adatalen);  // the frame returns to the ring automatically
+  bool                Send(void * adataptr, unsigned adatalen);  // copying variant
+
+  unsigned            TxMaxDataLen() { return txmaxdatalen; }
+
+public: // virtual functions
+  // called directly from the RX path, the frame (and pdata) is valid only during this call
+  virtual void        HandleFrame(TPacketMem * pmem, uint8_t * pdata, unsigned adatalen) { }
+
+protected:
+  TPacketMem * *      txring = nullptr;
+  uint8_t             txring_count = 0;
+  uint8_t             txring_idx = 0;
+  uint16_t            txmaxdatalen = 0;
+};
+
+class TRawEthHandler : public TProtocolHandler
+{
+public: // settings, must be set before Init()
+  uint8_t             max_protocols = 4;
+
+public:
+  uint8_t             protocol_count = 0;
+  TRawEthProtocol * * protocols = nullptr;  // the dispatch table
+
+  // should be added before the TIp4Handler for the shortest RX path
+  bool                Init(TNetAdapter * aadapter);
+
+  bool                AddProtocol(TRawEthProtocol * aprot);
+  TRawEthProtocol *   FindProtocol(uint16_t aethertype);
+
+public: // virtual functions
+  virtual bool        HandleRxPacket(TPacketMem * pmem);
+};
+
+#endif /* NETWORK_NET_RAWETH_H_ */
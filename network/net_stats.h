@@ -0,0 +1,107 @@
+/*
+ * net_stats.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#ifndef NETWORK_NET_STATS_H_
+#define NETWORK_NET_STATS_H_
+
+#include "stdint.h"
+#include "clockcnt.h"
+
+// Network stack instrumentation, compile-time switch: define NET_STATS to 1 in the board.h or in the compiler flags.
+// When disabled, the counters and the histograms are not present and the NET_STAT_... macros generate no code.
+#ifndef NET_STATS
+  #define NET_STATS  0
+#endif
+
+#define NET_HISTO_BUCKETS   16
+#define NET_HISTO_SHIFT      4  // bucket[0]: < 16 clocks, bucket[n]: 2^(n+3) .. 2^(n+4)-1, the last one collects the rest
+
+typedef struct  // processing time histogram in CPU clocks (CLOCKCNT)
+{
+  uint32_t  count;
+  uint32_t  min;
+  uint32_t  max;
+  uint32_t  _pad;
+  uint64_t  sum;
+  uint32_t  bucket[NET_HISTO_BUCKETS];
+//
+} TNetCycleHisto;
+
+typedef struct
+{
+  // TNetAdapter
+  uint32_t        rx_frames;
+  uint32_t        rx_bytes;
+  uint32_t        rx_unhandled;     // no handler accepted it
+  uint32_t        tx_frames;
+  uint32_t        tx_bytes;
+  uint32_t        tx_errors;        // the MAC did not accept the frame
+  uint32_t        tx_alloc_fails;   // no free TX packet
+
+  // TIp4Handler
+  uint32_t        rx_arp;
+  uint32_t        rx_ip4;
+  uint32_t        rx_icmp;
+  uint32_t        rx_igmp;
+  uint32_t        rx_udp;
+  uint32_t        rx_tcp;
+  uint32_t        rx_ip_other;      // unknown IP protocol
+  uint32_t        drop_udp_noport;  // no socket listens on the port
+  uint32_t        drop_mcast;       // multicast group not joined
+  uint32_t        drop_tcp_invalid; // length or checksum error
+  uint32_t        tcp_resets_sent;  // no matching socket
+  uint32_t        arp_hits;
+  uint32_t        arp_misses;       // address resolution started / queued
+  uint32_t        arp_drops;        // packets dropped because of unsuccessful resolution
+
+  TNetCycleHisto  tx_histo;         // TNetAdapter::SendTxPacket()
+//
+} TNetStats;
+
+#if NET_STATS
+
+  #define NET_STAT_INC(aadapter, afield)          ++((aadapter)->stats.afield)
+  #define NET_STAT_ADD(aadapter, afield, avalue)  ((aadapter)->stats.afield += (avalue))
+  #define NET_STAT_TIME_START(avar)               clockcnt_t avar = CLOCKCNT
+  #define NET_STAT_TIME_END(ahisto, avar)         net_histo_add(&(ahisto), ELAPSEDCLOCKS(CLOCKCNT, avar))
+
+#else
+
+  #define NET_STAT_INC(aadapter, afield)
+  #define NET_STAT_ADD(aadapter, afield, avalue)
+  #define NET_STAT_TIME_START(avar)
+  #define NET_STAT_TIME_END(ahisto, avar)
+
+#endif
+
+inline void net_histo_add(TNetCycleHisto * ph, uint32_t aclocks)
+{
+  if (!ph->count || (aclocks < ph->min))  ph->min = aclocks;
+  if (aclocks > ph->max)                  ph->max = aclocks;
+  ph->sum += aclocks;
+  ++ph->count;
+
+  unsigned b = (aclocks >> NET_HISTO_SHIFT);
+  b = (b ? 32 - __builtin_clz(b) : 0);
+  if (b >= NET_HISTO_BUCKETS)  b = NET_HISTO_BUCKETS - 1;
+  ++ph->bucket[b];
+}
+
+#define NET_STATS_SNAPSHOT_MAGIC    0x5354534E  // "NSTS"
+#define NET_STATS_SNAPSHOT_VERSION  1
+
+typedef struct  // the snapshot starts with this, then the TNetStats and the handler_count x TNetCycleHisto follow
+{
+  uint32_t        magic;
+  uint16_t        version;
+  uint16_t        handler_count;  // RX processing histograms in the handler order
+  uint32_t        mscounter;
+  uint32_t        clocks_per_us;
+//
+} TNetStatsSnapshotHead;
+
+#endif /* NETWORK_NET_STATS_H_ */
@@ -0,0 +1,84 @@
+/*
+ * net_statspub.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#include "platform.h"
+#include "net_statspub.h"
+
+#if NET_STATS
+
+void TNetStatsPublisher::Init(TIp4Handler * aiphandler, uint16_t alistenport, TIp4Addr * adestaddr, uint16_t adestport)
+{
+  phandler = aiphandler;
+  adapter = phandler->adapter;
+
+  udp.Init(phandler, alistenport);
+
+  periodic = (adestaddr != nullptr);
+  if (periodic)
+  {
+    periodic_addr = *adestaddr;
+    periodic_port = adestport;
+  }
+
+  sent_count = 0;
+  last_send_ms = adapter->mscounter;
+
+  adapter->AddHandler(this);
+}
+
+bool TNetStatsPublisher::Publish()
+{
+  uint8_t *    pdata;
+  TPacketMem * pmem = udp.AllocateTxPacket(&pdata);
+  if (!pmem)
+  {
+    return false;
+  }
+
+  unsigned len = adapter->StatsSnapshot(pdata, UDP4_MAX_DATALEN);
+  if (!len)
+  {
+    udp.ReleaseTxPacket(pmem);  // too many handlers
+    return false;
+  }
+
+  if (udp.SendTxPacket(pmem, len) <= 0)
+  {
+    return false;
+  }
+
+  ++sent_count;
+  return true;
+}
+
+void TNetStatsPublisher::Run()
+{
+  uint8_t * pdata;
+  unsigned  datalen;
+  while (udp.ReceiveRef(&pdata, &datalen))
+  {
+    udp.ReleaseRx();
+
+    // answer to the requester
+    udp.destaddr = udp.srcaddr;
+    udp.destport = udp.srcport;
+    Publish();
+  }
+
+  if (periodic && interval_ms && (adapter->mscounter - last_send_ms >= interval_ms))
+  {
+    last_send_ms = adapter->mscounter;
+    if (adapter->IsLinkUp())
+    {
+      udp.destaddr = periodic_addr;
+      udp.destport = periodic_port;
+      Publish();
+    }
+  }
+}
+
+#endif
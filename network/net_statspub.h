@@ -0,0 +1,45 @@
+/*
+ * net_statspub.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#ifndef NETWORK_NET_STATSPUB_H_
+#define NETWORK_NET_STATSPUB_H_
+
+#include "stdint.h"
+#include "net_ip4.h"
+
+#if NET_STATS
+
+/* Publishes the TNetAdapter::StatsSnapshot() in UDP datagrams: periodically to the destination (when set)
+   and as a response to any datagram received on the listen port. */
+
+class TNetStatsPublisher : public TProtocolHandler
+{
+public: // settings
+  uint32_t            interval_ms = 1000;  // 0 = only on request
+
+public:
+  TIp4Handler *       phandler = nullptr;
+  TUdp4Socket         udp;
+
+  uint32_t            sent_count = 0;
+
+  // adestaddr = nullptr: no periodic sending
+  void                Init(TIp4Handler * aiphandler, uint16_t alistenport, TIp4Addr * adestaddr, uint16_t adestport);
+  virtual void        Run();
+
+  bool                Publish();  // sends a snapshot to the udp.destaddr / udp.destport
+
+protected:
+  bool                periodic = false;
+  TIp4Addr            periodic_addr;
+  uint16_t            periodic_port = 0;
+  uint32_t            last_send_ms = 0;
+};
+
+#endif
+
+#endif /* NETWORK_NET_STATSPUB_H_ */
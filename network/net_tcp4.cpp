@@ -0,0 +1,977 @@
+/*
+ * net_tcp4.cpp
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#include "string.h"
+#include "platform.h"
+#include "net_tcp4.h"
+#include "clockcnt.h"
+#include "traces.h"
+
+uint16_t calc_tcp4_checksum(TIp4Header * piph, uint16_t atcplen)
+{
+  // the checksum field is included, so it must be zeroed before the generation,
+  // on a received segment the result is 0 when the checksum is correct
+
+  uint32_t sum = calc_ip4_pseudo_header_sum(piph, atcplen);
+  return net_checksum_fold(net_checksum_add(sum, piph + 1, atcplen));
+}
+
+static TTcp4Header * tcp4_prepare_ip_header(TIp4Handler * ahandler, TPacketMem * pmem, uint8_t * adstaddr, uint16_t aid)
+{
+  PEthernetHeader eh  = PEthernetHeader(&pmem->data[0]);
+  PIp4Header      iph = PIp4Header(eh + 1);
+
+  eh->ethertype = 0x0008; // ether type: 0x0800 = IPV4 (byte swapped)
+
+  iph->hl_v = 0x45;
+  iph->tos = 0;
+  iph->id = __builtin_bswap16(aid);
+  iph->fl_offs = __builtin_bswap16(0x4000);
+  iph->ttl = 64;
+  iph->protocol = 6;
+
+  // unaligned safe address copy
+  *(uint16_t *)&iph->srcaddr[0] = ahandler->ipaddress.u16[0];
+  *(uint16_t *)&iph->srcaddr[2] = ahandler->ipaddress.u16[1];
+  *(uint16_t *)&iph->dstaddr[0] = *(uint16_t *)&adstaddr[0];
+  *(uint16_t *)&iph->dstaddr[2] = *(uint16_t *)&adstaddr[2];
+
+  return PTcp4Header(iph + 1);
+}
+
+static void tcp4_finish_packet(TIp4Handler * ahandler, TPacketMem * pmem, TTcp4Header * ptcph, unsigned atcplen)
+{
+  PIp4Header iph = PIp4Header(&pmem->data[sizeof(TEthernetHeader)]);
+
+  iph->len = __builtin_bswap16(atcplen + sizeof(TIp4Header));
+  iph->csum = 0;
+  ptcph->csum = 0;
+
+  if (!ahandler->adapter->peth->hw_ip_checksum)  // otherwise the MAC inserts the checksums
+  {
+    iph->csum = calc_ip4_header_checksum(iph);
+    ptcph->csum = calc_tcp4_checksum(iph, atcplen);
+  }
+
+  pmem->datalen = atcplen + sizeof(TIp4Header) + sizeof(TEthernetHeader);
+}
+
+void tcp4_send_reset(TIp4Handler * ahandler, TIp4Header * piph, TTcp4Header * ptcph, unsigned atcplen)
+{
+  if (ptcph->flags & TCPF_RST)
+  {
+    return;  // never answer a reset with a reset
+  }
+
+  TPacketMem * pmem = ahandler->adapter->AllocateTxPacket(sizeof(TEthernetHeader) + sizeof(TIp4Header) + sizeof(TTcp4Header));
+  if (!pmem)
+  {
+    return;
+  }
+
+  TTcp4Header * txtcph = tcp4_prepare_ip_header(ahandler, pmem, &piph->srcaddr[0], 0);
+
+  txtcph->sport = ptcph->dport;
+  txtcph->dport = ptcph->sport;
+  if (ptcph->flags & TCPF_ACK)
+  {
+    txtcph->seqnum[0] = ptcph->acknum[0];
+    txtcph->seqnum[1] = ptcph->acknum[1];
+    tcp_set_u32(&txtcph->acknum[0], 0);
+    txtcph->flags = TCPF_RST;
+  }
+  else
+  {
+    uint32_t seglen = atcplen - ((ptcph->hlen >> 4) << 2);
+    if (ptcph->flags & TCPF_SYN)  ++seglen;
+    if (ptcph->flags & TCPF_FIN)  ++seglen;
+
+    tcp_set_u32(&txtcph->seqnum[0], 0);
+    tcp_set_u32(&txtcph->acknum[0], tcp_get_u32(&ptcph->seqnum[0]) + seglen);
+    txtcph->flags = TCPF_RST | TCPF_ACK;
+  }
+  txtcph->hlen = (sizeof(TTcp4Header) >> 2) << 4;
+  txtcph->window = 0;
+  txtcph->urgptr = 0;
+
+  tcp4_finish_packet(ahandler, pmem, txtcph, sizeof(TTcp4Header));
+
+  ahandler->SendWithRouting(pmem);
+}
+
+//--------------------------------------------------------------
+
+bool TTcp4Socket::Init(TIp4Handler * ahandler)
+{
+  phandler = ahandler;
+
+  rxbuf = phandler->adapter->AllocateNetMem(rx_buf_size);
+  txbuf = phandler->adapter->AllocateNetMem(tx_buf_size);
+  if (!rxbuf || !txbuf)
+  {
+    TRACE("TCP: Error allocating socket buffers!\r\n");
+    return false;
+  }
+
+  listenport = 0;
+  ResetConnection();
+
+  phandler->AddTcpSocket(this);
+  return true;
+}
+
+void TTcp4Socket::ResetConnection()
+{
+  rx_rdidx = 0;
+  rx_cnt = 0;
+  tx_rdidx = 0;
+  tx_cnt = 0;
+  tx_ext_ptr = nullptr;
+  tx_ext_len = 0;
+
+  fin_pending = false;
+  fin_sent = false;
+  in_recovery = false;
+  dupacks = 0;
+  retries = 0;
+  unacked_segments = 0;
+  ack_pending = false;
+  ack_now = false;
+  rx_gap = false;
+
+  snd_mss = 536;
+  rto_ms = 1000;
+  srtt_ms = -1;
+  rttvar_ms = 0;
+  rtt_active = false;
+
+  remoteport = 0;
+  remoteaddr.u32 = 0;
+
+  if (listenport)
+  {
+    localport = listenport;
+    state = TCPS_LISTEN;
+  }
+  else
+  {
+    state = TCPS_CLOSED;
+  }
+}
+
+void TTcp4Socket::StartConnection(uint32_t airs)
+{
+  iss = CLOCKCNT;  // the initial sequence number should not be predictable
+  snd_una = iss;
+  snd_nxt = iss + 1;  // the SYN occupies one sequence number
+  snd_max = snd_nxt;
+  tx_seq  = snd_nxt;
+  rcv_nxt = airs + 1;
+
+  retries = 0;
+  rto_start_ms = phandler->adapter->mscounter;
+}
+
+bool TTcp4Socket::Listen(uint16_t aport)
+{
+  if ((TCPS_CLOSED != state) && (TCPS_LISTEN != state))
+  {
+    return false;
+  }
+
+  listenport = aport;
+  ResetConnection();
+  return true;
+}
+
+bool TTcp4Socket::Connect(TIp4Addr * aaddr, uint16_t aport, uint16_t alocalport)
+{
+  if ((TCPS_CLOSED != state) && (TCPS_LISTEN != state))
+  {
+    return false;
+  }
+
+  listenport = 0;
+  ResetConnection();
+
+  remoteaddr.CopyFrom16(aaddr);
+  remoteport = aport;
+  localport = (alocalport ? alocalport : phandler->TcpEphemeralPort());
+
+  StartConnection(0);
+  snd_wnd = 0;
+  state = TCPS_SYN_SENT;
+
+  SendSegment(iss, 0, TCPF_SYN);  // will be repeated by the Run() when the sending fails
+  return true;
+}
+
+void TTcp4Socket::Close()
+{
+  if ((TCPS_LISTEN == state) || (TCPS_SYN_SENT == state))
+  {
+    listenport = 0;
+    ResetConnection();
+  }
+  else if ((TCPS_SYN_RCVD == state) || (TCPS_ESTABLISHED == state) || (TCPS_CLOSE_WAIT == state))
+  {
+    fin_pending = true;
+    if (TCPS_SYN_RCVD != state)
+    {
+      TrySendData();
+    }
+  }
+}
+
+void TTcp4Socket::Abort()
+{
+  if ((TCPS_CLOSED != state) && (TCPS_LISTEN != state) && (TCPS_SYN_SENT != state))
+  {
+    SendSegment(snd_nxt, 0, TCPF_RST);
+  }
+  ResetConnection();
+}
+
+int TTcp4Socket::Send(void * adataptr, unsigned adatalen)
+{
+  bool canbuffer = ((state >= TCPS_SYN_SENT) && (state <= TCPS_ESTABLISHED)) || (TCPS_CLOSE_WAIT == state);
+  if (!canbuffer || fin_pending)
+  {
+    return -1;
+  }
+
+  unsigned len = TxFree();
+  if (len > adatalen)  len = adatalen;
+
+  // copy into the ring buffer
+  uint8_t * psrc = (uint8_t *)adataptr;
+  unsigned wridx = tx_rdidx + tx_cnt;
+  if (wridx >= tx_buf_size)  wridx -= tx_buf_size;
+  unsigned len1 = tx_buf_size - wridx;
+  if (len1 > len)  len1 = len;
+  memcpy(&txbuf[wridx], psrc, len1);
+  if (len1 < len)
+  {
+    memcpy(&txbuf[0], psrc + len1, len - len1);
+  }
+  tx_cnt += len;
+
+  if (state >= TCPS_ESTABLISHED)
+  {
+    TrySendData();
+  }
+
+  return len;
+}
+
+bool TTcp4Socket::SendRef(const void * adataptr, unsigned adatalen)
+{
+  bool canbuffer = ((state >= TCPS_SYN_SENT) && (state <= TCPS_ESTABLISHED)) || (TCPS_CLOSE_WAIT == state);
+  if (!canbuffer || fin_pending || tx_ext_len)
+  {
+    return false;
+  }
+
+  tx_ext_ptr = (const uint8_t *)adataptr;
+  tx_ext_len = adatalen;
+
+  if (state >= TCPS_ESTABLISHED)
+  {
+    TrySendData();
+  }
+
+  return true;
+}
+
+int TTcp4Socket::Receive(void * adataptr, unsigned adatalen)
+{
+  unsigned len = rx_cnt;
+  if (len > adatalen)  len = adatalen;
+  if (!len)
+  {
+    return 0;
+  }
+
+  uint8_t * pdst = (uint8_t *)adataptr;
+  unsigned len1 = rx_buf_size - rx_rdidx;
+  if (len1 > len)  len1 = len;
+  memcpy(pdst, &rxbuf[rx_rdidx], len1);
+  if (len1 < len)
+  {
+    memcpy(pdst + len1, &rxbuf[0], len - len1);
+  }
+
+  rx_rdidx += len;
+  if (rx_rdidx >= rx_buf_size)  rx_rdidx -= rx_buf_size;
+  rx_cnt -= len;
+
+  // send window update when the window opened significantly
+  unsigned wndinc = 2 * TCP4_MSS;
+  if (wndinc > (rx_buf_size >> 1u))  wndinc = (rx_buf_size >> 1u);
+  if ((state >= TCPS_ESTABLISHED) && (RxWindow() >= rcv_wnd_adv + wndinc))
+  {
+    ack_now = true;
+  }
+
+  return len;
+}
+
+uint16_t TTcp4Socket::RxWindow()
+{
+  return rx_buf_size - rx_cnt;
+}
+
+bool TTcp4Socket::Matches(TIp4Header * piph, TTcp4Header * ptcph)
+{
+  return (state > TCPS_LISTEN)
+         && (localport == __builtin_bswap16(ptcph->dport))
+         && (remoteport == __builtin_bswap16(ptcph->sport))
+         && remoteaddr.Matches(&piph->srcaddr[0]);
+}
+
+bool TTcp4Socket::SendSegment(uint32_t aseq, unsigned adatalen, uint8_t aflags)
+{
+  // + 4 bytes for the MSS option
+  TPacketMem * pmem = phandler->adapter->AllocateTxPacket(sizeof(TEthernetHeader) + sizeof(TIp4Header) + sizeof(TTcp4Header) + 4 + adatalen);
+  if (!pmem)
+  {
+    return false;
+  }
+
+  TTcp4Header * tcph = tcp4_prepare_ip_header(phandler, pmem, &remoteaddr.u8[0], ++idcounter);
+
+  unsigned hlen = sizeof(TTcp4Header);
+  if (aflags & TCPF_SYN)
+  {
+    // add the MSS option
+    uint8_t * popt = (uint8_t *)(tcph + 1);
+    popt[0] = 2;
+    popt[1] = 4;
+    popt[2] = (TCP4_MSS >> 8);
+    popt[3] = (TCP4_MSS & 0xFF);
+    hlen += 4;
+  }
+
+  if (adatalen)
+  {
+    CopyTxData((uint8_t *)tcph + hlen, aseq - tx_seq, adatalen);
+  }
+
+  if (TCPS_SYN_SENT != state)
+  {
+    aflags |= TCPF_ACK;
+  }
+
+  rcv_wnd_adv = RxWindow();
+
+  tcph->sport = __builtin_bswap16(localport);
+  tcph->dport = __builtin_bswap16(remoteport);
+  tcp_set_u32(&tcph->seqnum[0], aseq);
+  tcp_set_u32(&tcph->acknum[0], (aflags & TCPF_ACK ? rcv_nxt : 0));
+  tcph->hlen = (hlen >> 2) << 4;
+  tcph->flags = aflags;
+  tcph->window = __builtin_bswap16(rcv_wnd_adv);
+  tcph->urgptr = 0;
+
+  tcp4_finish_packet(phandler, pmem, tcph, hlen + adatalen);
+
+  // every segment carries the actual ACK
+  ack_pending = false;
+  ack_now = false;
+  unacked_segments = 0;
+
+  return phandler->SendWithRouting(pmem);
+}
+
+void TTcp4Socket::CopyTxData(uint8_t * pdst, unsigned aoffs, unsigned alen)
+{
+  if (aoffs < tx_cnt)
+  {
+    // from the TX ring buffer
+    unsigned len = tx_cnt - aoffs;
+    if (len > alen)  len = alen;
+
+    unsigned rdidx = tx_rdidx + aoffs;
+    if (rdidx >= tx_buf_size)  rdidx -= tx_buf_size;
+    unsigned len1 = tx_buf_size - rdidx;
+    if (len1 > len)  len1 = len;
+    memcpy(pdst, &txbuf[rdidx], len1);
+    if (len1 < len)
+    {
+      memcpy(pdst + len1, &txbuf[0], len - len1);
+    }
+
+    pdst += len;
+    aoffs += len;
+    alen -= len;
+  }
+
+  if (alen)
+  {
+    memcpy(pdst, tx_ext_ptr + (aoffs - tx_cnt), alen);  // the SendRef() data
+  }
+}
+
+void TTcp4Socket::SendAck()
+{
+  SendSegment(snd_nxt, 0, 0);
+}
+
+void TTcp4Socket::TrySendData(bool aprobe)
+{
+  uint32_t now = phandler->adapter->mscounter;
+
+  while (!fin_sent)
+  {
+    uint32_t unsent = tx_seq + TxQueued() - snd_nxt;
+    if (0 == unsent)
+    {
+      break;
+    }
+
+    if (in_recovery && TCP_SEQ_GE(snd_nxt, recover_seq))
+    {
+      break;  // no new data until the recovery is finished, a peer like this one would drop it as out of order
+    }
+
+    uint32_t inflight = snd_nxt - snd_una;
+    uint32_t len;
+    if (inflight < snd_wnd)
+    {
+      len = snd_wnd - inflight;
+      if (len > unsent)   len = unsent;
+      if (len > snd_mss)  len = snd_mss;
+    }
+    else if ((0 == snd_wnd) && (0 == inflight) && (aprobe || (now - rto_start_ms >= rto_ms)))
+    {
+      len = 1;  // zero window probe, repeated by the retransmission timer with backoff
+    }
+    else
+    {
+      break;
+    }
+
+    if (!SendSegment(snd_nxt, len, (len == unsent ? TCPF_PSH : 0)))
+    {
+      break;  // no free TX packet, continue at the next Run()
+    }
+
+    if (0 == inflight)
+    {
+      rto_start_ms = now;
+    }
+
+    if (!rtt_active && (snd_nxt == snd_max))  // measure only new data (Karn)
+    {
+      rtt_active = true;
+      rtt_seq = snd_nxt + len;
+      rtt_start_ms = now;
+    }
+
+    snd_nxt += len;
+    if (TCP_SEQ_GT(snd_nxt, snd_max))  snd_max = snd_nxt;
+  }
+
+  if (fin_pending && !fin_sent && (snd_nxt == tx_seq + TxQueued()))  // all data sent
+  {
+    if (SendSegment(snd_nxt, 0, TCPF_FIN))
+    {
+      if (snd_nxt == snd_una)
+      {
+        rto_start_ms = now;
+      }
+      ++snd_nxt;
+      if (TCP_SEQ_GT(snd_nxt, snd_max))  snd_max = snd_nxt;
+      fin_sent = true;
+
+      if (TCPS_ESTABLISHED == state)
+      {
+        state = TCPS_FIN_WAIT_1;
+      }
+      else if (TCPS_CLOSE_WAIT == state)
+      {
+        state = TCPS_LAST_ACK;
+      }
+    }
+  }
+}
+
+void TTcp4Socket::RetransmitFirst()
+{
+  uint32_t len = snd_max - snd_una;
+  if (len > TxQueued())  len = TxQueued();
+  if (len > snd_mss)  len = snd_mss;
+  if (len)
+  {
+    SendSegment(snd_una, len, 0);
+  }
+  rtt_active = false;
+  rto_start_ms = phandler->adapter->mscounter;
+}
+
+void TTcp4Socket::UpdateRtt(uint32_t aack)
+{
+  if (!rtt_active || TCP_SEQ_LT(aack, rtt_seq))
+  {
+    return;
+  }
+
+  rtt_active = false;
+
+  int r = phandler->adapter->mscounter - rtt_start_ms;
+  if (srtt_ms < 0)
+  {
+    srtt_ms = r;
+    rttvar_ms = (r >> 1);
+  }
+  else
+  {
+    int d = srtt_ms - r;
+    if (d < 0)  d = -d;
+    rttvar_ms = ((3 * rttvar_ms + d) >> 2);
+    srtt_ms = ((7 * srtt_ms + r) >> 3);
+  }
+
+  unsigned rto = srtt_ms + 4 * rttvar_ms;
+  if (rto < rto_min_ms)  rto = rto_min_ms;
+  if (rto > rto_max_ms)  rto = rto_max_ms;
+  rto_ms = rto;
+}
+
+bool TTcp4Socket::ProcessAck(uint32_t aack, uint16_t awnd, unsigned adatalen)
+{
+  if (TCP_SEQ_GT(aack, snd_max))  // acknowledges something not sent yet
+  {
+    ack_now = true;
+    return false;
+  }
+
+  if (TCP_SEQ_LE(aack, snd_una))  // no new data acknowledged
+  {
+    if (aack == snd_una)
+    {
+      if ((0 == adatalen) && (snd_max != snd_una) && (awnd == snd_wnd) && (0 != awnd))  // not a window probe answer
+      {
+        if (++dupacks == 3)
+        {
+          // fast retransmit, the recovery lasts until everything sent so far is acknowledged
+          in_recovery = true;
+          recover_seq = snd_max;
+          RetransmitFirst();
+        }
+      }
+
+      snd_wnd = awnd;
+      if (0 == snd_wnd)
+      {
+        retries = 0;  // the peer is alive, just its window is full
+      }
+    }
+    return true;
+  }
+
+  // new data acknowledged
+
+  snd_una = aack;
+  if (TCP_SEQ_LT(snd_nxt, snd_una))
+  {
+    snd_nxt = snd_una;  // acknowledged after a go back retransmission
+  }
+
+  // remove the acknowledged data from the TX buffer
+  int32_t acked = aack - tx_seq;
+  if (acked > 0)
+  {
+    if (uint32_t(acked) > TxQueued())  acked = TxQueued();  // the rest is the FIN
+    tx_seq += acked;
+
+    unsigned len = (unsigned(acked) < tx_cnt ? acked : tx_cnt);
+    tx_rdidx += len;
+    if (tx_rdidx >= tx_buf_size)  tx_rdidx -= tx_buf_size;
+    tx_cnt -= len;
+
+    acked -= len;  // the rest from the SendRef() data
+    tx_ext_ptr += acked;
+    tx_ext_len -= acked;
+  }
+
+  UpdateRtt(aack);
+
+  snd_wnd = awnd;
+  dupacks = 0;
+  retries = 0;
+  rto_start_ms = phandler->adapter->mscounter;
+
+  if (in_recovery)
+  {
+    if (TCP_SEQ_LT(aack, recover_seq))
+    {
+      RetransmitFirst();  // partial ACK: the next segment is lost too
+    }
+    else
+    {
+      in_recovery = false;
+    }
+  }
+
+  if (fin_pending && (state >= TCPS_FIN_WAIT_1) && TCP_SEQ_GT(aack, tx_seq + TxQueued()))
+  {
+    fin_sent = true;  // might be cleared by a go back retransmission
+    ProcessFinAcked();
+  }
+
+  return true;
+}
+
+void TTcp4Socket::ProcessFinAcked()
+{
+  if (TCPS_FIN_WAIT_1 == state)
+  {
+    state = TCPS_FIN_WAIT_2;
+  }
+  else if (TCPS_CLOSING == state)
+  {
+    state = TCPS_TIME_WAIT;
+    timewait_start_ms = phandler->adapter->mscounter;
+  }
+  else if (TCPS_LAST_ACK == state)
+  {
+    ResetConnection();
+  }
+}
+
+void TTcp4Socket::HandleRxSegment(TIp4Header * piph, TTcp4Header * ptcph, unsigned atcplen)
+{
+  uint32_t  now = phandler->adapter->mscounter;
+  uint8_t   flags = ptcph->flags;
+  uint32_t  seq = tcp_get_u32(&ptcph->seqnum[0]);
+  uint32_t  ack = tcp_get_u32(&ptcph->acknum[0]);
+  uint16_t  wnd = __builtin_bswap16(ptcph->window);
+  unsigned  hlen = ((ptcph->hlen >> 4) << 2);
+
+  if ((hlen < sizeof(TTcp4Header)) || (hlen > atcplen))
+  {
+    return;
+  }
+
+  uint8_t * pdata = (uint8_t *)ptcph + hlen;
+  unsigned  datalen = atcplen - hlen;
+
+  if (flags & TCPF_SYN)
+  {
+    // search the MSS option
+    uint8_t * popt = (uint8_t *)(ptcph + 1);
+    while (popt + 4 <= pdata)
+    {
+      if (0 == popt[0])  // end of options
+      {
+        break;
+      }
+      else if (1 == popt[0])  // NOP
+      {
+        ++popt;
+      }
+      else if (popt[1] < 2)  // invalid
+      {
+        break;
+      }
+      else
+      {
+        if ((2 == popt[0]) && (4 == popt[1]))
+        {
+          snd_mss = (popt[2] << 8) | popt[3];
+          if (snd_mss > TCP4_MSS)  snd_mss = TCP4_MSS;
+        }
+        popt += popt[1];
+      }
+    }
+  }
+
+  if (TCPS_LISTEN == state)
+  {
+    if (flags & TCPF_RST)
+    {
+      return;
+    }
+    if ((flags & TCPF_ACK) || !(flags & TCPF_SYN))
+    {
+      tcp4_send_reset(phandler, piph, ptcph, atcplen);
+      return;
+    }
+
+    remoteaddr.CopyFrom16(&piph->srcaddr[0]);
+    remoteport = __builtin_bswap16(ptcph->sport);
+    localport = listenport;
+
+    StartConnection(seq);
+    snd_wnd = wnd;
+    state = TCPS_SYN_RCVD;
+
+    SendSegment(iss, 0, TCPF_SYN);  // SYN + ACK
+    return;
+  }
+
+  if (TCPS_SYN_SENT == state)
+  {
+    if ((flags & TCPF_ACK) && (ack != iss + 1))
+    {
+      tcp4_send_reset(phandler, piph, ptcph, atcplen);
+      return;
+    }
+    if (flags & TCPF_RST)
+    {
+      if (flags & TCPF_ACK)
+      {
+        ResetConnection();  // connection refused
+      }
+      return;
+    }
+    if (0 == (flags & TCPF_SYN))
+    {
+      return;
+    }
+
+    rcv_nxt = seq + 1;
+    snd_wnd = wnd;
+    if (flags & TCPF_ACK)
+    {
+      snd_una = ack;
+      retries = 0;
+      state = TCPS_ESTABLISHED;
+      SendAck();
+      TrySendData();
+    }
+    else  // simultaneous open
+    {
+      state = TCPS_SYN_RCVD;
+      SendSegment(iss, 0, TCPF_SYN);
+    }
+    return;
+  }
+
+  // synchronized states
+
+  if (TCP_SEQ_GT(seq, rcv_nxt + RxWindow()))
+  {
+    // not acceptable segment
+    if (0 == (flags & TCPF_RST))
+    {
+      SendAck();
+    }
+    return;
+  }
+
+  if (flags & TCPF_RST)
+  {
+    if (TCP_SEQ_GE(seq, rcv_nxt))
+    {
+      ResetConnection();
+    }
+    return;
+  }
+
+  uint32_t seglen = datalen + (flags & TCPF_FIN ? 1 : 0);
+  if (seglen && TCP_SEQ_LE(seq + seglen, rcv_nxt))
+  {
+    ack_now = true;  // duplicate segment, our ACK was probably lost
+  }
+
+  if (flags & TCPF_SYN)
+  {
+    SendAck();  // challenge ACK
+    return;
+  }
+
+  if (0 == (flags & TCPF_ACK))
+  {
+    return;
+  }
+
+  if (TCPS_SYN_RCVD == state)
+  {
+    if (TCP_SEQ_LE(ack, snd_una) || TCP_SEQ_GT(ack, snd_max))
+    {
+      tcp4_send_reset(phandler, piph, ptcph, atcplen);
+      return;
+    }
+    state = TCPS_ESTABLISHED;
+  }
+
+  if (!ProcessAck(ack, wnd, datalen))
+  {
+    SendAck();
+    return;
+  }
+
+  if (state <= TCPS_LISTEN)  // the connection was finished (LAST_ACK)
+  {
+    return;
+  }
+
+  uint32_t finseq = seq + datalen;
+
+  if (datalen && ((TCPS_ESTABLISHED == state) || (TCPS_FIN_WAIT_1 == state) || (TCPS_FIN_WAIT_2 == state)))
+  {
+    if (seq != rcv_nxt)
+    {
+      if (TCP_SEQ_LT(seq, rcv_nxt))  // partially known segment
+      {
+        unsigned skip = rcv_nxt - seq;
+        if (skip > datalen)  skip = datalen;
+        pdata += skip;
+        datalen -= skip;
+      }
+      else  // out of order segment, drop it and signalize the gap with a duplicate ACK
+      {
+        datalen = 0;
+        ack_now = true;
+        rx_gap = true;
+      }
+    }
+
+    unsigned len = rx_buf_size - rx_cnt;
+    if (len > datalen)  len = datalen;
+    if (len)
+    {
+      unsigned wridx = rx_rdidx + rx_cnt;
+      if (wridx >= rx_buf_size)  wridx -= rx_buf_size;
+      unsigned len1 = rx_buf_size - wridx;
+      if (len1 > len)  len1 = len;
+      memcpy(&rxbuf[wridx], pdata, len1);
+      if (len1 < len)
+      {
+        memcpy(&rxbuf[0], pdata + len1, len - len1);
+      }
+      rx_cnt += len;
+      rcv_nxt += len;
+
+      // delayed ACK: every second segment is acknowledged immediately,
+      // and the segment filling a gap too, so the sender recovery is not delayed (RFC 5681 4.2)
+      if ((++unacked_segments >= 2) || rx_gap)
+      {
+        ack_now = true;
+        rx_gap = false;
+      }
+      else if (!ack_pending)
+      {
+        ack_pending = true;
+        delack_start_ms = now;
+      }
+    }
+
+    if (len < datalen)
+    {
+      ack_now = true;  // the rest did not fit into the window
+    }
+  }
+
+  if (flags & TCPF_FIN)
+  {
+    if (finseq == rcv_nxt)
+    {
+      ++rcv_nxt;
+      if (TCPS_ESTABLISHED == state)
+      {
+        state = TCPS_CLOSE_WAIT;
+      }
+      else if (TCPS_FIN_WAIT_1 == state)
+      {
+        state = TCPS_CLOSING;
+      }
+      else if (TCPS_FIN_WAIT_2 == state)
+      {
+        state = TCPS_TIME_WAIT;
+        timewait_start_ms = now;
+      }
+    }
+    else if (TCPS_TIME_WAIT == state)
+    {
+      timewait_start_ms = now;  // FIN retransmission
+    }
+    ack_now = true;
+  }
+
+  TrySendData();  // the window might be opened
+
+  if (ack_now)
+  {
+    SendAck();
+  }
+}
+
+void TTcp4Socket::Run()
+{
+  if (state <= TCPS_LISTEN)
+  {
+    return;
+  }
+
+  uint32_t now = phandler->adapter->mscounter;
+
+  if (TCPS_TIME_WAIT == state)
+  {
+    if (ack_now)
+    {
+      SendAck();
+    }
+    if (now - timewait_start_ms >= time_wait_ms)
+    {
+      ResetConnection();
+    }
+    return;
+  }
+
+  if ((TCPS_SYN_SENT == state) || (TCPS_SYN_RCVD == state))
+  {
+    if (now - rto_start_ms >= rto_ms)
+    {
+      if (++retries > max_retries)
+      {
+        ResetConnection();
+        return;
+      }
+
+      rto_ms <<= 1;
+      if (rto_ms > rto_max_ms)  rto_ms = rto_max_ms;
+      rto_start_ms = now;
+
+      SendSegment(iss, 0, TCPF_SYN);
+    }
+    return;
+  }
+
+  // retransmission timeout
+  bool rto_expired = false;
+  if ((snd_max != snd_una) && (now - rto_start_ms >= rto_ms))
+  {
+    if (++retries > max_retries)
+    {
+      TRACE("TCP: connection timeout\r\n");
+      Abort();
+      return;
+    }
+
+    rto_ms <<= 1;
+    if (rto_ms > rto_max_ms)  rto_ms = rto_max_ms;
+    rto_start_ms = now;
+
+    // go back to the first unacknowledged byte
+    snd_nxt = snd_una;
+    fin_sent = false;
+    rtt_active = false;
+    dupacks = 0;
+    in_recovery = false;
+    rto_expired = true;
+  }
+
+  TrySendData(rto_expired);  // with a zero window the expired timer sends the next probe
+
+  if (ack_now || (ack_pending && (now - delack_start_ms >= delayed_ack_ms)))
+  {
+    SendAck();
+  }
+}
@@ -0,0 +1,181 @@
+/*
+ * net_tcp4.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: agent
+ */
+
+#ifndef NETWORK_NET_TCP4_H_
+#define NETWORK_NET_TCP4_H_
+
+#include "stdint.h"
+#include "net_ip4.h"
+
+typedef struct  // 20 bytes (without options)
+{
+  uint16_t  sport;      // source port
+  uint16_t  dport;      // destination port
+  uint16_t  seqnum[2];  // sequence number, 2x16 bit for unaligned handling
+  uint16_t  acknum[2];  // acknowledgment number
+  uint8_t   hlen;       // header length in 32-bit words in the upper 4 bits
+  uint8_t   flags;
+  uint16_t  window;
+  uint16_t  csum;
+  uint16_t  urgptr;
+//
+} TTcp4Header, * PTcp4Header;
+
+#define TCPF_FIN   0x01
+#define TCPF_SYN   0x02
+#define TCPF_RST   0x04
+#define TCPF_PSH   0x08
+#define TCPF_ACK   0x10
+
+// the maximal segment size, limited by the standard 1500 byte Ethernet MTU
+#define TCP4_MSS  ((HWETH_MAX_PACKET_SIZE - 54) < 1460 ? (HWETH_MAX_PACKET_SIZE - 54) : 1460)
+
+#define TCPS_CLOSED       0
+#define TCPS_LISTEN       1
+#define TCPS_SYN_SENT     2
+#define TCPS_SYN_RCVD     3
+#define TCPS_ESTABLISHED  4
+#define TCPS_FIN_WAIT_1   5
+#define TCPS_FIN_WAIT_2   6
+#define TCPS_CLOSE_WAIT   7
+#define TCPS_CLOSING      8
+#define TCPS_LAST_ACK     9
+#define TCPS_TIME_WAIT   10
+
+inline uint32_t tcp_get_u32(uint16_t * asrc)  // unaligned safe, converts to host byte order
+{
+  return (__builtin_bswap16(asrc[0]) << 16) | __builtin_bswap16(asrc[1]);
+}
+
+inline void tcp_set_u32(uint16_t * adst, uint32_t avalue)  // unaligned safe, converts to network byte order
+{
+  adst[0] = __builtin_bswap16(avalue >> 16);
+  adst[1] = __builtin_bswap16(avalue & 0xFFFF);
+}
+
+// sequence number comparisons with wrap-around
+#define TCP_SEQ_LT(a, b)  (int32_t((a) - (b)) < 0)
+#define TCP_SEQ_LE(a, b)  (int32_t((a) - (b)) <= 0)
+#define TCP_SEQ_GT(a, b)  (int32_t((a) - (b)) > 0)
+#define TCP_SEQ_GE(a, b)  (int32_t((a) - (b)) >= 0)
+
+/* Minimal TCP connection with fixed size RX and TX ring buffers allocated from the NetMem.
+   Only in-order segments are accepted, the out of order ones are answered with an immediate
+   (duplicate) ACK, which triggers the fast retransmit on the peer side. */
+
+class TTcp4Socket
+{
+public: // settings, must be set before Init()
+  uint16_t          rx_buf_size = 4096;
+  uint16_t          tx_buf_size = 4096;
+
+  uint16_t          delayed_ack_ms = 20;
+  uint16_t          rto_min_ms = 200;    // retransmission timeout limits
+  uint16_t          rto_max_ms = 4000;
+  uint16_t          time_wait_ms = 1000;
+  uint8_t           max_retries = 8;     // the connection is aborted after so many retransmissions
+
+public:
+  uint8_t           state = TCPS_CLOSED;
+
+  TIp4Addr          remoteaddr;
+  uint16_t          remoteport = 0;
+  uint16_t          localport = 0;
+  uint16_t          listenport = 0;  // if set, the socket returns to listening after the connection is closed
+
+  uint16_t          idcounter = 0;
+
+  TIp4Handler *     phandler = nullptr;
+  TTcp4Socket *     nextsocket = nullptr;
+
+  bool              Init(TIp4Handler * ahandler);  // allocates the buffers from the NetMem
+
+  bool              Listen(uint16_t aport);  // passive open
+  bool              Connect(TIp4Addr * aaddr, uint16_t aport, uint16_t alocalport = 0);  // active open
+  void              Close();  // graceful close, the buffered TX data will be sent before the FIN
+  void              Abort();  // sends RST
+
+  int               Send(void * adataptr, unsigned adatalen);  // returns the number of bytes buffered
+  // zero-copy: the segments are filled directly from the given memory, which must remain unchanged until
+  // SendRefDone(), the Send() does not accept data until then
+  bool              SendRef(const void * adataptr, unsigned adatalen);
+  bool              SendRefDone() { return (0 == tx_ext_len); }
+  int               Receive(void * adataptr, unsigned adatalen);
+
+  bool              Connected()   { return (TCPS_ESTABLISHED == state) || (TCPS_CLOSE_WAIT == state); }
+  bool              RemoteClosed() { return (TCPS_CLOSE_WAIT == state) || (TCPS_LAST_ACK == state) || (TCPS_CLOSED == state); }
+  unsigned          RxAvailable() { return rx_cnt; }
+  unsigned          TxFree()      { return (tx_ext_len ? 0 : tx_buf_size - tx_cnt); }
+
+  void              Run();  // timers and transmission, called from TIp4Handler::Run()
+  void              HandleRxSegment(TIp4Header * piph, TTcp4Header * ptcph, unsigned atcplen);
+
+  bool              Matches(TIp4Header * piph, TTcp4Header * ptcph);
+
+protected:
+  uint8_t *         rxbuf = nullptr;
+  uint16_t          rx_rdidx = 0;
+  uint16_t          rx_cnt = 0;
+
+  uint8_t *         txbuf = nullptr;
+  uint16_t          tx_rdidx = 0;
+  uint16_t          tx_cnt = 0;   // unacknowledged + unsent bytes
+  uint32_t          tx_seq = 0;   // sequence number of the first byte in the txbuf
+  const uint8_t *   tx_ext_ptr = nullptr;  // SendRef() data, follows the txbuf data in the stream
+  uint32_t          tx_ext_len = 0;        // unacknowledged + unsent SendRef() bytes
+
+  uint32_t          iss = 0;      // initial send sequence number
+  uint32_t          snd_una = 0;  // oldest unacknowledged sequence number
+  uint32_t          snd_nxt = 0;  // next sequence number to send
+  uint32_t          snd_max = 0;  // highest sequence number sent
+  uint32_t          snd_wnd = 0;  // peer receive window
+  uint16_t          snd_mss = 536;
+  uint32_t          rcv_nxt = 0;
+  uint16_t          rcv_wnd_adv = 0;  // the last advertised receive window
+
+  bool              fin_pending = false;  // Close() requested
+  bool              fin_sent = false;
+  uint8_t           dupacks = 0;
+  bool              in_recovery = false;  // fast recovery after fast retransmit
+  uint32_t          recover_seq = 0;
+  uint8_t           retries = 0;
+  uint8_t           unacked_segments = 0;
+  bool              ack_pending = false;
+  bool              ack_now = false;
+  bool              rx_gap = false;  // an out of order segment was dropped, the gap filling one is acknowledged at once
+
+  uint16_t          rto_ms = 1000;
+  int16_t           srtt_ms = -1;   // -1 = no measurement yet
+  uint16_t          rttvar_ms = 0;
+  bool              rtt_active = false;
+  uint32_t          rtt_seq = 0;
+  uint32_t          rtt_start_ms = 0;
+
+  uint32_t          rto_start_ms = 0;
+  uint32_t          delack_start_ms = 0;
+  uint32_t          timewait_start_ms = 0;
+
+  inline uint32_t   TxQueued() { return tx_cnt + tx_ext_len; }
+
+  void              ResetConnection();
+  void              StartConnection(uint32_t airs);
+  bool              SendSegment(uint32_t aseq, unsigned adatalen, uint8_t aflags);
+  void              SendAck();
+  void              TrySendData(bool aprobe = false);  // aprobe: send the zero window probe now
+  void              CopyTxData(uint8_t * pdst, unsigned aoffs, unsigned alen);
+  bool              ProcessAck(uint32_t aack, uint16_t awnd, unsigned adatalen);
+  void              ProcessFinAcked();
+  void              RetransmitFirst();
+  void              UpdateRtt(uint32_t aack);
+  uint16_t          RxWindow();
+};
+
+uint16_t calc_tcp4_checksum(TIp4Header * piph, uint16_t atcplen);  // 0 = the received segment is valid
+
+void tcp4_send_reset(TIp4Handler * ahandler, TIp4Header * piph, TTcp4Header * ptcph, unsigned atcplen);
+
+#endif /* NETWORK_NET_TCP4_H_ */
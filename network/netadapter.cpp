@@ -6,7 +6,9 @@
  */
 
 
+#include "string.h"
 #include "netadapter.h"
+#include "net_capture.h"
 #include "clockcnt.h"
 #include "traces.h"
 
@@ -18,8 +20,26 @@ bool TNetAdapter::Init(THwEth * aeth, void * anetmem, unsigned anetmemsize)
 
   initialized = false;
   firsthandler = nullptr;
-  first_sending_pkt = nullptr;
-  last_sending_pkt = nullptr;
+  tx_sending_count = 0;
+  tx_complete_flag = false;
+  capture = nullptr;
+
+  rx_drained_count = 0;
+  rx_dropped_count = 0;
+  rx_budget_full_count = 0;
+  rx_ring_full_count = 0;
+  netmem_fail_count = 0;
+
+#if NET_STATS
+  memset(&stats, 0, sizeof(stats));
+#endif
+
+  if (tx_irq_reaping && !peth->TxIrqSupported())
+  {
+    TRACE("NetAdapter: tx_irq_reaping is not supported by this MAC driver!\r\n");
+    TRACE_FLUSH();
+    return false;
+  }
 
   mscounter = 0;
   last_mscounter_clocks = CLOCKCNT;
@@ -29,8 +49,10 @@ bool TNetAdapter::Init(THwEth * aeth, void * anetmem, unsigned anetmemsize)
   netmem_allocated = 0;
   // RX and TX descriptors
   rx_desc_mem = AllocateNetMem(sizeof(HW_ETH_DMA_DESC) * max_rx_packets);
-  tx_desc_mem = AllocateNetMem(sizeof(HW_ETH_DMA_DESC) * max_tx_packets);
-  if (!rx_desc_mem || !tx_desc_mem)
+  tx_desc_count = max_tx_packets + max_tx_small_packets + max_tx_medium_packets;
+  tx_desc_mem = AllocateNetMem(sizeof(HW_ETH_DMA_DESC) * tx_desc_count);
+  tx_desc_pkt = (TPacketMem * *)AllocateNetMem(sizeof(TPacketMem *) * tx_desc_count);
+  if (!rx_desc_mem || !tx_desc_mem || !tx_desc_pkt)
   {
     TRACE("NetAdapter: Error allocating RX/TX descriptors!\r\n");
     TRACE_FLUSH();
@@ -45,8 +67,9 @@ bool TNetAdapter::Init(THwEth * aeth, void * anetmem, unsigned anetmemsize)
     return false;
   }
 
-  tx_pmem = AllocateNetMem(sizeof(TPacketMem) * max_tx_packets);
-  if (!tx_pmem)
+  if (   !InitTxPool(&txpool[0], max_tx_small_packets,  NET_POOL_SMALL_DATALEN)
+      || !InitTxPool(&txpool[1], max_tx_medium_packets, NET_POOL_MEDIUM_DATALEN)
+      || !InitTxPool(&txpool[2], max_tx_packets,        HWETH_MAX_PACKET_SIZE))
   {
     TRACE("NetAdapter: Error allocating TX packet buffers!\r\n");
     TRACE_FLUSH();
@@ -54,9 +77,18 @@ bool TNetAdapter::Init(THwEth * aeth, void * anetmem, unsigned anetmemsize)
   }
 
   peth->promiscuous_mode = false;
-  peth->hw_ip_checksum = false; //true;
+  peth->hw_ip_checksum = hw_checksum;
+  if (tx_irq_reaping)
+  {
+    peth->irq_on_tx = true;
+  }
 
-  if (!peth->Init(rx_desc_mem, max_rx_packets, tx_desc_mem, max_tx_packets))
+  for (unsigned n = 0; n < tx_desc_count; ++n)
+  {
+    tx_desc_pkt[n] = nullptr;
+  }
+
+  if (!peth->Init(rx_desc_mem, max_rx_packets, tx_desc_mem, tx_desc_count))
   {
     TRACE("NetAdapter: ETH INIT FAILED!\r\n");
     TRACE_FLUSH();
@@ -67,22 +99,9 @@ bool TNetAdapter::Init(THwEth * aeth, void * anetmem, unsigned anetmemsize)
 
   for (unsigned n = 0; n < max_rx_packets; ++n)
   {
-    peth->AssignRxBuf(n, (TPacketMem *)&rx_pmem[sizeof(TPacketMem) * n], HWETH_MAX_PACKET_SIZE);
-  }
-
-  // Initialize TX packet allocation
-  TPacketMem *  pmem = (TPacketMem *)tx_pmem;
-  TPacketMem *  prevpmem = pmem;
-  first_free_tx_pmem = pmem;
-  for (unsigned n = 1; n < max_tx_packets; ++n)
-  {
-    pmem->flags = 0;
-    pmem->max_datalen = sizeof(pmem->data); // these are max sized packets
-
-    ++pmem;
-    prevpmem->next = pmem;
-    pmem->next = nullptr;
-    prevpmem = pmem;
+    TPacketMem * pmem = (TPacketMem *)&rx_pmem[sizeof(TPacketMem) * n];
+    pmem->timestamp_ns = 0;  // only the timestamping drivers set it, the PTP and the capture rely on the 0
+    peth->AssignRxBuf(n, pmem, HWETH_MAX_PACKET_SIZE);
   }
 
   // start the network interface
@@ -93,6 +112,43 @@ bool TNetAdapter::Init(THwEth * aeth, void * anetmem, unsigned anetmemsize)
   return true;
 }
 
+bool TNetAdapter::InitTxPool(TNetPacketPool * apool, unsigned acount, unsigned adatalen)
+{
+  apool->datalen = adatalen;
+  apool->count = acount;
+  apool->used = 0;
+  apool->used_max = 0;
+  apool->fail_count = 0;
+  apool->first_free = nullptr;
+
+  if (!acount)
+  {
+    return true;
+  }
+
+  unsigned  pktsize = HWETH_PMEM_HEAD_SIZE + adatalen;  // multiple of 32, keeps the cache line alignment
+  uint8_t * pmem8 = AllocateNetMem(pktsize * acount);
+  if (!pmem8)
+  {
+    return false;
+  }
+
+  pmem8 += pktsize * acount;
+  for (unsigned n = 0; n < acount; ++n)  // build the free list backwards, so the first one is allocated first
+  {
+    pmem8 -= pktsize;
+    TPacketMem * pmem = (TPacketMem *)pmem8;
+    pmem->flags = 0;
+    pmem->status = 0;
+    pmem->timestamp_ns = 0;
+    pmem->max_datalen = adatalen;
+    pmem->next = apool->first_free;
+    apool->first_free = pmem;
+  }
+
+  return true;
+}
+
 void TNetAdapter::AddHandler(TProtocolHandler * ahandler)
 {
   ahandler->next = nullptr;
@@ -113,15 +169,13 @@ void TNetAdapter::AddHandler(TProtocolHandler * ahandler)
 
 uint8_t * TNetAdapter::AllocateNetMem(unsigned asize)
 {
+  asize = ((asize + 7) & ~7);  // keeps the 64-bit fields aligned
+
   if (asize > NetMemFree())
   {
+    // serious error, change the memory sizes, the adapter configuration
     TRACE("AllocateNetMem FAILED!\r\n");
-    TRACE_FLUSH();
-
-#if defined(CPU_ARMM)
-    __BKPT();  // serious error, change the memory sizes, the adapter configuration
-#endif
-
+    ++netmem_fail_count;
     return nullptr;
   }
 
@@ -138,6 +192,8 @@ TPacketMem * TNetAdapter::CreateSysTxPacket(unsigned asize)  // allocates from t
   {
     result->max_datalen = asize;
     result->flags = PMEMFLAG_SYS;
+    result->status = 0;
+    result->timestamp_ns = 0;
   }
 
   return result;
@@ -160,31 +216,35 @@ void TNetAdapter::Run()
   }
 
   // free Sended Tx Packets
-  // TODO: check the whole chain ?
-  while (first_sending_pkt && peth->SendFinished(first_sending_pkt->idx))
+  if (tx_sending_count && (!tx_irq_reaping || tx_complete_flag))
   {
-    pmem = first_sending_pkt;
-    first_sending_pkt = first_sending_pkt->next; // unchain first before free !
-
-    //TRACE("%u Releasing TX packet %u\r\n", mscounter, pmem->idx);
-    ReleaseTxPacket(pmem);
-  }
-  if (!first_sending_pkt)
-  {
-    last_sending_pkt = nullptr;
+    tx_complete_flag = false;  // cleared before the scan, so a completion during the scan is not lost
+    ReapTxPackets();
   }
 
-  // check for Rx Packets
+  // process the Rx Packets, at most rx_budget of them
 
-  if (peth->TryRecv(&pmem))
+  unsigned rxcnt = 0;
+  while ((rxcnt < rx_budget) && peth->TryRecv(&pmem))
   {
+    ++rxcnt;
     pmem->flags = 0;
 
+    if (capture)
+    {
+      capture->CaptureFrame(pmem, false);
+    }
+
+    NET_STAT_INC(this, rx_frames);
+    NET_STAT_ADD(this, rx_bytes, pmem->datalen);
+
     ph = firsthandler;
     while (ph)
     {
+      NET_STAT_TIME_START(t0);
       if (ph->HandleRxPacket(pmem))
       {
+        NET_STAT_TIME_END(ph->rx_histo, t0);
         break;
       }
       ph = ph->next;
@@ -193,6 +253,8 @@ void TNetAdapter::Run()
     if (!ph)
     {
       // the packet was not handled
+      ++rx_dropped_count;
+      NET_STAT_INC(this, rx_unhandled);
     }
 
     if (0 == (pmem->flags & PMEMFLAG_KEEP))  // release the packet when not explicitly told to keep it
@@ -201,6 +263,15 @@ void TNetAdapter::Run()
     }
   }
 
+  rx_drained_count += rxcnt;
+  if (rxcnt >= rx_budget)
+  {
+    ++rx_budget_full_count;
+  }
+  // the frames lost for lack of a free RX descriptor are counted by the driver,
+  // the Run() should be called more frequently or the max_rx_packets increased
+  rx_ring_full_count = peth->recv_missed_count;
+
   // Run Idle parts
 
   ph = firsthandler;
@@ -211,18 +282,68 @@ void TNetAdapter::Run()
   }
 }
 
-TPacketMem * TNetAdapter::AllocateTxPacket()
+unsigned TNetAdapter::ReapTxPackets()
 {
-  if (first_free_tx_pmem)
+  // the whole ring is checked, the descriptors might complete in any order
+  unsigned result = 0;
+  for (unsigned n = 0; n < tx_desc_count; ++n)
   {
-    TPacketMem * result = first_free_tx_pmem;
-    first_free_tx_pmem = first_free_tx_pmem->next;
-    return result;
+    TPacketMem * pmem = tx_desc_pkt[n];
+    if (pmem && peth->SendFinished(n))
+    {
+      tx_desc_pkt[n] = nullptr;
+      --tx_sending_count;
+      ++result;
+
+      //TRACE("%u Releasing TX packet %u\r\n", mscounter, pmem->idx);
+      ReleaseTxPacket(pmem);
+    }
   }
-  else
+  return result;
+}
+
+TPacketMem * TNetAdapter::AllocateTxPacket(unsigned alen)
+{
+  TNetPacketPool * pfit = nullptr;  // the smallest class that fits
+
+  for (unsigned c = 0; c < NET_POOL_CLASSES; ++c)
   {
-    return nullptr;
+    TNetPacketPool * pool = &txpool[c];
+    if (pool->datalen < alen)
+    {
+      continue;
+    }
+
+    if (!pfit && pool->count)
+    {
+      pfit = pool;
+    }
+
+    TPacketMem * result = pool->first_free;
+    if (result)
+    {
+      pool->first_free = result->next;
+      ++pool->used;
+      if (pool->used > pool->used_max)
+      {
+        pool->used_max = pool->used;
+      }
+      return result;
+    }
   }
+
+  // the completed packets might be not reaped yet (IRQ mode or Run() not called since)
+  if (tx_sending_count && ReapTxPackets())
+  {
+    return AllocateTxPacket(alen);
+  }
+
+  if (pfit)
+  {
+    ++pfit->fail_count;
+  }
+  NET_STAT_INC(this, tx_alloc_fails);
+  return nullptr;
 }
 
 void TNetAdapter::ReleaseTxPacket(TPacketMem * apmem)
@@ -234,12 +355,28 @@ void TNetAdapter::ReleaseTxPacket(TPacketMem * apmem)
     return; // do not touch the system packets
   }
 
-  apmem->next = first_free_tx_pmem;
-  first_free_tx_pmem = apmem;
+  for (unsigned c = 0; c < NET_POOL_CLASSES; ++c)
+  {
+    TNetPacketPool * pool = &txpool[c];
+    if (pool->datalen == apmem->max_datalen)
+    {
+      apmem->next = pool->first_free;
+      pool->first_free = apmem;
+      --pool->used;
+      return;
+    }
+  }
 }
 
 void TNetAdapter::ReleaseRxPacket(TPacketMem * apmem)
 {
+  if (apmem->flags & PMEMFLAG_SYS)  // not an Ethernet RX buffer (e.g. reassembled IP datagram)
+  {
+    apmem->flags = PMEMFLAG_SYS;
+    apmem->status = 0;
+    return;
+  }
+
   peth->ReleaseRxBuf(apmem);
 }
 
@@ -247,10 +384,18 @@ bool TNetAdapter::SendTxPacket(TPacketMem * apmem)  // the packet will be automa
 {
   // send the packet on the Ethernet
 
+  if (capture)
+  {
+    capture->CaptureFrame(apmem, true);
+  }
+
+  NET_STAT_TIME_START(t0);
+
   uint32_t idx;
   if (!peth->TrySend(&idx, &apmem->data[0], apmem->datalen))
   {
     ReleaseTxPacket(apmem);
+    NET_STAT_INC(this, tx_errors);
     return false;
   }
 
@@ -260,19 +405,83 @@ bool TNetAdapter::SendTxPacket(TPacketMem * apmem)  // the packet will be automa
   apmem->status = 1; // sending active
   apmem->next = nullptr;
 
-  // add to the sending chain
-  if (last_sending_pkt)
+  if (idx < tx_desc_count)
   {
-    last_sending_pkt->next = apmem;
-    last_sending_pkt = apmem;
+    // the MAC gave this descriptor back, so its previous packet is already sent
+    TPacketMem * prevpkt = tx_desc_pkt[idx];
+    if (prevpkt)
+    {
+      --tx_sending_count;
+      if (prevpkt != apmem)
+      {
+        ReleaseTxPacket(prevpkt);
+      }
+    }
+
+    tx_desc_pkt[idx] = apmem;
+    ++tx_sending_count;
   }
-  else
+
+  NET_STAT_INC(this, tx_frames);
+  NET_STAT_ADD(this, tx_bytes, apmem->datalen);
+  NET_STAT_TIME_END(stats.tx_histo, t0);
+
+  return true;
+}
+
+#if NET_STATS
+
+void TNetAdapter::ResetStats()
+{
+  memset(&stats, 0, sizeof(stats));
+
+  TProtocolHandler * ph = firsthandler;
+  while (ph)
+  {
+    memset(&ph->rx_histo, 0, sizeof(ph->rx_histo));
+    ph = ph->next;
+  }
+}
+
+unsigned TNetAdapter::StatsSnapshot(void * adst, unsigned amaxlen)
+{
+  unsigned hcnt = 0;
+  TProtocolHandler * ph = firsthandler;
+  while (ph)
   {
-    first_sending_pkt = apmem;
-    last_sending_pkt = apmem;
+    ++hcnt;
+    ph = ph->next;
   }
 
-  apmem->next = nullptr;  // prevents circular chaining on double addition
+  unsigned len = sizeof(TNetStatsSnapshotHead) + sizeof(TNetStats) + hcnt * sizeof(TNetCycleHisto);
+  if (len > amaxlen)
+  {
+    return 0;
+  }
 
-  return true;
+  uint8_t * pdst = (uint8_t *)adst;
+
+  TNetStatsSnapshotHead head;
+  head.magic = NET_STATS_SNAPSHOT_MAGIC;
+  head.version = NET_STATS_SNAPSHOT_VERSION;
+  head.handler_count = hcnt;
+  head.mscounter = mscounter;
+  head.clocks_per_us = SystemCoreClock / 1000000;
+  memcpy(pdst, &head, sizeof(head));
+  pdst += sizeof(head);
+
+  memcpy(pdst, &stats, sizeof(stats));
+  pdst += sizeof(stats);
+
+  ph = firsthandler;
+  while (ph)
+  {
+    memcpy(pdst, &ph->rx_histo, sizeof(TNetCycleHisto));
+    pdst += sizeof(TNetCycleHisto);
+    ph = ph->next;
+  }
+
+  return len;
 }
+
+#endif
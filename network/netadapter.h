@@ -11,8 +11,10 @@
 #include "stdint.h"
 #include "network.h"
 #include "hweth.h"
+#include "net_stats.h"
 
 class TNetAdapter;
+class TNetCapture;
 
 class TProtocolHandler
 {
@@ -21,6 +23,10 @@ public:
 
   TProtocolHandler *  next = nullptr;
 
+#if NET_STATS
+  TNetCycleHisto      rx_histo = {};  // HandleRxPacket() time of the accepted packets
+#endif
+
   virtual             ~TProtocolHandler() { } // never ment to be destructed, but the GCC requires this
 
 public: // virtual functions
@@ -28,6 +34,21 @@ public: // virtual functions
   virtual void        Run() { }
 };
 
+#define NET_POOL_CLASSES         3  // TX packet size classes
+#define NET_POOL_SMALL_DATALEN   128  // ARP, ICMP and TCP ACK frames, DHCP needs the medium size
+#define NET_POOL_MEDIUM_DATALEN  512
+
+typedef struct  // a fixed size TX packet pool
+{
+  uint16_t            datalen;     // max data length of the packets in this class
+  uint16_t            count;
+  uint16_t            used;
+  uint16_t            used_max;    // high-water mark
+  uint32_t            fail_count;  // no free packet in this or in a larger class
+  TPacketMem *        first_free;
+//
+} TNetPacketPool;
+
 // TNetAdapter could be the child of the THwEth too
 
 class TNetAdapter
@@ -35,23 +56,51 @@ class TNetAdapter
 public: // settings
 
   uint8_t             max_rx_packets = 8;
-  uint8_t             max_tx_packets = 8;
+  uint8_t             max_tx_packets = 8;   // full sized (HWETH_MAX_PACKET_SIZE) TX packets
+  uint8_t             max_tx_small_packets = 0;   // NET_POOL_SMALL_DATALEN sized TX packets
+  uint8_t             max_tx_medium_packets = 0;  // NET_POOL_MEDIUM_DATALEN sized TX packets
+  uint8_t             rx_budget = 4;  // maximal number of RX packets processed in one Run() call
+  bool                hw_checksum = false;  // use the MAC checksum offload, set only when the MAC supports it
+  bool                tx_irq_reaping = false;  // scan the TX ring only after TxCompleteIrq() calls (sets the peth->irq_on_tx), Init() fails when !peth->TxIrqSupported()
+
+public: // statistics
+  uint32_t            rx_drained_count = 0;    // received packets processed
+  uint32_t            rx_dropped_count = 0;    // received packets that no handler accepted
+  uint32_t            rx_budget_full_count = 0;  // the rx_budget was exhausted, more packets might be pending
+  uint32_t            rx_ring_full_count = 0;  // frames dropped by the MAC because the RX ring was full (peth->recv_missed_count)
+  uint32_t            netmem_fail_count = 0;   // AllocateNetMem() failures
+
+#if NET_STATS
+  TNetStats           stats;
+
+  void                ResetStats();
+  unsigned            StatsSnapshot(void * adst, unsigned amaxlen);  // returns the snapshot length, see TNetStatsSnapshotHead
+#endif
 
 public:
   bool                initialized = false;
   THwEth *            peth = nullptr;
 
   TProtocolHandler *  firsthandler = nullptr;
-  TPacketMem *        first_sending_pkt = nullptr;
-  TPacketMem *        last_sending_pkt = nullptr;
+  TPacketMem * *      tx_desc_pkt = nullptr;  // the packets under sending, indexed by the TX descriptor
+  uint16_t            tx_desc_count = 0;      // one for every TX packet
+  uint16_t            tx_sending_count = 0;
+
+  TNetCapture *       capture = nullptr;  // optional frame capture tap, see TNetCapture
 
   bool                Init(THwEth * aeth, void * anetmem, unsigned anetmemsize);
 
   void                Run(); // must be called regularly
 
+  unsigned            ReapTxPackets();  // releases the completed TX packets, returns their count
+  inline void         TxCompleteIrq() { tx_complete_flag = true; }  // call from the ETH TX interrupt
+
   bool                SendTxPacket(TPacketMem * apmem);  // the packet will be automatically released
 
-  TPacketMem *        AllocateTxPacket();
+  TNetPacketPool      txpool[NET_POOL_CLASSES];  // in increasing size order
+
+  // returns the smallest free packet that can hold alen bytes (including the Ethernet header)
+  TPacketMem *        AllocateTxPacket(unsigned alen = HWETH_MAX_PACKET_SIZE);
   void                ReleaseTxPacket(TPacketMem * apmem);
   void                ReleaseRxPacket(TPacketMem * apmem);
 
@@ -69,21 +118,22 @@ public:
 
 protected: // internal memory management
 
+  volatile bool       tx_complete_flag = false;
+
   unsigned            last_mscounter_clocks = 0;
   unsigned            clocks_per_ms = 0;
 
-  TPacketMem *        first_free_tx_pmem = nullptr;
-
   uint8_t *           rx_desc_mem = nullptr;
   uint8_t *           tx_desc_mem = nullptr;
 
   uint8_t *           rx_pmem = nullptr;
-  uint8_t *           tx_pmem = nullptr;
 
   uint8_t *           netmem = nullptr;
   unsigned            netmem_size = 0;
   unsigned            netmem_allocated = 0;
 
+  bool                InitTxPool(TNetPacketPool * apool, unsigned acount, unsigned adatalen);
+
 };
 
 
@@ -8,22 +8,76 @@
 #include "platform.h"
 #include "network.h"
 
-uint16_t calc_icmp_checksum(void * pdata, uint32_t datalen)
+uint32_t net_checksum_add(uint32_t asum, void * pdata, uint32_t datalen)
 {
-  //((uint8_t *)&pdata)[datalen] = 0; // for odd size handling
+  uint64_t  sum = asum;
+  uint8_t * pd8 = (uint8_t *)pdata;
+
+  if ((uintptr_t(pd8) & 2) && (datalen >= 2))  // align to 4 bytes
+  {
+    sum += *(uint16_t *)pd8;
+    pd8 += 2;
+    datalen -= 2;
+  }
+
+  // 32-bit wide accumulation, the carries are collected in the upper 32 bits
+  uint32_t * pd32 = (uint32_t *)pd8;
+  uint32_t * pd32_end = pd32 + (datalen >> 2);
+  while (pd32 + 4 <= pd32_end)
+  {
+    sum += pd32[0];
+    sum += pd32[1];
+    sum += pd32[2];
+    sum += pd32[3];
+    pd32 += 4;
+  }
+  while (pd32 < pd32_end)
+  {
+    sum += *pd32++;
+  }
+
+  pd8 = (uint8_t *)pd32;
+  if (datalen & 2)
+  {
+    sum += *(uint16_t *)pd8;
+    pd8 += 2;
+  }
+  if (datalen & 1)  // one byte remained
+  {
+    #if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+      sum += (*pd8 << 8);
+    #else
+      sum += *pd8;
+    #endif
+  }
 
-  uint32_t n;
-  uint32_t clen = ((datalen + 1) >> 1);
-  uint32_t sum = 0;
-  uint16_t * pd16 = (uint16_t *)pdata;
+  //  Fold 64-bit sum to 32 bits, then to 16 bits
+  sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+  sum = (sum & 0xFFFFFFFF) + (sum >> 32);
 
-  for (n = 0; n < clen; ++n)
+  uint32_t sum32 = (sum & 0xFFFF) + (uint32_t(sum) >> 16);
+  return (sum32 & 0xFFFF) + (sum32 >> 16);
+}
+
+uint16_t net_checksum_fold(uint32_t asum)
+{
+  while (asum >> 16)
   {
-    sum += __builtin_bswap16(*pd16++);
+    asum = (asum & 0xffff) + (asum >> 16);
   }
 
-  sum = (sum & 0xffff) + (sum >> 16);
+  return (uint16_t) (~asum);
+}
 
+uint16_t net_checksum_update(uint16_t acsum, uint16_t aoldword, uint16_t anewword)
+{
+  // HC' = ~(~HC + ~m + m')
+  uint32_t sum = uint16_t(~acsum) + uint16_t(~aoldword) + anewword;
+  return net_checksum_fold(sum);
+}
 
-  return (uint16_t) (~sum);
+uint16_t calc_icmp_checksum(void * pdata, uint32_t datalen)
+{
+  // the result is in host byte order
+  return __builtin_bswap16(net_checksum_fold(net_checksum_add(0, pdata, datalen)));
 }
@@ -42,6 +42,12 @@ typedef struct
 //
 } TIcmpHeader, * PIcmpHeader;
 
+// Internet checksum (RFC 1071) helpers, the data must be at least 2-bytes aligned.
+// The sum is built from native 16-bit words, so the folded result can be stored directly into the header.
+uint32_t net_checksum_add(uint32_t asum, void * pdata, uint32_t datalen);  // returns a partial sum
+uint16_t net_checksum_fold(uint32_t asum);  // returns the final (inverted) checksum
+uint16_t net_checksum_update(uint16_t acsum, uint16_t aoldword, uint16_t anewword);  // incremental update (RFC 1624)
+
 uint16_t calc_icmp_checksum(void * pdata, uint32_t datalen);
 
 #endif /* NETWORK_NETWORK_H_ */
@@ -0,0 +1,206 @@
+/*
+ *  file:     bench_fat.cpp (host tests)
+ *  brief:    FAT read benchmark, counts the storage transactions and the SD card commands
+ *  date:     2026-10-17
+ *  authors:  agent
+ *
+ *  bench_fat <image> [read chunk size = 4096]
+ *
+ *  The image is made by the mkfatimg.py, the file contents are verified.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "platform.h"
+#include "filesys_fat.h"
+#include "fake_sdcard.h"
+
+static TFakeSdCard  sd;
+static TStorManCnt  sm;
+static TFileSysFat  fs;
+
+static uint8_t      rbuf[1024 * 1024];
+
+static const char * filenames[2] = { "BIG.BIN", "FRAG.BIN" };
+static unsigned     fileids[2]   = { 1, 2 };
+
+// returns the count of the bytes differing from the mkfatimg.py pattern
+static unsigned verify(unsigned afileid, uint64_t apos, uint8_t * adata, unsigned alen)
+{
+	unsigned errors = 0;
+	for (unsigned n = 0; n < alen; ++n)
+	{
+		uint64_t p = apos + n;
+		uint32_t w = uint32_t((p >> 2) * 2654435761u + afileid);
+		if (adata[n] != uint8_t(w >> (8 * (p & 3))))
+		{
+			++errors;
+		}
+	}
+	return errors;
+}
+
+static TFile * open_file(const char * aname)
+{
+	TFile * pf = fs.NewFileObj(nullptr, 0);
+	pf->Open(aname, 0);
+	if (pf->WaitComplete())
+	{
+		printf("error opening %s: %d\n", aname, pf->result);
+		exit(1);
+	}
+	return pf;
+}
+
+// seeks and reads on a fresh file object (the cluster run map is empty at the start)
+static unsigned bench_cold_seeks(unsigned afile)
+{
+	TFile * pf = open_file(filenames[afile]);
+	uint64_t fsize = pf->fdata.size;
+	uint32_t t0 = sm.transactions;
+	unsigned errors = 0;
+
+	srand(99);
+	for (unsigned n = 0; n < 300; ++n)
+	{
+		uint64_t spos = (uint64_t(rand()) * 7919) % fsize;
+		if (7 == (n % 50))  spos = fsize;
+		if (8 == (n % 50))  spos &= ~uint64_t(fs.clusterbytes - 1);
+
+		pf->Seek(spos);
+		if (pf->WaitComplete())
+		{
+			printf("seek error at %llu\n", (unsigned long long)spos);
+			return errors + 1;
+		}
+
+		unsigned rlen = ((n % 5) ? 100 : 30000 + n);
+		pf->Read(&rbuf[0], rlen);
+		pf->WaitComplete();
+		unsigned explen = (spos + rlen > fsize ? fsize - spos : rlen);
+		if (pf->transferlen != explen)
+		{
+			printf("short read at %llu: %u\n", (unsigned long long)spos, pf->transferlen);
+			++errors;
+		}
+		errors += verify(fileids[afile], spos, &rbuf[0], pf->transferlen);
+	}
+
+	printf("%-9s cold 300x seek+read  errors=%u  transactions=%6u\n", filenames[afile], errors, sm.transactions - t0);
+	delete pf;
+	return errors;
+}
+
+static unsigned bench_sequential_and_seeks(unsigned afile, unsigned achunk)
+{
+	TFile * pf = open_file(filenames[afile]);
+	uint64_t fsize = pf->fdata.size;
+
+	// sequential read
+	uint32_t t0 = sm.transactions;
+	uint32_t c0 = sd.sd_cmds;
+	uint32_t b0 = sd.sd_blocks;
+	uint64_t pos = 0;
+	unsigned errors = 0;
+	while (true)
+	{
+		pf->Read(&rbuf[0], achunk);
+		if (pf->WaitComplete() || !pf->transferlen)
+		{
+			break;
+		}
+		errors += verify(fileids[afile], pos, &rbuf[0], pf->transferlen);
+		pos += pf->transferlen;
+	}
+	if (pos != fsize)
+	{
+		++errors;
+	}
+
+	double ms = ((sd.sd_cmds - c0) * 0.1 + (sd.sd_blocks - b0) * 0.041);
+	printf("%-9s seq  %8llu bytes   errors=%u  transactions=%6u  sd_cmds=%6u  sd_blocks=%6u  ~%.1f ms = %.2f MB/s\n",
+	    filenames[afile], (unsigned long long)pos, errors, sm.transactions - t0,
+	    sd.sd_cmds - c0, sd.sd_blocks - b0, ms, pos / ms / 1000.0);
+
+	// random seeks after the sequential read, each followed by a short read
+	t0 = sm.transactions;
+	c0 = sd.sd_cmds;
+	b0 = sd.sd_blocks;
+	unsigned seekerrors = 0;
+	srand(1234);
+	for (unsigned n = 0; n < 200; ++n)
+	{
+		uint64_t spos = (uint64_t(rand()) * 7919) % fsize;
+		if (5 == n)  spos = fs.clusterbytes * 3;  // exactly to a cluster boundary
+
+		pf->Seek(spos);
+		if (pf->WaitComplete())
+		{
+			printf("seek error at %llu\n", (unsigned long long)spos);
+			++seekerrors;
+			break;
+		}
+		pf->Read(&rbuf[0], 100);
+		pf->WaitComplete();
+		seekerrors += verify(fileids[afile], spos, &rbuf[0], pf->transferlen);
+	}
+
+	printf("%-9s 200x seek+read        errors=%u  transactions=%6u  sd_cmds=%6u  sd_blocks=%6u  ~%.1f ms\n",
+	    filenames[afile], seekerrors, sm.transactions - t0, sd.sd_cmds - c0, sd.sd_blocks - b0,
+	    ((sd.sd_cmds - c0) * 0.1 + (sd.sd_blocks - b0) * 0.041));
+
+	delete pf;
+	return errors + seekerrors;
+}
+
+int main(int argc, char ** argv)
+{
+	if (argc < 2)
+	{
+		printf("usage: bench_fat <image> [read chunk size]\n");
+		return 1;
+	}
+
+	unsigned chunk = (argc > 2 ? atoi(argv[2]) : 4096);
+	if ((chunk < 1) || (chunk > sizeof(rbuf)))
+	{
+		printf("invalid chunk size\n");
+		return 1;
+	}
+
+	if (!sd.Open(argv[1]))
+	{
+		printf("error opening %s\n", argv[1]);
+		return 1;
+	}
+
+	sm.Init(&sd);
+	fs.Init(&sm, 0, sd.fsize);
+	while (!fs.initialized)
+	{
+		fs.Run();
+	}
+	if (!fs.fsok)
+	{
+		printf("invalid file system\n");
+		return 1;
+	}
+
+	printf("%s: %u byte clusters, %u byte reads\n", argv[1], fs.clusterbytes, chunk);
+
+	unsigned errors = 0;
+	for (unsigned n = 0; n < 2; ++n)
+	{
+		errors += bench_cold_seeks(n);
+	}
+	for (unsigned n = 0; n < 2; ++n)
+	{
+		errors += bench_sequential_and_seeks(n, chunk);
+	}
+
+#ifdef FSFAT_FATCACHE_SECTORS
+	printf("FAT cache hits=%u misses=%u\n", fs.fatcache_hits, fs.fatcache_misses);
+#endif
+
+	return (errors ? 1 : 0);
+}
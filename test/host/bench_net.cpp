@@ -0,0 +1,179 @@
+/*
+ *  file:     bench_net.cpp (host tests)
+ *  brief:    network stack micro benchmarks on the simulated node pair
+ *  date:     2026-10-17
+ *  authors:  agent
+ *
+ *  bench_net [rounds = 20000]
+ *
+ *  The times are TSC cycles on x86 hosts, nanoseconds elsewhere. Only the relative
+ *  numbers are meaningful, the absolute ones depend on the host.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "platform.h"
+#include "host_net.h"
+#include "ref_checksum.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+	#include <x86intrin.h>
+	#define BENCH_UNIT  "cycles"
+	static inline uint64_t bench_ticks() { return __rdtsc(); }
+#else
+	#define BENCH_UNIT  "ns"
+	static inline uint64_t bench_ticks()
+	{
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return uint64_t(ts.tv_sec) * 1000000000u + ts.tv_nsec;
+	}
+#endif
+
+static TUdp4Socket  udp_a;
+static TUdp4Socket  udp_b;
+
+static unsigned     rounds = 20000;
+static volatile uint32_t sink;  // keeps the consumed data alive
+
+static uint8_t      txbuf[UDP4_MAX_DATALEN];
+static uint8_t      rxbuf[UDP4_MAX_DATALEN];
+
+#define RX_BATCH  6  // datagrams queued at once, less than the RX buffers of the adapter
+
+// sends RX_BATCH datagrams from the node A and runs the node B until all of them are queued at udp_b
+static void queue_datagrams(unsigned alen)
+{
+	for (unsigned n = 0; n < RX_BATCH; ++n)
+	{
+		udp_a.Send(&txbuf[0], alen);
+	}
+	while (!g_node_b.eth.inq.empty())
+	{
+		g_node_b.adapter.Run();
+	}
+	g_node_a.adapter.Run();  // reaps the sent packets
+}
+
+// user-001: the copying Receive() against the in-place ReceiveRef() / ReleaseRx()
+static void bench_udp_receive(unsigned alen)
+{
+	uint64_t t_copy = 0;
+	uint64_t t_ref = 0;
+	unsigned cnt_copy = 0;
+	unsigned cnt_ref = 0;
+
+	for (unsigned r = 0; r < rounds; ++r)
+	{
+		queue_datagrams(alen);
+		uint64_t t0 = bench_ticks();
+		for (unsigned n = 0; n < RX_BATCH; ++n)
+		{
+			int len = udp_b.Receive(&rxbuf[0], sizeof(rxbuf));
+			if (len > 0)
+			{
+				sink += rxbuf[len - 1];
+				++cnt_copy;
+			}
+		}
+		t_copy += bench_ticks() - t0;
+
+		queue_datagrams(alen);
+		t0 = bench_ticks();
+		for (unsigned n = 0; n < RX_BATCH; ++n)
+		{
+			uint8_t * pdata;
+			unsigned  len;
+			if (udp_b.ReceiveRef(&pdata, &len))
+			{
+				sink += pdata[len - 1];
+				udp_b.ReleaseRx();
+				++cnt_ref;
+			}
+		}
+		t_ref += bench_ticks() - t0;
+	}
+
+	if ((cnt_copy != rounds * RX_BATCH) || (cnt_ref != rounds * RX_BATCH))
+	{
+		printf("UDP receive %4u bytes: lost datagrams (%u, %u)\n", alen, cnt_copy, cnt_ref);
+		exit(1);
+	}
+
+	printf("UDP receive %4u bytes: Receive() %6.1f, ReceiveRef() + ReleaseRx() %6.1f %s / datagram\n",
+	    alen, double(t_copy) / cnt_copy, double(t_ref) / cnt_ref, BENCH_UNIT);
+}
+
+// user-005: the word wide net_checksum_add() against the original 16-bit loops, on a UDP datagram in a frame buffer
+static void bench_checksum(unsigned alen)
+{
+	static uint32_t  frame32[HWETH_MAX_PACKET_SIZE / 4];
+	TIp4Header *  piph = (TIp4Header *)((uint8_t *)&frame32[0] + 2 + sizeof(TEthernetHeader));
+	TUdp4Header * pudp = PUdp4Header(piph + 1);
+
+	memcpy(pudp + 1, &txbuf[0], alen);
+	piph->protocol = 17;
+	pudp->len = __builtin_bswap16(alen + sizeof(TUdp4Header));
+
+	uint16_t cs_old = old_udp4_checksum(piph, alen);
+	uint16_t cs_new = calc_udp4_checksum(piph, alen);
+	if ((cs_old != cs_new) || (old_ip4_header_checksum(piph) != calc_ip4_header_checksum(piph)))
+	{
+		printf("checksum %4u bytes: result mismatch (%04X, %04X)\n", alen, cs_old, cs_new);
+		exit(1);
+	}
+
+	uint64_t t0 = bench_ticks();
+	for (unsigned r = 0; r < rounds; ++r)
+	{
+		sink += old_ip4_header_checksum(piph) + old_udp4_checksum(piph, alen);
+		piph->ttl = uint8_t(r);  // prevents hoisting the calculation out of the loop
+	}
+	uint64_t t_old = bench_ticks() - t0;
+
+	t0 = bench_ticks();
+	for (unsigned r = 0; r < rounds; ++r)
+	{
+		sink += calc_ip4_header_checksum(piph) + calc_udp4_checksum(piph, alen);
+		piph->ttl = uint8_t(r);
+	}
+	uint64_t t_new = bench_ticks() - t0;
+
+	printf("IP + UDP checksum %4u bytes: 16-bit loops %6.1f, net_checksum_add() %6.1f %s\n",
+	    alen, double(t_old) / rounds, double(t_new) / rounds, BENCH_UNIT);
+}
+
+int main(int argc, char ** argv)
+{
+	if (argc > 1)
+	{
+		rounds = atoi(argv[1]);
+	}
+
+	test_net_setup();
+	udp_a.Init(&g_node_a.ip, 1000);
+	udp_a.destaddr.Set(10, 0, 0, 2);
+	udp_a.destport = 2000;
+	udp_b.Init(&g_node_b.ip, 2000);
+
+	for (unsigned n = 0; n < sizeof(txbuf); ++n)
+	{
+		txbuf[n] = uint8_t(n * 7 + 1);
+	}
+
+	// resolve the ARP first
+	udp_a.Send(&txbuf[0], 1);
+	test_net_run(5);
+	udp_b.Receive(&rxbuf[0], sizeof(rxbuf));
+
+	bench_udp_receive(64);
+	bench_udp_receive(512);
+	bench_udp_receive(UDP4_MAX_DATALEN);
+
+	bench_checksum(64);
+	bench_checksum(512);
+	bench_checksum(1472);
+
+	return 0;
+}
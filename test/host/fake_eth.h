@@ -0,0 +1,135 @@
+/*
+ *  file:     fake_eth.h (host tests)
+ *  brief:    Simulated Ethernet MAC: frame queues instead of DMA rings, emulated PHY and ns clock
+ *  date:     2026-10-17
+ *  authors:  agent
+*/
+
+#ifndef FAKE_ETH_H_
+#define FAKE_ETH_H_
+
+#include <stdlib.h>
+#include <string.h>
+#include <deque>
+#include <vector>
+
+typedef std::deque<std::vector<uint8_t>>  TFakeWire;
+
+class THwEth_fake : public THwEth_pre
+{
+public: // test settings
+	TFakeWire *        wire_out = nullptr;   // the sent frames are appended here (the inq of the peer)
+	int                drop_permille = 0;    // random TX frame loss
+	bool               rx_timestamps = true; // false: GetTimeStamp() returns 0 like MACs without RX time stamping
+	bool               ns_timer = true;      // false: NsTimeRead() returns 0 like MACs without ns timer
+	bool               tx_irq = false;       // reported by TxIrqSupported(), the test calls TxCompleteIrq()
+	double             sim_drift = 0;        // relative frequency error of the ns clock
+
+	// called with every sent frame, false: the frame is lost (the filter can also delay or duplicate it)
+	bool               (* tx_filter)(THwEth_fake * aeth, std::vector<uint8_t> & aframe) = nullptr;
+
+public:
+	TFakeWire          inq;                  // frames waiting for reception
+	TPacketMem *       rxbufs[64];
+	bool               rxused[64];
+	uint64_t           rxts[64];
+	unsigned           rxcount = 0;
+	unsigned           txcnt = 0;
+
+	bool               InitMac(void * prxdesclist, uint32_t rxcnt, void * ptxdesclist, uint32_t txcnt)
+	{
+		rxcount = rxcnt;
+		memset(rxused, 0, sizeof(rxused));
+		return (rxcnt <= 64);
+	}
+
+	void               Start() { }
+	void               Stop()  { }
+
+	void               SetMacAddress(uint8_t * amacaddr) { memcpy(&mac_address[0], amacaddr, 6); }
+	void               SetSpeed(bool speed100) { }
+	void               SetDuplex(bool full)    { }
+	bool               SetMulticastFilter(uint8_t * amaclist, unsigned acount) { return true; }
+	bool               TxIrqSupported() { return tx_irq; }
+
+	bool               TryRecv(TPacketMem * * ppmem)
+	{
+		if (inq.empty())
+		{
+			return false;
+		}
+
+		for (unsigned i = 0; i < rxcount; ++i)
+		{
+			if (!rxused[i])
+			{
+				std::vector<uint8_t> & f = inq.front();
+				rxused[i] = true;
+				memcpy(&rxbufs[i]->data[0], f.data(), f.size());
+				rxbufs[i]->datalen = f.size();
+				rxbufs[i]->idx = i;
+				rxts[i] = (rx_timestamps ? NsTimeRead() : 0);
+				inq.pop_front();
+				++recv_count;
+				*ppmem = rxbufs[i];
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void               ReleaseRxBuf(TPacketMem * pmem) { rxused[pmem->idx] = false; }
+	void               AssignRxBuf(uint32_t idx, TPacketMem * pmem, uint32_t datalen) { rxbufs[idx] = pmem; pmem->idx = idx; }
+
+	bool               TrySend(uint32_t * pidx, void * pdata, uint32_t datalen)
+	{
+		*pidx = (txcnt++ & 7);
+		if (drop_permille && ((rand() % 1000) < drop_permille))
+		{
+			return true;  // lost on the wire
+		}
+		if (wire_out)
+		{
+			std::vector<uint8_t> frame((uint8_t *)pdata, (uint8_t *)pdata + datalen);
+			if (!tx_filter || tx_filter(this, frame))
+			{
+				wire_out->push_back(frame);
+			}
+		}
+		return true;
+	}
+
+	bool               SendFinished(uint32_t idx) { return true; }
+	uint64_t           GetTimeStamp(uint32_t idx) { return rxts[idx]; }
+
+	// PHY emulation: LAN8720A with the link up at 100 Mbit/s full duplex
+	uint16_t           mii_data = 0;
+	void               StartMiiWrite(uint8_t reg, uint16_t data) { }
+	void               StartMiiRead(uint8_t reg)
+	{
+		if (HWETH_PHY_PHYID1_REG == reg)         mii_data = 0x0007;
+		else if (HWETH_PHY_PHYID2_REG == reg)    mii_data = 0xC0F1;
+		else if (HWETH_PHY_BSR_REG == reg)       mii_data = HWETH_PHY_BSR_LINK_STATUS | HWETH_PHY_BSR_AUTONEG_COMP;
+		else if (HWETH_PHY_SPEEDINFO_REG == reg) mii_data = HWETH_PHY_SPEEDINFO_MASK;
+		else                                     mii_data = 0;
+	}
+	bool               IsMiiBusy() { return false; }
+	inline uint16_t    MiiData()   { return mii_data; }
+
+	// the ns clock follows the g_clockcnt (1 us resolution) with the sim_drift and the correction applied
+	double             sim_local = 0;
+	double             sim_corr = 0;
+	uint32_t           sim_last = 0;
+
+	void               NsTimeStart() { sim_last = g_clockcnt; }
+	uint64_t           NsTimeRead()
+	{
+		uint32_t now = g_clockcnt;
+		sim_local += double(uint32_t(now - sim_last)) * 1000.0 * (1.0 + sim_drift + sim_corr);
+		sim_last = now;
+		return (ns_timer ? uint64_t(sim_local) : 0);
+	}
+	void               NsTimeSetCorrection(float acorr) { NsTimeRead(); sim_corr = acorr; }
+};
+
+#endif
@@ -0,0 +1,74 @@
+/*
+ *  file:     fake_sdcard.h (host tests)
+ *  brief:    file backed SD card and a storage manager with transaction counter
+ *  date:     2026-10-17
+ *  authors:  agent
+*/
+
+#ifndef FAKE_SDCARD_H_
+#define FAKE_SDCARD_H_
+
+#include <stdio.h>
+#include "storman_sdcard.h"
+
+// Completes every block transfer immediately from / to the image file.
+// The time estimate models a card with 100 us command overhead and a 12.5 MByte/s bus (41 us / block).
+class TFakeSdCard : public TSdCard
+{
+public:
+	FILE *             f = nullptr;
+	uint64_t           fsize = 0;
+
+	uint32_t           sd_cmds = 0;    // read or write block commands
+	uint32_t           sd_blocks = 0;  // transferred 512 byte blocks
+
+	bool Open(const char * afilename)
+	{
+		f = fopen(afilename, "r+b");
+		if (!f)
+		{
+			return false;
+		}
+		fseeko(f, 0, SEEK_END);
+		fsize = ftello(f);
+		initialized = true;
+		card_initialized = true;
+		card_megabytes = uint32_t(fsize >> 20);
+		return true;
+	}
+
+	virtual void Run()
+	{
+		if (completed)
+		{
+			return;
+		}
+
+		++sd_cmds;
+		sd_blocks += blockcount;
+		fseeko(f, uint64_t(startblock) << 9, SEEK_SET);
+		size_t r = (iswrite ? fwrite(dataptr, 512, blockcount, f) : fread(dataptr, 512, blockcount, f));
+		errorcode = (r == blockcount ? 0 : 1);
+		completed = true;
+	}
+
+	double TimeMs() { return sd_cmds * 0.1 + sd_blocks * 0.041; }
+};
+
+// counts the storage transactions started by the file system
+class TStorManCnt : public TStorManSdcard
+{
+public:
+	uint32_t           transactions = 0;
+
+	virtual void Run()
+	{
+		if (firsttra && (0 == state))
+		{
+			++transactions;
+		}
+		TStorManSdcard::Run();
+	}
+};
+
+#endif
@@ -0,0 +1,95 @@
+/*
+ *  file:     fake_uart.h (host tests)
+ *  brief:    simulated UART with DMA: the RX goes into the circular DMA buffer, the TX is collected
+ *  date:     2026-10-17
+ *  authors:  agent
+*/
+
+// included twice from the stubs/mcu_impl.h: the DMA part by the hwdma.h, the UART part by the hwuart.h
+
+#if defined(HWDMA_H_) && !defined(FAKE_UART_DMA_)
+#define FAKE_UART_DMA_
+
+// The DMA channels are driven by the THwUart_fake, the transfers complete immediately
+class THwDmaChannel_fake : public THwDmaChannel_pre
+{
+public:
+	THwDmaTransfer *   xfer = nullptr;
+	unsigned           remaining = 0;
+
+	bool Init(int achnum)  { initialized = true; return true; }
+
+	void Prepare(bool aistx, void * aperiphaddr, unsigned aflags)  { istx = aistx; }
+	void Disable() { }
+	void Enable()  { }
+
+	bool Enabled() { return true; }
+	bool Active()  { return false; }
+
+	void PrepareTransfer(THwDmaTransfer * axfer)  { xfer = axfer;  remaining = axfer->count; }
+	void StartPreparedTransfer()  { }
+
+	unsigned Remaining() { return remaining; }
+};
+
+#endif
+
+#if defined(HWUART_H_) && !defined(FAKE_UART_H_)
+#define FAKE_UART_H_
+
+#include <string>
+
+class THwUart_fake : public THwUart_pre
+{
+public:
+	std::string        txdata;     // everything sent by the driver
+	unsigned           rxpos = 0;  // write position in the circular RX DMA buffer
+	unsigned           rxcount = 0;
+
+	bool Init(int adevnum)        { initialized = true; return true; }
+	void SetBaudRate(int abaudrate)  { baudrate = abaudrate; }
+
+	bool TrySendChar(char ach)    { txdata.push_back(ach); return true; }
+	bool TryRecvChar(char * ach)  { return false; }
+	bool SendFinished()           { return true; }
+
+	void SetTransmit(bool atransmit)  { }
+
+	void DmaAssign(bool istx, THwDmaChannel * admach)
+	{
+		if (istx)  txdma = admach;
+		else       rxdma = admach;
+	}
+
+	bool DmaStartSend(THwDmaTransfer * axfer)
+	{
+		txdata.append((const char *)axfer->srcaddr, axfer->count);
+		return true;
+	}
+
+	bool DmaStartRecv(THwDmaTransfer * axfer)
+	{
+		rxdma->PrepareTransfer(axfer);
+		rxpos = 0;
+		return true;
+	}
+
+	bool DmaSendCompleted()  { return true; }
+	bool DmaRecvCompleted()  { return false; }
+
+	// the bytes arrive into the circular buffer, the caller must not overrun the reader
+	void Receive(const void * adata, unsigned alen)
+	{
+		THwDmaTransfer * xfer = rxdma->xfer;
+		const uint8_t * psrc = (const uint8_t *)adata;
+		for (unsigned n = 0; n < alen; ++n)
+		{
+			((uint8_t *)xfer->dstaddr)[rxpos] = psrc[n];
+			if (++rxpos >= xfer->count)  rxpos = 0;
+		}
+		rxcount += alen;
+		rxdma->remaining = xfer->count - rxpos;
+	}
+};
+
+#endif
@@ -0,0 +1,118 @@
+#!/usr/bin/env python3
+#
+#  file:     fatcheck.py (host tests)
+#  brief:    FAT32 / FAT16 image consistency checker for the FAT host tests
+#  date:     2026-10-17
+#  authors:  agent
+#
+#  fatcheck.py <image>
+#
+#  Checks: the FAT copies are equal, the cluster chains of the files and directories
+#  (free clusters, cross links, chain ends), the chain lengths against the file sizes,
+#  lost clusters and the FSInfo free cluster count. The exit code is 1 on errors.
+
+import sys, struct
+
+img = open(sys.argv[1], 'rb').read()
+bps, spc, rsv, nfats, rootents, tot16, _, fatsz16 = struct.unpack_from('<HBHBHHBH', img, 11)
+tot = tot16 if tot16 else struct.unpack_from('<I', img, 32)[0]
+fat16 = (fatsz16 != 0)
+if fat16:
+    fatsz = fatsz16
+    rootcl = 0
+    fsis = 0
+else:
+    fatsz, = struct.unpack_from('<I', img, 36)
+    rootcl, fsis = struct.unpack_from('<IH', img, 44)
+
+cb = bps * spc
+rootstart = (rsv + nfats * fatsz) * bps
+data = rootstart + rootents * 32
+nclus = (tot * bps - data) // cb
+if fat16 and nclus < 4085:
+    sys.exit('FAT12 is not supported')
+lim = nclus + 2
+esize = (2 if fat16 else 4)
+eoc = (0xFFF8 if fat16 else 0x0FFFFFF8)
+
+fats = [img[(rsv + i * fatsz) * bps:(rsv + (i + 1) * fatsz) * bps] for i in range(nfats)]
+errs = []
+for i in range(1, nfats):
+    if fats[i][:lim * esize] != fats[0][:lim * esize]:
+        errs.append('FAT copy %d differs' % i)
+if fat16:
+    fat = list(struct.unpack_from('<%dH' % lim, fats[0], 0))
+else:
+    fat = [v & 0x0FFFFFFF for v in struct.unpack_from('<%dI' % lim, fats[0], 0)]
+
+owner = {}
+
+def chain(c, name):
+    res = []
+    while 2 <= c < lim:
+        if c in owner:
+            errs.append('%s: cross link at %d with %s' % (name, c, owner[c]))
+            break
+        owner[c] = name
+        res.append(c)
+        if fat[c] == 0:
+            errs.append('%s: free cluster %d in chain' % (name, c))
+            break
+        c = fat[c]
+    if not ((c >= eoc) or (c in owner) or not res):
+        errs.append('%s: bad chain end %x' % (name, c))
+    return res
+
+def readchain(cl, size):
+    return b''.join(img[data + (c - 2) * cb:data + (c - 1) * cb] for c in cl)[:size]
+
+files = {}
+
+def walk(raw, path):
+    for i in range(0, len(raw), 32):
+        e = raw[i:i + 32]
+        if e[0] == 0:
+            break
+        if (e[0] == 0xE5) or (e[11] == 0x0F):
+            continue
+        nm = e[0:8].decode('latin1').rstrip() + ('.' + e[8:11].decode('latin1').rstrip() if e[8] != 32 else '')
+        if nm in ('.', '..'):
+            continue
+        attr = e[11]
+        c = (0 if fat16 else struct.unpack_from('<H', e, 20)[0] << 16) | struct.unpack_from('<H', e, 26)[0]
+        size = struct.unpack_from('<I', e, 28)[0]
+        full = path + '/' + nm
+        if attr & 0x08:
+            continue
+        if attr & 0x10:
+            cls = chain(c, full)
+            walk(readchain(cls, len(cls) * cb), full)
+            continue
+        fcl = chain(c, full) if c else []
+        need = (size + cb - 1) // cb
+        if len(fcl) != need:
+            errs.append('%s: size %d needs %d clusters, chain has %d' % (full, size, need, len(fcl)))
+        files[full] = (size, fcl)
+
+if fat16:
+    walk(img[rootstart:data], '')
+else:
+    cls = chain(rootcl, '/')
+    walk(readchain(cls, len(cls) * cb), '')
+
+used = sum(1 for v in fat[2:] if v)
+lost = [c for c in range(2, lim) if fat[c] and c not in owner]
+if lost:
+    errs.append('%d lost clusters (first %d)' % (len(lost), lost[0]))
+free = nclus - used
+fcount = 0xFFFFFFFF
+if fsis:
+    fsi = img[fsis * bps:(fsis + 1) * bps]
+    fcount, fnext = struct.unpack_from('<II', fsi, 0x1E8)
+    if (fcount != 0xFFFFFFFF) and (fcount != free):
+        errs.append('FSInfo free count %d, real %d' % (fcount, free))
+
+print('%s: FAT%d files=%d free=%d %s' % (sys.argv[1], 16 if fat16 else 32, len(files), free, 'OK' if not errs else 'ERRORS:'))
+for e in errs[:20]:
+    print('  ' + e)
+sys.exit(1 if errs else 0)
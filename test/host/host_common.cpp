@@ -0,0 +1,17 @@
+/*
+ *  file:     host_common.cpp (host tests)
+ *  brief:    the platform globals of the stubs/platform.h
+ *  date:     2026-10-17
+ *  authors:  agent
+*/
+
+#include "platform.h"
+#include "clockcnt.h"
+
+volatile uint32_t g_clockcnt = 0;
+uint32_t SystemCoreClock = 1000000;  // the g_clockcnt counts microseconds
+
+void delay_clocks(unsigned aclocks)
+{
+	g_clockcnt += aclocks;  // the time passes only by the test steps
+}
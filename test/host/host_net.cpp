@@ -0,0 +1,39 @@
+/*
+ *  file:     host_net.cpp (host tests)
+ *  brief:    two simulated network nodes connected back to back
+ *  date:     2026-10-17
+ *  authors:  agent
+*/
+
+#include "platform.h"
+#include "host_net.h"
+
+TTestNode  g_node_a;
+TTestNode  g_node_b;
+
+static void test_node_init(TTestNode * anode, uint8_t amacid, uint8_t aipid)
+{
+	anode->eth.mac_address[5] = amacid;
+	anode->adapter.Init(&anode->eth, &anode->netmem[0], sizeof(anode->netmem));
+	anode->ip.ipaddress.Set(10, 0, 0, aipid);
+	anode->ip.netmask.Set(255, 255, 255, 0);
+	anode->ip.Init(&anode->adapter);
+}
+
+void test_net_setup()
+{
+	g_node_a.eth.wire_out = &g_node_b.eth.inq;
+	g_node_b.eth.wire_out = &g_node_a.eth.inq;
+	test_node_init(&g_node_a, 0x0A, 1);
+	test_node_init(&g_node_b, 0x0B, 2);
+}
+
+void test_net_run(unsigned ams)
+{
+	for (unsigned n = 0; n < ams * 10; ++n)
+	{
+		g_clockcnt += 100;
+		g_node_a.adapter.Run();
+		g_node_b.adapter.Run();
+	}
+}
@@ -0,0 +1,29 @@
+/*
+ *  file:     host_net.h (host tests)
+ *  brief:    two simulated network nodes connected back to back
+ *  date:     2026-10-17
+ *  authors:  agent
+*/
+
+#ifndef HOST_NET_H_
+#define HOST_NET_H_
+
+#include "net_ip4.h"
+#include "host_test.h"
+
+// Node A (10.0.0.1) and node B (10.0.0.2) connected back to back through the simulated MACs
+struct TTestNode
+{
+	THwEth        eth;
+	TNetAdapter   adapter;
+	TIp4Handler   ip;
+	uint8_t       netmem[128 * 1024];
+};
+
+extern TTestNode  g_node_a;
+extern TTestNode  g_node_b;
+
+void test_net_setup();  // settings can be changed before calling this
+void test_net_run(unsigned ams);  // runs both nodes for ams simulated milliseconds in 100 us steps
+
+#endif
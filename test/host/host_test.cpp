@@ -0,0 +1,17 @@
+/*
+ *  file:     host_test.cpp (host tests)
+ *  brief:    test summary and the two node network setup
+ *  date:     2026-10-17
+ *  authors:  agent
+*/
+
+#include "platform.h"
+#include "host_test.h"
+
+int g_test_failures = 0;
+
+int test_result(const char * atestname)
+{
+	printf("%s: %s\n", atestname, (g_test_failures ? "FAILED" : "OK"));
+	return (g_test_failures ? 1 : 0);
+}
@@ -0,0 +1,21 @@
+/*
+ *  file:     host_test.h (host tests)
+ *  brief:    check macros of the host tests
+ *  date:     2026-10-17
+ *  authors:  agent
+*/
+
+#ifndef HOST_TEST_H_
+#define HOST_TEST_H_
+
+#include <stdio.h>
+#include <string.h>
+
+extern int g_test_failures;
+
+#define CHECK(cond, ...)  do { if (!(cond)) { ++g_test_failures; printf("FAIL %s:%d: ", __FILE__, __LINE__); printf(__VA_ARGS__); printf("\n"); } } while (0)
+
+// prints the summary, returns the exit code for main()
+int test_result(const char * atestname);
+
+#endif
@@ -0,0 +1,199 @@
+#!/usr/bin/env python3
+#
+#  file:     mkfatimg.py (host tests)
+#  brief:    FAT32 / FAT16 test image generator for the FAT host tests and benchmark
+#  date:     2026-10-17
+#  authors:  agent
+#
+#  mkfatimg.py <image> [sectors per cluster = 8] [MBytes = 128] [empty] [fat16] [lfn]
+#
+#  The root directory contains
+#    BIG.BIN   8 MB + 1234 bytes, contiguous
+#    FRAG.BIN  2 MB + 77 bytes, every cluster is a separate fragment
+#    FILL.BIN  the clusters between the FRAG.BIN fragments
+#  The file data is a pattern of little endian 32-bit words: (word index * 2654435761 + file id),
+#  the file ids are 1, 2 and 3. With "empty" only the root directory is created.
+#  With "lfn" the files of the LFN_FILES follow (file ids from 4), with long names:
+#  the second chain spans a sector boundary (deleted entries before it), the last one is orphaned
+#  (bad checksum, only the 8.3 name is valid).
+#  The FAT16 volume has a fixed size root directory (512 entries) before the data area,
+#  so the first file starts at the cluster 2.
+
+import sys, struct
+
+out = sys.argv[1]
+spc = int(sys.argv[2]) if len(sys.argv) > 2 else 8
+mbytes = int(sys.argv[3]) if len(sys.argv) > 3 else 128
+empty = 'empty' in sys.argv[4:]
+fat16 = 'fat16' in sys.argv[4:]
+lfn = 'lfn' in sys.argv[4:]
+
+# (8.3 name, long name, size, valid checksum)
+LFN_FILES = [
+    ('LONGFI~1TXT', 'Long file name number one.txt', 1000, True),
+    ('SECTOR~1DAT', 'The chain of this name spans a sector.dat', 3000, True),
+    ('RVZTR~1 TXT', '\u00c1rv\u00edzt\u0171r\u0151 t\u00fck\u00f6rf\u00far\u00f3g\u00e9p \u20ac.txt', 200, True),
+    ('SMILE~1 TXT', 'smile \U0001F600 \U0001F680.txt', 77, True),
+    ('ORPHAN  TXT', 'Orphaned long name.txt', 55, False),
+]
+
+total_sectors = mbytes * 2048
+nfats = 2
+clus_bytes = spc * 512
+if fat16:
+    reserved = 4
+    root_entries = 512
+    root_sectors = root_entries * 32 // 512
+    fatsz = ((total_sectors // spc) * 2 + 4 + 511) // 512
+    eoc = 0xFFFF
+else:
+    reserved = 32
+    root_entries = 0
+    root_sectors = 0
+    fatsz = ((total_sectors // spc) * 4 + 511) // 512
+    eoc = 0x0FFFFFFF
+root_start = reserved + nfats * fatsz
+data_start = root_start + root_sectors
+nclus = (total_sectors - data_start) // spc
+if fat16 and not (4085 <= nclus < 65525):
+    sys.exit('invalid FAT16 cluster count: %u' % nclus)
+
+img = bytearray(total_sectors * 512)
+fat = [0] * (nclus + 2)
+fat[0] = eoc & ~7
+fat[1] = eoc
+if fat16:
+    nextfree = [2]
+else:
+    fat[2] = eoc  # root directory
+    nextfree = [3]
+
+def take(n):
+    r = list(range(nextfree[0], nextfree[0] + n))
+    nextfree[0] += n
+    return r
+
+def link_chain(clusters):
+    for i, c in enumerate(clusters):
+        fat[c] = clusters[i + 1] if i + 1 < len(clusters) else eoc
+
+def pattern(fileid, size):
+    n = (size + 3) // 4
+    return b''.join(struct.pack('<I', (i * 2654435761 + fileid) & 0xFFFFFFFF) for i in range(n))[:size]
+
+def write_clusters(clusters, data):
+    for i, c in enumerate(clusters):
+        offs = (data_start + (c - 2) * spc) * 512
+        chunk = data[i * clus_bytes:(i + 1) * clus_bytes]
+        img[offs:offs + len(chunk)] = chunk
+
+files = []
+if not empty:
+    big_size = 8 * 1024 * 1024 + 1234
+    files.append(('BIG     BIN', take((big_size + clus_bytes - 1) // clus_bytes), big_size, 1))
+
+    frag_size = 2 * 1024 * 1024 + 77
+    fragc = []
+    fillc = []
+    for i in range((frag_size + clus_bytes - 1) // clus_bytes):
+        fragc += take(1)
+        fillc += take(1 + (i % 3))
+    files.append(('FRAG    BIN', fragc, frag_size, 2))
+    files.append(('FILL    BIN', fillc, len(fillc) * clus_bytes, 3))
+
+def lfn_checksum(name):
+    s = 0
+    for b in name.encode():
+        s = (((s & 1) << 7) + (s >> 1) + b) & 0xFF
+    return s
+
+def lfn_entries(longname, shortname, valid):
+    # the LFN entries in the directory order: the last part comes first
+    u = longname.encode('utf-16-le')
+    chars = [u[i:i + 2] for i in range(0, len(u), 2)]
+    if len(chars) % 13:
+        chars += [b'\0\0'] + [b'\xFF\xFF'] * (12 - len(chars) % 13)
+    csum = lfn_checksum(shortname) ^ (0 if valid else 0x5A)
+    cnt = len(chars) // 13
+    result = []
+    for seq in range(cnt, 0, -1):
+        part = b''.join(chars[(seq - 1) * 13:seq * 13])
+        e = bytearray(32)
+        e[0] = seq | (0x40 if seq == cnt else 0)
+        e[1:11] = part[0:10]
+        e[11] = 0x0F
+        e[13] = csum
+        e[14:26] = part[10:22]
+        e[28:32] = part[22:26]
+        result.append(bytes(e))
+    return result
+
+entries = []
+for i, (name, clusters, size, fileid) in enumerate(files):
+    link_chain(clusters)
+    write_clusters(clusters, pattern(fileid, size))
+    entries.append(struct.pack('<11sBBBHHHHHHHI', name.encode(), 0x20, 0, 0, 0, 0, 0,
+                               clusters[0] >> 16, 0, 0, clusters[0] & 0xFFFF, size))
+if lfn:
+    for i, (name, longname, size, valid) in enumerate(LFN_FILES):
+        chain = lfn_entries(longname, name, valid)
+        if 1 == i:
+            # two LFN entries in this sector, the rest in the next one
+            while len(entries) % 16 != 14:
+                entries.append(b'\xE5' + bytes(31))
+        clusters = take((size + clus_bytes - 1) // clus_bytes)
+        link_chain(clusters)
+        write_clusters(clusters, pattern(4 + i, size))
+        entries += chain
+        entries.append(struct.pack('<11sBBBHHHHHHHI', name.encode(), 0x20, 0, 0, 0, 0, 0,
+                                   clusters[0] >> 16, 0, 0, clusters[0] & 0xFFFF, size))
+
+root = bytearray(root_sectors * 512 if fat16 else clus_bytes)
+if len(entries) * 32 > len(root):
+    sys.exit('the root directory is too small for %u entries' % len(entries))
+root[0:len(entries) * 32] = b''.join(entries)
+if fat16:
+    img[root_start * 512:root_start * 512 + len(root)] = root
+else:
+    write_clusters([2], bytes(root))
+
+# boot sector
+bs = bytearray(512)
+bs[0:3] = b'\xEB\x58\x90'
+bs[3:11] = b'MSWIN4.1'
+if fat16:
+    total16 = total_sectors if total_sectors < 0x10000 else 0
+    total32 = 0 if total16 else total_sectors
+    struct.pack_into('<HBHBHHBHHHII', bs, 11, 512, spc, reserved, nfats, root_entries, total16, 0xF8, fatsz, 63, 255, 0, total32)
+    bs[36] = 0x80
+    bs[38] = 0x29
+    bs[43:54] = b'NO NAME    '
+    bs[54:62] = b'FAT16   '
+else:
+    struct.pack_into('<HBHBHHBHHHII', bs, 11, 512, spc, reserved, nfats, 0, 0, 0xF8, 0, 63, 255, 0, total_sectors)
+    struct.pack_into('<IHHIHH', bs, 36, fatsz, 0, 0, 2, 1, 6)  # FAT size, flags, version, root cluster, FSInfo, backup
+    bs[66] = 0x29
+    bs[71:82] = b'NO NAME    '
+    bs[82:90] = b'FAT32   '
+bs[510] = 0x55
+bs[511] = 0xAA
+img[0:512] = bs
+
+if not fat16:
+    # FSInfo
+    used = sum(1 for v in fat[2:] if v)
+    fsi = bytearray(512)
+    struct.pack_into('<I', fsi, 0, 0x41615252)
+    struct.pack_into('<I', fsi, 0x1E4, 0x61417272)
+    struct.pack_into('<II', fsi, 0x1E8, nclus - used, nextfree[0])
+    fsi[510] = 0x55
+    fsi[511] = 0xAA
+    img[512:1024] = fsi
+
+fatb = b''.join(struct.pack('<H' if fat16 else '<I', v) for v in fat)
+for f in range(nfats):
+    offs = (reserved + f * fatsz) * 512
+    img[offs:offs + len(fatb)] = fatb
+
+open(out, 'wb').write(img)
+print('%s: %u clusters of %u bytes' % (out, nclus, clus_bytes))
@@ -0,0 +1,122 @@
+/*
+ *  file:     ref_checksum.h (host tests)
+ *  brief:    reference checksum routines: the original 16-bit ones and a byte wise RFC 1071 sum
+ *  date:     2026-10-17
+ *  authors:  agent
+*/
+
+#ifndef REF_CHECKSUM_H_
+#define REF_CHECKSUM_H_
+
+#include "net_ip4.h"
+
+// byte wise RFC 1071 checksum, the result is in host byte order
+static inline uint16_t ref_checksum(const void * pdata, unsigned datalen, uint32_t asum = 0)
+{
+	const uint8_t * p = (const uint8_t *)pdata;
+	uint64_t sum = asum;
+	for (unsigned n = 0; n + 1 < datalen; n += 2)
+	{
+		sum += (p[n] << 8) | p[n + 1];
+	}
+	if (datalen & 1)
+	{
+		sum += (p[datalen - 1] << 8);
+	}
+	while (sum >> 16)
+	{
+		sum = (sum & 0xFFFF) + (sum >> 16);
+	}
+	return uint16_t(~sum);
+}
+
+// the routines replaced by the net_checksum_add() kernel, unchanged
+
+static inline uint16_t old_ip4_header_checksum(TIp4Header * piph)
+{
+	uint32_t sum = 0;
+	uint16_t * pd16 = (uint16_t *)(piph);
+	uint16_t * pd16_end = (uint16_t *)(piph + 1);
+
+	while (pd16 < pd16_end)
+	{
+		sum += __builtin_bswap16(*pd16++);
+	}
+
+	sum -= __builtin_bswap16(piph->csum);  // remove the csum
+
+	//  Fold 32-bit sum to 16 bits
+	while (sum >> 16)
+	{
+		sum = (sum & 0xffff) + (sum >> 16);
+	}
+
+	return __builtin_bswap16(~sum);
+}
+
+static inline uint16_t old_udp4_checksum(TIp4Header * piph, uint16_t datalen)
+{
+	uint32_t sum = 0;
+	TUdp4Header * pudp = PUdp4Header(piph + 1); // the UDP header comes after the IP header
+	uint16_t * pd16;
+	uint16_t * pd16_end;  // using this needs fewer registers
+
+	// add the two IP addresses first
+	pd16 = (uint16_t *)&piph->srcaddr;
+	pd16_end = pd16 + 4;
+	while (pd16 < pd16_end)
+	{
+		sum += __builtin_bswap16(*pd16++);
+	}
+
+	sum += piph->protocol; // add the protocol as well (8-bit only)
+	sum += __builtin_bswap16(pudp->len); // add the UDP length
+
+	// add the UDP header parts exlusive the checksum
+	pd16 = (uint16_t *)pudp;
+	pd16_end = pd16 + 3;
+	while (pd16 < pd16_end)
+	{
+		sum += __builtin_bswap16(*pd16++);
+	}
+
+	// and then the data
+	pd16 = (uint16_t *)(pudp + 1);
+	pd16_end = pd16 + (datalen >> 1);
+	while (pd16 < pd16_end)
+	{
+		sum += __builtin_bswap16(*pd16++);
+	}
+
+	if (datalen & 1)  // one byte remained
+	{
+		sum += ((*(uint8_t *)pd16) << 8);
+	}
+
+	//  Fold 32-bit sum to 16 bits
+	while (sum >> 16)
+	{
+		sum = (sum & 0xffff) + (sum >> 16);
+	}
+
+	return __builtin_bswap16(~sum);
+}
+
+static inline uint16_t old_icmp_checksum(void * pdata, uint32_t datalen)
+{
+	uint32_t n;
+	uint32_t clen = ((datalen + 1) >> 1);
+	uint32_t sum = 0;
+	uint16_t * pd16 = (uint16_t *)pdata;
+
+	for (n = 0; n < clen; ++n)
+	{
+		sum += __builtin_bswap16(*pd16++);
+	}
+
+	sum = (sum & 0xffff) + (sum >> 16);
+
+	return (uint16_t) (~sum);
+}
+
+#endif
@@ -0,0 +1,36 @@
+/*
+ *  file:     mcu_impl.h (host test stub)
+ *  brief:    selects the simulated Ethernet MAC (fake_eth.h, except for the HWETH_LINUX builds) and UART with DMA (fake_uart.h)
+ *  date:     2026-10-17
+ *  authors:  agent
+*/
+
+#if !defined(HWETH_LINUX)  // the Linux backend (core/linux) has its own descriptors
+
+#ifndef HOST_MCU_IMPL_BASE
+#define HOST_MCU_IMPL_BASE
+
+typedef struct
+{
+	uint32_t  d[8];
+//
+} HW_ETH_DMA_DESC;
+
+#endif
+
+#if defined(HWETH_H_) && !defined(HWETH_IMPL)
+  #include "fake_eth.h"
+  #define HWETH_IMPL  THwEth_fake
+#endif
+
+#if defined(HWDMA_H_) && !defined(HWDMACHANNEL_IMPL)
+  #include "fake_uart.h"
+  #define HWDMACHANNEL_IMPL  THwDmaChannel_fake
+#endif
+
+#if defined(HWUART_H_) && !defined(HWUART_IMPL)
+  #include "fake_uart.h"
+  #define HWUART_IMPL  THwUart_fake
+#endif
+
+#endif
@@ -0,0 +1,30 @@
+/*
+ *  file:     platform.h (host test stub)
+ *  brief:    Minimal platform definitions for compiling the VIHAL sources on a Linux host
+ *  date:     2026-10-17
+ *  authors:  agent
+*/
+
+#ifndef __PLATFORM_H
+#define __PLATFORM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+extern volatile uint32_t g_clockcnt;  // advanced by the tests, 1 MHz (SystemCoreClock)
+extern uint32_t SystemCoreClock;
+
+#define CLOCKCNT            g_clockcnt
+#define CLOCKCNT_BITS       32
+#define MCU_NO_UNALIGNED    0
+
+inline void __DSB() { }
+inline void __DMB() { }
+inline void __BKPT() { __builtin_trap(); }
+
+#define __CLZ(x)  __builtin_clz(x)
+
+#include "generic_defs.h"
+
+#endif
@@ -0,0 +1,85 @@
+/*
+ *  file:     strparse.h (host test stub)
+ *  brief:    the TStrParseObj subset used by the ESP AT driver (the original comes with the application utilities)
+ *  date:     2026-10-17
+ *  authors:  agent
+*/
+
+#ifndef STRPARSE_H_
+#define STRPARSE_H_
+
+#include <stdint.h>
+#include <string.h>
+
+class TStrParseObj
+{
+public:
+	char *    bufstart = nullptr;
+	char *    bufend = nullptr;
+	char *    readptr = nullptr;
+	char *    prevptr = nullptr;
+	unsigned  prevlen = 0;
+
+	void Init(char * astr, unsigned alen)
+	{
+		bufstart = astr;
+		bufend = astr + alen;
+		readptr = astr;
+		prevptr = astr;
+		prevlen = 0;
+	}
+
+	void SkipSpaces()
+	{
+		while ((readptr < bufend) && ((' ' == *readptr) || ('\t' == *readptr)))
+		{
+			++readptr;
+		}
+	}
+
+	bool CheckSymbol(const char * asymbol)  // advances the readptr on match
+	{
+		unsigned len = strlen(asymbol);
+		if ((unsigned)(bufend - readptr) < len)
+		{
+			return false;
+		}
+		if (0 != memcmp(readptr, asymbol, len))
+		{
+			return false;
+		}
+		prevptr = readptr;
+		prevlen = len;
+		readptr += len;
+		return true;
+	}
+
+	bool ReadDecimalNumbers()
+	{
+		char * p = readptr;
+		while ((p < bufend) && (*p >= '0') && (*p <= '9'))
+		{
+			++p;
+		}
+		if (p == readptr)
+		{
+			return false;
+		}
+		prevptr = readptr;
+		prevlen = p - readptr;
+		readptr = p;
+		return true;
+	}
+
+	int PrevToInt()
+	{
+		int result = 0;
+		for (unsigned n = 0; n < prevlen; ++n)
+		{
+			result = result * 10 + (prevptr[n] - '0');
+		}
+		return result;
+	}
+};
+
+#endif
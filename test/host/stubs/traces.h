@@ -0,0 +1,7 @@
+#ifndef __TRACES_H
+#define __TRACES_H
+
+#define TRACE(...)
+#define TRACE_FLUSH()
+
+#endif
@@ -0,0 +1,237 @@
+/*
+ *  file:     test_arp.cpp (host tests)
+ *  brief:    ARP table hashing, LRU replacement and the packet limit of the unresolved addresses
+ *  date:     2026-10-17
+ *  authors:  agent
+*/
+
+#include <stdlib.h>
+#include <map>
+#include "platform.h"
+#include "host_net.h"
+
+#define PEER_COUNT  256
+
+struct TArpModelItem
+{
+	uint8_t   mac[6];
+	uint32_t  timestamp_ms;
+};
+
+static TTestNode  node;
+static std::map<uint32_t, TArpModelItem>  model;
+
+static uint32_t   exp_lookups;
+static uint32_t   exp_misses;
+static uint32_t   exp_evictions;
+
+static void peer_addr(unsigned apeer, TIp4Addr * raddr)
+{
+	raddr->Set(192, 168, 1, apeer);  // one /24 subnet, the typical case
+}
+
+// every peer must be found exactly when the model has it, without changing the LRU state
+static bool check_table(TArp4Table * at)
+{
+	uint32_t saved_ts[PEER_COUNT];  // max_items <= PEER_COUNT
+	for (unsigned n = 0; n < at->itemcount; ++n)
+	{
+		saved_ts[n] = at->items[n].timestamp_ms;
+	}
+
+	bool ok = true;
+	for (unsigned p = 0; p < PEER_COUNT; ++p)
+	{
+		TIp4Addr addr;
+		peer_addr(p, &addr);
+		TArp4TableItem * item = at->FindByIp(&addr);
+		++exp_lookups;
+
+		auto it = model.find(addr.u32);
+		if (it == model.end())
+		{
+			++exp_misses;
+			if (item)
+			{
+				CHECK(false, "peer %u is still in the table", p);
+				ok = false;
+			}
+		}
+		else if (!item)
+		{
+			++exp_misses;
+			CHECK(false, "peer %u is not found", p);
+			ok = false;
+		}
+		else if (0 != memcmp(item->macaddr, it->second.mac, 6))
+		{
+			CHECK(false, "peer %u has a wrong MAC address", p);
+			ok = false;
+		}
+	}
+
+	for (unsigned n = 0; n < at->itemcount; ++n)
+	{
+		at->items[n].timestamp_ms = saved_ts[n];
+	}
+
+	unsigned used = 0;
+	for (unsigned n = 0; n < (1u << at->hashbits); ++n)
+	{
+		if (ARP_HASH_EMPTY != at->hashtable[n])
+		{
+			++used;
+		}
+	}
+	if ((used != at->itemcount) || (model.size() != at->itemcount))
+	{
+		CHECK(false, "item count %u, hash slots %u, model %u", at->itemcount, used, unsigned(model.size()));
+		ok = false;
+	}
+
+	return ok;
+}
+
+// random updates and lookups of 256 peers in a table with amaxitems entries
+static void test_random(unsigned amaxitems, unsigned asteps)
+{
+	node.adapter.Init(&node.eth, &node.netmem[0], sizeof(node.netmem));
+	node.ip.arptable.max_items = amaxitems;
+	CHECK(node.ip.Init(&node.adapter), "IP init failed");
+
+	TArp4Table * at = &node.ip.arptable;
+	model.clear();
+	exp_lookups = 0;
+	exp_misses = 0;
+	exp_evictions = 0;
+
+	for (unsigned step = 0; step < asteps; ++step)
+	{
+		node.adapter.mscounter = 1000 + step;  // unique timestamps, the LRU victim is unambiguous
+
+		unsigned p = rand() % PEER_COUNT;
+		TIp4Addr addr;
+		peer_addr(p, &addr);
+
+		if (rand() % 100 < 60)
+		{
+			uint8_t mac[6] = { 0x02, 0x00, 0x5E, uint8_t(p), uint8_t(step), uint8_t(step >> 8) };
+			auto it = model.find(addr.u32);
+			if ((it == model.end()) && (model.size() == amaxitems))
+			{
+				auto victim = model.begin();
+				for (auto mit = model.begin(); mit != model.end(); ++mit)
+				{
+					if (mit->second.timestamp_ms < victim->second.timestamp_ms)
+					{
+						victim = mit;
+					}
+				}
+				model.erase(victim);
+				++exp_evictions;
+			}
+
+			TArpModelItem & mitem = model[addr.u32];
+			memcpy(mitem.mac, mac, 6);
+			mitem.timestamp_ms = node.adapter.mscounter;
+
+			at->Update(&addr, mac);
+		}
+		else
+		{
+			TArp4TableItem * item = at->FindByIp(&addr);
+			++exp_lookups;
+			auto it = model.find(addr.u32);
+			if (it == model.end())
+			{
+				++exp_misses;
+				CHECK(!item, "step %u: lookup of the missing peer %u succeeded", step, p);
+			}
+			else
+			{
+				it->second.timestamp_ms = node.adapter.mscounter;
+				CHECK(item, "step %u: lookup of peer %u failed", step, p);
+			}
+		}
+
+		if (!check_table(at))
+		{
+			printf("  at step %u, max_items = %u\n", step, amaxitems);
+			break;
+		}
+	}
+
+	CHECK(at->lookup_count == exp_lookups, "lookup_count %u, expected %u", at->lookup_count, exp_lookups);
+	CHECK(at->miss_count == exp_misses, "miss_count %u, expected %u", at->miss_count, exp_misses);
+	CHECK(at->evict_count == exp_evictions, "evict_count %u, expected %u", at->evict_count, exp_evictions);
+	if (amaxitems < PEER_COUNT)
+	{
+		CHECK(exp_evictions > asteps / 10, "only %u evictions", exp_evictions);
+	}
+}
+
+static TUdp4Socket  udp_a;
+static TUdp4Socket  udp_b;
+
+static int udp_send_to(uint8_t aip4, uint8_t avalue)
+{
+	udp_a.destaddr.Set(10, 0, 0, aip4);
+	return udp_a.Send(&avalue, 1);
+}
+
+// a packet dropped at the ARP request job limit must fail the send
+static void test_send_unresolved()
+{
+	g_node_a.ip.arptable.max_requests = 1;
+	g_node_a.adapter.max_tx_packets = 16;
+	test_net_setup();
+
+	udp_a.Init(&g_node_a.ip, 1000);
+	udp_a.destport = 2000;
+	udp_b.Init(&g_node_b.ip, 2000);
+
+	TArp4Table * at = &g_node_a.ip.arptable;
+	TNetPacketPool * pool = &g_node_a.adapter.txpool[NET_POOL_CLASSES - 1];
+	unsigned used0 = pool->used;
+
+	// the first address gets the only request slot
+	for (unsigned n = 0; n < at->max_request_jobs; ++n)
+	{
+		CHECK(1 == udp_send_to(99, n), "send %u to the unresolved address failed", n);
+	}
+	CHECK(-1 == udp_send_to(99, 0xFF), "send above the request job limit succeeded");
+	CHECK(1 == at->drop_count, "drop_count: %u", at->drop_count);
+
+	// the second one waits for a request slot, with the same limit
+	for (unsigned n = 0; n < at->max_request_jobs; ++n)
+	{
+		CHECK(1 == udp_send_to(98, n), "send %u to the waiting address failed", n);
+	}
+	CHECK(-1 == udp_send_to(98, 0xFF), "send above the waiting limit succeeded");
+	CHECK(2 == at->drop_count, "drop_count: %u", at->drop_count);
+
+	// a live host behind the waiting ones
+	CHECK(1 == udp_send_to(2, 0x42), "send to the live host failed");
+	CHECK(pool->used == used0 + 2 * at->max_request_jobs + 1, "%u TX packets are used", pool->used - used0);
+
+	// both dead addresses time out, then the live one is resolved
+	test_net_run(2 * at->max_tries * at->response_timeout_ms + 100);
+
+	uint8_t rxbuf[4] = { 0 };  // Receive() copies whole 32-bit words
+	int r = udp_b.Receive(&rxbuf[0], 1);
+	CHECK((1 == r) && (0x42 == rxbuf[0]), "the datagram to the live host is not received: %d", r);
+	CHECK(pool->used == used0, "%u TX packets are not released", pool->used - used0);
+}
+
+int main()
+{
+	srand(2026);
+
+	test_random(64, 20000);
+	test_random(100, 10000);  // the hash table size is not a multiple of the item count
+	test_random(PEER_COUNT, 5000);  // no evictions after all peers are known
+
+	test_send_unresolved();
+
+	return test_result("test_arp");
+}
@@ -0,0 +1,157 @@
+/*
+ *  file:     test_checksum.cpp (host tests)
+ *  brief:    the word wide checksum routines against the original ones and the RFC 1624 update
+ *  date:     2026-10-17
+ *  authors:  agent
+*/
+
+#include <stdlib.h>
+#include "platform.h"
+#include "host_test.h"
+#include "network.h"
+#include "net_ip4.h"
+#include "ref_checksum.h"
+
+static uint32_t  buf32[1024];  // 4 kByte, 32-bit aligned
+static uint8_t * buf = (uint8_t *)&buf32[0];
+
+static void fill_random(uint8_t * pdst, unsigned alen)
+{
+	for (unsigned n = 0; n < alen; ++n)
+	{
+		pdst[n] = uint8_t(rand());
+	}
+}
+
+// the raw sum at every length and both 2-byte alignments, the partial sums must be chainable
+static void test_checksum_add()
+{
+	fill_random(buf, 2048);
+	for (unsigned offs = 0; offs <= 2; offs += 2)
+	{
+		for (unsigned len = 0; len <= 1600; ++len)
+		{
+			uint16_t r = __builtin_bswap16(net_checksum_fold(net_checksum_add(0, buf + offs, len)));
+			uint16_t ref = ref_checksum(buf + offs, len);
+			CHECK(r == ref, "sum offs=%u len=%u: %04X, expected %04X", offs, len, r, ref);
+
+			unsigned split = (len / 3) & ~1u;  // the first part must have even length
+			uint32_t sum = net_checksum_add(0, buf + offs, split);
+			sum = net_checksum_add(sum, buf + offs + split, len - split);
+			r = __builtin_bswap16(net_checksum_fold(sum));
+			CHECK(r == ref, "chained sum offs=%u len=%u split=%u: %04X, expected %04X", offs, len, split, r, ref);
+		}
+	}
+
+	// many carries: the 64-bit accumulator must not lose them
+	memset(buf, 0xFF, 4096);
+	buf[4095] = 0xFE;
+	uint16_t r = __builtin_bswap16(net_checksum_fold(net_checksum_add(0, buf, 4096)));
+	CHECK(r == ref_checksum(buf, 4096), "all ones sum: %04X, expected %04X", r, ref_checksum(buf, 4096));
+}
+
+static void test_ip4_header()
+{
+	TIp4Header * piph = (TIp4Header *)(buf + 2);  // as in a received frame after the 14 byte Ethernet header
+	for (unsigned n = 0; n < 10000; ++n)
+	{
+		fill_random((uint8_t *)piph, sizeof(TIp4Header));
+		uint16_t r = calc_ip4_header_checksum(piph);
+		uint16_t old = old_ip4_header_checksum(piph);
+		CHECK(r == old, "IP header checksum: %04X, original %04X", r, old);
+	}
+}
+
+static void test_udp4()
+{
+	TIp4Header *  piph = (TIp4Header *)(buf + 2);
+	TUdp4Header * pudp = PUdp4Header(piph + 1);
+
+	for (unsigned datalen = 0; datalen <= UDP4_MAX_DATALEN; ++datalen)
+	{
+		fill_random(buf, 2 + sizeof(TIp4Header) + sizeof(TUdp4Header) + datalen);
+		piph->protocol = 17;
+		pudp->len = __builtin_bswap16(datalen + sizeof(TUdp4Header));
+
+		uint16_t r = calc_udp4_checksum(piph, datalen);
+		uint16_t old = old_udp4_checksum(piph, datalen);
+		if (0 == old)
+		{
+			old = 0xFFFF;  // the original code sent 0 here, which means no checksum
+		}
+		CHECK(r == old, "UDP checksum len=%u: %04X, original %04X", datalen, r, old);
+
+		// the receiver must see a zero sum over the pseudo header and the datagram
+		pudp->csum = r;
+		uint32_t sum = calc_ip4_pseudo_header_sum(piph, datalen + sizeof(TUdp4Header));
+		sum = net_checksum_add(sum, pudp, datalen + sizeof(TUdp4Header));
+		CHECK(0 == net_checksum_fold(sum), "UDP checksum len=%u does not verify", datalen);
+	}
+}
+
+static void test_icmp()
+{
+	for (unsigned len = 8; len <= 1480; ++len)
+	{
+		fill_random(buf, len);
+		uint16_t r = calc_icmp_checksum(buf, len);
+		uint16_t ref = ref_checksum(buf, len);
+		CHECK(r == ref, "ICMP checksum len=%u: %04X, expected %04X", len, r, ref);
+	}
+
+	// the sum 0x1FFFF needs two folds, the original routine lost the second carry
+	static const uint8_t data[] = { 0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0x01 };
+	memcpy(buf, data, sizeof(data));
+	uint16_t r = calc_icmp_checksum(buf, sizeof(data));
+	CHECK(0xFFFE == r, "ICMP checksum of 0x1FFFF: %04X, expected FFFE", r);
+	CHECK(0xFFFF == old_icmp_checksum(buf, sizeof(data)), "the original ICMP checksum changed");
+}
+
+static void test_update()
+{
+	// the RFC 1624 section 4 example: eqn. 3 gives 0x0000 like the recomputation, eqn. 2 would give 0xFFFF
+	uint16_t r = net_checksum_update(0xDD2F, 0x5555, 0x3285);
+	CHECK(0x0000 == r, "RFC 1624 example: %04X, expected 0000", r);
+
+	r = net_checksum_update(0x1234, 0xABCD, 0xABCD);
+	CHECK(0x1234 == r, "update with the same word: %04X", r);
+
+	// random single word changes against the recomputed sum
+	uint16_t * pw = (uint16_t *)buf;
+	for (unsigned n = 0; n < 100000; ++n)
+	{
+		unsigned wcnt = 2 + (rand() % 32);
+		fill_random(buf, wcnt * 2);
+		pw[0] |= 1;  // the all zero data has no unique checksum (+0 / -0)
+
+		uint16_t csum = net_checksum_fold(net_checksum_add(0, buf, wcnt * 2));
+		unsigned idx = 1 + (rand() % (wcnt - 1));
+		uint16_t oldword = pw[idx];
+		pw[idx] = uint16_t(rand());
+		if (n & 1)
+		{
+			pw[idx] = uint16_t(~oldword);  // every bit changes
+		}
+
+		uint16_t upd = net_checksum_update(csum, oldword, pw[idx]);
+		uint16_t recalc = net_checksum_fold(net_checksum_add(0, buf, wcnt * 2));
+		CHECK(upd == recalc, "update %04X -> %04X: %04X, recomputed %04X", oldword, pw[idx], upd, recalc);
+		if (upd != recalc)
+		{
+			break;
+		}
+	}
+}
+
+int main()
+{
+	srand(1624);
+
+	test_checksum_add();
+	test_ip4_header();
+	test_udp4();
+	test_icmp();
+	test_update();
+
+	return test_result("test_checksum");
+}
@@ -0,0 +1,244 @@
+/*
+ *  file:     test_dhcp.cpp (host tests)
+ *  brief:    DHCP client against a scripted server on the other node
+ *  date:     2026-10-17
+ *  authors:  agent
+*/
+
+#include "platform.h"
+#include "host_net.h"
+#include "net_dhcp.h"
+
+// the node A runs the client, the node B (10.0.0.2) the scripted server
+
+static TDhcpClient  client;
+static TUdp4Socket  udp_srv;
+
+static uint8_t      srvbuf[600];
+
+struct TDhcpScript
+{
+	uint8_t    request_reply = DHCPACK;  // the answer to the requests
+	unsigned   bad_xid_offers = 0;  // so many offers go out with a wrong transaction id
+
+	unsigned   discover_count = 0;
+	unsigned   request_count = 0;
+	uint32_t   discover_xid = 0;
+	uint32_t   request_xid = 0;
+	TIp4Addr   request_ciaddr;
+	TIp4Addr   request_ip;  // option 50
+	TIp4Addr   request_server;  // option 54
+	TIp4Addr   request_src;  // IP source address of the last request
+};
+
+static TDhcpScript  script;
+
+static uint32_t ip4(int a0, int a1, int a2, int a3)
+{
+	TIp4Addr addr;
+	addr.Set(a0, a1, a2, a3);
+	return addr.u32;
+}
+
+static uint32_t dhcp_xid(TDhcpHeader * pdh)
+{
+	return (pdh->xid[0] << 16) | pdh->xid[1];
+}
+
+static void put_option_ip(uint8_t * * ppopt, uint8_t acode, uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+{
+	uint8_t * popt = *ppopt;
+	popt[0] = acode;
+	popt[1] = 4;
+	popt[2] = a;
+	popt[3] = b;
+	popt[4] = c;
+	popt[5] = d;
+	*ppopt = popt + 6;
+}
+
+static void server_reply(TDhcpHeader * preq, uint8_t amsgtype, uint32_t axid)
+{
+	memset(srvbuf, 0, 300);
+	TDhcpHeader * pdh = (TDhcpHeader *)&srvbuf[0];
+	pdh->op = 2;
+	pdh->htype = 1;
+	pdh->hlen = 6;
+	pdh->xid[0] = (axid >> 16);
+	pdh->xid[1] = (axid & 0xFFFF);
+	memcpy(pdh->ciaddr, preq->ciaddr, 4);
+	if (DHCPNAK != amsgtype)
+	{
+		pdh->yiaddr[0] = 10;
+		pdh->yiaddr[1] = 0;
+		pdh->yiaddr[2] = 0;
+		pdh->yiaddr[3] = 50;
+	}
+	memcpy(pdh->chaddr, preq->chaddr, 16);
+
+	uint8_t * popt = (uint8_t *)(pdh + 1);
+	*popt++ = 99;
+	*popt++ = 130;
+	*popt++ = 83;
+	*popt++ = 99;
+	*popt++ = 53;
+	*popt++ = 1;
+	*popt++ = amsgtype;
+	put_option_ip(&popt, 54, 10, 0, 0, 2);
+	if (DHCPNAK != amsgtype)
+	{
+		put_option_ip(&popt, 51, 0, 0, 0, 60);  // lease time: 60 s, T1 = 30 s
+		put_option_ip(&popt, 1, 255, 255, 255, 0);
+		put_option_ip(&popt, 3, 10, 0, 0, 2);
+		*popt++ = 0;  // a pad option
+		put_option_ip(&popt, 6, 10, 0, 0, 3);
+	}
+	*popt++ = 255;
+
+	// renewals are answered to the client address, the rest is broadcast
+	TIp4Addr ciaddr;
+	ciaddr.CopyFrom8(preq->ciaddr);
+	if (ciaddr.u32 && (DHCPNAK != amsgtype))
+	{
+		udp_srv.destaddr = ciaddr;
+	}
+	else
+	{
+		udp_srv.destaddr.u32 = 0xFFFFFFFF;
+	}
+	udp_srv.destport = DHCP_CLIENT_PORT;
+	udp_srv.Send(&srvbuf[0], 300);
+}
+
+static void server_run()
+{
+	int r;
+	while ((r = udp_srv.Receive(&srvbuf[0], sizeof(srvbuf))) > 0)
+	{
+		TDhcpHeader * pdh = (TDhcpHeader *)&srvbuf[0];
+		CHECK(unsigned(r) >= 300, "short DHCP message: %d bytes", r);
+		CHECK((1 == pdh->op) && (0 == memcmp(pdh->chaddr, &g_node_a.eth.mac_address[0], 6)), "invalid request header");
+
+		uint8_t msgtype = 0;
+		script.request_ip.u32 = 0;
+		script.request_server.u32 = 0;
+		uint8_t * popt = (uint8_t *)(pdh + 1) + 4;
+		while ((popt < &srvbuf[r]) && (255 != *popt))
+		{
+			if (53 == popt[0])  msgtype = popt[2];
+			if (50 == popt[0])  script.request_ip.CopyFrom8(&popt[2]);
+			if (54 == popt[0])  script.request_server.CopyFrom8(&popt[2]);
+			popt += 2 + popt[1];
+		}
+
+		TDhcpHeader req = *pdh;  // the reply overwrites the buffer
+		if (DHCPDISCOVER == msgtype)
+		{
+			++script.discover_count;
+			script.discover_xid = dhcp_xid(pdh);
+			uint32_t xid = script.discover_xid;
+			if (script.bad_xid_offers)
+			{
+				--script.bad_xid_offers;
+				xid ^= 0x1000;
+			}
+			server_reply(&req, DHCPOFFER, xid);
+		}
+		else if (DHCPREQUEST == msgtype)
+		{
+			++script.request_count;
+			script.request_xid = dhcp_xid(pdh);
+			script.request_ciaddr.CopyFrom8(pdh->ciaddr);
+			script.request_src = udp_srv.srcaddr;
+			server_reply(&req, script.request_reply, script.request_xid);
+		}
+		else
+		{
+			CHECK(false, "unexpected DHCP message type %u", msgtype);
+		}
+	}
+}
+
+static void run(unsigned ams)
+{
+	for (unsigned n = 0; n < ams; ++n)
+	{
+		test_net_run(1);
+		server_run();
+	}
+}
+
+static bool bound_to_offer()
+{
+	return client.bound && (DHCPS_BOUND == client.state)
+	    && (g_node_a.ip.ipaddress.u32 == ip4(10, 0, 0, 50))
+	    && (g_node_a.ip.netmask.u32 == ip4(255, 255, 255, 0))
+	    && (g_node_a.ip.gwaddress.u32 == ip4(10, 0, 0, 2))
+	    && (client.lease.dnsaddress.u32 == ip4(10, 0, 0, 3))
+	    && (60 == client.lease.lease_time_s);
+}
+
+// DISCOVER, a lost OFFER (wrong xid), DISCOVER again, OFFER, REQUEST, ACK
+static void test_bind()
+{
+	script.bad_xid_offers = 1;
+	run(2000);
+	CHECK(1 == script.discover_count, "DISCOVER count in the first 2 s: %u", script.discover_count);
+	CHECK(!client.bound && (DHCPS_SELECTING == client.state), "the OFFER with a wrong xid was accepted");
+
+	run(3000);  // the DISCOVER is repeated after 4 s
+	CHECK(2 == script.discover_count, "DISCOVER count: %u", script.discover_count);
+	CHECK(1 == script.request_count, "REQUEST count: %u", script.request_count);
+	CHECK(script.request_xid == script.discover_xid, "the REQUEST has a new xid");
+	CHECK(script.request_ip.u32 == ip4(10, 0, 0, 50), "option 50 of the REQUEST is missing");
+	CHECK(script.request_server.u32 == ip4(10, 0, 0, 2), "option 54 of the REQUEST is missing");
+	CHECK(0 == script.request_ciaddr.u32, "ciaddr is set in the REQUEST");
+	CHECK(bound_to_offer(), "not bound to the offered lease, state %u", client.state);
+}
+
+// the lease is renewed at T1 with a unicast REQUEST
+static void test_renew()
+{
+	uint32_t xid = script.request_xid;
+
+	run(28000);  // bound at about 4 s, the lease timing has 1 s resolution
+	CHECK(1 == script.request_count, "renewal before T1: %u requests, %u s", script.request_count, client.seconds);
+
+	run(3000);
+	CHECK(2 == script.request_count, "no renewal at T1, REQUEST count: %u", script.request_count);
+	CHECK(script.request_xid != xid, "the renewal uses the old xid");
+	CHECK(script.request_ciaddr.u32 == ip4(10, 0, 0, 50), "ciaddr is not set in the renewal");
+	CHECK(0 == script.request_ip.u32, "option 50 in the renewal");
+	CHECK(script.request_src.u32 == ip4(10, 0, 0, 50), "the renewal is not sent from the leased address");
+	CHECK(bound_to_offer(), "not bound after the renewal, state %u", client.state);
+}
+
+// a NAK for the renewal drops the lease and starts over after the retry timeout
+static void test_nak()
+{
+	script.request_reply = DHCPNAK;
+	run(31000);
+	CHECK(3 == script.request_count, "REQUEST count: %u", script.request_count);
+	CHECK(!client.bound && (DHCPS_INIT == client.state), "the NAK is not handled, state %u", client.state);
+	CHECK(0 == g_node_a.ip.ipaddress.u32, "the address is kept after the NAK");
+
+	script.request_reply = DHCPACK;
+	unsigned discovers = script.discover_count;
+	run(5000);
+	CHECK(discovers + 1 == script.discover_count, "no new DISCOVER after the NAK");
+	CHECK(bound_to_offer(), "not bound again after the NAK, state %u", client.state);
+}
+
+int main()
+{
+	test_net_setup();
+
+	udp_srv.Init(&g_node_b.ip, DHCP_SERVER_PORT);
+	client.Init(&g_node_a.ip);
+
+	test_bind();
+	test_renew();
+	test_nak();
+
+	return test_result("test_dhcp");
+}
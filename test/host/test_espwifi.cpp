@@ -0,0 +1,292 @@
+/*
+ *  file:     test_espwifi.cpp (host tests)
+ *  brief:    ESP AT driver: scripted module responses and +IPD streams across the RX DMA ring wrap
+ *  date:     2026-10-17
+ *  authors:  agent
+*/
+
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include "platform.h"
+#include "host_test.h"
+#include "espwifi_uart.h"
+
+#define PMEM_COUNT  4
+
+static TEspWifiUart     wifi;
+static TEspAtUdpSocket  udp;
+static TEspAtTcpSocket  tcp;
+static uint8_t          netmem[PMEM_COUNT * sizeof(TEspPmem)];
+
+bool TEspWifiUart::InitHw()
+{
+	return true;
+}
+
+// the AT firmware side: answers the commands collected from the UART TX
+
+static size_t                    mod_txpos = 0;
+static std::vector<std::string>  mod_commands;
+
+static void module_send(const std::string & astr)
+{
+	wifi.uart.Receive(astr.data(), astr.size());
+}
+
+static void module_run()
+{
+	std::string & tx = wifi.uart.txdata;
+	size_t eol;
+	while ((eol = tx.find("\r\n", mod_txpos)) != std::string::npos)
+	{
+		std::string cmd = tx.substr(mod_txpos, eol - mod_txpos);
+		mod_txpos = eol + 2;
+		mod_commands.push_back(cmd);
+
+		if (0 == cmd.compare(0, 9, "AT+CWJAP="))
+		{
+			module_send("WIFI CONNECTED\r\nWIFI GOT IP\r\n\r\nOK\r\n");
+		}
+		else if (0 == cmd.compare(0, 12, "AT+CIPSTART="))
+		{
+			module_send(std::string(1, cmd[12]) + ",CONNECT\r\n\r\nOK\r\n");
+		}
+		else if (0 == cmd.compare(0, 12, "AT+CIPCLOSE="))
+		{
+			module_send(std::string(1, cmd[12]) + ",CLOSED\r\n\r\nOK\r\n");
+		}
+		else
+		{
+			module_send("\r\nOK\r\n");
+		}
+	}
+}
+
+static unsigned command_count(const char * aprefix)
+{
+	unsigned result = 0;
+	for (std::string & cmd : mod_commands)
+	{
+		if (0 == cmd.compare(0, strlen(aprefix), aprefix))
+		{
+			++result;
+		}
+	}
+	return result;
+}
+
+static void step()
+{
+	g_clockcnt += 100;
+	wifi.Run();
+	module_run();
+}
+
+static void run(unsigned ams)
+{
+	for (unsigned n = 0; n < ams * 10; ++n)
+	{
+		step();
+	}
+}
+
+// the TCP byte stream: the pattern depends on the stream position
+
+static unsigned  stream_tx = 0;
+static unsigned  stream_rx = 0;
+static bool      stream_error = false;
+
+static uint8_t stream_byte(unsigned apos)
+{
+	return uint8_t(apos * 7 + (apos >> 8));
+}
+
+static std::string tcp_ipd(unsigned alen)
+{
+	std::string s = "+IPD,1," + std::to_string(alen) + ",\"10.0.0.9\",80:";
+	for (unsigned n = 0; n < alen; ++n)
+	{
+		s.push_back(char(stream_byte(stream_tx++)));
+	}
+	return s + "\r\n";
+}
+
+static void tcp_read()
+{
+	uint8_t buf[300];
+	int r;
+	while ((r = tcp.Receive(&buf[0], sizeof(buf))) > 0)
+	{
+		for (int n = 0; n < r; ++n)
+		{
+			if (buf[n] != stream_byte(stream_rx) && !stream_error)
+			{
+				CHECK(false, "stream byte %u is wrong", stream_rx);
+				stream_error = true;
+			}
+			++stream_rx;
+		}
+	}
+}
+
+// fills the ring with empty lines until aspace bytes are left to its end
+static void align_ring(unsigned aspace)
+{
+	unsigned ringsize = wifi.uart.rxdma->xfer->count;
+	unsigned fill = (2 * ringsize - wifi.uart.rxpos - aspace) % ringsize;
+	module_send(std::string(fill, '\n'));
+	step();
+}
+
+static void test_init()
+{
+	run(20);
+	module_send("\r\nready\r\n");
+	for (unsigned n = 0; (n < 1000) && !wifi.IsLinkUp(); ++n)
+	{
+		run(1);
+	}
+	CHECK(wifi.IsLinkUp(), "init did not finish");
+	CHECK(1 == command_count("AT+CWJAP="), "no AP join command");
+	CHECK(1 == command_count("AT+CIPSTART=0,\"UDP\""), "the UDP link is not started");
+	CHECK(udp.connected, "the UDP link is not connected");
+	CHECK(!tcp.Connected() && (0 == command_count("AT+CIPSTART=1")), "the TCP link is connected without request");
+}
+
+static void test_udp()
+{
+	module_send("+IPD,0,5,\"10.0.0.9\",1234:hello\r\n");
+	run(1);
+
+	uint8_t buf[16];
+	int r = udp.Receive(&buf[0], sizeof(buf));
+	CHECK((5 == r) && (0 == memcmp(buf, "hello", 5)), "UDP datagram: %d bytes", r);
+	CHECK((1234 == udp.srcport) && (9 == udp.srcaddr.u8[3]), "UDP source: port %u", udp.srcport);
+}
+
+static void test_tcp_connect()
+{
+	TIp4Addr addr;
+	addr.Set(10, 0, 0, 9);
+	CHECK(tcp.Connect(&addr, 80), "Connect() failed");
+	run(5);
+	CHECK(1 == command_count("AT+CIPSTART=1,\"TCP\",\"10.0.0.9\",80"), "no TCP connect command");
+	CHECK(tcp.Connected(), "TCP link is not connected");
+}
+
+// the +IPD header and data split at every interesting place by the ring end
+static void test_tcp_wrap()
+{
+	stream_tx = 0;
+	stream_rx = 0;
+
+	unsigned hdrlen = strlen("+IPD,1,100,\"10.0.0.9\",80:");
+	unsigned splits[] = { 1, 3, 6, hdrlen - 1, hdrlen, hdrlen + 1, hdrlen + 50, hdrlen + 99, hdrlen + 100, hdrlen + 101 };
+	for (unsigned split : splits)
+	{
+		align_ring(split);
+		module_send(tcp_ipd(100));
+		step();
+		tcp_read();
+	}
+	CHECK(stream_rx == stream_tx, "received %u of %u bytes at the split tests", stream_rx, stream_tx);
+
+	// byte by byte across the wrap
+	align_ring(20);
+	std::string s = tcp_ipd(60);
+	for (char c : s)
+	{
+		module_send(std::string(1, c));
+		step();
+	}
+	tcp_read();
+	CHECK(stream_rx == stream_tx, "received %u of %u bytes at the byte by byte test", stream_rx, stream_tx);
+
+	// random chunk sizes arriving in random pieces
+	for (unsigned n = 0; (n < 300) && !stream_error; ++n)
+	{
+		s = tcp_ipd(1 + rand() % 400);
+		size_t pos = 0;
+		while (pos < s.size())
+		{
+			size_t len = 1 + rand() % 200;
+			if (len > s.size() - pos)  len = s.size() - pos;
+			module_send(s.substr(pos, len));
+			pos += len;
+			step();
+			tcp_read();
+		}
+	}
+	CHECK(stream_rx == stream_tx, "received %u of %u bytes at the random test", stream_rx, stream_tx);
+	CHECK((0 == wifi.ipd_drop_count) && (0 == wifi.invalid_ipd_count), "drops: %u, invalid: %u", wifi.ipd_drop_count, wifi.invalid_ipd_count);
+	CHECK(tcp.Connected(), "TCP link is closed");
+}
+
+// a chunk without free TEspPmem closes the link, the data after the gap is never delivered
+static void test_tcp_drop()
+{
+	stream_tx = 0;
+	stream_rx = 0;
+
+	for (unsigned n = 0; n < PMEM_COUNT; ++n)
+	{
+		module_send(tcp_ipd(100));
+		step();
+	}
+	CHECK(0 == wifi.ipd_drop_count, "chunk dropped with free TEspPmem");
+
+	module_send(tcp_ipd(100));
+	step();
+	CHECK(1 == wifi.ipd_drop_count, "ipd_drop_count: %u", wifi.ipd_drop_count);
+	CHECK(!tcp.Connected(), "the link is still connected after the lost data");
+	CHECK(-1 == tcp.Send((void *)"x", 1), "send accepted on the aborted link");
+
+	// a TEspPmem is free again, but the stream is already broken
+	uint8_t buf[100];
+	CHECK(100 == tcp.Receive(&buf[0], sizeof(buf)), "first chunk is not readable");
+	module_send(tcp_ipd(100));
+	step();
+	CHECK(2 == wifi.ipd_drop_count, "the chunk after the gap is not dropped");
+
+	run(5);
+	CHECK(1 == command_count("AT+CIPCLOSE=1"), "no close command for the aborted link");
+
+	stream_rx = 100;
+	tcp_read();
+	CHECK(PMEM_COUNT * 100 == stream_rx, "received %u bytes before the gap", stream_rx);
+	CHECK(-1 == tcp.Receive(&buf[0], sizeof(buf)), "the abort is not reported");
+
+	// reconnect
+	TIp4Addr addr;
+	addr.Set(10, 0, 0, 9);
+	CHECK(tcp.Connect(&addr, 80), "reconnect failed");
+	run(5);
+	CHECK(tcp.Connected(), "not connected again");
+	CHECK(0 == tcp.Receive(&buf[0], sizeof(buf)), "the abort is reported after the reconnect");
+
+	stream_tx = 0;
+	stream_rx = 0;
+	module_send(tcp_ipd(50));
+	step();
+	tcp_read();
+	CHECK((50 == stream_rx) && (2 == wifi.ipd_drop_count), "no data after the reconnect");
+}
+
+int main()
+{
+	srand(2026);
+
+	wifi.pin_rst.pinnum = 0;  // the reset is driven by the init state machine
+	CHECK(wifi.Init(&netmem[0], sizeof(netmem)), "Init() failed");
+	udp.Init(&wifi, 5000);
+	tcp.Init(&wifi);
+
+	test_init();
+	test_udp();
+	test_tcp_connect();
+	test_tcp_wrap();
+	test_tcp_drop();
+
+	return test_result("test_espwifi");
+}
@@ -0,0 +1,178 @@
+/*
+ *  file:     test_fat_lfn.cpp (host tests)
+ *  brief:    FAT long file names and the path resolution name cache on the mkfatimg.py "lfn" images
+ *  date:     2026-10-17
+ *  authors:  agent
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "platform.h"
+#include "host_test.h"
+#include "filesys_fat.h"
+#include "fake_sdcard.h"
+
+static TFakeSdCard *  psd;
+static TStorManCnt *  psm;
+static TFileSysFat *  pfs;
+
+static uint8_t        rbuf[4096];
+
+struct TLfnFile
+{
+	const char *  shortname;
+	const char *  longname;
+	unsigned      size;
+	unsigned      fileid;
+};
+
+// the LFN_FILES of the mkfatimg.py with valid long names
+static const TLfnFile lfn_files[] =
+{
+	{ "LONGFI~1.TXT", "Long file name number one.txt", 1000, 4 },
+	{ "SECTOR~1.DAT", "The chain of this name spans a sector.dat", 3000, 5 },
+	{ "RVZTR~1.TXT", "\xC3\x81rv\xC3\xADzt\xC5\xB1r\xC5\x91 t\xC3\xBCk\xC3\xB6rf\xC3\xBAr\xC3\xB3g\xC3\xA9p \xE2\x82\xAC.txt", 200, 6 },
+	{ "SMILE~1.TXT", "smile \xF0\x9F\x98\x80 \xF0\x9F\x9A\x80.txt", 77, 7 },
+};
+
+static TFile * open_file(const char * aname, int * rresult)
+{
+	TFile * pf = pfs->NewFileObj(nullptr, 0);
+	pf->Open(aname, 0);
+	*rresult = pf->WaitComplete();
+	return pf;
+}
+
+static void close_file(TFile * pf)
+{
+	pf->Close();
+	CHECK(0 == pf->WaitComplete(), "close: %d", pf->result);
+	delete pf;
+}
+
+// opens the file, checks the names and the content (mkfatimg.py pattern)
+static void check_file(const char * aopenname, const char * aname, const char * ashortname, unsigned asize, unsigned afileid)
+{
+	int r;
+	TFile * pf = open_file(aopenname, &r);
+	CHECK(0 == r, "open \"%s\": %d", aopenname, r);
+	if (r)
+	{
+		delete pf;
+		return;
+	}
+
+	CHECK(0 == strcmp(pf->fdata.name, aname), "open \"%s\": name \"%s\"", aopenname, pf->fdata.name);
+	CHECK(0 == strcmp(pf->fdata.shortname, ashortname), "open \"%s\": short name \"%s\"", aopenname, pf->fdata.shortname);
+	CHECK(pf->fdata.size == asize, "open \"%s\": size %llu", aopenname, (unsigned long long)pf->fdata.size);
+
+	uint64_t pos = 0;
+	unsigned errors = 0;
+	while (true)
+	{
+		pf->Read(&rbuf[0], sizeof(rbuf));
+		if (pf->WaitComplete() || !pf->transferlen)
+		{
+			break;
+		}
+		for (unsigned n = 0; n < pf->transferlen; ++n)
+		{
+			uint64_t p = pos + n;
+			uint32_t w = uint32_t((p >> 2) * 2654435761u + afileid);
+			if (rbuf[n] != uint8_t(w >> (8 * (p & 3))))  ++errors;
+		}
+		pos += pf->transferlen;
+	}
+	CHECK((pos == asize) && !errors, "\"%s\": read %llu, errors %u", aopenname, (unsigned long long)pos, errors);
+	close_file(pf);
+}
+
+// a repeated open reads only the cached directory location, the long name is rebuilt from there
+static void test_namecache()
+{
+	const TLfnFile * lf = &lfn_files[1];  // the chain spans a sector boundary
+
+	CHECK((0 == pfs->namecache_hits) && (0 == pfs->namecache_misses), "name cache used before the first open");
+	check_file(lf->longname, lf->longname, lf->shortname, lf->size, lf->fileid);
+	CHECK(0 == pfs->namecache_hits, "cache hit at the first open");
+
+	check_file(lf->longname, lf->longname, lf->shortname, lf->size, lf->fileid);
+	CHECK(1 == pfs->namecache_hits, "no cache hit at the repeated open by long name: %u", pfs->namecache_hits);
+
+	// the 8.3 name has its own cache entry
+	check_file(lf->shortname, lf->longname, lf->shortname, lf->size, lf->fileid);
+	CHECK(1 == pfs->namecache_hits, "cache hit at the first open by 8.3 name");
+	check_file(lf->shortname, lf->longname, lf->shortname, lf->size, lf->fileid);
+	CHECK(2 == pfs->namecache_hits, "no cache hit at the repeated open by 8.3 name: %u", pfs->namecache_hits);
+
+	lf = &lfn_files[2];
+	check_file(lf->longname, lf->longname, lf->shortname, lf->size, lf->fileid);
+	check_file(lf->longname, lf->longname, lf->shortname, lf->size, lf->fileid);
+	CHECK(3 == pfs->namecache_hits, "no cache hit at the repeated open of the non-ASCII name: %u", pfs->namecache_hits);
+	CHECK(0 == pfs->namecache_misses, "namecache_misses: %u", pfs->namecache_misses);
+}
+
+static void test_names()
+{
+	for (const TLfnFile & lf : lfn_files)
+	{
+		check_file(lf.longname, lf.longname, lf.shortname, lf.size, lf.fileid);
+		check_file(lf.shortname, lf.longname, lf.shortname, lf.size, lf.fileid);
+	}
+
+	// the ASCII part of the names is case insensitive
+	check_file("LONG FILE NAME NUMBER ONE.TXT", lfn_files[0].longname, lfn_files[0].shortname, 1000, 4);
+	check_file("longfi~1.txt", lfn_files[0].longname, lfn_files[0].shortname, 1000, 4);
+
+	// the orphaned long name (bad checksum) is ignored
+	int r;
+	TFile * pf = open_file("Orphaned long name.txt", &r);
+	CHECK(FSRESULT_FILE_NOT_FOUND == r, "open by the orphaned long name: %d", r);
+	delete pf;
+	check_file("ORPHAN.TXT", "ORPHAN.TXT", "ORPHAN.TXT", 55, 8);
+
+	// the files without long name behind the LFN entries
+	check_file("BIG.BIN", "BIG.BIN", "BIG.BIN", 8 * 1024 * 1024 + 1234, 1);
+}
+
+static void test_image(const char * aimgname, const char * amkargs)
+{
+	char cmd[256];
+	snprintf(cmd, sizeof(cmd), "python3 mkfatimg.py %s %s >/dev/null", aimgname, amkargs);
+	if (system(cmd))
+	{
+		CHECK(false, "image generation failed: %s", cmd);
+		return;
+	}
+
+	psd = new TFakeSdCard();
+	psm = new TStorManCnt();
+	pfs = new TFileSysFat();
+
+	if (!psd->Open(aimgname))
+	{
+		CHECK(false, "error opening %s", aimgname);
+		return;
+	}
+	psm->Init(psd);
+	pfs->Init(psm, 0, psd->fsize);
+	while (!pfs->initialized)
+	{
+		pfs->Run();
+	}
+	CHECK(pfs->fsok, "%s: invalid file system", aimgname);
+
+	test_namecache();
+	test_names();
+
+	fclose(psd->f);
+	remove(aimgname);
+}
+
+int main()
+{
+	test_image("test_lfn32.img", "8 32 lfn");
+	test_image("test_lfn16.img", "4 32 fat16 lfn");
+
+	return test_result("test_fat_lfn");
+}
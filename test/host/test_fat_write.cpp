@@ -0,0 +1,348 @@
+/*
+ *  file:     test_fat_write.cpp (host tests)
+ *  brief:    FAT write support on FAT32 and FAT16 images, checked by the fatcheck.py
+ *  date:     2026-10-17
+ *  authors:  agent
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "platform.h"
+#include "host_test.h"
+#include "filesys_fat.h"
+#include "fake_sdcard.h"
+
+static TFakeSdCard *  psd;
+static TStorManCnt *  psm;
+static TFileSysFat *  pfs;
+static const char *   imgname;
+
+static uint8_t        wbuf[70000];
+static uint8_t        rbuf[70000];
+
+static uint8_t pattern(unsigned afileid, uint64_t apos)
+{
+	return uint8_t(apos * 131 + afileid * 7 + (apos >> 9));
+}
+
+static void fill_pattern(uint8_t * adst, unsigned afileid, uint64_t apos, unsigned alen)
+{
+	for (unsigned n = 0; n < alen; ++n)
+	{
+		adst[n] = pattern(afileid, apos + n);
+	}
+}
+
+static void fsck(const char * aphase)
+{
+	fflush(psd->f);
+	char cmd[256];
+	snprintf(cmd, sizeof(cmd), "python3 fatcheck.py %s >/dev/null", imgname);
+	if (system(cmd))
+	{
+		snprintf(cmd, sizeof(cmd), "python3 fatcheck.py %s", imgname);
+		(void)!system(cmd);
+		CHECK(false, "%s: fatcheck failed after %s", imgname, aphase);
+	}
+}
+
+static TFile * open_file(const char * aname, uint32_t aflags, int * rresult = nullptr)
+{
+	TFile * pf = pfs->NewFileObj(nullptr, 0);
+	pf->Open(aname, aflags);
+	int r = pf->WaitComplete();
+	if (rresult)
+	{
+		*rresult = r;
+	}
+	else
+	{
+		CHECK(0 == r, "open %s: %d", aname, r);
+	}
+	return pf;
+}
+
+static void close_file(TFile * pf)
+{
+	pf->Close();
+	CHECK(0 == pf->WaitComplete(), "close: %d", pf->result);
+	CHECK(!pf->opened, "still open after close");
+	delete pf;
+}
+
+// verifies the file with the pattern, the [aofs, aofs + alen) range was overwritten with the aoid pattern
+static void verify(const char * aname, unsigned afileid, uint64_t asize, uint64_t aofs = 0, unsigned alen = 0, unsigned aoid = 0)
+{
+	TFile * pf = open_file(aname, 0);
+	CHECK(pf->fdata.size == asize, "%s size %llu != %llu", aname, (unsigned long long)pf->fdata.size, (unsigned long long)asize);
+	uint64_t pos = 0;
+	unsigned errors = 0;
+	while (true)
+	{
+		pf->Read(&rbuf[0], 7777);
+		if (pf->WaitComplete() || !pf->transferlen)
+		{
+			break;
+		}
+		for (unsigned n = 0; n < pf->transferlen; ++n)
+		{
+			uint64_t p = pos + n;
+			uint8_t e = (((p >= aofs) && (p < aofs + alen)) ? pattern(aoid, p) : pattern(afileid, p));
+			if (rbuf[n] != e)  ++errors;
+		}
+		pos += pf->transferlen;
+	}
+	CHECK((pos == asize) && !errors, "%s verify: read %llu, errors %u", aname, (unsigned long long)pos, errors);
+	close_file(pf);
+}
+
+// verifies a file written by the mkfatimg.py
+static void verify_image_file(const char * aname, unsigned afileid)
+{
+	TFile * pf = open_file(aname, 0);
+	uint64_t pos = 0;
+	unsigned errors = 0;
+	while (true)
+	{
+		pf->Read(&rbuf[0], 65536);
+		if (pf->WaitComplete() || !pf->transferlen)
+		{
+			break;
+		}
+		for (unsigned n = 0; n < pf->transferlen; ++n)
+		{
+			uint64_t p = pos + n;
+			uint32_t w = uint32_t((p >> 2) * 2654435761u + afileid);
+			if (rbuf[n] != uint8_t(w >> (8 * (p & 3))))  ++errors;
+		}
+		pos += pf->transferlen;
+	}
+	CHECK((pos == pf->fdata.size) && !errors, "%s changed: read %llu, errors %u", aname, (unsigned long long)pos, errors);
+	close_file(pf);
+}
+
+static uint64_t append(TFile * pf, unsigned afileid, unsigned alen)
+{
+	fill_pattern(&wbuf[0], afileid, pf->fdata.size, alen);
+	pf->Write(&wbuf[0], alen);
+	int r = pf->WaitComplete();
+	CHECK((0 == r) && (pf->transferlen == alen), "write %u: result %d, transferred %u", alen, r, pf->transferlen);
+	return pf->fdata.size;
+}
+
+static void test_append()
+{
+	srand(5);
+	TFile * pf = open_file("LOG.TXT", FOPEN_CREATE | FOPEN_APPEND);
+	CHECK(0 == pf->fdata.size, "new file is not empty");
+	uint64_t logsize = 0;
+	for (unsigned n = 0; n < 600; ++n)
+	{
+		logsize = append(pf, 1, (0 == n % 100) ? 65536 : 1 + rand() % 3000);
+	}
+	close_file(pf);
+	fsck("append");
+	verify("LOG.TXT", 1, logsize);
+
+	// opened with append: the position is 0, but the writes go to the end
+	pf = open_file("log.txt", FOPEN_APPEND);
+	logsize = append(pf, 1, 12345);
+	close_file(pf);
+	verify("LOG.TXT", 1, logsize);
+
+	// interleaved appends to two files
+	TFile * pa = open_file("A.BIN", FOPEN_CREATE);
+	TFile * pb = open_file("B.BIN", FOPEN_CREATE);
+	uint64_t asize = 0;
+	uint64_t bsize = 0;
+	for (unsigned n = 0; n < 200; ++n)
+	{
+		asize = append(pa, 2, 3000 + n);
+		bsize = append(pb, 3, 5000);
+	}
+	close_file(pa);
+	close_file(pb);
+	fsck("interleaved append");
+	verify("A.BIN", 2, asize);
+	verify("B.BIN", 3, bsize);
+
+	// truncate in the middle
+	pf = open_file("LOG.TXT", 0);
+	uint64_t tpos = logsize / 2 + 17;
+	pf->Seek(tpos);
+	CHECK(0 == pf->WaitComplete(), "seek");
+	pf->Truncate();
+	CHECK(0 == pf->WaitComplete(), "truncate: %d", pf->result);
+	close_file(pf);
+	fsck("truncate");
+	verify("LOG.TXT", 1, tpos);
+
+	// truncate to zero
+	pf = open_file("B.BIN", 0);
+	pf->Truncate();
+	CHECK(0 == pf->WaitComplete(), "truncate to 0: %d", pf->result);
+	close_file(pf);
+	fsck("truncate to 0");
+	verify("B.BIN", 3, 0);
+
+	// truncate at a cluster boundary, then append
+	pf = open_file("A.BIN", 0);
+	pf->Seek(pfs->clusterbytes * 7);
+	CHECK(0 == pf->WaitComplete(), "seek");
+	pf->Truncate();
+	CHECK(0 == pf->WaitComplete(), "truncate: %d", pf->result);
+	close_file(pf);
+	pf = open_file("A.BIN", FOPEN_APPEND);
+	asize = append(pf, 2, 20000);
+	close_file(pf);
+	fsck("truncate at cluster boundary");
+	verify("A.BIN", 2, asize);
+
+	// overwrite across the end
+	pf = open_file("A.BIN", 0);
+	uint64_t ofs = asize - 3000;
+	pf->Seek(ofs);
+	CHECK(0 == pf->WaitComplete(), "seek");
+	fill_pattern(&wbuf[0], 9, ofs, 10000);
+	pf->Write(&wbuf[0], 10000);
+	CHECK(0 == pf->WaitComplete(), "overwrite");
+	close_file(pf);
+	fsck("overwrite");
+	verify("A.BIN", 2, ofs + 10000, ofs, 10000, 9);
+}
+
+static void test_names()
+{
+	int r;
+	TFile * pf = open_file("LOG", 0, &r);
+	CHECK(FSRESULT_FILE_NOT_FOUND == r, "prefix match: %d", r);
+	delete pf;
+
+	pf = open_file("TOOLONGNAME.TXT", FOPEN_CREATE, &r);
+	CHECK(FSRESULT_INVALID_NAME == r, "long name: %d", r);
+	delete pf;
+
+	pf = open_file("A.BIN", FOPEN_CREATE);  // existing: opened, not truncated
+	CHECK(pf->fdata.size > 0, "existing file truncated by create");
+	close_file(pf);
+}
+
+// many files in the root, the FAT32 root directory is extended, the FAT16 root directory gets full
+static void test_many_files(bool afixedroot)
+{
+	char name[32];
+	unsigned created = 0;
+	int r = 0;
+	while (created < 600)
+	{
+		snprintf(name, sizeof(name), "f%03u.txt", created);
+		TFile * pf = open_file(name, FOPEN_CREATE, &r);
+		if (r)
+		{
+			delete pf;
+			break;
+		}
+		append(pf, 10 + created, 100 + created);
+		close_file(pf);
+		++created;
+	}
+
+	if (afixedroot)
+	{
+		// 512 entries: 3 image files, LOG.TXT, A.BIN, B.BIN
+		CHECK(FSRESULT_DISK_FULL == r, "full root directory: %d", r);
+		CHECK(512 - 6 == created, "created files in the root: %u", created);
+	}
+	else
+	{
+		CHECK(600 == created, "created files in the root: %u, result %d", created, r);
+	}
+	fsck("many files");
+
+	for (unsigned n = 0; n < created; n += 37)
+	{
+		snprintf(name, sizeof(name), "F%03u.TXT", n);
+		verify(name, 10 + n, 100 + n);
+	}
+	snprintf(name, sizeof(name), "F%03u.TXT", created - 1);
+	verify(name, 10 + created - 1, 100 + created - 1);
+}
+
+// fills the disk with the B.BIN (truncated to 0 before), the FAT16 root directory is already full
+static void test_disk_full()
+{
+	TFile * pf = open_file("B.BIN", FOPEN_APPEND);
+	uint64_t fsize = 0;
+	int r;
+	while (true)
+	{
+		fill_pattern(&wbuf[0], 5, fsize, 65536);
+		pf->Write(&wbuf[0], 65536);
+		r = pf->WaitComplete();
+		fsize += pf->transferlen;
+		if (r)  break;
+	}
+	CHECK(FSRESULT_DISK_FULL == r, "disk full result: %d", r);
+	CHECK(pf->fdata.size == fsize, "size at disk full: %llu != %llu", (unsigned long long)pf->fdata.size, (unsigned long long)fsize);
+	close_file(pf);
+	fsck("disk full");
+	verify("B.BIN", 5, fsize);
+
+	pf = open_file("B.BIN", 0);
+	pf->Truncate();
+	CHECK(0 == pf->WaitComplete(), "truncate after disk full: %d", pf->result);
+	close_file(pf);
+	fsck("free after disk full");
+	verify("B.BIN", 5, 0);
+}
+
+static void test_image(const char * aimgname, const char * amkargs, bool afixedroot)
+{
+	char cmd[256];
+	snprintf(cmd, sizeof(cmd), "python3 mkfatimg.py %s %s >/dev/null", aimgname, amkargs);
+	if (system(cmd))
+	{
+		CHECK(false, "image generation failed: %s", cmd);
+		return;
+	}
+
+	imgname = aimgname;
+	psd = new TFakeSdCard();
+	psm = new TStorManCnt();
+	pfs = new TFileSysFat();
+
+	if (!psd->Open(aimgname))
+	{
+		CHECK(false, "error opening %s", aimgname);
+		return;
+	}
+	psm->Init(psd);
+	pfs->Init(psm, 0, psd->fsize);
+	while (!pfs->initialized)
+	{
+		pfs->Run();
+	}
+	CHECK(pfs->fsok, "%s: invalid file system", aimgname);
+	CHECK(pfs->fat32 == !afixedroot, "%s: wrong FAT type", aimgname);
+
+	verify_image_file("BIG.BIN", 1);
+	test_append();
+	test_names();
+	test_many_files(afixedroot);
+	test_disk_full();
+
+	// the files of the image must be untouched, on FAT16 BIG.BIN starts at the cluster 2
+	verify_image_file("BIG.BIN", 1);
+	verify_image_file("FRAG.BIN", 2);
+
+	fclose(psd->f);
+	remove(aimgname);
+}
+
+int main()
+{
+	test_image("test_fat32.img", "1 40", false);
+	test_image("test_fat16.img", "4 32 fat16", true);
+
+	return test_result("test_fat_write");
+}
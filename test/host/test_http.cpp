@@ -0,0 +1,178 @@
+/*
+ *  file:     test_http.cpp (host tests)
+ *  brief:    HTTP server request limits and error responses
+ *  date:     2026-10-17
+ *  authors:  agent
+*/
+
+#include "platform.h"
+#include "host_net.h"
+#include "net_http.h"
+#include <string>
+
+class TTestServer : public THttpServer
+{
+public:
+	virtual bool HandleRequest(THttpConnection * pconn)
+	{
+		if (0 == strcmp(pconn->path, "/echo"))
+		{
+			pconn->StartResponse(200, "application/octet-stream", pconn->body_len);
+			pconn->Write(pconn->body, pconn->body_len);
+			pconn->EndResponse();
+			return true;
+		}
+		if (0 == strcmp(pconn->path, "/fill"))
+		{
+			// occupies the whole TX buffer, then leaves the request to the file server
+			static uint8_t fill[4096];
+			pconn->socket.Send(&fill[0], pconn->socket.TxFree());
+			return false;
+		}
+		return false;
+	}
+};
+
+static TTestServer  server;
+static TTcp4Socket  client;
+static std::string  rxstr;
+
+static uint8_t      image[1024] __attribute__((aligned(8)));
+static const char * index_html = "<html>hello</html>";
+
+static void build_image()
+{
+	TVrofsMainHead * pmh = (TVrofsMainHead *)&image[0];
+	memcpy(&pmh->vrofsid[0], VROFS_ID_10, 8);
+	pmh->main_head_bytes = sizeof(TVrofsMainHead);
+	pmh->index_rec_bytes = sizeof(TVrofsIndexRec);
+	pmh->index_block_bytes = sizeof(TVrofsIndexRec);
+	pmh->flags = VROFS_FLAG_ORDERED;
+
+	TVrofsIndexRec * prec = (TVrofsIndexRec *)(pmh + 1);
+	prec->path_len = strlen("/index.html");
+	memcpy(&prec->path[0], "/index.html", prec->path_len);
+	prec->offset = 0;
+	prec->data_bytes = strlen(index_html);
+	memcpy(prec + 1, index_html, prec->data_bytes);
+	pmh->data_block_bytes = (prec->data_bytes + 7) & ~7;
+}
+
+static void client_run(unsigned ams)
+{
+	uint8_t buf[1024];
+	for (unsigned n = 0; n < ams * 10; ++n)
+	{
+		g_clockcnt += 100;
+		g_node_a.adapter.Run();
+		g_node_b.adapter.Run();
+		int r = client.Receive(&buf[0], sizeof(buf));
+		if (r > 0)
+		{
+			rxstr.append((char *)&buf[0], r);
+		}
+	}
+}
+
+static bool client_connect()
+{
+	TIp4Addr dst;
+	dst.Set(10, 0, 0, 2);
+	rxstr.clear();
+	client.Connect(&dst, 80);
+	client_run(20);
+	return client.Connected();
+}
+
+static void client_close()
+{
+	client.Close();
+	client_run(50);
+	client.Abort();
+	client_run(server.request_timeout_ms + 10);  // the server connections return to listening
+}
+
+static std::string request(const std::string & areq)
+{
+	rxstr.clear();
+	client.Send((void *)areq.data(), areq.size());
+	client_run(50);
+	return rxstr;
+}
+
+static bool status_is(const std::string & aresp, const char * astatus)
+{
+	return (0 == aresp.compare(0, 9 + strlen(astatus), std::string("HTTP/1.1 ") + astatus));
+}
+
+static void test_get()
+{
+	CHECK(client_connect(), "connect failed");
+	std::string r = request("GET /index.html HTTP/1.1\r\n\r\n");
+	CHECK(status_is(r, "200") && (r.find(index_html) != std::string::npos), "GET: %s", r.c_str());
+
+	// the body is completed by a second segment
+	r = request("POST /echo HTTP/1.1\r\nContent-Length: 10\r\n\r\n01234");
+	CHECK(r.empty(), "incomplete body answered");
+	r = request("56789");
+	CHECK(status_is(r, "200") && (r.find("\r\n\r\n0123456789") != std::string::npos), "POST: %s", r.c_str());
+	client_close();
+}
+
+static void test_content_length(const char * alength)
+{
+	uint32_t reqcnt = server.request_count;
+	CHECK(client_connect(), "connect failed");
+	std::string r = request(std::string("POST /echo HTTP/1.1\r\nContent-Length: ") + alength + "\r\n\r\nabc");
+	CHECK(status_is(r, "413"), "Content-Length %s: %s", alength, r.c_str());
+	CHECK(client.RemoteClosed(), "Content-Length %s: connection not closed", alength);
+	CHECK(reqcnt + 1 == server.request_count, "Content-Length %s: not one request", alength);
+	client_close();
+}
+
+static void test_no_room_for_error()
+{
+	CHECK(client_connect(), "connect failed");
+	request("GET /fill HTTP/1.1\r\n\r\n");
+	CHECK(TCPS_CLOSED == client.state, "connection without response not reset, state=%u", client.state);
+	client_close();
+	CHECK(TCPS_LISTEN == server.connections[0].socket.state, "server socket not listening");
+
+	test_get();  // the connection is usable again
+}
+
+static void test_init_nomem()
+{
+	static TTestNode    node;
+	static THttpServer  bigserver;
+
+	node.adapter.Init(&node.eth, &node.netmem[0], sizeof(node.netmem));
+	node.ip.Init(&node.adapter);
+	bigserver.request_buf_size = 60000;
+	CHECK(!bigserver.Init(&node.ip, 80), "HTTP init without NetMem succeeded");
+	CHECK(bigserver.max_connections < 4, "connection count not limited");
+}
+
+int main()
+{
+	test_net_setup();
+
+	build_image();
+	server.max_connections = 1;
+	CHECK(server.Init(&g_node_b.ip, 80), "server init failed");
+	CHECK(server.SetVrofs(&image[0]), "invalid VROFS image");
+
+	client.rx_buf_size = 4096;
+	client.Init(&g_node_a.ip);
+
+	test_get();
+	test_content_length("1000");
+	test_content_length("4294967295");
+	test_content_length("4294967296");
+	test_content_length("99999999999999999999");
+	test_no_room_for_error();
+
+	test_init_nomem();
+
+	return test_result("test_http");
+}
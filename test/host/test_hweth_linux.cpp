@@ -0,0 +1,158 @@
+/*
+ *  file:     test_hweth_linux.cpp (host tests)
+ *  brief:    the Linux Ethernet backend (core/linux) in pcap replay mode, built with HWETH_LINUX
+ *  date:     2026-10-17
+ *  authors:  agent
+*/
+
+#include <stdio.h>
+#include <vector>
+#include "platform.h"
+#include "host_test.h"
+#include "net_ip4.h"
+
+#define RX_PCAP  "hweth_linux_rx.pcap"
+#define TX_PCAP  "hweth_linux_tx.pcap"
+
+static THwEth       eth;
+static TNetAdapter  adapter;
+static TIp4Handler  ip;
+static uint8_t      netmem[64 * 1024];
+
+static const uint8_t peer_mac[6] = { 0x02, 0x00, 0x00, 0x00, 0x00, 0x09 };
+static const uint8_t peer_ip[4]  = { 10, 0, 0, 9 };
+static const uint8_t my_ip[4]    = { 10, 0, 0, 1 };
+
+// an ARP request from the peer for our address
+static std::vector<uint8_t> arp_request()
+{
+	std::vector<uint8_t> f(42, 0);
+	memset(&f[0], 0xFF, 6);
+	memcpy(&f[6], peer_mac, 6);
+	f[12] = 0x08;  f[13] = 0x06;
+	f[14] = 0x00;  f[15] = 0x01;  // Ethernet
+	f[16] = 0x08;  f[17] = 0x00;  // IPv4
+	f[18] = 6;     f[19] = 4;
+	f[20] = 0x00;  f[21] = 0x01;  // request
+	memcpy(&f[22], peer_mac, 6);
+	memcpy(&f[28], peer_ip, 4);
+	memcpy(&f[38], my_ip, 4);
+	return f;
+}
+
+static void write_rx_pcap(const std::vector<std::vector<uint8_t>> & aframes, uint32_t amagic)
+{
+	FILE * f = fopen(RX_PCAP, "wb");
+	uint32_t fh[6] = { amagic, 0x00040002, 0, 0, 65535, 1 };
+	fwrite(&fh[0], sizeof(fh), 1, f);
+	uint32_t t = 0;
+	for (const std::vector<uint8_t> & frame : aframes)
+	{
+		uint32_t rh[4] = { 1000 + t, 0, uint32_t(frame.size()), uint32_t(frame.size()) };
+		fwrite(&rh[0], sizeof(rh), 1, f);
+		fwrite(frame.data(), frame.size(), 1, f);
+		++t;
+	}
+	fclose(f);
+}
+
+// returns the frames of the TX pcap file, checks the file header
+static std::vector<std::vector<uint8_t>> read_tx_pcap()
+{
+	std::vector<std::vector<uint8_t>> result;
+	FILE * f = fopen(TX_PCAP, "rb");
+	CHECK(f, "no TX pcap file");
+	if (!f)  return result;
+
+	uint32_t fh[6];
+	CHECK((1 == fread(&fh[0], sizeof(fh), 1, f)) && (0xA1B23C4D == fh[0]) && (1 == fh[5]), "invalid TX pcap header");
+
+	uint32_t rh[4];
+	while (1 == fread(&rh[0], sizeof(rh), 1, f))
+	{
+		CHECK((rh[1] < 1000000000) && (rh[2] == rh[3]), "invalid TX pcap record header");
+		std::vector<uint8_t> frame(rh[2]);
+		if (rh[2] && (1 != fread(frame.data(), rh[2], 1, f)))
+		{
+			CHECK(false, "truncated TX pcap record");
+			break;
+		}
+		result.push_back(frame);
+	}
+	fclose(f);
+	return result;
+}
+
+static bool start(const char * arxfile)
+{
+	eth.backend = HWETH_LINUX_PCAP;
+	eth.pcap_rx_filename = arxfile;
+	eth.pcap_tx_filename = TX_PCAP;
+	memset(&eth.mac_address[0], 0, 6);
+	eth.mac_address[0] = 0x02;
+	eth.mac_address[5] = 0x0A;
+
+	if (!adapter.Init(&eth, &netmem[0], sizeof(netmem)))
+	{
+		return false;
+	}
+	ip.ipaddress.Set(10, 0, 0, 1);
+	ip.netmask.Set(255, 255, 255, 0);
+	return ip.Init(&adapter);
+}
+
+static void run(unsigned ams)
+{
+	for (unsigned n = 0; n < ams * 10; ++n)
+	{
+		g_clockcnt += 100;
+		adapter.Run();
+	}
+}
+
+// the replayed ARP request must be answered into the TX pcap
+static void test_arp_reply()
+{
+	write_rx_pcap({ arp_request() }, 0xA1B2C3D4);
+	CHECK(start(RX_PCAP), "adapter init with the pcap backend failed");
+	run(10);
+	CHECK(1 == eth.recv_count, "received frames: %u", eth.recv_count);
+	eth.Close();  // flushes the TX file
+
+	std::vector<std::vector<uint8_t>> tx = read_tx_pcap();
+	unsigned replies = 0;
+	for (std::vector<uint8_t> & f : tx)
+	{
+		if ((f.size() < 42) || (0x08 != f[12]) || (0x06 != f[13]))
+		{
+			continue;
+		}
+		++replies;
+		CHECK(0 == memcmp(&f[0], peer_mac, 6), "ARP reply destination");
+		CHECK(0 == memcmp(&f[6], &eth.mac_address[0], 6), "ARP reply source");
+		CHECK((0x00 == f[20]) && (0x02 == f[21]), "not an ARP reply: opcode %u", f[21]);
+		CHECK((0 == memcmp(&f[22], &eth.mac_address[0], 6)) && (0 == memcmp(&f[28], my_ip, 4)), "ARP reply sender");
+		CHECK((0 == memcmp(&f[32], peer_mac, 6)) && (0 == memcmp(&f[38], peer_ip, 4)), "ARP reply target");
+	}
+	CHECK(1 == replies, "ARP replies in the TX pcap: %u of %u frames", replies, unsigned(tx.size()));
+}
+
+// a file that is not an Ethernet pcap is rejected at the init
+static void test_invalid_file()
+{
+	write_rx_pcap({ arp_request() }, 0x12345678);
+	CHECK(!start(RX_PCAP), "invalid pcap file accepted");
+	CHECK(!start("no_such_file.pcap"), "missing pcap file accepted");
+	eth.Close();
+}
+
+int main()
+{
+	test_arp_reply();
+	test_invalid_file();
+
+	remove(RX_PCAP);
+	remove(TX_PCAP);
+
+	return test_result("test_hweth_linux");
+}
@@ -0,0 +1,103 @@
+/*
+ *  file:     test_igmp.cpp (host tests)
+ *  brief:    IGMP message validation and the query handling
+ *  date:     2026-10-17
+ *  authors:  agent
+*/
+
+#include "platform.h"
+#include "host_net.h"
+
+static TIp4Addr  group;
+
+// puts an IGMP membership query (general, to 224.0.0.1) into the RX queue of the node B
+static void inject_query(unsigned aigmplen, bool abadcsum, unsigned atruncate = 0)
+{
+	uint8_t frame[14 + 24 + 32];
+	memset(&frame[0], 0, sizeof(frame));
+
+	TEthernetHeader * peh = (TEthernetHeader *)&frame[0];
+	TIp4Addr allhosts;
+	allhosts.Set(224, 0, 0, 1);
+	ip4_multicast_mac(&peh->dest_mac[0], &allhosts);
+	memcpy(&peh->src_mac[0], &g_node_a.eth.mac_address[0], 6);
+	peh->ethertype = __builtin_bswap16(0x0800);
+
+	TIp4Header * piph = (TIp4Header *)(peh + 1);
+	piph->hl_v = 0x46;  // with the router alert option
+	piph->tos = 0xC0;
+	piph->len = __builtin_bswap16(24 + aigmplen);
+	piph->ttl = 1;
+	piph->protocol = 2;
+	memcpy(&piph->srcaddr[0], &g_node_a.ip.ipaddress.u8[0], 4);
+	memcpy(&piph->dstaddr[0], &allhosts.u8[0], 4);
+	uint8_t * popt = (uint8_t *)(piph + 1);
+	popt[0] = 0x94;
+	popt[1] = 0x04;
+	piph->csum = net_checksum_fold(net_checksum_add(0, piph, 24));
+
+	TIgmpHeader * pigmp = (TIgmpHeader *)(popt + 4);
+	pigmp->type = IGMP_MEMBERSHIP_QUERY;
+	pigmp->maxresp = 10;  // 1 s
+	if (aigmplen > sizeof(TIgmpHeader))  // IGMPv3 query with one source address
+	{
+		uint8_t * pv3 = (uint8_t *)(pigmp + 1);
+		pv3[0] = 2;     // QRV
+		pv3[1] = 125;   // QQIC
+		pv3[3] = 1;     // number of sources
+		pv3[4] = 10;
+		pv3[7] = 9;
+	}
+	pigmp->csum = net_checksum_fold(net_checksum_add(0, pigmp, aigmplen));
+	if (abadcsum)
+	{
+		pigmp->csum ^= 0x0100;
+	}
+
+	g_node_b.eth.inq.push_back(std::vector<uint8_t>(&frame[0], &frame[14 + 24 + aigmplen - atruncate]));
+}
+
+static bool query_pending()
+{
+	TIp4McGroup * pgrp = g_node_b.ip.FindGroup(&group);
+	return pgrp && pgrp->report_pending;
+}
+
+int main()
+{
+	test_net_setup();
+
+	// both nodes join, they receive the reports of each other
+	group.Set(239, 1, 2, 3);
+	CHECK(g_node_b.ip.JoinGroup(&group), "JoinGroup failed on node B");
+	CHECK(g_node_a.ip.JoinGroup(&group), "JoinGroup failed on node A");
+	test_net_run(3000);
+	CHECK(0 == g_node_a.ip.igmp_error_count, "the reports of node B were rejected");
+	CHECK(0 == g_node_b.ip.igmp_error_count, "the reports of node A were rejected");
+	CHECK(!query_pending(), "unsolicited reports are still pending");
+
+	inject_query(sizeof(TIgmpHeader), true);
+	test_net_run(1);
+	CHECK(1 == g_node_b.ip.igmp_error_count, "the query with a bad checksum is not counted");
+	CHECK(!query_pending(), "the query with a bad checksum was answered");
+
+	inject_query(sizeof(TIgmpHeader), false, 4);
+	test_net_run(1);
+	CHECK(2 == g_node_b.ip.igmp_error_count, "the truncated query is not counted");
+	CHECK(!query_pending(), "the truncated query was answered");
+
+	inject_query(sizeof(TIgmpHeader), false);
+	test_net_run(1);
+	CHECK(2 == g_node_b.ip.igmp_error_count, "the valid query is counted as error");
+	CHECK(query_pending(), "the valid query is not answered");
+	test_net_run(1100);
+	CHECK(!query_pending(), "no report after the max. response time");
+
+	// the IGMPv3 checksum covers the source list too
+	inject_query(sizeof(TIgmpHeader) + 8, false);
+	test_net_run(1);
+	CHECK(2 == g_node_b.ip.igmp_error_count, "the valid IGMPv3 query is counted as error");
+	CHECK(query_pending(), "the IGMPv3 query is not answered");
+
+	return test_result("test_igmp");
+}
@@ -0,0 +1,218 @@
+/*
+ *  file:     test_ip4_frag.cpp (host tests)
+ *  brief:    IPv4 fragmentation and reassembly
+ *  date:     2026-10-17
+ *  authors:  agent
+*/
+
+#include "platform.h"
+#include "host_net.h"
+
+static TUdp4Socket  udp_a;
+static TUdp4Socket  udp_b;
+
+static uint8_t      datagram[64];  // UDP header + payload of the hand made fragments
+static uint16_t     frag_id = 0x100;
+
+// puts one fragment of the datagram[] into the RX queue of the node B
+static void inject_fragment(unsigned aoffs, unsigned alen, bool amore)
+{
+	uint8_t frame[14 + 20 + 64];
+	memset(&frame[0], 0, sizeof(frame));
+
+	TEthernetHeader * peh = (TEthernetHeader *)&frame[0];
+	memcpy(&peh->dest_mac[0], &g_node_b.eth.mac_address[0], 6);
+	memcpy(&peh->src_mac[0], &g_node_a.eth.mac_address[0], 6);
+	peh->ethertype = __builtin_bswap16(0x0800);
+
+	TIp4Header * piph = (TIp4Header *)(peh + 1);
+	piph->hl_v = 0x45;
+	piph->len = __builtin_bswap16(20 + alen);
+	piph->id = frag_id;
+	piph->fl_offs = __builtin_bswap16((amore ? 0x2000 : 0) | (aoffs >> 3));
+	piph->ttl = 64;
+	piph->protocol = 17;
+	memcpy(&piph->srcaddr[0], &g_node_a.ip.ipaddress.u8[0], 4);
+	memcpy(&piph->dstaddr[0], &g_node_b.ip.ipaddress.u8[0], 4);
+	piph->csum = calc_ip4_header_checksum(piph);
+	memcpy(piph + 1, &datagram[aoffs], alen);
+
+	g_node_b.eth.inq.push_back(std::vector<uint8_t>(&frame[0], &frame[14 + 20 + alen]));
+}
+
+static void prepare_datagram(unsigned alen)  // alen: IP payload length
+{
+	++frag_id;
+	TUdp4Header * pudp = (TUdp4Header *)&datagram[0];
+	pudp->sport = __builtin_bswap16(1000);
+	pudp->dport = __builtin_bswap16(2000);
+	pudp->len = __builtin_bswap16(alen);
+	pudp->csum = 0;
+	for (unsigned n = sizeof(TUdp4Header); n < alen; ++n)
+	{
+		datagram[n] = uint8_t(n * 7 + frag_id);
+	}
+}
+
+// returns the received UDP payload length, -1 = nothing received
+static int receive_b()
+{
+	uint8_t * pdata;
+	unsigned  dlen;
+	if (!udp_b.ReceiveRef(&pdata, &dlen))
+	{
+		return -1;
+	}
+	bool ok = (0 == memcmp(pdata, &datagram[sizeof(TUdp4Header)], dlen));
+	udp_b.ReleaseRx();
+	CHECK(ok, "received data mismatch");
+	return dlen;
+}
+
+static void test_send_large()
+{
+	static uint8_t txbuf[8000];
+	static uint8_t rxbuf[8000];
+	for (unsigned n = 0; n < sizeof(txbuf); ++n)
+	{
+		txbuf[n] = uint8_t(n * 13 + 5);
+	}
+
+	int r = udp_a.Send(&txbuf[0], sizeof(txbuf));
+	CHECK(r == int(sizeof(txbuf)), "large send: %d", r);
+	test_net_run(20);
+	r = udp_b.Receive(&rxbuf[0], sizeof(rxbuf));
+	CHECK((r == int(sizeof(txbuf))) && (0 == memcmp(txbuf, rxbuf, sizeof(txbuf))), "large receive: %d", r);
+}
+
+// more fragments than the ARP request jobs: nothing is sent before the address is resolved
+static void test_send_unresolved()
+{
+	static uint8_t txbuf[4000];  // 3 fragments
+	static uint8_t rxbuf[4000];
+	for (unsigned n = 0; n < sizeof(txbuf); ++n)
+	{
+		txbuf[n] = uint8_t(n * 3 + 1);
+	}
+
+	TNetPacketPool * pool = &g_node_a.adapter.txpool[NET_POOL_CLASSES - 1];
+	unsigned used0 = pool->used;
+	uint32_t fails = g_node_a.ip.frag_tx_fail_count;
+	g_node_a.ip.arptable.max_request_jobs = 2;
+
+	int r = udp_a.Send(&txbuf[0], sizeof(txbuf));
+	CHECK(0 == r, "send to an unresolved address: %d", r);
+	CHECK(fails + 1 == g_node_a.ip.frag_tx_fail_count, "the failed send is not counted");
+	CHECK(pool->used == used0, "%u TX packets are kept", pool->used - used0);
+	CHECK(0 == g_node_a.ip.arptable.drop_count, "fragments were dropped");
+
+	test_net_run(5);
+	CHECK(0 == udp_b.Receive(&rxbuf[0], sizeof(rxbuf)), "a partial datagram was sent");
+
+	// the resolution was started by the failed send
+	r = udp_a.Send(&txbuf[0], sizeof(txbuf));
+	CHECK(r == int(sizeof(txbuf)), "send after the resolution: %d", r);
+	test_net_run(5);
+	r = udp_b.Receive(&rxbuf[0], sizeof(rxbuf));
+	CHECK((r == int(sizeof(txbuf))) && (0 == memcmp(txbuf, rxbuf, sizeof(txbuf))), "receive after the resolution: %d", r);
+
+	// a dead host with queued packets: the fragment above the job limit fails the send,
+	// the further fragments are released at once
+	g_node_a.ip.arptable.max_request_jobs = 4;
+	udp_a.destaddr.Set(10, 0, 0, 77);
+	for (unsigned n = 0; n < 3; ++n)
+	{
+		CHECK(1 == udp_a.Send(&txbuf[0], 1), "small send %u to the dead host failed", n);
+	}
+	fails = g_node_a.ip.frag_tx_fail_count;
+	r = udp_a.Send(&txbuf[0], sizeof(txbuf));
+	CHECK(-1 == r, "send with a dropped fragment: %d", r);
+	CHECK(fails + 1 == g_node_a.ip.frag_tx_fail_count, "the dropped fragment is not counted");
+	CHECK(1 == g_node_a.ip.arptable.drop_count, "drop_count: %u", g_node_a.ip.arptable.drop_count);
+	CHECK(pool->used == used0 + 4, "%u TX packets are used", pool->used - used0);
+
+	test_net_run(g_node_a.ip.arptable.max_tries * g_node_a.ip.arptable.response_timeout_ms + 100);
+	CHECK(pool->used == used0, "%u TX packets are not released", pool->used - used0);
+
+	udp_a.destaddr.Set(10, 0, 0, 2);
+	g_node_a.ip.arptable.max_request_jobs = 8;
+}
+
+static void test_out_of_order()
+{
+	prepare_datagram(24);
+	inject_fragment(16, 8, false);
+	inject_fragment(0, 8, true);
+	inject_fragment(8, 8, true);
+	test_net_run(1);
+	CHECK(16 == receive_b(), "out of order datagram not delivered");
+}
+
+static void test_hole_behind_end()
+{
+	// the fragment at 32 lies behind the end announced by the last fragment,
+	// the bytes 8..15 are missing, the received byte count still reaches the total
+	uint32_t ovl = g_node_b.ip.reasm_overlap_count;
+	prepare_datagram(40);
+	inject_fragment(0, 8, true);
+	inject_fragment(32, 8, true);
+	inject_fragment(16, 8, false);
+	test_net_run(1);
+	CHECK(-1 == receive_b(), "datagram with a hole delivered");
+	CHECK(ovl + 1 == g_node_b.ip.reasm_overlap_count, "fragment behind the end not counted");
+}
+
+static void test_hole()
+{
+	uint32_t tocnt = g_node_b.ip.reasm_timeout_count;
+	prepare_datagram(24);
+	inject_fragment(16, 8, false);
+	inject_fragment(0, 8, true);
+	test_net_run(1);
+	CHECK(-1 == receive_b(), "datagram with a hole delivered");
+	test_net_run(g_node_b.ip.reasm_timeout_ms + 10);
+	CHECK(tocnt + 1 == g_node_b.ip.reasm_timeout_count, "incomplete datagram not timed out");
+}
+
+static void test_overlap()
+{
+	uint32_t ovl = g_node_b.ip.reasm_overlap_count;
+	prepare_datagram(32);
+	inject_fragment(0, 16, true);
+	inject_fragment(8, 16, true);
+	inject_fragment(24, 8, false);
+	test_net_run(1);
+	CHECK(-1 == receive_b(), "overlapping datagram delivered");
+	CHECK(ovl + 1 == g_node_b.ip.reasm_overlap_count, "overlap not counted");
+
+	// a plain duplicate is tolerated
+	prepare_datagram(32);
+	inject_fragment(0, 16, true);
+	inject_fragment(0, 16, true);
+	inject_fragment(16, 16, false);
+	test_net_run(1);
+	CHECK(24 == receive_b(), "datagram with a duplicate fragment not delivered");
+}
+
+int main()
+{
+	g_node_a.adapter.max_tx_packets = 16;
+	g_node_a.ip.arptable.max_request_jobs = 8;  // all fragments wait for the ARP reply
+	g_node_b.ip.reasm_slots = 2;
+	test_net_setup();
+
+	udp_a.Init(&g_node_a.ip, 1000);
+	udp_a.destaddr.Set(10, 0, 0, 2);
+	udp_a.destport = 2000;
+	udp_b.Init(&g_node_b.ip, 2000);
+
+	test_send_unresolved();
+	test_send_large();
+	test_out_of_order();
+	test_hole_behind_end();
+	test_hole();
+	test_overlap();
+	test_out_of_order();
+
+	return test_result("test_ip4_frag");
+}
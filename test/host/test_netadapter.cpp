@@ -0,0 +1,149 @@
+/*
+ *  file:     test_netadapter.cpp (host tests)
+ *  brief:    TX completion reaping, the RX budget and the packet initialization of the network adapter
+ *  date:     2026-10-17
+ *  authors:  agent
+*/
+
+#include "platform.h"
+#include "host_net.h"
+
+static TUdp4Socket  udp_a;
+static TUdp4Socket  udp_b;
+
+static uint8_t      txbuf[256];
+
+// tx_irq_reaping needs a driver with TX complete interrupt
+static void test_irq_reaping_unsupported()
+{
+	static TTestNode  node;
+
+	node.adapter.tx_irq_reaping = true;
+	CHECK(!node.adapter.Init(&node.eth, &node.netmem[0], sizeof(node.netmem)), "tx_irq_reaping accepted without TX IRQ");
+
+	node.eth.tx_irq = true;
+	CHECK(node.adapter.Init(&node.eth, &node.netmem[0], sizeof(node.netmem)), "tx_irq_reaping rejected with TX IRQ");
+	CHECK(node.eth.irq_on_tx, "TX IRQ not enabled");
+}
+
+// the sent packets are released only after TxCompleteIrq()
+static void test_irq_reaping()
+{
+	for (unsigned n = 0; n < 4; ++n)
+	{
+		CHECK(int(sizeof(txbuf)) == udp_a.Send(&txbuf[0], sizeof(txbuf)), "send failed");
+	}
+	test_net_run(1);
+	CHECK(4 <= g_node_a.adapter.tx_sending_count, "packets released without TX IRQ: %u", g_node_a.adapter.tx_sending_count);
+
+	g_node_a.adapter.TxCompleteIrq();
+	g_node_a.adapter.Run();
+	CHECK(0 == g_node_a.adapter.tx_sending_count, "packets not released after TX IRQ: %u", g_node_a.adapter.tx_sending_count);
+}
+
+// a burst of datagrams is processed in rx_budget sized portions
+static void test_rx_budget()
+{
+	TNetAdapter * adapter = &g_node_a.adapter;
+
+	udp_b.destaddr.Set(10, 0, 0, 1);
+	udp_b.destport = 1000;
+	CHECK(1 == udp_b.Send(&txbuf[0], 1), "reverse send failed");
+	test_net_run(10);
+	CHECK(1 == udp_a.Receive(&txbuf[0], sizeof(txbuf)), "reverse datagram not received");
+
+	adapter->rx_budget = 3;
+	for (unsigned n = 0; n < 7; ++n)
+	{
+		txbuf[0] = n;
+		CHECK(1 == udp_b.Send(&txbuf[0], 1), "burst send %u failed", n);
+	}
+	CHECK(7 == g_node_a.eth.inq.size(), "burst not pending: %u", unsigned(g_node_a.eth.inq.size()));
+
+	uint32_t drained = adapter->rx_drained_count;
+	uint32_t budget_full = adapter->rx_budget_full_count;
+	unsigned expected[3] = { 3, 3, 1 };
+	unsigned received = 0;
+	for (unsigned r = 0; r < 3; ++r)
+	{
+		adapter->Run();
+		CHECK(drained + expected[r] == adapter->rx_drained_count, "run %u drained %u", r, adapter->rx_drained_count - drained);
+		CHECK(budget_full + (r < 2 ? r + 1 : 2) == adapter->rx_budget_full_count, "run %u budget full count %u", r, adapter->rx_budget_full_count - budget_full);
+		drained = adapter->rx_drained_count;
+
+		uint8_t * pdata;
+		unsigned  len;
+		while (udp_a.ReceiveRef(&pdata, &len))
+		{
+			CHECK((1 == len) && (pdata[0] == received), "burst datagram %u out of order", received);
+			udp_a.ReleaseRx();
+			++received;
+		}
+	}
+	CHECK(7 == received, "burst datagrams received: %u", received);
+	CHECK(g_node_a.eth.inq.empty(), "burst frames left");
+	adapter->rx_budget = 4;
+}
+
+// the NetMem is not cleared (e.g. a NOLOAD section), a stale timestamp_ns would be used by the PTP and the capture
+static void test_netmem_garbage()
+{
+	static TTestNode  node;
+
+	memset(&node.netmem[0], 0xA5, sizeof(node.netmem));
+	node.adapter.max_tx_small_packets = 2;
+	node.adapter.max_tx_medium_packets = 2;
+	CHECK(node.adapter.Init(&node.eth, &node.netmem[0], sizeof(node.netmem)), "adapter init failed");
+
+	unsigned bad = 0;
+	for (unsigned n = 0; n < node.adapter.max_rx_packets; ++n)
+	{
+		TPacketMem * pmem = node.eth.rxbufs[n];  // assigned by the adapter
+		if (pmem->timestamp_ns)  ++bad;
+	}
+	CHECK(0 == bad, "%u RX buffers have a timestamp", bad);
+
+	bad = 0;
+	unsigned cnt = 0;
+	for (unsigned c = 0; c < NET_POOL_CLASSES; ++c)
+	{
+		for (TPacketMem * pmem = node.adapter.txpool[c].first_free; pmem; pmem = pmem->next)
+		{
+			if (pmem->timestamp_ns || pmem->status)  ++bad;
+			++cnt;
+		}
+	}
+	CHECK(12 == cnt, "%u TX pool packets", cnt);
+	CHECK(0 == bad, "%u TX pool packets have a timestamp or status", bad);
+
+	TPacketMem * syspkt = node.adapter.CreateSysTxPacket(64);
+	CHECK(syspkt && (0 == syspkt->timestamp_ns) && (0 == syspkt->status), "the system TX packet is not initialized");
+}
+
+int main()
+{
+	test_netmem_garbage();
+
+	test_irq_reaping_unsupported();
+
+	g_node_a.eth.tx_irq = true;
+	g_node_a.adapter.tx_irq_reaping = true;
+	test_net_setup();
+
+	udp_a.Init(&g_node_a.ip, 1000);
+	udp_a.destaddr.Set(10, 0, 0, 2);
+	udp_a.destport = 2000;
+	udp_b.Init(&g_node_b.ip, 2000);
+
+	// resolve the ARP first, the reply reaches the node A without TX completion
+	CHECK(1 == udp_a.Send(&txbuf[0], 1), "first send failed");
+	test_net_run(10);
+	g_node_a.adapter.TxCompleteIrq();
+	g_node_a.adapter.Run();
+	CHECK(0 == g_node_a.adapter.tx_sending_count, "first packets not released: %u", g_node_a.adapter.tx_sending_count);
+
+	test_irq_reaping();
+	test_rx_budget();
+
+	return test_result("test_netadapter");
+}
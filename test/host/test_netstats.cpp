@@ -0,0 +1,191 @@
+/*
+ *  file:     test_netstats.cpp (host tests)
+ *  brief:    the NET_STATS counters and the snapshot after known traffic, built with NET_STATS=1
+ *  date:     2026-10-17
+ *  authors:  agent
+*/
+
+#include "platform.h"
+#include "host_net.h"
+#include "net_statspub.h"
+
+#if !NET_STATS
+  #error "this test must be built with -DNET_STATS=1"
+#endif
+
+#define PUB_PORT  4000
+
+static TUdp4Socket  udp_a;
+static TUdp4Socket  udp_b;
+
+static unsigned     a_tx_frames;
+static unsigned     a_tx_bytes;
+
+static bool record_tx_a(THwEth_fake * aeth, std::vector<uint8_t> & aframe)
+{
+	++a_tx_frames;
+	a_tx_bytes += aframe.size();
+	return true;
+}
+
+static unsigned handler_count(TNetAdapter * aadapter)
+{
+	unsigned cnt = 0;
+	for (TProtocolHandler * ph = aadapter->firsthandler; ph; ph = ph->next)
+	{
+		++cnt;
+	}
+	return cnt;
+}
+
+static unsigned snapshot_len(TNetAdapter * aadapter)
+{
+	return sizeof(TNetStatsSnapshotHead) + sizeof(TNetStats) + handler_count(aadapter) * sizeof(TNetCycleHisto);
+}
+
+// ARP resolution, 3 datagrams to an open port, 1 to a closed port and an unknown EtherType
+static void test_counters()
+{
+	g_node_a.adapter.ResetStats();
+	g_node_b.adapter.ResetStats();
+	a_tx_frames = 0;
+	a_tx_bytes = 0;
+
+	uint8_t payload[10] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+	udp_a.destaddr.Set(10, 0, 0, 2);
+	udp_a.destport = 2000;
+	for (unsigned n = 0; n < 3; ++n)
+	{
+		CHECK(sizeof(payload) == udp_a.Send(&payload[0], sizeof(payload)), "send %u failed", n);
+		test_net_run(1);
+	}
+	udp_a.destport = 2001;
+	udp_a.Send(&payload[0], sizeof(payload));
+
+	uint8_t frame[60] = { 0 };
+	memcpy(&frame[0], &g_node_b.eth.mac_address[0], 6);
+	memcpy(&frame[6], &g_node_a.eth.mac_address[0], 6);
+	frame[12] = 0x12;
+	frame[13] = 0x34;
+	g_node_b.eth.inq.push_back(std::vector<uint8_t>(&frame[0], &frame[sizeof(frame)]));
+	test_net_run(5);
+
+	uint8_t rxbuf[12];  // Receive() copies whole 32-bit words
+	unsigned rxcnt = 0;
+	while (udp_b.Receive(&rxbuf[0], sizeof(rxbuf)) > 0)
+	{
+		++rxcnt;
+	}
+	CHECK(3 == rxcnt, "received datagrams: %u", rxcnt);
+
+	// node A: ARP request + 4 datagrams out, the ARP reply in
+	TNetStats * sa = &g_node_a.adapter.stats;
+	CHECK((5 == sa->tx_frames) && (a_tx_frames == sa->tx_frames), "A tx_frames: %u, on the wire %u", sa->tx_frames, a_tx_frames);
+	CHECK(a_tx_bytes == sa->tx_bytes, "A tx_bytes: %u, on the wire %u", sa->tx_bytes, a_tx_bytes);
+	CHECK(sa->tx_frames == sa->tx_histo.count, "A tx_histo.count: %u", sa->tx_histo.count);
+	CHECK((0 == sa->tx_errors) && (0 == sa->tx_alloc_fails), "A tx errors: %u, %u", sa->tx_errors, sa->tx_alloc_fails);
+	CHECK((1 == sa->rx_frames) && (1 == sa->rx_arp) && (0 == sa->rx_ip4), "A rx: %u frames, %u ARP, %u IP",
+	      sa->rx_frames, sa->rx_arp, sa->rx_ip4);
+	CHECK((1 == sa->arp_misses) && (3 == sa->arp_hits) && (0 == sa->arp_drops), "A ARP: %u misses, %u hits, %u drops",
+	      sa->arp_misses, sa->arp_hits, sa->arp_drops);
+
+	// node B: ARP request + 4 datagrams + the unknown frame in, the ARP reply out
+	TNetStats * sb = &g_node_b.adapter.stats;
+	CHECK(6 == sb->rx_frames, "B rx_frames: %u", sb->rx_frames);
+	CHECK(a_tx_bytes + sizeof(frame) == sb->rx_bytes, "B rx_bytes: %u, expected %u", sb->rx_bytes, unsigned(a_tx_bytes + sizeof(frame)));
+	CHECK(1 == sb->rx_unhandled, "B rx_unhandled: %u", sb->rx_unhandled);
+	CHECK((1 == sb->rx_arp) && (4 == sb->rx_ip4) && (4 == sb->rx_udp), "B rx: %u ARP, %u IP, %u UDP",
+	      sb->rx_arp, sb->rx_ip4, sb->rx_udp);
+	CHECK((0 == sb->rx_icmp) && (0 == sb->rx_tcp) && (0 == sb->rx_igmp) && (0 == sb->rx_ip_other), "B unexpected IP protocols");
+	CHECK(1 == sb->drop_udp_noport, "B drop_udp_noport: %u", sb->drop_udp_noport);
+	CHECK((1 == sb->tx_frames) && (1 == sb->tx_histo.count), "B tx: %u frames, %u timed", sb->tx_frames, sb->tx_histo.count);
+	CHECK(sb->tx_histo.min <= sb->tx_histo.max, "B tx_histo min %u > max %u", sb->tx_histo.min, sb->tx_histo.max);
+
+	// the IP handler is the first one, it took every frame except the unknown one
+	TProtocolHandler * iph = g_node_b.adapter.firsthandler;
+	CHECK((iph == &g_node_b.ip) && (5 == iph->rx_histo.count), "B IP rx_histo.count: %u", iph->rx_histo.count);
+	unsigned bsum = 0;
+	for (unsigned n = 0; n < NET_HISTO_BUCKETS; ++n)
+	{
+		bsum += iph->rx_histo.bucket[n];
+	}
+	CHECK(bsum == iph->rx_histo.count, "B IP rx_histo buckets: %u", bsum);
+}
+
+// the snapshot is the head, the TNetStats copy and the handler histograms
+static void test_snapshot()
+{
+	TNetAdapter * adapter = &g_node_b.adapter;
+	unsigned hcnt = handler_count(adapter);
+	unsigned explen = snapshot_len(adapter);
+
+	uint8_t buf[2048];
+	memset(&buf[0], 0xA5, sizeof(buf));
+	CHECK(0 == adapter->StatsSnapshot(&buf[0], explen - 1), "the snapshot does not fit but it was written");
+	CHECK(0xA5 == buf[0], "the too small buffer is overwritten");
+
+	unsigned len = adapter->StatsSnapshot(&buf[0], sizeof(buf));
+	CHECK(explen == len, "snapshot length: %u, expected %u", len, explen);
+	CHECK(0xA5 == buf[len], "written beyond the snapshot length");
+
+	TNetStatsSnapshotHead * phead = (TNetStatsSnapshotHead *)&buf[0];
+	CHECK((NET_STATS_SNAPSHOT_MAGIC == phead->magic) && (NET_STATS_SNAPSHOT_VERSION == phead->version), "snapshot head: %08X, %u",
+	      phead->magic, phead->version);
+	CHECK(hcnt == phead->handler_count, "handler_count: %u, expected %u", phead->handler_count, hcnt);
+	CHECK((adapter->mscounter == phead->mscounter) && (SystemCoreClock / 1000000 == phead->clocks_per_us), "snapshot time base");
+
+	uint8_t * p = &buf[sizeof(TNetStatsSnapshotHead)];
+	CHECK(0 == memcmp(p, &adapter->stats, sizeof(TNetStats)), "the stats copy differs");
+	p += sizeof(TNetStats);
+
+	unsigned n = 0;
+	for (TProtocolHandler * ph = adapter->firsthandler; ph; ph = ph->next)
+	{
+		CHECK(0 == memcmp(p, &ph->rx_histo, sizeof(TNetCycleHisto)), "rx_histo of handler %u differs", n);
+		p += sizeof(TNetCycleHisto);
+		++n;
+	}
+
+	adapter->ResetStats();
+	CHECK((0 == adapter->stats.rx_frames) && (0 == adapter->stats.tx_histo.count) && (0 == adapter->firsthandler->rx_histo.count),
+	      "ResetStats() left counters");
+}
+
+// the publisher answers a request with a snapshot of node B
+static void test_publisher()
+{
+	TNetStatsPublisher pub;
+	pub.Init(&g_node_b.ip, PUB_PORT, nullptr, 0);
+
+	udp_a.destport = PUB_PORT;
+	uint8_t req = 0;
+	udp_a.Send(&req, 1);
+	test_net_run(5);
+	CHECK(1 == pub.sent_count, "publisher sent_count: %u", pub.sent_count);
+
+	uint8_t buf[2048];
+	int r = udp_b.Receive(&buf[0], sizeof(buf));  // the reply goes to the port of udp_a
+	CHECK(r <= 0, "the snapshot arrived at the wrong socket");
+	r = udp_a.Receive(&buf[0], sizeof(buf));
+	CHECK(int(snapshot_len(&g_node_b.adapter)) == r, "published snapshot length: %d, expected %u", r, snapshot_len(&g_node_b.adapter));
+	TNetStatsSnapshotHead * phead = (TNetStatsSnapshotHead *)&buf[0];
+	CHECK((r > 0) && (NET_STATS_SNAPSHOT_MAGIC == phead->magic) && (2 == phead->handler_count), "published snapshot head");
+	TNetStats * ps = (TNetStats *)(phead + 1);
+	CHECK((r > 0) && (1 == ps->rx_udp) && (0 == ps->drop_udp_noport), "published counters: %u UDP", ps->rx_udp);
+}
+
+int main()
+{
+	g_node_a.eth.tx_filter = record_tx_a;
+	test_net_setup();
+
+	udp_a.Init(&g_node_a.ip, 1000);
+	udp_b.Init(&g_node_b.ip, 2000);
+	test_net_run(10);
+
+	test_counters();
+	test_snapshot();
+	test_publisher();
+
+	return test_result("test_netstats");
+}
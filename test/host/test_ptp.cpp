@@ -0,0 +1,176 @@
+/*
+ *  file:     test_ptp.cpp (host tests)
+ *  brief:    PTP slave against a simulated two-step master on a drifting clock
+ *  date:     2026-10-17
+ *  authors:  agent
+*/
+
+#include "platform.h"
+#include "host_net.h"
+#include "net_ptp.h"
+
+// node A: PTP slave, its ns clock runs 40 ppm fast and starts 5 s off
+// node B: master, the master time is derived from the g_clockcnt
+
+static TPtpSlave    ptp;
+static TUdp4Socket  m_event;
+static TUdp4Socket  m_general;
+
+static uint8_t      m_portid[10] = {0x00, 0x00, 0x00, 0xFF, 0xFE, 0x00, 0x00, 0x0B, 0x00, 0x01};
+static uint16_t     m_seqid = 0;
+
+static const uint64_t  link_delay_ns = 100000;  // the Delay_Req reception is reported this earlier
+
+static uint64_t master_ns()
+{
+	return uint64_t(g_clockcnt) * 1000 + 1000000000000ull;
+}
+
+static void put_timestamp(uint8_t * pdst, uint64_t ats)
+{
+	uint64_t sec = ats / 1000000000ull;
+	uint32_t ns = ats % 1000000000ull;
+	for (unsigned n = 0; n < 6; ++n)
+	{
+		pdst[n] = uint8_t(sec >> (40 - 8 * n));
+	}
+	pdst[6] = uint8_t(ns >> 24);
+	pdst[7] = uint8_t(ns >> 16);
+	pdst[8] = uint8_t(ns >> 8);
+	pdst[9] = uint8_t(ns);
+}
+
+static void put_header(uint8_t * pdst, uint8_t atype, unsigned alen, uint16_t aseqid)
+{
+	memset(pdst, 0, alen);
+	PPtpHeader ph = PPtpHeader(pdst);
+	ph->msgtype = atype;
+	ph->version = 2;
+	ph->msglen = __builtin_bswap16(alen);
+	ph->flags[0] = (PTP_MSG_SYNC == atype ? PTP_FLAG_TWO_STEP : 0);
+	memcpy(&ph->srcportid[0], &m_portid[0], 10);
+	ph->seqid = __builtin_bswap16(aseqid);
+}
+
+static void master_step(unsigned at)  // at: 100 us steps
+{
+	static uint8_t msg[64];
+
+	if (0 == (at % 10000))  // Announce every second
+	{
+		put_header(&msg[0], PTP_MSG_ANNOUNCE, 64, m_seqid);
+		msg[PTP_ANNOUNCE_DS_OFFS] = 128;      // priority1
+		msg[PTP_ANNOUNCE_DS_OFFS + 1] = 248;  // clock class
+		msg[PTP_ANNOUNCE_DS_OFFS + 5] = 128;  // priority2
+		memcpy(&msg[PTP_ANNOUNCE_DS_OFFS + 6], &m_portid[0], 8);
+		m_general.Send(&msg[0], 64);
+	}
+
+	if (5000 == (at % 10000))  // Sync + Follow_Up every second
+	{
+		++m_seqid;
+		uint64_t t1 = master_ns();
+		put_header(&msg[0], PTP_MSG_SYNC, 44, m_seqid);
+		m_event.Send(&msg[0], 44);
+		put_header(&msg[0], PTP_MSG_FOLLOW_UP, 44, m_seqid);
+		put_timestamp(&msg[PTP_TIMESTAMP_OFFS], t1);
+		m_general.Send(&msg[0], 44);
+	}
+
+	// answer the Delay_Req messages
+	uint8_t * pdata;
+	unsigned  dlen;
+	while (m_event.rxpkt_first)
+	{
+		uint64_t t4 = master_ns() - link_delay_ns;
+		if (m_event.ReceiveRef(&pdata, &dlen) && (PTP_MSG_DELAY_REQ == (pdata[0] & 0xF)))
+		{
+			put_header(&msg[0], PTP_MSG_DELAY_RESP, 54, (pdata[30] << 8) | pdata[31]);
+			put_timestamp(&msg[PTP_TIMESTAMP_OFFS], t4);
+			memcpy(&msg[PTP_REQPORTID_OFFS], pdata + 20, 10);
+			m_general.Send(&msg[0], 54);
+		}
+		m_event.ReleaseRx();
+	}
+}
+
+static void run_seconds(unsigned asec)
+{
+	for (unsigned t = 0; t < asec * 10000; ++t)
+	{
+		g_clockcnt += 100;
+		master_step(t);
+		g_node_a.adapter.Run();
+		g_node_b.adapter.Run();
+	}
+}
+
+static int64_t ptp_error_ns()
+{
+	return int64_t(ptp.PtpTimeNs() - master_ns());
+}
+
+static void test_hw_timestamps()
+{
+	run_seconds(60);
+	int64_t err = ptp_error_ns();
+	printf("  HW timestamps: state=%u steps=%u freq=%.0f ppb rms=%.0f ns err=%lld ns\n",
+	    ptp.state, ptp.step_count, ptp.freq_ppb, ptp.OffsetRms(), (long long)err);
+	CHECK(PTPS_SLAVE == ptp.state, "not synchronized");
+	CHECK(2 == ptp.step_count, "steps: %u", ptp.step_count);  // the initial step + the one after the frequency estimation
+	CHECK((ptp.freq_ppb > -41000) && (ptp.freq_ppb < -39000), "frequency correction: %.0f", ptp.freq_ppb);
+	CHECK((err > -20000) && (err < 20000), "time error: %lld ns", (long long)err);
+	CHECK(0 == ptp.rxts_soft_count, "software timestamps used");
+}
+
+static void test_soft_timestamps()
+{
+	// the MAC gives no RX timestamps (e.g. STM32): synchronized with software timestamps
+	g_node_a.eth.rx_timestamps = false;
+	uint32_t syncs = ptp.sync_count;
+	run_seconds(30);
+	printf("  SW timestamps: state=%u syncs=%u soft=%u err=%lld ns\n",
+	    ptp.state, ptp.sync_count - syncs, ptp.rxts_soft_count, (long long)ptp_error_ns());
+	CHECK(PTPS_SLAVE == ptp.state, "not synchronized with software timestamps");
+	CHECK(ptp.rxts_soft_count >= 29, "software timestamps not counted: %u", ptp.rxts_soft_count);
+	CHECK(ptp.sync_count - syncs >= 29, "syncs not processed");
+}
+
+static void test_no_timer()
+{
+	// no ns timer at all: the samples must be dropped, not fed into the servo as 0
+	g_node_a.eth.ns_timer = false;
+	uint32_t syncs = ptp.sync_count;
+	uint32_t misses = ptp.ts_missing_count;
+	uint32_t delays = ptp.delay_count;
+	run_seconds(10);
+	printf("  no ns timer: missing=%u\n", ptp.ts_missing_count - misses);
+	CHECK(ptp.ts_missing_count - misses >= 18, "zero timestamps not dropped: %u", ptp.ts_missing_count - misses);
+	CHECK(ptp.delay_count == delays, "Delay_Req sent without timestamp");
+	CHECK(ptp.sync_count == syncs, "zero timestamp Sync processed");
+}
+
+int main()
+{
+	g_node_a.eth.sim_drift = 40e-6;
+	g_node_a.eth.sim_local = 5e9;
+	test_net_setup();
+
+	ptp.Init(&g_node_a.ip);
+
+	TIp4Addr group;
+	group.Set(224, 0, 1, 129);
+	m_event.Init(&g_node_b.ip, PTP_EVENT_PORT);
+	m_event.destport = PTP_EVENT_PORT;
+	m_event.destaddr = group;
+	m_event.JoinGroup(&group);
+	m_general.Init(&g_node_b.ip, PTP_GENERAL_PORT);
+	m_general.destport = PTP_GENERAL_PORT;
+	m_general.destaddr = group;
+
+	test_hw_timestamps();
+	test_soft_timestamps();
+	test_no_timer();
+
+	return test_result("test_ptp");
+}
@@ -0,0 +1,194 @@
+/*
+ *  file:     test_raweth.cpp (host tests)
+ *  brief:    raw Ethernet EtherType dispatch and the TX frame ring
+ *  date:     2026-10-17
+ *  authors:  agent
+*/
+
+#include "platform.h"
+#include "host_net.h"
+#include "net_raweth.h"
+
+#define ETYPE_CYCLIC  0x88A4
+#define ETYPE_ECHO    0x88B5
+
+class TTestProtocol : public TRawEthProtocol
+{
+public:
+	bool       echo = false;  // answers directly from the RX path
+	unsigned   last_len = 0;
+	uint8_t    last_data[64];
+
+	virtual void HandleFrame(TPacketMem * pmem, uint8_t * pdata, unsigned adatalen)
+	{
+		last_len = adatalen;
+		memcpy(&last_data[0], pdata, (adatalen < sizeof(last_data) ? adatalen : sizeof(last_data)));
+		if (echo)
+		{
+			PEthernetHeader peh = PEthernetHeader(&pmem->data[0]);
+			SetDestMac(&peh->src_mac[0]);
+			Send(pdata, adatalen);
+		}
+	}
+};
+
+static TRawEthHandler  raw_a;
+static TRawEthHandler  raw_b;
+static TTestProtocol   cyc_a;
+static TTestProtocol   cyc_b;
+static TTestProtocol   echo_a;
+static TTestProtocol   echo_b;
+
+static std::vector<std::vector<uint8_t>>  sent_a;  // the frames sent by the node A
+
+static bool record_tx_a(THwEth_fake * aeth, std::vector<uint8_t> & aframe)
+{
+	sent_a.push_back(aframe);
+	return true;
+}
+
+static void test_dispatch()
+{
+	TRawEthProtocol dup;
+	CHECK(!dup.Init(&raw_b, ETYPE_CYCLIC), "duplicate EtherType accepted");
+
+	uint8_t payload[4] = { 1, 2, 3, 4 };
+	CHECK(cyc_a.Send(&payload[0], 4), "cyclic send failed");
+	test_net_run(1);
+	CHECK((1 == cyc_b.rx_count) && (0 == echo_b.rx_count), "cyclic frame dispatch: %u, %u", cyc_b.rx_count, echo_b.rx_count);
+	CHECK((4 == cyc_b.last_len) && (0 == memcmp(cyc_b.last_data, payload, 4)), "cyclic payload: %u bytes", cyc_b.last_len);
+
+	// an unknown EtherType is left to the other handlers
+	uint8_t frame[60] = { 0 };
+	memcpy(&frame[0], &g_node_b.eth.mac_address[0], 6);
+	memcpy(&frame[6], &g_node_a.eth.mac_address[0], 6);
+	frame[12] = 0x12;
+	frame[13] = 0x34;
+	g_node_b.eth.inq.push_back(std::vector<uint8_t>(&frame[0], &frame[sizeof(frame)]));
+	test_net_run(1);
+	CHECK((1 == cyc_b.rx_count) && (0 == echo_b.rx_count), "unknown EtherType dispatched");
+
+	// the IP traffic is not affected
+	TUdp4Socket udp_a;
+	TUdp4Socket udp_b;
+	udp_a.Init(&g_node_a.ip, 1000);
+	udp_a.destaddr.Set(10, 0, 0, 2);
+	udp_a.destport = 2000;
+	udp_b.Init(&g_node_b.ip, 2000);
+	udp_a.Send(&payload[0], 4);
+	test_net_run(5);
+	uint8_t rxbuf[8];
+	CHECK(4 == udp_b.Receive(&rxbuf[0], sizeof(rxbuf)), "UDP beside the raw protocols failed");
+	g_node_a.ip.RemoveUdpSocket(&udp_a);
+	g_node_b.ip.RemoveUdpSocket(&udp_b);
+}
+
+// the ring frames come back only after the TX completion, the headers are written only once
+static void test_tx_ring()
+{
+	uint8_t * pdata[4];
+	TPacketMem * pmem[4];
+
+	test_net_run(1);
+	sent_a.clear();
+	unsigned rx0 = cyc_b.rx_count;
+
+	for (unsigned n = 0; n < 3; ++n)
+	{
+		pmem[n] = cyc_a.AllocateTxFrame(&pdata[n]);
+		CHECK(pmem[n], "ring frame %u is not available", n);
+		if (!pmem[n])  return;
+		memset(pdata[n], 0x10 + n, 8);
+		CHECK(cyc_a.SendTxFrame(pmem[n], 8), "ring frame %u send failed", n);
+	}
+
+	pmem[3] = cyc_a.AllocateTxFrame(&pdata[3]);
+	CHECK(!pmem[3], "a sending frame was given out again");
+	CHECK(1 == cyc_a.tx_busy_count, "tx_busy_count: %u", cyc_a.tx_busy_count);
+
+	g_node_a.adapter.Run();  // reaps the sent frames
+	pmem[3] = cyc_a.AllocateTxFrame(&pdata[3]);
+	CHECK(pmem[3] == pmem[0], "the ring frames are not reused in order");
+	CHECK(pdata[3] == pdata[0], "the payload pointer changed");
+	memset(pdata[3], 0x13, 8);
+	cyc_a.SendTxFrame(pmem[3], 8);
+
+	test_net_run(1);
+	CHECK(rx0 + 4 == cyc_b.rx_count, "received ring frames: %u", cyc_b.rx_count - rx0);
+	CHECK(4 == sent_a.size(), "sent frames: %u", unsigned(sent_a.size()));
+	for (unsigned n = 0; n < sent_a.size(); ++n)
+	{
+		std::vector<uint8_t> & f = sent_a[n];
+		CHECK((14 + 8 == f.size()) && (0 == memcmp(&f[0], &g_node_b.eth.mac_address[0], 6))
+		      && (0 == memcmp(&f[6], &g_node_a.eth.mac_address[0], 6))
+		      && (0x88 == f[12]) && (0xA4 == f[13]) && (0x10 + n == f[14]), "ring frame %u is wrong", n);
+	}
+
+	// SetDestMac() rewrites the prepared headers
+	uint8_t bcast[6] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+	cyc_a.SetDestMac(nullptr);
+	sent_a.clear();
+	for (unsigned n = 0; n < 3; ++n)
+	{
+		uint8_t b = n;
+		cyc_a.Send(&b, 1);
+		g_node_a.adapter.Run();
+	}
+	CHECK(3 == sent_a.size(), "broadcast frames: %u", unsigned(sent_a.size()));
+	for (unsigned n = 0; n < sent_a.size(); ++n)
+	{
+		CHECK(0 == memcmp(&sent_a[n][0], bcast, 6), "frame %u is not broadcast", n);
+	}
+	cyc_a.SetDestMac(&g_node_b.eth.mac_address[0]);
+
+	// the payload is limited to the ring frame size
+	uint8_t big[64];
+	memset(big, 0x55, sizeof(big));
+	sent_a.clear();
+	cyc_a.Send(&big[0], sizeof(big));
+	CHECK((1 == sent_a.size()) && (14 + cyc_a.TxMaxDataLen() == sent_a[0].size()), "oversized payload is not truncated");
+	test_net_run(1);
+}
+
+// the echo is sent from the RX path of the node B, the answer arrives in the same adapter cycle
+static void test_turnaround()
+{
+	uint8_t payload[16];
+	for (unsigned n = 0; n < sizeof(payload); ++n)
+	{
+		payload[n] = uint8_t(n * 5 + 1);
+	}
+
+	unsigned rx0 = echo_a.rx_count;
+	CHECK(echo_a.Send(&payload[0], sizeof(payload)), "echo send failed");
+	g_node_b.adapter.Run();
+	CHECK(1 == echo_b.tx_count, "no echo sent from the RX path");
+	g_node_a.adapter.Run();
+	CHECK(rx0 + 1 == echo_a.rx_count, "echo not received");
+	CHECK((sizeof(payload) == echo_a.last_len) && (0 == memcmp(echo_a.last_data, payload, sizeof(payload))), "echo payload");
+}
+
+int main()
+{
+	test_net_setup();
+	g_node_a.eth.tx_filter = record_tx_a;
+
+	raw_a.max_protocols = 2;
+	CHECK(raw_a.Init(&g_node_a.adapter) && raw_b.Init(&g_node_b.adapter), "raw handler init failed");
+	CHECK(cyc_a.Init(&raw_a, ETYPE_CYCLIC) && echo_a.Init(&raw_a, ETYPE_ECHO), "protocol init failed on node A");
+	CHECK(cyc_b.Init(&raw_b, ETYPE_CYCLIC) && echo_b.Init(&raw_b, ETYPE_ECHO), "protocol init failed on node B");
+
+	TRawEthProtocol extra;
+	CHECK(!extra.Init(&raw_a, 0x88B6), "protocol above max_protocols accepted");
+
+	CHECK(cyc_a.InitTxRing(3, 32, &g_node_b.eth.mac_address[0]), "TX ring init failed");
+	CHECK(echo_a.InitTxRing(2, 64, &g_node_b.eth.mac_address[0]), "TX ring init failed");
+	CHECK(echo_b.InitTxRing(2, 64, nullptr), "TX ring init failed");
+	echo_b.echo = true;
+
+	test_dispatch();
+	test_tx_ring();
+	test_turnaround();
+
+	return test_result("test_raweth");
+}
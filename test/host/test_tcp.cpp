@@ -0,0 +1,391 @@
+/*
+ *  file:     test_tcp.cpp (host tests)
+ *  brief:    TCP loss recovery, delayed ACK, flow control and connection teardown
+ *  date:     2026-10-17
+ *  authors:  agent
+*/
+
+#include "platform.h"
+#include "host_net.h"
+#include "net_tcp4.h"
+
+static TTcp4Socket  tcp_a;  // client on the node A
+static TTcp4Socket  tcp_b;  // server on the node B
+
+typedef struct
+{
+	uint32_t  seq;
+	uint32_t  ack;
+	unsigned  len;
+	uint8_t   flags;
+	uint16_t  wnd;
+	uint32_t  ms;    // send time
+//
+} TSegInfo;
+
+typedef struct  // one direction of the connection
+{
+	std::vector<TSegInfo>  segs;  // sent segments
+	uint32_t               base = 0;  // sequence number of the first data byte (ISN + 1)
+	std::vector<uint32_t>  drop;  // the first data segment covering these stream offsets is lost
+	uint32_t               hold_offs = 0xFFFFFFFF;  // this data segment is delivered after the next one
+	std::vector<uint8_t>   held;
+	bool                   drop_fin = false;  // lose the first FIN
+//
+} TDirection;
+
+static TDirection   dir_a;  // A -> B
+static TDirection   dir_b;  // B -> A
+
+static uint32_t     tx_offs = 0;  // stream offset of the next byte to send from A
+static uint32_t     rx_offs = 0;  // stream offset of the next byte to receive on B
+static unsigned     rx_errors = 0;
+
+static uint32_t now_ms()
+{
+	return g_clockcnt / 1000;
+}
+
+static uint8_t pattern(uint32_t aoffs)
+{
+	return uint8_t(aoffs * 7 + (aoffs >> 9));
+}
+
+static bool parse_tcp(std::vector<uint8_t> & aframe, TSegInfo * rseg)
+{
+	if ((aframe.size() < 54) || (0x08 != aframe[12]) || (0x00 != aframe[13]) || (6 != aframe[23]))
+	{
+		return false;
+	}
+
+	unsigned   ihl = ((aframe[14] & 0x0F) << 2);
+	unsigned   iplen = ((aframe[16] << 8) | aframe[17]);
+	uint8_t *  ptcp = &aframe[14 + ihl];
+	unsigned   hlen = ((ptcp[12] >> 4) << 2);
+
+	rseg->seq   = (ptcp[4] << 24) | (ptcp[5] << 16) | (ptcp[6] << 8) | ptcp[7];
+	rseg->ack   = (ptcp[8] << 24) | (ptcp[9] << 16) | (ptcp[10] << 8) | ptcp[11];
+	rseg->flags = ptcp[13];
+	rseg->wnd   = (ptcp[14] << 8) | ptcp[15];
+	rseg->len   = iplen - ihl - hlen;
+	rseg->ms    = now_ms();
+	return true;
+}
+
+static bool filter(TDirection * adir, THwEth_fake * aeth, std::vector<uint8_t> & aframe)
+{
+	TSegInfo seg;
+	if (!parse_tcp(aframe, &seg))
+	{
+		return true;
+	}
+
+	if (seg.flags & TCPF_SYN)
+	{
+		adir->base = seg.seq + 1;
+	}
+	adir->segs.push_back(seg);
+
+	uint32_t offs = seg.seq - adir->base;
+	if (seg.len)
+	{
+		for (unsigned n = 0; n < adir->drop.size(); ++n)
+		{
+			if (adir->drop[n] - offs < seg.len)
+			{
+				adir->drop.erase(adir->drop.begin() + n);
+				return false;
+			}
+		}
+
+		if (offs == adir->hold_offs)
+		{
+			adir->held = aframe;
+			adir->hold_offs = 0xFFFFFFFF;
+			return false;
+		}
+	}
+
+	if ((seg.flags & TCPF_FIN) && adir->drop_fin)
+	{
+		adir->drop_fin = false;
+		return false;
+	}
+
+	if (adir->held.size())
+	{
+		// deliver the held segment after this one
+		aeth->wire_out->push_back(aframe);
+		aeth->wire_out->push_back(adir->held);
+		adir->held.clear();
+		return false;
+	}
+
+	return true;
+}
+
+static bool filter_a(THwEth_fake * aeth, std::vector<uint8_t> & aframe)  { return filter(&dir_a, aeth, aframe); }
+static bool filter_b(THwEth_fake * aeth, std::vector<uint8_t> & aframe)  { return filter(&dir_b, aeth, aframe); }
+
+// the count of the transmitted data segments covering the given stream offset (A -> B)
+static unsigned transmissions(uint32_t aoffs, uint32_t * rlastms = nullptr)
+{
+	unsigned cnt = 0;
+	for (TSegInfo & seg : dir_a.segs)
+	{
+		if (aoffs - (seg.seq - dir_a.base) < seg.len)
+		{
+			++cnt;
+			if (rlastms)  *rlastms = seg.ms;
+		}
+	}
+	return cnt;
+}
+
+static void receive_b()
+{
+	uint8_t buf[4096];
+	int r;
+	while ((r = tcp_b.Receive(&buf[0], sizeof(buf))) > 0)
+	{
+		for (int n = 0; n < r; ++n)
+		{
+			if (buf[n] != pattern(rx_offs + n))  ++rx_errors;
+		}
+		rx_offs += r;
+	}
+}
+
+// sends alen bytes from A to B, returns the elapsed milliseconds
+static unsigned transfer(unsigned alen, bool areceive = true, unsigned amaxms = 5000)
+{
+	uint8_t  buf[4096];
+	uint32_t start = now_ms();
+	uint32_t end = tx_offs + alen;
+	while ((rx_offs != end) && (now_ms() - start < amaxms))
+	{
+		unsigned len = end - tx_offs;
+		if (len > sizeof(buf))  len = sizeof(buf);
+		for (unsigned n = 0; n < len; ++n)
+		{
+			buf[n] = pattern(tx_offs + n);
+		}
+		int r = tcp_a.Send(&buf[0], len);
+		if (r > 0)
+		{
+			tx_offs += r;
+		}
+
+		test_net_run(1);
+		if (areceive)
+		{
+			receive_b();
+		}
+		else if (tx_offs == end)
+		{
+			break;
+		}
+	}
+	CHECK(0 == rx_errors, "received data errors: %u", rx_errors);
+	return now_ms() - start;
+}
+
+static void test_connect()
+{
+	tcp_b.Listen(80);
+	TIp4Addr addr;
+	addr.Set(10, 0, 0, 2);
+	CHECK(tcp_a.Connect(&addr, 80), "connect failed");
+	test_net_run(10);
+	CHECK(tcp_a.Connected() && tcp_b.Connected(), "not connected: %u, %u", tcp_a.state, tcp_b.state);
+	CHECK(dir_a.base && dir_b.base, "SYN not seen");
+}
+
+// a single segment is acknowledged after the delayed_ack_ms, two full segments immediately
+static void test_delayed_ack()
+{
+	size_t bsegs = dir_b.segs.size();
+	transfer(100);
+	test_net_run(tcp_b.delayed_ack_ms + 5);
+	CHECK(dir_b.segs.size() == bsegs + 1, "acks for a single segment: %u", unsigned(dir_b.segs.size() - bsegs));
+	TSegInfo & ack = dir_b.segs.back();
+	TSegInfo & data = dir_a.segs.back();
+	unsigned delay = ack.ms - data.ms;
+	CHECK((ack.ack == dir_a.base + tx_offs) && (delay + 1u >= tcp_b.delayed_ack_ms) && (delay <= tcp_b.delayed_ack_ms + 1u),
+	    "delayed ACK after %u ms", delay);
+
+	size_t asegs = dir_a.segs.size();
+	bsegs = dir_b.segs.size();
+	transfer(2 * TCP4_MSS);
+	CHECK(dir_a.segs.size() == asegs + 2, "full segments sent: %u", unsigned(dir_a.segs.size() - asegs));
+	CHECK(dir_b.segs.size() == bsegs + 1, "acks for two segments: %u", unsigned(dir_b.segs.size() - bsegs));
+	TSegInfo & ack2 = dir_b.segs[bsegs];
+	CHECK((ack2.ms == dir_a.segs.back().ms) && (ack2.ack == dir_a.base + tx_offs), "second segment not acknowledged immediately");
+
+	// reading the data opens the window by two segments, that is announced, but there is no further ACK
+	test_net_run(tcp_b.delayed_ack_ms + 5);
+	CHECK(dir_b.segs.size() == bsegs + 2, "ACKs after two segments: %u", unsigned(dir_b.segs.size() - bsegs));
+	CHECK((dir_b.segs.back().ack == ack2.ack) && (dir_b.segs.back().wnd > ack2.wnd), "not a window update");
+}
+
+// the last segment is lost, there are no duplicate ACKs, the retransmission timer resends it
+static void test_rto()
+{
+	uint32_t offs = tx_offs;
+	dir_a.drop.push_back(offs);
+	unsigned ms = transfer(300);
+	uint32_t lastms = 0;
+	CHECK(2 == transmissions(offs, &lastms), "transmissions of the lost segment: %u", transmissions(offs));
+	CHECK(ms >= tcp_a.rto_min_ms, "resent before the RTO: %u ms", ms);
+	CHECK(rx_offs == tx_offs, "lost segment not recovered");
+}
+
+// one lost segment in a window: three duplicate ACKs trigger the fast retransmit before the RTO
+static void test_fast_retransmit()
+{
+	uint32_t offs = tx_offs + TCP4_MSS;
+	dir_a.drop.push_back(offs);
+	size_t bsegs = dir_b.segs.size();
+	uint32_t start = now_ms();
+	unsigned ms = transfer(8 * TCP4_MSS);
+
+	unsigned dupacks = 0;
+	for (size_t n = bsegs; n < dir_b.segs.size(); ++n)
+	{
+		if (dir_b.segs[n].ack == dir_a.base + offs)  ++dupacks;
+	}
+	uint32_t lastms = 0;
+	CHECK(2 == transmissions(offs, &lastms), "transmissions of the lost segment: %u", transmissions(offs));
+	CHECK(dupacks >= 4, "duplicate ACKs: %u", dupacks);  // the first one is the normal ACK
+	CHECK(lastms - start < tcp_a.rto_min_ms, "not fast retransmitted: %u ms", lastms - start);
+	CHECK(ms < tcp_a.rto_min_ms, "transfer with a fast retransmit took %u ms", ms);
+}
+
+// two lost segments: the partial ACK after the fast retransmit resends the second one at once (NewReno)
+static void test_newreno()
+{
+	uint32_t offs1 = tx_offs + TCP4_MSS;
+	uint32_t offs2 = tx_offs + 4 * TCP4_MSS;
+	dir_a.drop.push_back(offs1);
+	dir_a.drop.push_back(offs2);
+	uint32_t start = now_ms();
+	unsigned ms = transfer(9 * TCP4_MSS);
+
+	uint32_t last1 = 0;
+	uint32_t last2 = 0;
+	CHECK(2 == transmissions(offs1, &last1), "transmissions of the first lost segment: %u", transmissions(offs1));
+	CHECK(2 == transmissions(offs2, &last2), "transmissions of the second lost segment: %u", transmissions(offs2));
+	CHECK(last2 - start < tcp_a.rto_min_ms, "second loss recovered only by the RTO: %u ms", last2 - start);
+	CHECK(ms < tcp_a.rto_min_ms, "transfer with two losses took %u ms", ms);
+}
+
+// a reordered segment is dropped by the receiver, the stream must be complete anyway
+static void test_reorder()
+{
+	dir_a.hold_offs = tx_offs + 2 * TCP4_MSS;
+	transfer(6 * TCP4_MSS);
+	CHECK(rx_offs == tx_offs, "reordered stream incomplete");
+}
+
+// the receiver does not read: the window closes, the sender probes it, then the reading opens it again
+static void test_zero_window()
+{
+	unsigned total = tcp_b.rx_buf_size + tcp_a.tx_buf_size;
+	size_t asegs = dir_a.segs.size();
+	size_t bsegs = dir_b.segs.size();
+	transfer(total, false);
+	test_net_run(3000);
+
+	CHECK(tcp_b.RxAvailable() == tcp_b.rx_buf_size, "receive buffer not full: %u", tcp_b.RxAvailable());
+	CHECK(tcp_a.TxFree() < tcp_a.tx_buf_size, "all data sent into a closed window");
+	CHECK(0 == dir_b.segs.back().wnd, "zero window not advertised");
+
+	unsigned probes = 0;
+	uint32_t lastprobe = 0;
+	bool     interval_ok = true;
+	for (size_t n = asegs; n < dir_a.segs.size(); ++n)
+	{
+		if (1 == dir_a.segs[n].len)
+		{
+			if (probes && (dir_a.segs[n].ms - lastprobe < tcp_a.rto_min_ms))  interval_ok = false;
+			lastprobe = dir_a.segs[n].ms;
+			++probes;
+		}
+	}
+	CHECK(probes >= 2, "window probes: %u", probes);
+	CHECK(interval_ok, "window probes too frequent");
+
+	bool probe_acked = false;
+	for (size_t n = bsegs; n < dir_b.segs.size(); ++n)
+	{
+		if ((0 == dir_b.segs[n].wnd) && (dir_b.segs[n].ms == lastprobe))  probe_acked = true;
+	}
+	CHECK(probe_acked, "window probe not answered");
+
+	// reading opens the window, the rest of the data must arrive
+	uint32_t start = now_ms();
+	transfer(0);
+	CHECK(rx_offs == tx_offs, "window not reopened: %u of %u", rx_offs, tx_offs);
+	CHECK(now_ms() - start < 500, "slow window reopening: %u ms", now_ms() - start);
+}
+
+// graceful close with a lost FIN, the server socket returns to listening
+static void test_close()
+{
+	transfer(1000);
+	dir_a.drop_fin = true;
+	tcp_a.Close();
+	test_net_run(tcp_a.rto_max_ms);
+	CHECK(tcp_b.RemoteClosed(), "FIN not received: %u", tcp_b.state);
+	CHECK(TCPS_FIN_WAIT_2 == tcp_a.state, "client state after FIN ACK: %u", tcp_a.state);
+
+	tcp_b.Close();
+	test_net_run(5);
+	CHECK(TCPS_TIME_WAIT == tcp_a.state, "client not in TIME_WAIT: %u", tcp_a.state);
+	CHECK(TCPS_LISTEN == tcp_b.state, "server not listening again: %u", tcp_b.state);
+	test_net_run(tcp_a.time_wait_ms + 10);
+	CHECK(TCPS_CLOSED == tcp_a.state, "client not closed after TIME_WAIT: %u", tcp_a.state);
+}
+
+// connection refused, then an established connection aborted by the client
+static void test_reset()
+{
+	TIp4Addr addr;
+	addr.Set(10, 0, 0, 2);
+	CHECK(tcp_a.Connect(&addr, 81), "connect failed");
+	test_net_run(10);
+	CHECK(TCPS_CLOSED == tcp_a.state, "refused connection not closed: %u", tcp_a.state);
+	CHECK((dir_b.segs.back().flags & TCPF_RST), "no RST for the closed port");
+
+	CHECK(tcp_a.Connect(&addr, 80), "connect failed");
+	test_net_run(10);
+	CHECK(tcp_b.Connected(), "server not connected");
+	tcp_a.Abort();
+	test_net_run(10);
+	CHECK(TCPS_LISTEN == tcp_b.state, "server not reset by RST: %u", tcp_b.state);
+}
+
+int main()
+{
+	g_node_a.eth.tx_filter = filter_a;
+	g_node_b.eth.tx_filter = filter_b;
+	test_net_setup();
+
+	tcp_a.rx_buf_size = 8192;
+	tcp_a.tx_buf_size = 16384;
+	tcp_b.rx_buf_size = 16384;
+	tcp_b.tx_buf_size = 4096;
+	CHECK(tcp_a.Init(&g_node_a.ip) && tcp_b.Init(&g_node_b.ip), "socket init failed");
+
+	test_connect();
+	test_delayed_ack();
+	test_rto();
+	test_fast_retransmit();
+	test_newreno();
+	test_reorder();
+	test_zero_window();
+	test_close();
+	test_reset();
+
+	return test_result("test_tcp");
+}
@@ -0,0 +1,88 @@
+/*
+ *  file:     test_udp.cpp (host tests)
+ *  brief:    UDP sends at the packet pool size limits
+ *  date:     2026-10-17
+ *  authors:  agent
+*/
+
+#include "platform.h"
+#include "host_net.h"
+
+static TUdp4Socket  udp_a;
+static TUdp4Socket  udp_b;
+
+static uint8_t      txbuf[UDP4_MAX_DATALEN + 4];
+static uint8_t      rxbuf[UDP4_MAX_DATALEN + 4];
+
+static void test_send(unsigned alen)
+{
+	for (unsigned n = 0; n < alen; ++n)
+	{
+		txbuf[n] = uint8_t(n * 11 + alen);
+	}
+
+	int r = udp_a.Send(&txbuf[0], alen);
+	CHECK(r == int(alen), "send %u: %d", alen, r);
+	test_net_run(2);
+	r = udp_b.Receive(&rxbuf[0], sizeof(rxbuf));
+	CHECK((r == int(alen)) && (0 == memcmp(txbuf, rxbuf, alen)), "receive %u: %d", alen, r);
+}
+
+// the IP handler init must fail cleanly when the ARP table does not fit into the NetMem
+static void test_init_nomem()
+{
+	static TTestNode  node;
+
+	node.adapter.Init(&node.eth, &node.netmem[0], sizeof(node.netmem));
+	unsigned adapter_size = sizeof(node.netmem) - node.adapter.NetMemFree();
+
+	unsigned extra = 0;
+	while (extra < 4096)
+	{
+		node.adapter.Init(&node.eth, &node.netmem[0], adapter_size + extra);
+		if (node.ip.Init(&node.adapter))
+		{
+			break;
+		}
+		extra += 4;
+	}
+	CHECK(extra > 0, "IP4 init without NetMem succeeded");
+	CHECK(extra < 4096, "IP4 init failed with enough NetMem");
+}
+
+int main()
+{
+	g_node_a.adapter.max_tx_small_packets = 2;
+	g_node_a.adapter.max_tx_medium_packets = 2;
+	test_net_setup();
+
+	udp_a.Init(&g_node_a.ip, 1000);
+	udp_a.destaddr.Set(10, 0, 0, 2);
+	udp_a.destport = 2000;
+	udp_b.Init(&g_node_b.ip, 2000);
+
+	unsigned hlen = HWETH_MAX_PACKET_SIZE - UDP4_MAX_DATALEN;
+
+	// the largest payloads, odd lengths end in the middle of a 32-bit word
+	for (unsigned len = UDP4_MAX_DATALEN - 3; len <= UDP4_MAX_DATALEN; ++len)
+	{
+		test_send(len);
+	}
+
+	// around the end of the small and medium pool packets
+	for (unsigned len = NET_POOL_SMALL_DATALEN - hlen - 3; len <= NET_POOL_SMALL_DATALEN - hlen + 1; ++len)
+	{
+		test_send(len);
+	}
+	for (unsigned len = NET_POOL_MEDIUM_DATALEN - hlen - 3; len <= NET_POOL_MEDIUM_DATALEN - hlen + 1; ++len)
+	{
+		test_send(len);
+	}
+
+	test_send(1);
+	test_send(0);
+
+	test_init_nomem();
+
+	return test_result("test_udp");
+}